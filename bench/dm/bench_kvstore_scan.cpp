@@ -0,0 +1,383 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : bench_kvstore_scan.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Full scans over catalog shaped track records, decoding every record on
+//   one thread and on a thread per core, versus reading a couple of fields,
+//   with the records stored as json
+//   text and in the binary encoding. Also reports the database file size
+//   of each, with a cover record per album, and compares visiting the
+//   albums by matching every key against a range scan of the album keys.
+//   Lookups of a hot set of tracks are timed with and without the record
+//   cache. Finally writes indexed track records one at a time and in
+//   transactions of a batch of records, as the scan of local files does.
+//
+// ----------------------------------------------------------------------------
+#include <dm/kvstore.h>
+#include <dm/base64.h>
+
+// ----------------------------------------------------------------------------
+#include <kchashdb.h>
+
+// ----------------------------------------------------------------------------
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <sys/stat.h>
+
+// ----------------------------------------------------------------------------
+using bench_clock = std::chrono::steady_clock;
+
+// ----------------------------------------------------------------------------
+static json::value make_track(const std::string& id, unsigned n)
+{
+  auto s = std::to_string(100000+n);
+
+  return json::object{
+    { "id",       id },
+    { "title",    "Track title number " + s + " (Remastered / Live)" },
+    { "tn",       n % 14 + 1 },
+    { "dn",       n % 2 + 1 },
+    { "duration", 180 + n % 240 },
+    { "tags",     n % 10 == 0 ? json::array{ "rock", "live" } : json::array{} },
+    { "alt_ids",  json::array{ "8a0b6f0c/1/" + std::to_string(n % 14 + 1) } },
+    { "artist",   json::object{ { "id", "ar" + s.substr(2) }, { "name", "Some Artist " + s } } },
+    { "album",    json::object{ { "id", "al" + s.substr(2) }, { "title", "Album Title " + s } } },
+    { "sources",  json::array{
+        json::object{
+          { "name",       "local" },
+          { "uri",        "/music/flac/Some Artist/Album Title " + s + "/" + s + ".flac" },
+          { "replaygain", json::object{ { "reference_loudness", 89.0 }, { "track_gain", -7.23 } } }
+        }
+      }
+    }
+  };
+}
+
+// ----------------------------------------------------------------------------
+static json::value make_album(const std::string& id, unsigned n)
+{
+  return json::object{
+    { "id",     id },
+    { "title",  "Album Title " + std::to_string(n) },
+    { "tracks", json::array{ "t00001", "t00002", "t00003", "t00004" } }
+  };
+}
+
+// ----------------------------------------------------------------------------
+static bool is_album_key(const std::string& key)
+{
+  return key.length() == 6 && key[0] == 'a' && key[1] == 'l';
+}
+
+// ----------------------------------------------------------------------------
+template <typename F> void run(const std::string& name, unsigned records, F func)
+{
+  auto start = bench_clock::now();
+
+  size_t matches = func();
+
+  auto elapsed = std::chrono::duration<double>(bench_clock::now()-start).count();
+
+  std::cout
+    << name << ": " << records << " records in " << elapsed << " s, "
+    << (records / elapsed) << " records/s (" << matches << " matches)" << std::endl;
+}
+
+// ----------------------------------------------------------------------------
+static json::value make_cover(unsigned n)
+{
+  std::string image(48*1024, '\0');
+
+  for ( size_t i = 0; i < image.size(); ++i ) {
+    image[i] = static_cast<char>((i * 2654435761u + n) >> 13);
+  }
+
+  return json::object{
+    { "image_format", "jpg" },
+    { "image_data",   base64::encode(image.data(), image.size()) }
+  };
+}
+
+// ----------------------------------------------------------------------------
+static long file_size(const std::string& filename)
+{
+  struct stat st;
+
+  if ( stat(filename.c_str(), &st) != 0 ) {
+    return -1;
+  }
+  return st.st_size;
+}
+
+// ----------------------------------------------------------------------------
+static void scan(dm::kvstore& kvstore, const std::string& format, unsigned num_tracks, unsigned rounds)
+{
+  run("each (decode), " + format, num_tracks*rounds, [&]()
+  {
+    size_t matches = 0;
+
+    for ( unsigned r = 0; r < rounds; ++r )
+    {
+      kvstore.each("t", [&](json::value& value) -> bool
+      {
+        auto& tags = value.as_object()["tags"];
+
+        if ( tags.is_array() && !tags.as_array().empty() ) {
+          matches++;
+        }
+        return true;
+      });
+    }
+    return matches;
+  });
+
+  run("parallel_each (decode), " + format, num_tracks*rounds, [&]()
+  {
+    size_t matches = 0;
+
+    for ( unsigned r = 0; r < rounds; ++r )
+    {
+      kvstore.parallel_each(
+        "t",
+        [](json::value& value) -> bool
+        {
+          auto& tags = value.as_object()["tags"];
+          return tags.is_array() && !tags.as_array().empty();
+        },
+        [&](json::value& value) -> bool
+        {
+          matches++;
+          return true;
+        }
+      );
+    }
+    return matches;
+  });
+
+  run("each (fields), " + format, num_tracks*rounds, [&]()
+  {
+    size_t matches = 0;
+
+    for ( unsigned r = 0; r < rounds; ++r )
+    {
+      kvstore.each("t", { "tags" }, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+      {
+        if ( fields[0].is_array() && !fields[0].as_array().empty() ) {
+          matches++;
+        }
+        return true;
+      });
+    }
+    return matches;
+  });
+}
+
+// ----------------------------------------------------------------------------
+static void tag_values(const json::value& record, std::vector<std::string>& values)
+{
+  for ( auto& tag : record.as_object().at("tags").as_array() ) {
+    values.push_back(tag.as_string());
+  }
+}
+
+// ----------------------------------------------------------------------------
+static void write(const std::string& name, unsigned num_writes, unsigned batch_size, dm::kvstore::durability durability)
+{
+  const std::string filename = "bench_kvstore_write.kdb";
+
+  std::remove(filename.c_str());
+  std::remove((filename+".idx").c_str());
+
+  dm::kvstore kvstore(filename, durability);
+
+  kvstore.index("tag", "t", tag_values);
+
+  run(name, num_writes, [&]()
+  {
+    std::unique_ptr<dm::kvstore::transaction> transaction;
+
+    for ( unsigned i = 0; i < num_writes; ++i )
+    {
+      if ( batch_size > 0 && !transaction ) {
+        transaction.reset(new dm::kvstore::transaction(kvstore));
+      }
+
+      auto id = "t" + std::to_string(100000+i).substr(1);
+      kvstore.set(id, make_track(id, i));
+
+      if ( transaction && (i+1) % batch_size == 0 )
+      {
+        transaction->commit();
+        transaction.reset();
+      }
+    }
+
+    if ( transaction ) {
+      transaction->commit();
+    }
+    return size_t(0);
+  });
+
+  std::remove(filename.c_str());
+  std::remove((filename+".idx").c_str());
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  const unsigned    num_tracks = 50000;
+  const unsigned    num_covers = 500;
+  const unsigned    rounds     = 5;
+  const std::string text_file  = "bench_kvstore_text.kdb";
+  const std::string bin_file   = "bench_kvstore_binary.kdb";
+
+  std::remove(text_file.c_str());
+  std::remove(bin_file.c_str());
+
+  {
+    // As stored before the binary encoding.
+    kyotocabinet::TreeDB db;
+
+    db.open(text_file, kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE);
+
+    for ( unsigned i = 0; i < num_tracks; ++i )
+    {
+      auto id = "t" + std::to_string(100000+i).substr(1);
+      db.set(id, to_string(make_track(id, i)));
+    }
+
+    for ( unsigned i = 0; i < num_covers; ++i ) {
+      db.set("cover/al" + std::to_string(10000+i).substr(1), to_string(make_cover(i)));
+    }
+    db.close();
+  }
+
+  {
+    dm::kvstore kvstore(bin_file);
+
+    for ( unsigned i = 0; i < num_tracks; ++i )
+    {
+      auto id = "t" + std::to_string(100000+i).substr(1);
+      kvstore.set(id, make_track(id, i));
+    }
+
+    for ( unsigned i = 0; i < num_covers; ++i )
+    {
+      auto id = "al" + std::to_string(10000+i).substr(1);
+      kvstore.set(id, make_album(id, i));
+      kvstore.set("cover/" + id, make_cover(i));
+    }
+  }
+
+  std::cout
+    << "file size, text: " << file_size(text_file) << " bytes, binary: "
+    << file_size(bin_file) << " bytes" << std::endl;
+
+  {
+    dm::kvstore kvstore(text_file);
+    scan(kvstore, "text", num_tracks, rounds);
+  }
+
+  {
+    dm::kvstore kvstore(bin_file);
+    scan(kvstore, "binary", num_tracks, rounds);
+
+    run("albums (key match)", num_covers*rounds, [&]()
+    {
+      size_t matches = 0;
+
+      for ( unsigned r = 0; r < rounds; ++r )
+      {
+        kvstore.each(is_album_key, { "title" }, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+        {
+          matches++;
+          return true;
+        });
+      }
+      return matches;
+    });
+
+    const unsigned hot_tracks = 2000;
+    const unsigned lookups    = 200000;
+
+    run("get (decode)", lookups, [&]()
+    {
+      size_t matches = 0;
+
+      for ( unsigned i = 0; i < lookups; ++i )
+      {
+        auto id = "t" + std::to_string(100000 + (i * 7919) % hot_tracks).substr(1);
+
+        if ( kvstore.get(id).is_object() ) {
+          matches++;
+        }
+      }
+      return matches;
+    });
+
+    run("get_shared (cached)", lookups, [&]()
+    {
+      size_t matches = 0;
+
+      for ( unsigned i = 0; i < lookups; ++i )
+      {
+        auto id = "t" + std::to_string(100000 + (i * 7919) % hot_tracks).substr(1);
+
+        if ( kvstore.get_shared(id)->is_object() ) {
+          matches++;
+        }
+      }
+      return matches;
+    });
+
+    auto cache = kvstore.cache_stats();
+
+    std::cout
+      << "record cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+      << cache.records << " records, " << cache.size << " bytes" << std::endl;
+
+    run("albums (range)", num_covers*rounds, [&]()
+    {
+      size_t matches = 0;
+
+      for ( unsigned r = 0; r < rounds; ++r )
+      {
+        kvstore.each("al", { "title" }, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+        {
+          matches++;
+          return true;
+        });
+      }
+      return matches;
+    });
+  }
+
+  {
+    dm::kvstore kvstore(text_file);
+
+    auto start     = bench_clock::now();
+    auto converted = kvstore.migrate();
+    auto elapsed   = std::chrono::duration<double>(bench_clock::now()-start).count();
+
+    std::cout << "migrate: " << converted << " records in " << elapsed << " s" << std::endl;
+  }
+
+  std::remove(text_file.c_str());
+  std::remove(bin_file.c_str());
+
+  const unsigned num_writes = 5000;
+
+  write("set, no transaction", num_writes, 0, dm::kvstore::durability::soft);
+  write("set, 64 per transaction (soft)", num_writes, 64, dm::kvstore::durability::soft);
+  write("set, 64 per transaction (hard)", num_writes, 64, dm::kvstore::durability::hard);
+  write("set, 1 per transaction (soft)", num_writes, 1, dm::kvstore::durability::soft);
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : bench.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Timing, allocation counting and peak rss for the json benchmarks.
+//
+// ----------------------------------------------------------------------------
+#include "bench.h"
+
+// ----------------------------------------------------------------------------
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <sys/resource.h>
+
+// ----------------------------------------------------------------------------
+using bench_clock = std::chrono::steady_clock;
+
+// ----------------------------------------------------------------------------
+static std::atomic<uint64_t> allocation_count{0};
+
+// ----------------------------------------------------------------------------
+void* operator new(size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+  if ( void* p = std::malloc(size ? size : 1) ) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+// ----------------------------------------------------------------------------
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+// ----------------------------------------------------------------------------
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+// ----------------------------------------------------------------------------
+namespace bench
+{
+  uint64_t allocations()
+  {
+    return allocation_count.load(std::memory_order_relaxed);
+  }
+
+  void reset_peak_rss()
+  {
+    // Writing 5 to clear_refs resets VmHWM, needs linux 4.0.
+    std::ofstream clear_refs("/proc/self/clear_refs");
+
+    if ( clear_refs ) {
+      clear_refs << "5";
+    }
+  }
+
+  long peak_rss_kb()
+  {
+    std::ifstream status("/proc/self/status");
+    std::string   line;
+
+    while ( std::getline(status, line) )
+    {
+      if ( line.compare(0, 6, "VmHWM:") == 0 ) {
+        return std::stol(line.substr(6));
+      }
+    }
+
+    // No procfs, ru_maxrss is the peak for the whole process.
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_maxrss;
+  }
+
+  result measure(const options& opts, std::function<void()> func)
+  {
+    // Warm up caches and any buffers the benchmark reuses.
+    func();
+
+    reset_peak_rss();
+
+    auto     allocs_before = allocations();
+    auto     start = bench_clock::now();
+    size_t   iterations = 0;
+    double   elapsed;
+
+    do
+    {
+      func();
+      iterations++;
+      elapsed = std::chrono::duration<double>(bench_clock::now()-start).count();
+    }
+    while ( elapsed < opts.min_time );
+
+    return result{ elapsed, iterations, allocations()-allocs_before, peak_rss_kb() };
+  }
+
+  void report(const std::string& name, const corpus& corpus, const result& r)
+  {
+    double bytes = static_cast<double>(corpus.bytes) * r.iterations;
+    double docs  = static_cast<double>(corpus.documents.size()) * r.iterations;
+
+    std::cout
+      << std::left << std::setw(52) << (corpus.name + ", " + name)
+      << std::right << std::fixed
+      << std::setw(10) << std::setprecision(1) << (bytes / r.seconds / (1024*1024)) << " MB/s"
+      << std::setw(12) << std::setprecision(0) << (docs / r.seconds) << " docs/s"
+      << std::setw(12) << std::setprecision(1) << (r.allocations / docs) << " allocs/doc"
+      << std::setw(10) << r.peak_rss_kb << " kB peak rss"
+      << std::endl;
+  }
+}
@@ -0,0 +1,82 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : bench.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Shared pieces of the json benchmark suite: catalog shaped corpora,
+//   timing, allocation counting and peak resident set size.
+//
+// ----------------------------------------------------------------------------
+#ifndef __bench__bench_h__
+#define __bench__bench_h__
+
+// ----------------------------------------------------------------------------
+#include <json/json.h>
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+namespace bench
+{
+  struct options
+  {
+    // Number of tracks in the large db/get/tracks corpus.
+    unsigned num_tracks = 100000;
+    // Size of the chunks fed to the parser in chunked mode, same as a
+    // dripcore connection read.
+    size_t   chunk_size = 1024;
+    // Repeat each measurement until at least this many seconds passed.
+    double   min_time   = 0.5;
+  };
+
+  // Documents shaped like the records and responses mboxd handles.
+  struct corpus
+  {
+    std::string              name;
+    std::vector<std::string> documents;
+    size_t                   bytes;
+  };
+
+  json::value make_track(unsigned n);
+  json::value make_album(unsigned n);
+  json::value make_cover(unsigned n, size_t image_size);
+
+  corpus track_records(unsigned count);
+  corpus album_records(unsigned count);
+  corpus cover_records(unsigned count, size_t image_size);
+  corpus track_list(unsigned count);
+
+  // Allocations made through operator new since start.
+  uint64_t allocations();
+
+  // Peak resident set size in kB since the last reset.
+  void   reset_peak_rss();
+  long   peak_rss_kb();
+
+  struct result
+  {
+    double   seconds;
+    size_t   iterations;
+    uint64_t allocations;
+    long     peak_rss_kb;
+  };
+
+  // Run func repeatedly for at least min_time seconds.
+  result measure(const options& opts, std::function<void()> func);
+
+  void report(const std::string& name, const corpus& corpus, const result& r);
+
+  void bench_writer(const options& opts, const std::vector<corpus>& corpora);
+  void bench_parser(const options& opts, const std::vector<corpus>& corpora);
+}
+
+// ----------------------------------------------------------------------------
+#endif // __bench__bench_h__
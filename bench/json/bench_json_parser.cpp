@@ -0,0 +1,142 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : bench_json_parser.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Parsing throughput. Whole buffer parsing is compared to feeding the
+//   parser chunks the size a connection reads from its socket.
+//
+// ----------------------------------------------------------------------------
+#include "bench.h"
+
+// ----------------------------------------------------------------------------
+#include <algorithm>
+
+// ----------------------------------------------------------------------------
+namespace bench
+{
+  // Receives events and does nothing with them, to measure the tokenizer
+  // on its own.
+  class null_handler : public json::handler
+  {
+  public:
+    void start_object() override {}
+    void end_object() override {}
+    void start_array() override {}
+    void end_array() override {}
+  public:
+    void key(std::string_view v) override {}
+    void string(std::string_view v) override {}
+    void number(double v) override {}
+    void integer(int64_t v) override {}
+    void boolean(bool v) override {}
+    void null() override {}
+  };
+
+  template <typename Parser>
+  static void parse_whole(Parser& parser, const std::string& doc)
+  {
+    parser.parse(doc.data(), doc.size());
+
+    if ( !parser.complete() ) {
+      throw std::runtime_error("incomplete document");
+    }
+  }
+
+  template <typename Parser>
+  static void parse_chunked(Parser& parser, const std::string& doc, size_t chunk_size)
+  {
+    for ( size_t pos = 0; pos < doc.size(); pos += chunk_size ) {
+      parser.parse(doc.data()+pos, std::min(chunk_size, doc.size()-pos));
+    }
+
+    if ( !parser.complete() ) {
+      throw std::runtime_error("incomplete document");
+    }
+  }
+
+  void bench_parser(const options& opts, const std::vector<corpus>& corpora)
+  {
+    for ( auto& corpus : corpora )
+    {
+      report("parser (whole buffer)", corpus, measure(opts, [&]()
+      {
+        for ( auto& doc : corpus.documents )
+        {
+          json::value  value;
+          json::parser parser(value);
+
+          parse_whole(parser, doc);
+        }
+      }));
+
+      report("parser (" + std::to_string(opts.chunk_size) + " byte chunks)", corpus, measure(opts, [&]()
+      {
+        for ( auto& doc : corpus.documents )
+        {
+          json::value  value;
+          json::parser parser(value);
+
+          parse_chunked(parser, doc, opts.chunk_size);
+        }
+      }));
+
+      null_handler handler;
+
+      report("sax_parser (whole buffer)", corpus, measure(opts, [&]()
+      {
+        json::sax_parser parser(handler);
+
+        for ( auto& doc : corpus.documents )
+        {
+          parser.reset();
+          parse_whole(parser, doc);
+        }
+      }));
+
+      report("sax_parser (" + std::to_string(opts.chunk_size) + " byte chunks)", corpus, measure(opts, [&]()
+      {
+        json::sax_parser parser(handler);
+
+        for ( auto& doc : corpus.documents )
+        {
+          parser.reset();
+          parse_chunked(parser, doc, opts.chunk_size);
+        }
+      }));
+
+      report("view (id of each record)", corpus, measure(opts, [&]()
+      {
+        std::string buf;
+
+        for ( auto& doc : corpus.documents )
+        {
+          json::view doc_view(doc);
+          json::view records = doc_view["result"];
+
+          auto read_id = [&](const json::view& record) -> bool
+          {
+            auto id = record["id"] ? record["id"] : record["album_id"];
+
+            if ( !id ) {
+              throw std::runtime_error("record has no id");
+            }
+            id.as_string(buf);
+            return true;
+          };
+
+          if ( records ) {
+            records.each(read_id);
+          }
+          else {
+            read_id(doc_view);
+          }
+        }
+      }));
+    }
+  }
+}
@@ -0,0 +1,47 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : bench_json_writer.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Serialization throughput.
+//
+// ----------------------------------------------------------------------------
+#include "bench.h"
+
+// ----------------------------------------------------------------------------
+namespace bench
+{
+  void bench_writer(const options& opts, const std::vector<corpus>& corpora)
+  {
+    for ( auto& corpus : corpora )
+    {
+      std::vector<json::value> values;
+
+      for ( auto& doc : corpus.documents ) {
+        values.push_back(json::view(doc).to_value());
+      }
+
+      report("to_string", corpus, measure(opts, [&]()
+      {
+        for ( auto& value : values ) {
+          to_string(value);
+        }
+      }));
+
+      std::string buf;
+
+      report("writer (reused buffer)", corpus, measure(opts, [&]()
+      {
+        for ( auto& value : values )
+        {
+          buf.clear();
+          json::writer(buf).write(value);
+        }
+      }));
+    }
+  }
+}
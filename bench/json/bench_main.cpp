@@ -0,0 +1,77 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : bench_main.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   usage: bench_json [parser|writer] [--tracks N] [--chunk N] [--time S]
+//
+// ----------------------------------------------------------------------------
+#include "bench.h"
+
+// ----------------------------------------------------------------------------
+#include <iostream>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  bench::options opts;
+  std::string    only;
+
+  try
+  {
+    for ( int i = 1; i < argc; ++i )
+    {
+      if ( strcmp(argv[i], "--tracks") == 0 && i+1 < argc ) {
+        opts.num_tracks = std::stoul(argv[++i]);
+      }
+      else if ( strcmp(argv[i], "--chunk") == 0 && i+1 < argc ) {
+        opts.chunk_size = std::stoul(argv[++i]);
+      }
+      else if ( strcmp(argv[i], "--time") == 0 && i+1 < argc ) {
+        opts.min_time = std::stod(argv[++i]);
+      }
+      else if ( argv[i][0] != '-' ) {
+        only = argv[i];
+      }
+      else {
+        std::cerr << "usage: " << argv[0] << " [parser|writer] [--tracks N] [--chunk N] [--time S]" << std::endl;
+        return 1;
+      }
+    }
+
+    std::vector<bench::corpus> corpora = {
+      bench::track_records(10000),
+      bench::album_records(10000),
+      bench::cover_records(20, 256*1024),
+      bench::track_list(opts.num_tracks)
+    };
+
+    for ( auto& corpus : corpora )
+    {
+      std::cout
+        << corpus.name << ": " << corpus.documents.size() << " documents, "
+        << corpus.bytes << " bytes" << std::endl;
+    }
+    std::cout << std::endl;
+
+    if ( only.empty() || only == "parser" ) {
+      bench::bench_parser(opts, corpora);
+    }
+
+    if ( only.empty() || only == "writer" ) {
+      bench::bench_writer(opts, corpora);
+    }
+  }
+  catch ( const std::exception& e )
+  {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
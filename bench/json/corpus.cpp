@@ -0,0 +1,145 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : corpus.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Generated documents shaped like the records dm stores and the responses
+//   the json rpc interface sends.
+//
+// ----------------------------------------------------------------------------
+#include "bench.h"
+
+// ----------------------------------------------------------------------------
+namespace bench
+{
+  json::value make_track(unsigned n)
+  {
+    auto id = std::to_string(100000+n);
+
+    return json::object{
+      { "id",       "t" + id.substr(1) },
+      { "title",    "Track title number " + id + " (Remastered / Live)" },
+      { "tn",       n % 14 + 1 },
+      { "dn",       n % 2 + 1 },
+      { "duration", 180 + n % 240 },
+      { "tags",     json::array{ "rock", "live" } },
+      { "alt_ids",  json::array{ "8a0b6f0c/1/" + std::to_string(n % 14 + 1) } },
+      { "artist",   json::object{ { "id", "ar" + id.substr(2) }, { "name", "Some Artist \"" + id + "\"" } } },
+      { "album",    json::object{ { "id", "al" + id.substr(2) }, { "title", "Album Title " + id } } },
+      { "sources",  json::array{
+          json::object{
+            { "name",       "local" },
+            { "uri",        "/music/flac/Some Artist/Album Title " + id + "/" + id + ".flac" },
+            { "replaygain", json::object{ { "reference_loudness", 89.0 }, { "track_gain", -7.23 } } }
+          }
+        }
+      }
+    };
+  }
+
+  json::value make_album(unsigned n)
+  {
+    auto id = std::to_string(100000+n);
+
+    json::array tracks;
+
+    for ( unsigned i = 0; i < 12; ++i ) {
+      tracks.push_back("t" + std::to_string(10000+n*12+i));
+    }
+
+    json::array artists;
+    artists.push_back("ar" + id.substr(2));
+
+    return json::object{
+      { "id",        "al" + id.substr(2) },
+      { "title",     "Album Title " + id },
+      { "artists",   std::move(artists) },
+      { "tracks",    std::move(tracks) },
+      { "alt_ids",   json::array{ "8a0b6f0c" } },
+      { "cover",     "c" + id.substr(2) }
+    };
+  }
+
+  static const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  json::value make_cover(unsigned n, size_t image_size)
+  {
+    auto id = std::to_string(100000+n);
+
+    // Only the shape of the encoded image matters, not its content.
+    std::string image_data;
+    size_t      encoded_size = (image_size+2) / 3 * 4;
+    uint32_t    x = 2463534242u + n;
+
+    image_data.reserve(encoded_size);
+
+    while ( image_data.size() < encoded_size )
+    {
+      x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+      image_data.push_back(base64_alphabet[x & 63]);
+    }
+
+    return json::object{
+      { "album_id",   "al" + id.substr(2) },
+      { "image_type", "image/jpeg" },
+      { "image_data", std::move(image_data) }
+    };
+  }
+
+  static corpus records(const std::string& name, unsigned count, std::function<json::value(unsigned)> make)
+  {
+    corpus result{ name, {}, 0 };
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+      result.documents.push_back(to_string(make(i)));
+      result.bytes += result.documents.back().size();
+    }
+    return result;
+  }
+
+  corpus track_records(unsigned count)
+  {
+    return records("track records", count, make_track);
+  }
+
+  corpus album_records(unsigned count)
+  {
+    return records("album records", count, make_album);
+  }
+
+  corpus cover_records(unsigned count, size_t image_size)
+  {
+    return records("cover records", count, [=](unsigned n) { return make_cover(n, image_size); });
+  }
+
+  // A db/get/tracks response with count tracks.
+  corpus track_list(unsigned count)
+  {
+    json::array tracks;
+
+    tracks.reserve(count);
+
+    for ( unsigned i = 0; i < count; ++i ) {
+      tracks.push_back(make_track(i));
+    }
+
+    json::value response = json::object{
+      { "jsonrpc", "2.0" },
+      { "result",  std::move(tracks) },
+      { "id",      1 }
+    };
+
+    corpus result{ "db/get/tracks " + std::to_string(count), {}, 0 };
+
+    result.documents.push_back(to_string(response));
+    result.bytes = result.documents.back().size();
+
+    return result;
+  }
+}
@@ -0,0 +1,308 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : bench_storage.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Compares the storage engines under the kvstore on the access patterns
+//   of mboxd. Each engine is loaded with catalog shaped track records,
+//   in transactions of a batch of records as the scan of local files
+//   writes them. Then times loading the in-memory catalog, from the
+//   records and from its file, random lookups by id, as find_by_id does
+//   without the record cache, full scans of the tracks, decoding every
+//   record and reading a single field, and lookups while another thread
+//   writes bursts of records, as happens during a scan.
+//
+//   Usage: bench_storage [tracks] [engine...]
+//
+// ----------------------------------------------------------------------------
+#include <dm/kvstore.h>
+#include <dm/catalog.h>
+
+// ----------------------------------------------------------------------------
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <sys/stat.h>
+
+// ----------------------------------------------------------------------------
+using bench_clock = std::chrono::steady_clock;
+
+// ----------------------------------------------------------------------------
+static std::string track_id(unsigned n)
+{
+  return "t" + std::to_string(100000+n).substr(1);
+}
+
+// ----------------------------------------------------------------------------
+static json::value make_track(const std::string& id, unsigned n)
+{
+  auto s = std::to_string(100000+n);
+
+  return json::object{
+    { "id",       id },
+    { "title",    "Track title number " + s + " (Remastered / Live)" },
+    { "tn",       n % 14 + 1 },
+    { "dn",       n % 2 + 1 },
+    { "duration", 180 + n % 240 },
+    { "tags",     n % 10 == 0 ? json::array{ "rock", "live" } : json::array{} },
+    { "alt_ids",  json::array{ "8a0b6f0c/1/" + std::to_string(n % 14 + 1) } },
+    { "artist",   json::object{ { "id", "ar" + s.substr(2) }, { "name", "Some Artist " + s } } },
+    { "album",    json::object{ { "id", "al" + s.substr(2) }, { "title", "Album Title " + s } } },
+    { "sources",  json::array{
+        json::object{
+          { "name",       "local" },
+          { "uri",        "/music/flac/Some Artist/Album Title " + s + "/" + s + ".flac" },
+          { "replaygain", json::object{ { "reference_loudness", 89.0 }, { "track_gain", -7.23 } } }
+        }
+      }
+    }
+  };
+}
+
+// ----------------------------------------------------------------------------
+template <typename F> void run(const std::string& name, unsigned records, F func)
+{
+  auto start = bench_clock::now();
+
+  size_t matches = func();
+
+  auto elapsed = std::chrono::duration<double>(bench_clock::now()-start).count();
+
+  std::cout
+    << name << ": " << records << " records in " << elapsed << " s, "
+    << (records / elapsed) << " records/s (" << matches << " matches)" << std::endl;
+}
+
+// ----------------------------------------------------------------------------
+static long file_size(const std::string& filename)
+{
+  struct stat st;
+
+  if ( stat(filename.c_str(), &st) != 0 ) {
+    return -1;
+  }
+  return st.st_size;
+}
+
+// ----------------------------------------------------------------------------
+static void alt_id_values(const json::value& record, std::vector<std::string>& values)
+{
+  for ( auto& alt_id : record.as_object().at("alt_ids").as_array() ) {
+    values.push_back(alt_id.as_string());
+  }
+}
+
+// ----------------------------------------------------------------------------
+static void write_batches(dm::kvstore& kvstore, unsigned first, unsigned count, unsigned batch_size)
+{
+  for ( unsigned i = first; i < first + count; i += batch_size )
+  {
+    dm::kvstore::transaction transaction(kvstore);
+
+    for ( unsigned j = i; j < i + batch_size && j < first + count; ++j ) {
+      kvstore.set(track_id(j), make_track(track_id(j), j));
+    }
+
+    transaction.commit();
+  }
+}
+
+// ----------------------------------------------------------------------------
+static size_t lookups(dm::kvstore& kvstore, unsigned num_tracks, unsigned count, unsigned seed)
+{
+  size_t matches = 0;
+
+  for ( unsigned i = 0; i < count; ++i )
+  {
+    if ( kvstore.get(track_id((i * 7919u + seed) % num_tracks)).is_object() ) {
+      matches++;
+    }
+  }
+  return matches;
+}
+
+// ----------------------------------------------------------------------------
+static void bench(const std::string& engine_name, unsigned num_tracks)
+{
+  const unsigned    batch_size = 64;
+  const unsigned    rounds     = 3;
+  const unsigned    num_gets   = 200000;
+  const std::string filename   = "bench_storage." + engine_name;
+
+  auto engine = dm::storage_engine::parse_type(engine_name);
+
+  std::remove(filename.c_str());
+  std::remove((filename+".idx").c_str());
+  std::remove((filename+".catalog").c_str());
+
+  std::cout << "--- " << engine_name << std::endl;
+
+  {
+    dm::kvstore kvstore(filename, dm::kvstore::durability::soft, engine);
+
+    kvstore.index("alt_id", "t", alt_id_values);
+
+    run("load, " + std::to_string(batch_size) + " per transaction", num_tracks, [&]()
+    {
+      write_batches(kvstore, 0, num_tracks, batch_size);
+      return size_t(0);
+    });
+
+    if ( engine != dm::storage_engine::type::memory ) {
+      std::cout << "file size: " << file_size(filename) << " bytes" << std::endl;
+    }
+
+    run("catalog load", num_tracks, [&]()
+    {
+      dm::catalog catalog(kvstore, filename + ".catalog");
+      auto stats = catalog.stats();
+
+      std::cout << "catalog size: " << stats.size << " bytes, " << stats.size_per_10k_tracks << " per 10k tracks" << std::endl;
+      return stats.tracks;
+    });
+
+    run("catalog load (file)", num_tracks, [&]()
+    {
+      dm::catalog catalog(kvstore, filename + ".catalog");
+      return catalog.stats().tracks;
+    });
+
+    run("random get", num_gets, [&]()
+    {
+      return lookups(kvstore, num_tracks, num_gets, 0);
+    });
+
+    run("each (decode)", num_tracks*rounds, [&]()
+    {
+      size_t matches = 0;
+
+      for ( unsigned r = 0; r < rounds; ++r )
+      {
+        kvstore.each("t", [&](json::value& value) -> bool
+        {
+          auto& tags = value.as_object()["tags"];
+
+          if ( tags.is_array() && !tags.as_array().empty() ) {
+            matches++;
+          }
+          return true;
+        });
+      }
+      return matches;
+    });
+
+    run("each (fields)", num_tracks*rounds, [&]()
+    {
+      size_t matches = 0;
+
+      for ( unsigned r = 0; r < rounds; ++r )
+      {
+        kvstore.each("t", { "tags" }, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+        {
+          if ( fields[0].is_array() && !fields[0].as_array().empty() ) {
+            matches++;
+          }
+          return true;
+        });
+      }
+      return matches;
+    });
+
+    run("parallel_each (decode)", num_tracks*rounds, [&]()
+    {
+      size_t matches = 0;
+
+      for ( unsigned r = 0; r < rounds; ++r )
+      {
+        kvstore.parallel_each(
+          "t",
+          [](json::value& value) -> bool
+          {
+            auto& tags = value.as_object()["tags"];
+            return tags.is_array() && !tags.as_array().empty();
+          },
+          [&](json::value& value) -> bool
+          {
+            matches++;
+            return true;
+          }
+        );
+      }
+      return matches;
+    });
+
+    // Lookups, as the player and rpc clients make them, while a scan
+    // rewrites a quarter of the tracks.
+    std::atomic<bool> writing(true);
+    std::atomic<long> num_lookups(0);
+    double            write_elapsed = 0;
+
+    std::thread reader([&]()
+    {
+      unsigned seed = 0;
+
+      while ( writing )
+      {
+        lookups(kvstore, num_tracks, 1000, seed++);
+        num_lookups += 1000;
+      }
+    });
+
+    run("burst writes, with concurrent gets", num_tracks / 4, [&]()
+    {
+      auto start = bench_clock::now();
+
+      write_batches(kvstore, 0, num_tracks / 4, batch_size);
+
+      write_elapsed = std::chrono::duration<double>(bench_clock::now()-start).count();
+      writing = false;
+
+      return size_t(0);
+    });
+
+    reader.join();
+
+    std::cout
+      << "concurrent gets: " << num_lookups << " records in " << write_elapsed << " s, "
+      << (num_lookups / write_elapsed) << " records/s" << std::endl;
+  }
+
+  std::remove(filename.c_str());
+  std::remove((filename+".idx").c_str());
+  std::remove((filename+".catalog").c_str());
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+  unsigned                 num_tracks = 50000;
+  std::vector<std::string> engines;
+
+  if ( argc > 1 ) {
+    num_tracks = std::max(1000, atoi(argv[1]));
+  }
+
+  for ( int i = 2; i < argc; ++i ) {
+    engines.push_back(argv[i]);
+  }
+
+  if ( engines.empty() ) {
+    engines = { "memory", "kyoto", "lmdb" };
+  }
+
+  for ( auto& engine : engines ) {
+    bench(engine, num_tracks);
+  }
+
+  return 0;
+}
@@ -0,0 +1,600 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_sax_parser_impl.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Definitions of json::basic_sax_parser, included by json_sax_parser.h.
+//
+// ----------------------------------------------------------------------------
+#ifndef __json__json_sax_parser_impl_h__
+#define __json__json_sax_parser_impl_h__
+
+// ----------------------------------------------------------------------------
+#include <json/json_error.h>
+#include <json/details/json_scan.h>
+#include <json/details/json_utf8.h>
+
+// ----------------------------------------------------------------------------
+#include <utility>
+#include <stdexcept>
+#include <charconv>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  namespace details
+  {
+    // Skip whitespace, return true if pb < pe (not at the end)
+    inline bool skip_ws_to_token(const char*& pb, const char* pe)
+    {
+      pb = skip_ws(pb, pe);
+      return pb < pe;
+    }
+
+    inline bool skip_comment(const char*& pb, const char* pe)
+    {
+      if ( pb+1 >= pe )
+        return true;
+
+      if ( *pb != '/' || *(pb+1) != '/' )
+        return true;
+
+      pb += 2;
+
+      while ( pb < pe )
+      {
+        if ( *pb != '\n' && *pb != '\r' )
+          pb++;
+        else
+          break;
+      }
+      return skip_ws_to_token(pb, pe);
+    }
+
+    inline bool skip_ws_n_comments(const char*& pb, const char* pe)
+    {
+      if ( skip_ws_to_token(pb, pe) ) {
+        return skip_comment(pb, pe);
+      }
+      else {
+        return false;
+      }
+    }
+
+    inline constexpr char literal_true[]  = "true";
+    inline constexpr char literal_false[] = "false";
+    inline constexpr char literal_null[]  = "null";
+  }
+
+  template <typename Handler>
+  basic_sax_parser<Handler>::basic_sax_parser(Handler& handler, size_t max_depth, utf8_mode utf8)
+    :
+    handler_(handler),
+    max_depth_(max_depth),
+    utf8_(utf8),
+    state_(state::document),
+    stack_(),
+    token_(),
+    token_is_key_(false),
+    token_is_integer_(true),
+    literal_(nullptr),
+    literal_pos_(0),
+    unicode_(0),
+    unicode_digits_(0),
+    surrogate_(0)
+  {
+  }
+
+  template <typename Handler>
+  size_t basic_sax_parser<Handler>::parse(const char* data, size_t data_len)
+  {
+    const char* it  = data;
+    const char* end = data+data_len;
+
+    while ( it < end && state_ != state::complete )
+    {
+      switch ( state_ )
+      {
+        case state::document:
+          if ( details::skip_ws_n_comments(it, end) )
+          {
+            switch ( *it )
+            {
+              case '{':
+                begin_container(container::object);
+                break;
+              case '[':
+                begin_container(container::array);
+                break;
+              default:
+                throw error("JSON text must start with '{' or '['" );
+                break;
+            }
+            it++;
+          }
+          break;
+        case state::value:
+          if ( details::skip_ws_n_comments(it, end) )
+          {
+            switch ( *it )
+            {
+              case '[':
+                begin_container(container::array);
+                it++;
+                break;
+              case '{':
+                begin_container(container::object);
+                it++;
+                break;
+              case '"':
+                token_is_key_ = false;
+                state_ = state::string;
+                it++;
+                break;
+              case 't':
+                literal_ = details::literal_true;
+                literal_pos_ = 0;
+                state_ = state::literal;
+                break;
+              case 'f':
+                literal_ = details::literal_false;
+                literal_pos_ = 0;
+                state_ = state::literal;
+                break;
+              case 'n':
+                literal_ = details::literal_null;
+                literal_pos_ = 0;
+                state_ = state::literal;
+                break;
+              case '-':
+              case '0':
+              case '1':
+              case '2':
+              case '3':
+              case '4':
+              case '5':
+              case '6':
+              case '7':
+              case '8':
+              case '9':
+                token_is_integer_ = true;
+                state_ = state::number;
+                break;
+              default:
+                throw error("error reading value");
+                break;
+            }
+          }
+          break;
+        case state::array_value_or_end:
+          if ( details::skip_ws_n_comments(it, end) )
+          {
+            if ( *it == ']' ) // empty array
+            {
+              it++;
+              end_container();
+            }
+            else
+            {
+              state_ = state::value;
+            }
+          }
+          break;
+        case state::array_next_value_or_end:
+          if ( details::skip_ws_n_comments(it, end) )
+          {
+            switch ( *it )
+            {
+              case ']':
+                end_container();
+                break;
+              case ',':
+                state_ = state::value;
+                break;
+              default:
+                throw error("error reading array, expected ']' or ','");
+                break;
+            }
+            it++;
+          }
+          break;
+        case state::object_key_or_end:
+          if ( details::skip_ws_n_comments(it, end) )
+          {
+            switch ( *it )
+            {
+              case '}': // empty object
+                end_container();
+                break;
+              case '"':
+                token_is_key_ = true;
+                state_ = state::string;
+                break;
+              default:
+                throw error("error reading object, expected '}' or '\"'");
+                break;
+            }
+            it++;
+          }
+          break;
+        case state::object_key:
+          if ( details::skip_ws_n_comments(it, end) )
+          {
+            switch ( *it )
+            {
+              case '"':
+                token_is_key_ = true;
+                state_ = state::string;
+                break;
+              default:
+                throw error("error reading object, expected '\"'");
+                break;
+            }
+            it++;
+          }
+          break;
+        case state::object_sep:
+          if ( details::skip_ws_n_comments(it, end) )
+          {
+            switch ( *it )
+            {
+              case ':':
+                state_ = state::value;
+                break;
+              default:
+                throw error("error reading object, expected ':'");
+                break;
+            }
+            it++;
+          }
+          break;
+        case state::object_next_member_or_end:
+          if ( details::skip_ws_n_comments(it, end) )
+          {
+            switch ( *it )
+            {
+              case '}':
+                end_container();
+                break;
+              case ',':
+                state_ = state::object_key;
+                break;
+              default:
+                throw error("error reading object, expected '}' or ','");
+                break;
+            }
+            it++;
+          }
+          break;
+        case state::string:
+        {
+          if ( surrogate_ && *it != '\\' ) {
+            throw error("error reading string, invalid unicode escape");
+          }
+
+          // Copy everything up to the next quote, backslash or control
+          // character in one go.
+          const char* special = details::find_string_special(it, end);
+
+          token_.append(it, special-it);
+          it = special;
+
+          if ( it == end ) {
+            break;
+          }
+
+          switch ( *it )
+          {
+            case '"':
+              end_string();
+              break;
+            case '\\':
+              state_ = state::string_escape;
+              break;
+            default:
+              // Unescaped control character. Not valid json, but records
+              // written by older versions of the library can contain them.
+              token_.push_back(*it);
+              break;
+          }
+          it++;
+          break;
+        }
+        case state::string_escape:
+          if ( surrogate_ && *it != 'u' ) {
+            throw error("error reading string, invalid unicode escape");
+          }
+
+          switch ( *it )
+          {
+            case '"':
+            case '\\':
+            case '/':
+              token_.push_back(*it);
+              state_ = state::string;
+              break;
+            case 'b':
+              token_.push_back('\b');
+              state_ = state::string;
+              break;
+            case 'f':
+              token_.push_back('\f');
+              state_ = state::string;
+              break;
+            case 'n':
+              token_.push_back('\n');
+              state_ = state::string;
+              break;
+            case 'r':
+              token_.push_back('\r');
+              state_ = state::string;
+              break;
+            case 't':
+              token_.push_back('\t');
+              state_ = state::string;
+              break;
+            case 'u':
+              unicode_ = 0;
+              unicode_digits_ = 0;
+              state_ = state::string_unicode;
+              break;
+            default:
+              throw error("error reading string,  invalid escaping");
+              break;
+          }
+          it++;
+          break;
+        case state::string_unicode:
+        {
+          int v = details::hex_value(*it);
+
+          if ( v < 0 ) {
+            throw error("error reading string, invalid unicode escape");
+          }
+
+          unicode_ = (unicode_ << 4) | v;
+          it++;
+
+          if ( ++unicode_digits_ == 4 ) {
+            end_unicode_escape();
+          }
+          break;
+        }
+        case state::number:
+        {
+          // Integer digits are by far the most common.
+          const char* digits = it;
+
+          while ( it < end && *it >= '0' && *it <= '9' ) {
+            it++;
+          }
+
+          token_.append(digits, it-digits);
+
+          if ( it == end ) {
+            break;
+          }
+
+          switch ( *it )
+          {
+            case 'E':
+            case 'e':
+            case '.':
+            case '+':
+              token_is_integer_ = false;
+              token_.push_back(*it++);
+              break;
+            case '-':
+              token_.push_back(*it++);
+              break;
+            case '\n':
+            case '\r':
+            case '\t':
+            case ' ':
+            case ',':
+            case '}':
+            case ']':
+              end_number();
+              break;
+            default:
+              throw error("error reading number");
+              break;
+          }
+          break;
+        }
+        case state::literal:
+          if ( *it != literal_[literal_pos_] ) {
+            throw error(std::string("error reading ") + literal_ + ", expected '" + literal_[literal_pos_] + "'");
+          }
+
+          it++;
+
+          if ( literal_[++literal_pos_] == '\0' ) {
+            end_literal();
+          }
+          break;
+        case state::complete:
+          break;
+      }
+    }
+
+    return it-data;
+  }
+
+  template <typename Handler>
+  bool basic_sax_parser<Handler>::complete() const noexcept
+  {
+    return state_ == state::complete;
+  }
+
+  template <typename Handler>
+  void basic_sax_parser<Handler>::reset()
+  {
+    stack_.clear();
+    token_.clear();
+    surrogate_ = 0;
+    // Set state to initial.
+    state_ = state::document;
+  }
+
+  template <typename Handler>
+  void basic_sax_parser<Handler>::begin_container(container c)
+  {
+    if ( stack_.size() >= max_depth_ ) {
+      throw error("error reading value, maximum nesting depth exceeded");
+    }
+
+    stack_.push_back(c);
+
+    if ( c == container::array )
+    {
+      handler_.start_array();
+      state_ = state::array_value_or_end;
+    }
+    else
+    {
+      handler_.start_object();
+      state_ = state::object_key_or_end;
+    }
+  }
+
+  template <typename Handler>
+  void basic_sax_parser<Handler>::end_container()
+  {
+    container c = stack_.back();
+
+    stack_.pop_back();
+
+    if ( c == container::array ) {
+      handler_.end_array();
+    }
+    else {
+      handler_.end_object();
+    }
+    end_value();
+  }
+
+  // Move on to what can follow a value in the enclosing container.
+  template <typename Handler>
+  void basic_sax_parser<Handler>::end_value()
+  {
+    if ( stack_.empty() ) {
+      state_ = state::complete;
+    }
+    else if ( stack_.back() == container::array ) {
+      state_ = state::array_next_value_or_end;
+    }
+    else {
+      state_ = state::object_next_member_or_end;
+    }
+  }
+
+  template <typename Handler>
+  void basic_sax_parser<Handler>::end_string()
+  {
+    if ( !details::validate_utf8(token_.data(), token_.data()+token_.length()) )
+    {
+      if ( utf8_ == utf8_mode::strict ) {
+        throw error("error reading string, invalid utf-8");
+      }
+      details::replace_invalid_utf8(token_);
+    }
+
+    if ( token_is_key_ )
+    {
+      handler_.key(token_);
+      token_.clear();
+      state_ = state::object_sep;
+    }
+    else
+    {
+      handler_.string(token_);
+      token_.clear();
+      end_value();
+    }
+  }
+
+  template <typename Handler>
+  void basic_sax_parser<Handler>::end_number()
+  {
+    const char* pb = token_.data();
+    const char* pe = pb+token_.length();
+
+    if ( token_is_integer_ )
+    {
+      int64_t v;
+      auto res = std::from_chars(pb, pe, v);
+
+      if ( res.ec == std::errc() && res.ptr == pe )
+      {
+        token_.clear();
+        handler_.integer(v);
+        end_value();
+        return;
+      }
+      // Integers out of int64 range are read as double.
+    }
+
+    double v;
+    auto res = std::from_chars(pb, pe, v);
+
+    if ( res.ec != std::errc() || res.ptr != pe ) {
+      throw error("error reading number");
+    }
+
+    token_.clear();
+    handler_.number(v);
+    end_value();
+  }
+
+  template <typename Handler>
+  void basic_sax_parser<Handler>::end_literal()
+  {
+    if ( literal_ == details::literal_true ) {
+      handler_.boolean(true);
+    }
+    else if ( literal_ == details::literal_false ) {
+      handler_.boolean(false);
+    }
+    else {
+      handler_.null();
+    }
+    end_value();
+  }
+
+  template <typename Handler>
+  void basic_sax_parser<Handler>::end_unicode_escape()
+  {
+    uint32_t cp = unicode_;
+
+    if ( surrogate_ )
+    {
+      if ( cp < 0xdc00 || cp > 0xdfff ) {
+        throw error("error reading string, invalid unicode escape");
+      }
+      cp = 0x10000 + ((surrogate_ - 0xd800) << 10) + (cp - 0xdc00);
+      surrogate_ = 0;
+    }
+    else if ( cp >= 0xd800 && cp <= 0xdbff )
+    {
+      // Wait for the low surrogate.
+      surrogate_ = cp;
+      state_ = state::string;
+      return;
+    }
+    else if ( cp >= 0xdc00 && cp <= 0xdfff )
+    {
+      throw error("error reading string, invalid unicode escape");
+    }
+
+    details::append_utf8(token_, cp);
+    state_ = state::string;
+  }
+}
+
+// ----------------------------------------------------------------------------
+#endif // __json__json_sax_parser_impl_h__
@@ -0,0 +1,58 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_scan.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Character scanning primitives used by the parser. Each has a scalar,
+//   SSE2 and AVX2 implementation, the best one supported by the cpu is
+//   selected at runtime. None of them keep state between calls, so they can
+//   be applied to any chunk of input the parser has been given.
+//
+// ----------------------------------------------------------------------------
+#ifndef __json__json_scan_h__
+#define __json__json_scan_h__
+
+// ----------------------------------------------------------------------------
+#include <cstddef>
+#include <string>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  namespace details
+  {
+    enum class scan_level
+    {
+      scalar,
+      sse2,
+      avx2
+    };
+
+    // Return the first character in [pb, pe) that is not json whitespace or
+    // pe if there is none.
+    const char* skip_ws(const char* pb, const char* pe);
+
+    // Return the first '"', '\\' or control character in [pb, pe) or pe if
+    // there is none.
+    const char* find_string_special(const char* pb, const char* pe);
+
+    // Return true if [pb, pe) is well formed utf-8.
+    bool validate_utf8(const char* pb, const char* pe);
+
+    // Replace each byte of s that is not part of a well formed utf-8
+    // sequence with U+FFFD.
+    void replace_invalid_utf8(std::string& s);
+
+    // Select the implementation to use. If the cpu does not support the
+    // requested level the best supported one below it is used. Returns the
+    // level now in use.
+    scan_level select_scan_level(scan_level level);
+  }
+}
+
+// ----------------------------------------------------------------------------
+#endif // __json__json_scan_h__
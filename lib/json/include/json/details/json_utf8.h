@@ -0,0 +1,70 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_utf8.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Helpers for decoding \uXXXX escapes, shared by the parser and views.
+//
+// ----------------------------------------------------------------------------
+#ifndef __json__json_utf8_h__
+#define __json__json_utf8_h__
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  namespace details
+  {
+    inline int hex_value(char c)
+    {
+      if ( c >= '0' && c <= '9' ) {
+        return c - '0';
+      }
+      else if ( c >= 'a' && c <= 'f' ) {
+        return c - 'a' + 10;
+      }
+      else if ( c >= 'A' && c <= 'F' ) {
+        return c - 'A' + 10;
+      }
+      else {
+        return -1;
+      }
+    }
+
+    inline void append_utf8(std::string& s, uint32_t cp)
+    {
+      if ( cp < 0x80 )
+      {
+        s.push_back(static_cast<char>(cp));
+      }
+      else if ( cp < 0x800 )
+      {
+        s.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+        s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+      }
+      else if ( cp < 0x10000 )
+      {
+        s.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+        s.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+      }
+      else
+      {
+        s.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+        s.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+        s.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        s.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+      }
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+#endif // __json__json_utf8_h__
@@ -16,7 +16,12 @@
 #include <json/json_value.h>
 #include <json/json_array.h>
 #include <json/json_object.h>
+#include <json/json_handler.h>
+#include <json/json_builder.h>
+#include <json/json_sax_parser.h>
 #include <json/json_parser.h>
+#include <json/json_writer.h>
+#include <json/json_view.h>
 #include <json/json_error.h>
 
 // ----------------------------------------------------------------------------
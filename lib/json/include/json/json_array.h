@@ -24,6 +24,7 @@ namespace json
 {
   class array
   {
+    friend class writer;
   public:
     using elements = std::vector<value>;
   public:
@@ -43,6 +44,8 @@ namespace json
     size_t size() const { return value_.size(); }
   public:
     bool empty() const { return value_.empty(); }
+  public:
+    void reserve(size_t n) { value_.reserve(n); }
   public:
     template <typename V> void push_back(V v)
     {
@@ -50,10 +53,13 @@ namespace json
     }
   public:
     //value at(size_t index) { return value_[index]; }
-    const value& operator[](size_t index) { return value_[index]; }
+    const value& operator[](size_t index) const { return value_[index]; }
   public:
     elements::iterator begin() { return value_.begin(); }
     elements::iterator end()   { return value_.end(); }
+  public:
+    elements::const_iterator begin() const { return value_.begin(); }
+    elements::const_iterator end()   const { return value_.end(); }
   public:
     virtual void write(std::ostream& os) const;
   private:
@@ -62,21 +68,6 @@ namespace json
   private:
     elements value_;
   };
-
-  inline void array::write(std::ostream& os) const
-  {
-    os << "[";
-
-    for ( elements::const_iterator it = begin(value_); it != end(value_); )
-    {
-      os << (*it);
-
-      if ( ++it != end(value_) ) {
-        os << ",";
-      }
-    }
-    os << "]";
-  }
 }
 
 // ----------------------------------------------------------------------------
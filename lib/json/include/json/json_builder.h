@@ -0,0 +1,99 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_builder.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Handlers building values from parser events. builder builds one value,
+//   array_stream builds the elements of an array one at a time and hands
+//   each to a callback, so the array as a whole is never held in memory.
+//
+// ----------------------------------------------------------------------------
+#ifndef __json__json_builder_h__
+#define __json__json_builder_h__
+
+// ----------------------------------------------------------------------------
+#include <json/json_handler.h>
+#include <json/json_value.h>
+#include <json/json_array.h>
+#include <json/json_object.h>
+
+// ----------------------------------------------------------------------------
+#include <functional>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  class builder final : public handler
+  {
+  public:
+    builder(value& value);
+  public:
+    void start_object() override;
+    void end_object() override;
+    void start_array() override;
+    void end_array() override;
+  public:
+    void key(std::string_view v) override;
+    void string(std::string_view v) override;
+    void number(double v) override;
+    void integer(int64_t v) override;
+    void boolean(bool v) override;
+    void null() override;
+  public:
+    // True when a complete value has been built.
+    bool complete() const noexcept { return complete_; }
+  public:
+    // Discard any partially built value and clear the value.
+    void reset();
+  private:
+    void add(json::value v);
+  private:
+    value&                   value_;
+    bool                     complete_;
+    // Containers being built, innermost last, and their pending keys.
+    std::vector<json::value> values_;
+    std::vector<std::string> keys_;
+  };
+
+  class array_stream final : public handler
+  {
+  public:
+    using element_func = std::function<void(value& element)>;
+  public:
+    array_stream(element_func element_cb);
+  public:
+    void start_object() override;
+    void end_object() override;
+    void start_array() override;
+    void end_array() override;
+  public:
+    void key(std::string_view v) override;
+    void string(std::string_view v) override;
+    void number(double v) override;
+    void integer(int64_t v) override;
+    void boolean(bool v) override;
+    void null() override;
+  public:
+    // True when the end of the array has been seen.
+    bool complete() const noexcept { return complete_; }
+  public:
+    void reset();
+  private:
+    void begin_value();
+    void end_value();
+  private:
+    element_func element_cb_;
+    value        element_;
+    builder      builder_;
+    size_t       depth_;
+    bool         complete_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __json__json_builder_h__
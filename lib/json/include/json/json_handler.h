@@ -0,0 +1,44 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_handler.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Receiver of the events produced by json::sax_parser. Strings and keys
+//   are only valid for the duration of the call.
+//
+// ----------------------------------------------------------------------------
+#ifndef __json__json_handler_h__
+#define __json__json_handler_h__
+
+// ----------------------------------------------------------------------------
+#include <string_view>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  class handler
+  {
+  public:
+    virtual ~handler() {}
+  public:
+    virtual void start_object() = 0;
+    virtual void end_object() = 0;
+    virtual void start_array() = 0;
+    virtual void end_array() = 0;
+  public:
+    virtual void key(std::string_view v) = 0;
+    virtual void string(std::string_view v) = 0;
+    virtual void number(double v) = 0;
+    virtual void integer(int64_t v) = 0;
+    virtual void boolean(bool v) = 0;
+    virtual void null() = 0;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __json__json_handler_h__
@@ -25,6 +25,7 @@ namespace json
 
   class object
   {
+    friend class writer;
   public:
     using member_map = std::unordered_map<std::string, value>;
   public:
@@ -56,10 +57,15 @@ namespace json
     virtual ~object() {}
   public:
     bool empty() const { return value_.empty(); }
+  public:
+    size_t size() const { return value_.size(); }
+  public:
+    member_map::const_iterator begin() const { return value_.begin(); }
+    member_map::const_iterator end()   const { return value_.end(); }
   public:
     bool has_member(std::string key) const
     {
-      return value_.find(key) != end(value_);
+      return value_.find(key) != value_.end();
     }
   public:
     virtual void write(std::ostream& os) const;
@@ -74,20 +80,6 @@ namespace json
   private:
     member_map value_;
   };
-
-  inline void object::write(std::ostream& os) const
-  {
-    os << "{";
-    for ( member_map::const_iterator it = begin(value_); it != end(value_); )
-    {
-      os << escape((*it).first) << ":" << (*it).second;
-
-      if ( ++it != end(value_) ) {
-        os << ",";
-      }
-    }
-    os << "}";
-  }
 }
 
 // ----------------------------------------------------------------------------
@@ -98,12 +90,7 @@ inline std::ostream& operator<<(std::ostream& os, const json::object& v)
 }
 
 // ----------------------------------------------------------------------------
-inline std::string to_string(const json::object& value)
-{
-  std::stringstream os;
-  os << value;
-  return os.str();
-}
+std::string to_string(const json::object& value);
 
 // ----------------------------------------------------------------------------
 #endif // __json__object_h__
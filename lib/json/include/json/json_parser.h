@@ -7,34 +7,27 @@
 //
 // --- Description: -----------------------------------------------------------
 //
+//   Incremental json parser. Input can be given in chunks split at any
+//   position, parse() consumes as much as it can and keeps its state until
+//   it is called with the next chunk.
 //
 // ----------------------------------------------------------------------------
 #ifndef __json__json_parser_h__
 #define __json__json_parser_h__
 
 // ----------------------------------------------------------------------------
-#include <json/json_value.h>
-#include <json/json_array.h>
-#include <json/json_object.h>
-
-// ----------------------------------------------------------------------------
-#include <json/details/json_parser_state.h>
-
-// ----------------------------------------------------------------------------
-#include <memory>
-#include <stack>
-#include <array>
+#include <json/json_sax_parser.h>
+#include <json/json_builder.h>
 
 // ----------------------------------------------------------------------------
 namespace json
 {
   class parser
   {
-    friend class parser_state_base;
-  private:
-    using state_ptr = std::unique_ptr<parser_state_base>;
   public:
-    parser(value& value);
+    static const size_t default_max_depth = sax_parser::default_max_depth;
+  public:
+    parser(value& value, size_t max_depth=default_max_depth, utf8_mode utf8=utf8_mode::strict);
   public:
     size_t parse(const char* data, size_t data_len);
   public:
@@ -42,11 +35,8 @@ namespace json
   public:
     void reset();
   private:
-    void push_state(parser_state_base* state);
-  private:
-    value& value_;
-    //std::stack<state_ptr> stack_;
-    std::stack<state_ptr, std::vector<state_ptr>> stack_;
+    builder                   builder_;
+    basic_sax_parser<builder> sax_parser_;
   };
 }
 
@@ -0,0 +1,123 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_sax_parser.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Incremental event driven json parser. Input can be given in chunks
+//   split at any position, parse() consumes as much as it can, reporting
+//   what it reads to its handler, and keeps its state until it is called
+//   with the next chunk.
+//
+//   The parser is a template on the handler, so events are plain calls
+//   to a handler of a final class. sax_parser reports to any json::handler
+//   through its virtual functions.
+//
+// ----------------------------------------------------------------------------
+#ifndef __json__json_sax_parser_h__
+#define __json__json_sax_parser_h__
+
+// ----------------------------------------------------------------------------
+#include <json/json_handler.h>
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  // How strings that are not well formed utf-8 are read. Strict rejects
+  // them with a json::error, replace reads them with each bad byte replaced
+  // by U+FFFD, for data written before it was checked.
+  enum class utf8_mode : uint8_t
+  {
+    strict,
+    replace
+  };
+
+  template <typename Handler>
+  class basic_sax_parser
+  {
+  public:
+    static const size_t default_max_depth = 512;
+  public:
+    basic_sax_parser(Handler& handler, size_t max_depth=default_max_depth, utf8_mode utf8=utf8_mode::strict);
+  public:
+    size_t parse(const char* data, size_t data_len);
+  public:
+    bool complete() const noexcept;
+  public:
+    void reset();
+  private:
+    enum class state : uint8_t
+    {
+      document,
+      value,
+      array_value_or_end,
+      array_next_value_or_end,
+      object_key_or_end,
+      object_key,
+      object_sep,
+      object_next_member_or_end,
+      string,
+      string_escape,
+      string_unicode,
+      number,
+      literal,
+      complete
+    };
+    enum class container : uint8_t
+    {
+      array,
+      object
+    };
+  private:
+    void begin_container(container c);
+    void end_container();
+    void end_value();
+    void end_string();
+    void end_number();
+    void end_literal();
+    void end_unicode_escape();
+  private:
+    Handler&    handler_;
+    size_t      max_depth_;
+    utf8_mode   utf8_;
+    state       state_;
+    // Containers currently being parsed, innermost last.
+    std::vector<container> stack_;
+    // String and number characters read so far.
+    std::string token_;
+    bool        token_is_key_;
+    bool        token_is_integer_;
+    // Literal being matched (true, false or null) and position in it.
+    const char* literal_;
+    uint8_t     literal_pos_;
+    // Unicode escape code point, number of hex digits read and a pending
+    // high surrogate.
+    uint32_t    unicode_;
+    uint8_t     unicode_digits_;
+    uint32_t    surrogate_;
+  };
+
+  using sax_parser = basic_sax_parser<handler>;
+
+  class builder;
+  class array_stream;
+
+  // Instantiated in the library.
+  extern template class basic_sax_parser<handler>;
+  extern template class basic_sax_parser<builder>;
+  extern template class basic_sax_parser<array_stream>;
+}
+
+// ----------------------------------------------------------------------------
+#include <json/details/json_sax_parser_impl.h>
+
+// ----------------------------------------------------------------------------
+#endif // __json__json_sax_parser_h__
@@ -14,9 +14,11 @@
 
 // ----------------------------------------------------------------------------
 #include <string>
+#include <string_view>
 #include <memory>
 #include <cassert>
 #include <sstream>
+#include <cstdint>
 
 // ----------------------------------------------------------------------------
 namespace json
@@ -27,6 +29,7 @@ namespace json
     num = 0x01,
     tru = 0x02,
     fal = 0x03,
+    i64 = 0x04,
     str = 0x81,
     obj = 0x82,
     arr = 0x83
@@ -54,6 +57,10 @@ namespace json
     value(double v);
     value(int v);
     value(unsigned v);
+    value(long v);
+    value(unsigned long v);
+    value(long long v);
+    value(unsigned long long v);
     value(bool v);
     value(const json::array& v);
     value(json::array&& v);
@@ -62,11 +69,15 @@ namespace json
   public:
     ~value();
   public:
-    operator std::string() const;
+    // Conversions copy, unless converting an rvalue which is moved from.
+    operator std::string() const &;
+    operator std::string() &&;
     operator double() const;
     operator bool() const;
-    operator json::object() const;
-    operator json::array() const;
+    operator json::object() const &;
+    operator json::object() &&;
+    operator json::array() const &;
+    operator json::array() &&;
   public:
     type type_id() const noexcept { return type_; }
   public:
@@ -75,7 +86,8 @@ namespace json
     bool is_false()  const noexcept { return type_ == type::fal; }
     bool is_bool()   const noexcept { return is_true() || is_false(); }
     bool is_string() const noexcept { return type_ == type::str; }
-    bool is_number() const noexcept { return type_ == type::num; }
+    bool is_number() const noexcept { return type_ == type::num || type_ == type::i64; }
+    bool is_integer() const noexcept { return type_ == type::i64; }
     bool is_array()  const noexcept { return type_ == type::arr; }
     bool is_object() const noexcept { return type_ == type::obj; }
   public:
@@ -84,11 +96,23 @@ namespace json
       assert(is_string());
       return *str_;
     }
+  public:
+    std::string_view as_string_view() const
+    {
+      assert(is_string());
+      return *str_;
+    }
   public:
     double as_number() const
     {
       assert(is_number());
-      return num_;
+      return type_ == type::i64 ? static_cast<double>(int_) : num_;
+    }
+  public:
+    int64_t as_integer() const
+    {
+      assert(is_number());
+      return type_ == type::i64 ? int_ : static_cast<int64_t>(num_);
     }
   public:
     bool as_bool() const
@@ -116,6 +140,12 @@ namespace json
       assert(is_string());
       return std::move(*str_);
     }
+  public:
+    // Move the contents out of an rvalue without copying, e.g.
+    // std::move(v).take_object(). The value is left holding an empty
+    // object or array.
+    object take_object() &&;
+    array  take_array() &&;
   public:
     void write(std::ostream& os) const;
   private:
@@ -127,39 +157,12 @@ namespace json
     {
       str_ptr str_;
       double  num_;
+      int64_t int_;
       bool    t_f_;
       arr_ptr arr_;
       obj_ptr obj_;
     };
   };
-
-  inline std::string escape(const std::string& s)
-  {
-      std::string result;
-
-      result.reserve(s.size()+2);
-
-      result += "\"";
-      for ( auto c : s )
-      {
-        switch ( c )
-        {
-          case '"':  result += "\\\""; break;
-          case '\\': result += "\\\\"; break;
-          case '/':  result += "\\/";  break;
-          case '\b': result += "\\b";  break;
-          case '\f': result += "\\f";  break;
-          case '\n': result += "\\n";  break;
-          case '\r': result += "\\r";  break;
-          case '\t': result += "\\t";  break;
-          default:
-            result += c;
-        }
-      }
-      result += "\"";
-
-      return result;
-  }
 }
 
 // ----------------------------------------------------------------------------
@@ -173,12 +176,7 @@ inline std::ostream& operator<<(std::ostream& os, const json::value& v)
 }
 
 // ----------------------------------------------------------------------------
-inline std::string to_string(const json::value& value)
-{
-  std::stringstream os;
-  os << value;
-  return os.str();
-}
+std::string to_string(const json::value& value);
 
 // ----------------------------------------------------------------------------
 #endif // __json__value_h__
@@ -0,0 +1,94 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_view.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Read only view of a serialized json document. Nothing is parsed up
+//   front, member and element lookups scan the text on demand and return
+//   views of the sub values, so reading a couple of fields of a record
+//   does not build a tree of values. The text must outlive the view.
+//
+//   A default constructed view, and the result of looking up a member or
+//   element that does not exist, is empty. An empty view reads as null.
+//
+// ----------------------------------------------------------------------------
+#ifndef __json__json_view_h__
+#define __json__json_view_h__
+
+// ----------------------------------------------------------------------------
+#include <json/json_value.h>
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  class view
+  {
+  public:
+    view() : pb_(nullptr), pe_(nullptr) {}
+  public:
+    view(const char* data, size_t len);
+    view(std::string_view text) : view(text.data(), text.size()) {}
+  public:
+    explicit operator bool() const noexcept { return pb_ != nullptr; }
+  public:
+    type type_id() const;
+  public:
+    bool is_null()    const { return type_id() == type::nul; }
+    bool is_true()    const { return type_id() == type::tru; }
+    bool is_false()   const { return type_id() == type::fal; }
+    bool is_bool()    const { return is_true() || is_false(); }
+    bool is_number()  const { auto t = type_id(); return t == type::num || t == type::i64; }
+    bool is_integer() const { return type_id() == type::i64; }
+    bool is_string()  const { return type_id() == type::str; }
+    bool is_object()  const { return type_id() == type::obj; }
+    bool is_array()   const { return type_id() == type::arr; }
+  public:
+    // Object member, empty if there is no such member or this is not an
+    // object.
+    view operator[](std::string_view key) const;
+    // Array element, empty if out of range or this is not an array.
+    view operator[](size_t index) const;
+  public:
+    // Look up several members in a single pass over the object. values is
+    // resized to keys.size() and values[i] is set to the member named
+    // keys[i], or left empty if there is none.
+    void project(const std::vector<std::string>& keys, std::vector<view>& values) const;
+  public:
+    // Iterate array elements and object members. Return false from the
+    // callback to stop.
+    void each(std::function<bool(const view& value)> value_cb) const;
+    void each_member(std::function<bool(std::string_view key, const view& value)> member_cb) const;
+  public:
+    // The serialized text of the value.
+    std::string_view raw() const noexcept { return std::string_view(pb_, pe_-pb_); }
+  public:
+    // String contents. If the string has no escapes the result refers to
+    // the document text, otherwise it is unescaped into buf.
+    std::string_view as_string(std::string& buf) const;
+    std::string      as_string() const;
+    bool             as_bool() const;
+    double           as_number() const;
+    int64_t          as_integer() const;
+  public:
+    // Parse the viewed text into a value.
+    value to_value() const;
+  private:
+    static view range(const char* pb, const char* pe);
+  private:
+    const char* pb_;
+    const char* pe_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __json__json_view_h__
@@ -0,0 +1,50 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_writer.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Serialize json values directly into a growable byte buffer. The buffer
+//   is only appended to, so it can be cleared and reused between documents
+//   without giving back its capacity.
+//
+// ----------------------------------------------------------------------------
+#ifndef __json__json_writer_h__
+#define __json__json_writer_h__
+
+// ----------------------------------------------------------------------------
+#include <json/json_value.h>
+#include <json/json_array.h>
+#include <json/json_object.h>
+
+// ----------------------------------------------------------------------------
+#include <string>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  class writer
+  {
+  public:
+    writer(std::string& buf) : buf_(buf) {}
+  public:
+    void write(const value& v);
+    void write(const array& v);
+    void write(const object& v);
+  public:
+    void write_string(const char* s, size_t len);
+    void write_string(const std::string& s) { write_string(s.data(), s.length()); }
+    void write_number(double v);
+    void write_integer(int64_t v);
+  public:
+    std::string& buffer() { return buf_; }
+  private:
+    std::string& buf_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __json__json_writer_h__
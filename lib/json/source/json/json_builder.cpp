@@ -0,0 +1,215 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_builder.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include <json/json_builder.h>
+#include <json/json_error.h>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  builder::builder(json::value& value)
+    :
+    value_(value),
+    complete_(false),
+    values_(),
+    keys_()
+  {
+  }
+
+  void builder::start_object()
+  {
+    values_.emplace_back(json::object());
+  }
+
+  void builder::end_object()
+  {
+    json::value v = std::move(values_.back());
+    values_.pop_back();
+    add(std::move(v));
+  }
+
+  void builder::start_array()
+  {
+    values_.emplace_back(json::array());
+  }
+
+  void builder::end_array()
+  {
+    json::value v = std::move(values_.back());
+    values_.pop_back();
+    add(std::move(v));
+  }
+
+  void builder::key(std::string_view v)
+  {
+    keys_.emplace_back(v);
+  }
+
+  void builder::string(std::string_view v)
+  {
+    add(json::value(std::string(v)));
+  }
+
+  void builder::number(double v)
+  {
+    add(json::value(v));
+  }
+
+  void builder::integer(int64_t v)
+  {
+    add(json::value(v));
+  }
+
+  void builder::boolean(bool v)
+  {
+    add(json::value(v));
+  }
+
+  void builder::null()
+  {
+    add(json::value());
+  }
+
+  void builder::reset()
+  {
+    values_.clear();
+    keys_.clear();
+    value_ = json::value();
+    complete_ = false;
+  }
+
+  void builder::add(json::value v)
+  {
+    if ( values_.empty() )
+    {
+      value_ = std::move(v);
+      complete_ = true;
+    }
+    else if ( values_.back().is_array() )
+    {
+      values_.back().as_array().push_back(std::move(v));
+    }
+    else
+    {
+      values_.back().as_object().member(std::move(keys_.back()), std::move(v));
+      keys_.pop_back();
+    }
+  }
+
+  array_stream::array_stream(element_func element_cb)
+    :
+    element_cb_(std::move(element_cb)),
+    element_(),
+    builder_(element_),
+    depth_(0),
+    complete_(false)
+  {
+  }
+
+  void array_stream::start_object()
+  {
+    begin_value();
+    depth_++;
+    builder_.start_object();
+  }
+
+  void array_stream::end_object()
+  {
+    depth_--;
+    builder_.end_object();
+    end_value();
+  }
+
+  void array_stream::start_array()
+  {
+    // The streamed array itself is not built.
+    if ( depth_++ > 0 ) {
+      builder_.start_array();
+    }
+  }
+
+  void array_stream::end_array()
+  {
+    if ( --depth_ > 0 )
+    {
+      builder_.end_array();
+      end_value();
+    }
+    else
+    {
+      complete_ = true;
+    }
+  }
+
+  void array_stream::key(std::string_view v)
+  {
+    builder_.key(v);
+  }
+
+  void array_stream::string(std::string_view v)
+  {
+    begin_value();
+    builder_.string(v);
+    end_value();
+  }
+
+  void array_stream::number(double v)
+  {
+    begin_value();
+    builder_.number(v);
+    end_value();
+  }
+
+  void array_stream::integer(int64_t v)
+  {
+    begin_value();
+    builder_.integer(v);
+    end_value();
+  }
+
+  void array_stream::boolean(bool v)
+  {
+    begin_value();
+    builder_.boolean(v);
+    end_value();
+  }
+
+  void array_stream::null()
+  {
+    begin_value();
+    builder_.null();
+    end_value();
+  }
+
+  void array_stream::reset()
+  {
+    builder_.reset();
+    depth_ = 0;
+    complete_ = false;
+  }
+
+  void array_stream::begin_value()
+  {
+    if ( depth_ == 0 ) {
+      throw error("expected array");
+    }
+  }
+
+  // Hand over the element once it is complete.
+  void array_stream::end_value()
+  {
+    if ( depth_ == 1 )
+    {
+      element_cb_(element_);
+      builder_.reset();
+    }
+  }
+}
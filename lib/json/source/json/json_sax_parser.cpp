@@ -0,0 +1,21 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_sax_parser.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include <json/json_sax_parser.h>
+#include <json/json_builder.h>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  template class basic_sax_parser<handler>;
+  template class basic_sax_parser<builder>;
+  template class basic_sax_parser<array_stream>;
+}
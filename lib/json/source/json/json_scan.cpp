@@ -0,0 +1,395 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_scan.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include <json/details/json_scan.h>
+
+// ----------------------------------------------------------------------------
+#include <atomic>
+
+// ----------------------------------------------------------------------------
+#if defined(__x86_64__) || defined(__i386__)
+#define JSON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  namespace details
+  {
+    static inline bool is_ws(char c)
+    {
+      return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+    }
+
+    static inline bool is_string_special(char c)
+    {
+      return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    }
+
+    // Check the multi byte sequence starting at pb. Returns a pointer past
+    // the sequence or nullptr if it is not well formed.
+    static const char* utf8_sequence(const char* pb, const char* pe)
+    {
+      unsigned char c  = static_cast<unsigned char>(*pb);
+      unsigned char lo = 0x80;
+      unsigned char hi = 0xbf;
+      ptrdiff_t     n;
+
+      if ( c >= 0xc2 && c <= 0xdf ) {
+        n = 1;
+      }
+      else if ( c == 0xe0 ) {
+        n = 2; lo = 0xa0; // overlong
+      }
+      else if ( c == 0xed ) {
+        n = 2; hi = 0x9f; // surrogates
+      }
+      else if ( c >= 0xe1 && c <= 0xef ) {
+        n = 2;
+      }
+      else if ( c == 0xf0 ) {
+        n = 3; lo = 0x90; // overlong
+      }
+      else if ( c >= 0xf1 && c <= 0xf3 ) {
+        n = 3;
+      }
+      else if ( c == 0xf4 ) {
+        n = 3; hi = 0x8f; // > U+10FFFF
+      }
+      else {
+        return nullptr;
+      }
+
+      if ( pe-pb <= n ) {
+        return nullptr;
+      }
+
+      unsigned char c1 = static_cast<unsigned char>(pb[1]);
+
+      if ( c1 < lo || c1 > hi ) {
+        return nullptr;
+      }
+
+      for ( ptrdiff_t i = 2; i <= n; ++i )
+      {
+        if ( (static_cast<unsigned char>(pb[i]) & 0xc0) != 0x80 ) {
+          return nullptr;
+        }
+      }
+      return pb+n+1;
+    }
+
+    //
+    // Scalar
+    //
+
+    static const char* skip_ws_scalar(const char* pb, const char* pe)
+    {
+      while ( pb < pe && is_ws(*pb) ) {
+        pb++;
+      }
+      return pb;
+    }
+
+    static const char* find_string_special_scalar(const char* pb, const char* pe)
+    {
+      while ( pb < pe && !is_string_special(*pb) ) {
+        pb++;
+      }
+      return pb;
+    }
+
+    static bool validate_utf8_scalar(const char* pb, const char* pe)
+    {
+      while ( pb < pe )
+      {
+        if ( static_cast<unsigned char>(*pb) < 0x80 ) {
+          pb++;
+        }
+        else if ( (pb = utf8_sequence(pb, pe)) == nullptr ) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+#ifdef JSON_SCAN_X86
+    //
+    // SSE2
+    //
+
+    __attribute__((target("sse2")))
+    static const char* skip_ws_sse2(const char* pb, const char* pe)
+    {
+      // Most whitespace runs are a single character or none at all.
+      if ( pb < pe && !is_ws(*pb) ) {
+        return pb;
+      }
+
+      const __m128i sp  = _mm_set1_epi8(' ');
+      const __m128i nl  = _mm_set1_epi8('\n');
+      const __m128i tab = _mm_set1_epi8('\t');
+      const __m128i cr  = _mm_set1_epi8('\r');
+
+      while ( pe-pb >= 16 )
+      {
+        __m128i x  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb));
+        __m128i ws = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(x, sp), _mm_cmpeq_epi8(x, nl)),
+          _mm_or_si128(_mm_cmpeq_epi8(x, tab), _mm_cmpeq_epi8(x, cr)));
+
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(ws)) & 0xffff;
+
+        if ( mask ) {
+          return pb+__builtin_ctz(mask);
+        }
+        pb += 16;
+      }
+      return skip_ws_scalar(pb, pe);
+    }
+
+    __attribute__((target("sse2")))
+    static const char* find_string_special_sse2(const char* pb, const char* pe)
+    {
+      const __m128i quote = _mm_set1_epi8('"');
+      const __m128i bslash = _mm_set1_epi8('\\');
+      const __m128i ctrl  = _mm_set1_epi8(0x1f);
+
+      while ( pe-pb >= 16 )
+      {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb));
+        // x <= 0x1f (unsigned) <=> max(x, 0x1f) == 0x1f
+        __m128i special = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, bslash)),
+          _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl));
+
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+
+        if ( mask ) {
+          return pb+__builtin_ctz(mask);
+        }
+        pb += 16;
+      }
+      return find_string_special_scalar(pb, pe);
+    }
+
+    __attribute__((target("sse2")))
+    static bool validate_utf8_sse2(const char* pb, const char* pe)
+    {
+      while ( pe-pb >= 16 )
+      {
+        __m128i  x    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(x));
+
+        if ( mask == 0 )
+        {
+          pb += 16;
+        }
+        else
+        {
+          // Skip the ascii prefix and check the sequence one at a time.
+          pb += __builtin_ctz(mask);
+
+          if ( (pb = utf8_sequence(pb, pe)) == nullptr ) {
+            return false;
+          }
+        }
+      }
+      return validate_utf8_scalar(pb, pe);
+    }
+
+    //
+    // AVX2
+    //
+
+    __attribute__((target("avx2")))
+    static const char* skip_ws_avx2(const char* pb, const char* pe)
+    {
+      if ( pb < pe && !is_ws(*pb) ) {
+        return pb;
+      }
+
+      const __m256i sp  = _mm256_set1_epi8(' ');
+      const __m256i nl  = _mm256_set1_epi8('\n');
+      const __m256i tab = _mm256_set1_epi8('\t');
+      const __m256i cr  = _mm256_set1_epi8('\r');
+
+      while ( pe-pb >= 32 )
+      {
+        __m256i x  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pb));
+        __m256i ws = _mm256_or_si256(
+          _mm256_or_si256(_mm256_cmpeq_epi8(x, sp), _mm256_cmpeq_epi8(x, nl)),
+          _mm256_or_si256(_mm256_cmpeq_epi8(x, tab), _mm256_cmpeq_epi8(x, cr)));
+
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ws));
+
+        if ( mask ) {
+          return pb+__builtin_ctz(mask);
+        }
+        pb += 32;
+      }
+      return skip_ws_sse2(pb, pe);
+    }
+
+    __attribute__((target("avx2")))
+    static const char* find_string_special_avx2(const char* pb, const char* pe)
+    {
+      const __m256i quote  = _mm256_set1_epi8('"');
+      const __m256i bslash = _mm256_set1_epi8('\\');
+      const __m256i ctrl   = _mm256_set1_epi8(0x1f);
+
+      while ( pe-pb >= 32 )
+      {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pb));
+        __m256i special = _mm256_or_si256(
+          _mm256_or_si256(_mm256_cmpeq_epi8(x, quote), _mm256_cmpeq_epi8(x, bslash)),
+          _mm256_cmpeq_epi8(_mm256_max_epu8(x, ctrl), ctrl));
+
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+
+        if ( mask ) {
+          return pb+__builtin_ctz(mask);
+        }
+        pb += 32;
+      }
+      return find_string_special_sse2(pb, pe);
+    }
+
+    __attribute__((target("avx2")))
+    static bool validate_utf8_avx2(const char* pb, const char* pe)
+    {
+      while ( pe-pb >= 32 )
+      {
+        __m256i  x    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pb));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(x));
+
+        if ( mask == 0 )
+        {
+          pb += 32;
+        }
+        else
+        {
+          pb += __builtin_ctz(mask);
+
+          if ( (pb = utf8_sequence(pb, pe)) == nullptr ) {
+            return false;
+          }
+        }
+      }
+      return validate_utf8_sse2(pb, pe);
+    }
+#endif
+
+    //
+    // Dispatch
+    //
+
+    struct scan_functions
+    {
+      scan_level  level;
+      const char* (*skip_ws)(const char* pb, const char* pe);
+      const char* (*find_string_special)(const char* pb, const char* pe);
+      bool        (*validate_utf8)(const char* pb, const char* pe);
+    };
+
+    static const scan_functions scalar_functions = {
+      scan_level::scalar, skip_ws_scalar, find_string_special_scalar, validate_utf8_scalar
+    };
+
+#ifdef JSON_SCAN_X86
+    static const scan_functions sse2_functions = {
+      scan_level::sse2, skip_ws_sse2, find_string_special_sse2, validate_utf8_sse2
+    };
+
+    static const scan_functions avx2_functions = {
+      scan_level::avx2, skip_ws_avx2, find_string_special_avx2, validate_utf8_avx2
+    };
+#endif
+
+    static const scan_functions* supported_functions(scan_level level)
+    {
+#ifdef JSON_SCAN_X86
+      __builtin_cpu_init();
+
+      if ( level >= scan_level::avx2 && __builtin_cpu_supports("avx2") ) {
+        return &avx2_functions;
+      }
+
+      if ( level >= scan_level::sse2 && __builtin_cpu_supports("sse2") ) {
+        return &sse2_functions;
+      }
+#endif
+      return &scalar_functions;
+    }
+
+    static std::atomic<const scan_functions*> current_functions{nullptr};
+
+    static inline const scan_functions& functions()
+    {
+      auto f = current_functions.load(std::memory_order_relaxed);
+
+      if ( !f )
+      {
+        f = supported_functions(scan_level::avx2);
+        current_functions.store(f, std::memory_order_relaxed);
+      }
+      return *f;
+    }
+
+    const char* skip_ws(const char* pb, const char* pe)
+    {
+      return functions().skip_ws(pb, pe);
+    }
+
+    const char* find_string_special(const char* pb, const char* pe)
+    {
+      return functions().find_string_special(pb, pe);
+    }
+
+    bool validate_utf8(const char* pb, const char* pe)
+    {
+      return functions().validate_utf8(pb, pe);
+    }
+
+    void replace_invalid_utf8(std::string& s)
+    {
+      std::string result;
+
+      result.reserve(s.length()+8);
+
+      const char* pb = s.data();
+      const char* pe = s.data()+s.length();
+
+      while ( pb < pe )
+      {
+        const char* next = pb+1;
+
+        if ( static_cast<unsigned char>(*pb) < 0x80 || (next = utf8_sequence(pb, pe)) != nullptr ) {
+          result.append(pb, next);
+          pb = next;
+        }
+        else {
+          result.append("\xef\xbf\xbd");
+          pb++;
+        }
+      }
+      s.swap(result);
+    }
+
+    scan_level select_scan_level(scan_level level)
+    {
+      auto f = supported_functions(level);
+      current_functions.store(f, std::memory_order_relaxed);
+      return f->level;
+    }
+  }
+}
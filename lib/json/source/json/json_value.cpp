@@ -12,6 +12,7 @@
 #include <json/json_value.h>
 #include <json/json_array.h>
 #include <json/json_object.h>
+#include <json/json_writer.h>
 
 // ----------------------------------------------------------------------------
 namespace json
@@ -39,6 +40,9 @@ namespace json
       case json::type::num:
         num_ = rhs.num_;
         break;
+      case json::type::i64:
+        int_ = rhs.int_;
+        break;
       case json::type::tru:
       case json::type::fal:
         t_f_ = rhs.t_f_;
@@ -70,6 +74,9 @@ namespace json
       case json::type::num:
         num_ = rhs.num_;
         break;
+      case json::type::i64:
+        int_ = rhs.int_;
+        break;
       case json::type::tru:
       case json::type::fal:
         t_f_ = rhs.t_f_;
@@ -115,14 +122,50 @@ namespace json
 
   value::value(int v)
     :
-    type_(type::num), num_(v)
+    type_(type::i64), int_(v)
   {
   }
 
   value::value(unsigned v)
     :
-    type_(type::num), num_(v)
+    type_(type::i64), int_(v)
+  {
+  }
+
+  value::value(long v)
+    :
+    type_(type::i64), int_(v)
+  {
+  }
+
+  value::value(unsigned long v)
+    :
+    type_(type::i64), int_(v)
+  {
+    // Values out of int64 range can only be represented as double.
+    if ( v > static_cast<unsigned long>(INT64_MAX) )
+    {
+      type_ = type::num;
+      num_  = v;
+    }
+  }
+
+  value::value(long long v)
+    :
+    type_(type::i64), int_(v)
+  {
+  }
+
+  value::value(unsigned long long v)
+    :
+    type_(type::i64), int_(v)
   {
+    // Values out of int64 range can only be represented as double.
+    if ( v > static_cast<unsigned long long>(INT64_MAX) )
+    {
+      type_ = type::num;
+      num_  = v;
+    }
   }
 
   value::value(bool v)
@@ -160,11 +203,16 @@ namespace json
     free_value();
   }
 
-  value::operator std::string() const
+  value::operator std::string() const &
   {
     return as_string();
   }
 
+  value::operator std::string() &&
+  {
+    return move_string();
+  }
+
   value::operator double() const
   {
     return as_number();
@@ -175,45 +223,57 @@ namespace json
     return as_bool();
   }
 
-  value::operator json::object() const
+  value::operator json::object() const &
   {
     return as_object();
   }
 
-  value::operator json::array() const
+  value::operator json::object() &&
+  {
+    return std::move(*this).take_object();
+  }
+
+  value::operator json::array() const &
   {
     return as_array();
   }
 
+  value::operator json::array() &&
+  {
+    return std::move(*this).take_array();
+  }
+
+  object value::take_object() &&
+  {
+    assert(is_object());
+    return std::move(*obj_);
+  }
+
+  array value::take_array() &&
+  {
+    assert(is_array());
+    return std::move(*arr_);
+  }
+
   void value::write(std::ostream& os) const
   {
-    switch ( type_ )
-    {
-      case json::type::nul:
-        os << "null";
-        break;
-      case json::type::str:
-        os << escape(*str_);
-        break;
-      case json::type::num:
-        os << num_;
-        break;
-      case json::type::tru:
-        os << "true";
-        break;
-      case json::type::fal:
-        os << "false";
-        break;
-      case json::type::arr:
-        os << *arr_;
-        break;
-      case json::type::obj:
-        os << *obj_;
-        break;
-      default:
-        assert(false);
-        break;
-    }
+    std::string buf;
+    writer(buf).write(*this);
+    os.write(buf.data(), buf.length());
+  }
+
+  void array::write(std::ostream& os) const
+  {
+    std::string buf;
+    writer(buf).write(*this);
+    os.write(buf.data(), buf.length());
+  }
+
+  void object::write(std::ostream& os) const
+  {
+    std::string buf;
+    writer(buf).write(*this);
+    os.write(buf.data(), buf.length());
   }
 
   void value::free_value()
@@ -247,6 +307,7 @@ std::ostream& operator<<(std::ostream& os, json::type t)
     case json::type::nul: os << "null";   break;
     case json::type::str: os << "string"; break;
     case json::type::num: os << "number"; break;
+    case json::type::i64: os << "integer"; break;
     case json::type::tru: os << "true";   break;
     case json::type::fal: os << "false";  break;
     case json::type::arr: os << "array";  break;
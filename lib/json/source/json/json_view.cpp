@@ -0,0 +1,572 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_view.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include <json/json_view.h>
+#include <json/json_parser.h>
+#include <json/json_error.h>
+#include <json/details/json_scan.h>
+#include <json/details/json_utf8.h>
+
+// ----------------------------------------------------------------------------
+#include <charconv>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  static inline bool is_ws(char c)
+  {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+  }
+
+  // pb points at the opening quote. Returns a pointer past the closing
+  // quote.
+  static const char* skip_string(const char* pb, const char* pe)
+  {
+    const char* it = pb+1;
+
+    while ( true )
+    {
+      it = details::find_string_special(it, pe);
+
+      if ( it >= pe ) {
+        throw error("unterminated string");
+      }
+
+      if ( *it == '"' ) {
+        return it+1;
+      }
+      else if ( *it == '\\' ) {
+        it += 2;
+      }
+      else {
+        it++;
+      }
+    }
+  }
+
+  // pb points at the opening bracket. Returns a pointer past the matching
+  // closing bracket.
+  static const char* skip_container(const char* pb, const char* pe)
+  {
+    const char* it    = pb;
+    size_t      depth = 0;
+
+    while ( it < pe )
+    {
+      switch ( *it )
+      {
+        case '"':
+          it = skip_string(it, pe);
+          continue;
+        case '{':
+        case '[':
+          depth++;
+          break;
+        case '}':
+        case ']':
+          if ( --depth == 0 ) {
+            return it+1;
+          }
+          break;
+      }
+      it++;
+    }
+    throw error("unterminated object or array");
+  }
+
+  // Numbers and literals.
+  static const char* skip_scalar(const char* pb, const char* pe)
+  {
+    const char* it = pb;
+
+    while ( it < pe && !is_ws(*it) && *it != ',' && *it != '}' && *it != ']' && *it != ':' ) {
+      it++;
+    }
+
+    if ( it == pb ) {
+      throw error(std::string("unexpected character '") + *pb + "'");
+    }
+    return it;
+  }
+
+  static const char* skip_value(const char* pb, const char* pe)
+  {
+    switch ( *pb )
+    {
+      case '"':
+        return skip_string(pb, pe);
+      case '{':
+      case '[':
+        return skip_container(pb, pe);
+      default:
+        return skip_scalar(pb, pe);
+    }
+  }
+
+  static uint32_t read_hex4(const char* pb, const char* pe)
+  {
+    if ( pe-pb < 4 ) {
+      throw error("invalid unicode escape");
+    }
+
+    uint32_t cp = 0;
+
+    for ( int i = 0; i < 4; ++i )
+    {
+      int v = details::hex_value(pb[i]);
+
+      if ( v < 0 ) {
+        throw error("invalid unicode escape");
+      }
+      cp = (cp << 4) | v;
+    }
+    return cp;
+  }
+
+  // Unescape string contents [pb, pe) into buf.
+  static void unescape(const char* pb, const char* pe, std::string& buf)
+  {
+    buf.clear();
+
+    while ( pb < pe )
+    {
+      auto bs = static_cast<const char*>(memchr(pb, '\\', pe-pb));
+
+      if ( !bs )
+      {
+        buf.append(pb, pe-pb);
+        break;
+      }
+
+      buf.append(pb, bs-pb);
+
+      if ( bs+1 >= pe ) {
+        throw error("unterminated escape sequence");
+      }
+
+      pb = bs+2;
+
+      switch ( bs[1] )
+      {
+        case '"':
+        case '\\':
+        case '/':
+          buf.push_back(bs[1]);
+          break;
+        case 'b':
+          buf.push_back('\b');
+          break;
+        case 'f':
+          buf.push_back('\f');
+          break;
+        case 'n':
+          buf.push_back('\n');
+          break;
+        case 'r':
+          buf.push_back('\r');
+          break;
+        case 't':
+          buf.push_back('\t');
+          break;
+        case 'u':
+        {
+          uint32_t cp = read_hex4(pb, pe);
+          pb += 4;
+
+          if ( cp >= 0xd800 && cp <= 0xdbff )
+          {
+            if ( pe-pb < 2 || pb[0] != '\\' || pb[1] != 'u' ) {
+              throw error("unpaired surrogate in unicode escape");
+            }
+
+            uint32_t lo = read_hex4(pb+2, pe);
+
+            if ( lo < 0xdc00 || lo > 0xdfff ) {
+              throw error("unpaired surrogate in unicode escape");
+            }
+
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            pb += 6;
+          }
+          else if ( cp >= 0xdc00 && cp <= 0xdfff )
+          {
+            throw error("unpaired surrogate in unicode escape");
+          }
+          details::append_utf8(buf, cp);
+          break;
+        }
+        default:
+          throw error(std::string("invalid escape character '") + bs[1] + "'");
+      }
+    }
+  }
+
+  // Compare a raw (possibly escaped) member key to key.
+  static bool key_equals(std::string_view raw, std::string_view key)
+  {
+    if ( memchr(raw.data(), '\\', raw.size()) == nullptr ) {
+      return raw == key;
+    }
+
+    std::string buf;
+    unescape(raw.data(), raw.data()+raw.size(), buf);
+    return buf == key;
+  }
+
+  // Call member_cb(raw_key, value_begin, value_end) for each member of the
+  // object starting at pb, until it returns false.
+  template <typename F>
+  static void members(const char* pb, const char* pe, F member_cb)
+  {
+    const char* it = details::skip_ws(pb+1, pe);
+
+    if ( it < pe && *it == '}' ) {
+      return;
+    }
+
+    while ( it < pe )
+    {
+      if ( *it != '"' ) {
+        throw error("expected '\"' at start of object key");
+      }
+
+      const char* key_end = skip_string(it, pe);
+      std::string_view key(it+1, key_end-it-2);
+
+      it = details::skip_ws(key_end, pe);
+
+      if ( it >= pe || *it != ':' ) {
+        throw error("expected ':' after object key");
+      }
+
+      it = details::skip_ws(it+1, pe);
+
+      if ( it >= pe ) {
+        break;
+      }
+
+      const char* value_end = skip_value(it, pe);
+
+      if ( !member_cb(key, it, value_end) ) {
+        return;
+      }
+
+      it = details::skip_ws(value_end, pe);
+
+      if ( it < pe && *it == ',' ) {
+        it = details::skip_ws(it+1, pe);
+      }
+      else if ( it < pe && *it == '}' ) {
+        return;
+      }
+      else {
+        throw error("expected ',' or '}' after object member");
+      }
+    }
+    throw error("unterminated object");
+  }
+
+  // Call value_cb(value_begin, value_end) for each element of the array
+  // starting at pb, until it returns false.
+  template <typename F>
+  static void elements(const char* pb, const char* pe, F value_cb)
+  {
+    const char* it = details::skip_ws(pb+1, pe);
+
+    if ( it < pe && *it == ']' ) {
+      return;
+    }
+
+    while ( it < pe )
+    {
+      const char* value_end = skip_value(it, pe);
+
+      if ( !value_cb(it, value_end) ) {
+        return;
+      }
+
+      it = details::skip_ws(value_end, pe);
+
+      if ( it < pe && *it == ',' ) {
+        it = details::skip_ws(it+1, pe);
+      }
+      else if ( it < pe && *it == ']' ) {
+        return;
+      }
+      else {
+        throw error("expected ',' or ']' after array element");
+      }
+    }
+    throw error("unterminated array");
+  }
+
+  view::view(const char* data, size_t len)
+    :
+    pb_(nullptr),
+    pe_(nullptr)
+  {
+    const char* pb = details::skip_ws(data, data+len);
+    const char* pe = data+len;
+
+    // Stored documents may carry a terminating nul.
+    while ( pe > pb && (is_ws(pe[-1]) || pe[-1] == '\0') ) {
+      pe--;
+    }
+
+    if ( pb < pe )
+    {
+      pb_ = pb;
+      pe_ = pe;
+    }
+  }
+
+  view view::range(const char* pb, const char* pe)
+  {
+    view v;
+    v.pb_ = pb;
+    v.pe_ = pe;
+    return v;
+  }
+
+  type view::type_id() const
+  {
+    if ( !pb_ ) {
+      return type::nul;
+    }
+
+    switch ( *pb_ )
+    {
+      case '"':
+        return type::str;
+      case '{':
+        return type::obj;
+      case '[':
+        return type::arr;
+      case 't':
+        return type::tru;
+      case 'f':
+        return type::fal;
+      case 'n':
+        return type::nul;
+      default:
+      {
+        int64_t v;
+        auto res = std::from_chars(pb_, pe_, v);
+
+        if ( res.ec == std::errc() && res.ptr == pe_ ) {
+          return type::i64;
+        }
+        else {
+          return type::num;
+        }
+      }
+    }
+  }
+
+  view view::operator[](std::string_view key) const
+  {
+    view result;
+
+    if ( is_object() )
+    {
+      members(pb_, pe_, [&](std::string_view raw_key, const char* vb, const char* ve) -> bool
+      {
+        if ( key_equals(raw_key, key) )
+        {
+          result = range(vb, ve);
+          return false;
+        }
+        return true;
+      });
+    }
+    return result;
+  }
+
+  view view::operator[](size_t index) const
+  {
+    view result;
+
+    if ( is_array() )
+    {
+      size_t n = 0;
+
+      elements(pb_, pe_, [&](const char* vb, const char* ve) -> bool
+      {
+        if ( n++ == index )
+        {
+          result = range(vb, ve);
+          return false;
+        }
+        return true;
+      });
+    }
+    return result;
+  }
+
+  void view::project(const std::vector<std::string>& keys, std::vector<view>& values) const
+  {
+    values.assign(keys.size(), view());
+
+    if ( keys.empty() || !is_object() ) {
+      return;
+    }
+
+    size_t remaining = keys.size();
+
+    members(pb_, pe_, [&](std::string_view raw_key, const char* vb, const char* ve) -> bool
+    {
+      for ( size_t i = 0; i < keys.size(); ++i )
+      {
+        if ( !values[i] && key_equals(raw_key, keys[i]) )
+        {
+          values[i] = range(vb, ve);
+          remaining--;
+          break;
+        }
+      }
+      return remaining > 0;
+    });
+  }
+
+  void view::each(std::function<bool(const view& value)> value_cb) const
+  {
+    if ( !is_array() ) {
+      return;
+    }
+
+    elements(pb_, pe_, [&](const char* vb, const char* ve) -> bool
+    {
+      return value_cb(range(vb, ve));
+    });
+  }
+
+  void view::each_member(std::function<bool(std::string_view key, const view& value)> member_cb) const
+  {
+    if ( !is_object() ) {
+      return;
+    }
+
+    std::string buf;
+
+    members(pb_, pe_, [&](std::string_view raw_key, const char* vb, const char* ve) -> bool
+    {
+      if ( memchr(raw_key.data(), '\\', raw_key.size()) == nullptr ) {
+        return member_cb(raw_key, range(vb, ve));
+      }
+
+      unescape(raw_key.data(), raw_key.data()+raw_key.size(), buf);
+      return member_cb(buf, range(vb, ve));
+    });
+  }
+
+  std::string_view view::as_string(std::string& buf) const
+  {
+    if ( !is_string() ) {
+      throw error("value is not a string");
+    }
+
+    const char* pb = pb_+1;
+    const char* pe = pe_-1;
+
+    if ( memchr(pb, '\\', pe-pb) == nullptr ) {
+      return std::string_view(pb, pe-pb);
+    }
+
+    unescape(pb, pe, buf);
+    return buf;
+  }
+
+  std::string view::as_string() const
+  {
+    std::string buf;
+    auto s = as_string(buf);
+
+    if ( s.data() == buf.data() ) {
+      return buf;
+    }
+    else {
+      return std::string(s);
+    }
+  }
+
+  bool view::as_bool() const
+  {
+    switch ( type_id() )
+    {
+      case type::tru:
+        return true;
+      case type::fal:
+        return false;
+      default:
+        throw error("value is not a boolean");
+    }
+  }
+
+  double view::as_number() const
+  {
+    if ( pb_ )
+    {
+      double v;
+      auto res = std::from_chars(pb_, pe_, v);
+
+      if ( res.ec == std::errc() && res.ptr == pe_ ) {
+        return v;
+      }
+    }
+    throw error("value is not a number");
+  }
+
+  int64_t view::as_integer() const
+  {
+    if ( pb_ )
+    {
+      int64_t v;
+      auto res = std::from_chars(pb_, pe_, v);
+
+      if ( res.ec == std::errc() && res.ptr == pe_ ) {
+        return v;
+      }
+    }
+    return static_cast<int64_t>(as_number());
+  }
+
+  value view::to_value() const
+  {
+    switch ( type_id() )
+    {
+      case type::nul:
+        return value();
+      case type::tru:
+        return value(true);
+      case type::fal:
+        return value(false);
+      case type::num:
+        return value(as_number());
+      case type::i64:
+        return value(static_cast<long long>(as_integer()));
+      case type::str:
+        return value(as_string());
+      default:
+      {
+        value        result;
+        json::parser parser(result, json::parser::default_max_depth, utf8_mode::replace);
+
+        parser.parse(pb_, pe_-pb_);
+
+        if ( !parser.complete() ) {
+          throw error("incomplete json document");
+        }
+        return result;
+      }
+    }
+  }
+}
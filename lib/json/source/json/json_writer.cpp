@@ -0,0 +1,189 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : json_writer.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include <json/json_writer.h>
+
+// ----------------------------------------------------------------------------
+#include <charconv>
+#include <cmath>
+
+// ----------------------------------------------------------------------------
+namespace json
+{
+  // Non zero for characters that must be escaped inside a json string. The
+  // value is the character to put after the backslash, 'u' means use the
+  // \u00XX form.
+  static const char escape_table[256] =
+  {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+     0,   0,  '"',  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  '/',
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, '\\',  0,   0,   0,
+     // Remaining characters are all safe.
+  };
+
+  static const char hex_digits[] = "0123456789abcdef";
+
+  void writer::write(const value& v)
+  {
+    switch ( v.type_id() )
+    {
+      case json::type::nul:
+        buf_.append("null", 4);
+        break;
+      case json::type::str:
+        write_string(v.as_string());
+        break;
+      case json::type::num:
+        write_number(v.as_number());
+        break;
+      case json::type::i64:
+        write_integer(v.as_integer());
+        break;
+      case json::type::tru:
+        buf_.append("true", 4);
+        break;
+      case json::type::fal:
+        buf_.append("false", 5);
+        break;
+      case json::type::arr:
+        write(v.as_array());
+        break;
+      case json::type::obj:
+        write(v.as_object());
+        break;
+      default:
+        assert(false);
+        break;
+    }
+  }
+
+  void writer::write(const array& v)
+  {
+    buf_.push_back('[');
+
+    auto it  = v.value_.begin();
+    auto end = v.value_.end();
+
+    if ( it != end )
+    {
+      write(*it);
+
+      for ( ++it; it != end; ++it )
+      {
+        buf_.push_back(',');
+        write(*it);
+      }
+    }
+    buf_.push_back(']');
+  }
+
+  void writer::write(const object& v)
+  {
+    buf_.push_back('{');
+
+    auto it  = v.value_.begin();
+    auto end = v.value_.end();
+
+    if ( it != end )
+    {
+      write_string((*it).first);
+      buf_.push_back(':');
+      write((*it).second);
+
+      for ( ++it; it != end; ++it )
+      {
+        buf_.push_back(',');
+        write_string((*it).first);
+        buf_.push_back(':');
+        write((*it).second);
+      }
+    }
+    buf_.push_back('}');
+  }
+
+  void writer::write_string(const char* s, size_t len)
+  {
+    const char* end = s+len;
+    const char* run = s;
+
+    buf_.reserve(buf_.length()+len+2);
+    buf_.push_back('"');
+
+    for ( const char* it = s; it < end; ++it )
+    {
+      char esc = escape_table[static_cast<unsigned char>(*it)];
+
+      if ( esc == 0 ) {
+        continue;
+      }
+
+      // Copy the run of safe characters preceding this one in one go.
+      buf_.append(run, it-run);
+      run = it+1;
+
+      if ( esc != 'u' )
+      {
+        char seq[2] = { '\\', esc };
+        buf_.append(seq, 2);
+      }
+      else
+      {
+        unsigned char c = static_cast<unsigned char>(*it);
+        char seq[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf] };
+        buf_.append(seq, 6);
+      }
+    }
+
+    buf_.append(run, end-run);
+    buf_.push_back('"');
+  }
+
+  void writer::write_number(double v)
+  {
+    // Json has no representation of nan and infinity.
+    if ( !std::isfinite(v) )
+    {
+      buf_.append("null", 4);
+      return;
+    }
+
+    // Shortest representation that reads back to the same double.
+    char tmp[32];
+    auto res = std::to_chars(tmp, tmp+sizeof(tmp), v);
+    buf_.append(tmp, res.ptr-tmp);
+  }
+
+  void writer::write_integer(int64_t v)
+  {
+    char tmp[24];
+    auto res = std::to_chars(tmp, tmp+sizeof(tmp), v);
+    buf_.append(tmp, res.ptr-tmp);
+  }
+}
+
+// ----------------------------------------------------------------------------
+std::string to_string(const json::value& value)
+{
+  std::string buf;
+  json::writer(buf).write(value);
+  return buf;
+}
+
+// ----------------------------------------------------------------------------
+std::string to_string(const json::object& value)
+{
+  std::string buf;
+  json::writer(buf).write(value);
+  return buf;
+}
@@ -15,7 +15,7 @@ else
     ENV["LDFLAGS"] = %q(-g -pthread)
 end
 
-ENV["CPPFLAGS"] = %q(-std=c++11)
+ENV["CPPFLAGS"] = %q(-std=c++17)
 
 # -----------------------------------------------------------------------------
 popt = Rake::StaticLibraryTask.new("lib/program-options/program-options.yml")
@@ -40,7 +40,7 @@ spec = Rake::ExecutableSpecification.new do |s|
     s.sources.add %w(
         src/*.cpp
     )
-    s.libraries += [ popt, dm, dc, json ] + %w(asound FLAC++ tag spotify kyotocabinet)
+    s.libraries += [ popt, dm, dc, json ] + %w(asound FLAC++ tag spotify kyotocabinet lmdb jpeg)
 end
 
 # -----------------------------------------------------------------------------
@@ -61,16 +61,73 @@ spec = Rake::ExecutableSpecification.new do |s|
     )
     s.sources.add %w(
         src/local_source.cpp
-        src/base64.cpp
+        src/json_rpc.cpp
+        src/http.cpp
         test/**/*.cpp
 
     )
-    s.libraries += [ dm, dc, json ] + %w(asound FLAC++ tag kyotocabinet)
+    s.libraries += [ dm, dc, json ] + %w(asound FLAC++ tag kyotocabinet lmdb jpeg)
 end
 
 # -----------------------------------------------------------------------------
 Rake::ExecutableTask.new(:test, spec)
 
+# -----------------------------------------------------------------------------
+spec = Rake::ExecutableSpecification.new do |s|
+    s.name = 'bench_json'
+    s.includes.add %w(
+        lib/json/include
+    )
+    s.libincludes.add %w(
+        build
+    )
+    s.sources.add %w(
+        bench/json/*.cpp
+    )
+    s.libraries += [ json ]
+end
+
+# -----------------------------------------------------------------------------
+Rake::ExecutableTask.new(:bench_json, spec)
+
+# -----------------------------------------------------------------------------
+spec = Rake::ExecutableSpecification.new do |s|
+    s.name = 'bench_kvstore'
+    s.includes.add %w(
+        src
+        lib/json/include
+    )
+    s.libincludes.add %w(
+        build
+    )
+    s.sources.add %w(
+        bench/dm/*.cpp
+    )
+    s.libraries += [ dm, json ] + %w(kyotocabinet lmdb jpeg)
+end
+
+# -----------------------------------------------------------------------------
+Rake::ExecutableTask.new(:bench_kvstore, spec)
+
+# -----------------------------------------------------------------------------
+spec = Rake::ExecutableSpecification.new do |s|
+    s.name = 'bench_storage'
+    s.includes.add %w(
+        src
+        lib/json/include
+    )
+    s.libincludes.add %w(
+        build
+    )
+    s.sources.add %w(
+        bench/storage/*.cpp
+    )
+    s.libraries += [ dm, json ] + %w(kyotocabinet lmdb jpeg)
+end
+
+# -----------------------------------------------------------------------------
+Rake::ExecutableTask.new(:bench_storage, spec)
+
 # -----------------------------------------------------------------------------
 namespace :json do
     task :update do
@@ -37,8 +37,8 @@ namespace jsonrpc
         :
         dripcore::connection(std::move(socket)),
         service_(service),
-        value_(),
-        parser_(value_),
+        reader_(service),
+        parser_(reader_),
         queue_(std::make_shared<dripcore::queue>(context_))
       {
         std::cout << "connection " << this << std::endl;
@@ -67,8 +67,7 @@ namespace jsonrpc
       {
         queue_->push([=]()
         {
-          auto buf = to_string(notification).append(1, '\0');
-          send(buf.data(), buf.length());
+          send_json(notification);
         });
       }
     protected:
@@ -94,25 +93,56 @@ namespace jsonrpc
               consumed += 1; // Discard zero terminator.
             }
 
-            process_json_value(std::move(value_));
+            process_request();
 
-            // Start on a new value.
+            // Start on a new request.
             parser_.reset();
+            reader_.reset();
           }
         }
         while ( consumed < len );
       }
     protected:
-      void process_json_value(json::value value)
+      void process_request()
       {
-        auto request = json_rpc_request::from_json(value);
+        auto request = json_rpc_request::from_json(reader_.value());
 
         //std::cerr << "method=" << req.method() << ", params=" << req.params() << std::endl;
 
-        auto response = service_.execute(request);
-        auto buf = to_string(response).append(1, '\0');
+        if ( reader_.error().empty() )
+        {
+          auto response = service_.execute(request);
+          send_json(response);
+        }
+        else
+        {
+          json_rpc_response response{request};
+          response.invalid_params(reader_.error());
+          send_json(response);
+        }
+      }
+    private:
+      template <typename T> void send_json(const T& v)
+      {
+        // If data is already waiting to be sent, serialize directly onto the
+        // end of the output buffer. Otherwise serialize into the reusable
+        // send buffer and try to send it straight away.
+        if ( obuf_.empty() )
+        {
+          sbuf_.clear();
+
+          json::writer writer(sbuf_);
+          v.write(writer);
+          sbuf_.push_back('\0');
 
-        send(buf.data(), buf.length());
+          send(sbuf_.data(), sbuf_.length());
+        }
+        else
+        {
+          json::writer writer(obuf_);
+          v.write(writer);
+          obuf_.push_back('\0');
+        }
       }
     private:
       size_t obuf_len()
@@ -136,10 +166,11 @@ namespace jsonrpc
         obuf_.erase(0, len);
       }
     private:
-      jsonrpc::service& service_;
-      json::value       value_;
-      json::parser      parser_;
-      std::string       obuf_;
+      jsonrpc::service&        service_;
+      jsonrpc::request_reader  reader_;
+      jsonrpc::request_parser  parser_;
+      std::string              obuf_;
+      std::string              sbuf_;
     private:
       std::shared_ptr<dripcore::queue> queue_;
     };
@@ -0,0 +1,331 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : cover_connection.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Serves album covers over HTTP, GET /covers/<album id>[?size=<pixels>].
+//   The image, or the smallest thumbnail of at least size pixels, is sent
+//   with sendfile straight from its file in the blob store. The entity tag
+//   is the blob id, so clients can cache covers and revalidate them with
+//   If-None-Match or If-Modified-Since.
+//
+// ----------------------------------------------------------------------------
+#ifndef __cover_connection_h__
+#define __cover_connection_h__
+
+// ----------------------------------------------------------------------------
+#include <dripcore/loop.h>
+#include <dripcore/connection.h>
+#include <dm/dm.h>
+#include <http.h>
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+// ----------------------------------------------------------------------------
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------
+namespace http
+{
+  namespace server
+  {
+    class cover_connection : public dripcore::connection
+    {
+    public:
+      cover_connection(dripcore::socket socket)
+        :
+        dripcore::connection(std::move(socket)),
+        closed_(false),
+        sending_(false),
+        keep_alive_(true),
+        file_fd_(-1),
+        file_offset_(0),
+        file_remaining_(0)
+      {
+      }
+    public:
+      ~cover_connection()
+      {
+        close_file();
+      }
+    protected:
+      virtual void stopped(dripcore::loop* loop)
+      {
+        closed_ = true;
+        dripcore::connection::stopped(loop);
+      }
+    protected:
+      void receive_data(const char* data, size_t len)
+      {
+        ibuf_.append(data, len);
+        process_requests();
+      }
+    protected:
+      void write()
+      {
+        dripcore::connection::write();
+
+        if ( sending_ && continue_response() ) {
+          process_requests();
+        }
+      }
+    private:
+      void process_requests()
+      {
+        while ( !sending_ && !closed_ )
+        {
+          auto end = ibuf_.find("\r\n\r\n");
+
+          if ( end == std::string::npos )
+          {
+            if ( ibuf_.length() > max_head_length ) {
+              respond_error(431, "Request Header Fields Too Large");
+              continue_response();
+            }
+            return;
+          }
+
+          http::request request;
+
+          bool valid = request.parse(ibuf_.substr(0, end));
+
+          ibuf_.erase(0, end + 4);
+
+          if ( !valid ) {
+            respond_error(400, "Bad Request");
+          }
+          else {
+            respond(request);
+          }
+
+          if ( !continue_response() ) {
+            return;
+          }
+        }
+      }
+    private:
+      void respond(const http::request& request)
+      {
+        keep_alive_ = request.keep_alive();
+
+        auto& method = request.method();
+        auto  query  = request.path().find('?');
+        auto  path   = request.path().substr(0, query);
+        auto  size   = 0u;
+
+        if ( query != std::string::npos )
+        {
+          auto params = request.path().substr(query + 1);
+
+          if ( params.compare(0, 5, "size=") == 0 ) {
+            size = static_cast<unsigned>(strtoul(params.c_str() + 5, nullptr, 10));
+          }
+        }
+
+        if ( method != "GET" && method != "HEAD" ) {
+          return respond_error(405, "Method Not Allowed");
+        }
+
+        // Requests have no body, anything else is not understood.
+        if ( !request.header("content-length").empty() || !request.header("transfer-encoding").empty() ) {
+          return respond_error(400, "Bad Request");
+        }
+
+        if ( path.compare(0, covers_path.length(), covers_path) != 0 ) {
+          return respond_error(404, "Not Found");
+        }
+
+        auto cover    = dm::album_cover::find_by_album_id(path.substr(covers_path.length()));
+        auto filename = cover.image_filename(size);
+
+        if ( filename.empty() || (file_fd_ = open(filename.c_str(), O_RDONLY)) < 0 ) {
+          return respond_error(404, "Not Found");
+        }
+
+        struct stat st;
+
+        if ( fstat(file_fd_, &st) < 0 )
+        {
+          close_file();
+          return respond_error(500, "Internal Server Error");
+        }
+
+        auto blob_id       = cover.blob_id(size);
+        auto etag          = "\"" + blob_id + "\"";
+        auto if_none_match = request.header("if-none-match");
+        bool not_modified;
+
+        // If-Modified-Since is only used by clients without the entity tag.
+        if ( !if_none_match.empty() ) {
+          not_modified = http::etag_matches(if_none_match, etag);
+        }
+        else {
+          auto since = http::parse_date(request.header("if-modified-since"));
+          not_modified = since >= 0 && st.st_mtime <= since;
+        }
+
+        std::string head;
+
+        head.append(not_modified ? "HTTP/1.1 304 Not Modified\r\n" : "HTTP/1.1 200 OK\r\n");
+        head.append("Date: " + http::format_date(time(nullptr)) + "\r\n");
+        head.append("ETag: " + etag + "\r\n");
+        head.append("Last-Modified: " + http::format_date(st.st_mtime) + "\r\n");
+        // Covers may change, clients must ask if the copy they have is
+        // still valid. That is answered by a 304 without the image.
+        head.append("Cache-Control: no-cache\r\n");
+
+        if ( !not_modified )
+        {
+          // Thumbnails are always jpeg.
+          auto format = blob_id == cover.blob_id() ? cover.format() : std::string("jpg");
+
+          head.append("Content-Type: " + content_type(format) + "\r\n");
+          head.append("Content-Length: " + std::to_string(st.st_size) + "\r\n");
+        }
+
+        head.append(keep_alive_ ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+        head.append("\r\n");
+
+        if ( not_modified || method == "HEAD" ) {
+          close_file();
+        }
+        else {
+          file_offset_    = 0;
+          file_remaining_ = st.st_size;
+        }
+
+        sending_ = true;
+        send(head.data(), head.length());
+      }
+    private:
+      void respond_error(unsigned status, const std::string& reason)
+      {
+        std::string head;
+
+        // The rest of the input can not be trusted after an error.
+        if ( status == 400 || status == 431 ) {
+          keep_alive_ = false;
+        }
+
+        head.append("HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n");
+        head.append("Content-Length: 0\r\n");
+        head.append(keep_alive_ ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+        head.append("\r\n");
+
+        sending_ = true;
+        send(head.data(), head.length());
+      }
+    private:
+      // Send what is left of the response. Returns true when it has all been
+      // sent and the connection is ready for the next request.
+      bool continue_response()
+      {
+        if ( closed_ || obuf_len() > 0 ) {
+          return false;
+        }
+
+        while ( file_remaining_ > 0 )
+        {
+          auto res = sendfile(get_os_handle(), file_fd_, &file_offset_, file_remaining_);
+
+          if ( res > 0 ) {
+            file_remaining_ -= res;
+          }
+          else if ( res < 0 && errno == EINTR ) {
+            continue;
+          }
+          else if ( res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+            return false;
+          }
+          else
+          {
+            std::cerr << "cover connection sendfile error " << strerror(errno) << std::endl;
+            stop();
+            return false;
+          }
+        }
+
+        close_file();
+
+        // Nothing more is read from a connection being closed.
+        if ( !keep_alive_ )
+        {
+          stop();
+          return false;
+        }
+
+        sending_ = false;
+        return true;
+      }
+    private:
+      void close_file()
+      {
+        if ( file_fd_ >= 0 )
+        {
+          close(file_fd_);
+          file_fd_        = -1;
+          file_remaining_ = 0;
+        }
+      }
+    private:
+      static std::string content_type(const std::string& format)
+      {
+        if ( format == "jpg" || format == "jpeg" ) {
+          return "image/jpeg";
+        }
+        else if ( format == "png" ) {
+          return "image/png";
+        }
+        else {
+          return "application/octet-stream";
+        }
+      }
+    private:
+      size_t obuf_len()
+      {
+        return obuf_.length();
+      }
+    private:
+      const char* obuf_ptr()
+      {
+        return obuf_.data();
+      }
+    private:
+      void obuf_write(const char* buf, size_t len)
+      {
+        obuf_.append(buf, len);
+      }
+    private:
+      void obuf_sent(size_t len)
+      {
+        obuf_.erase(0, len);
+      }
+    private:
+      static constexpr size_t max_head_length = 8192;
+    private:
+      const std::string covers_path = "/covers/";
+    private:
+      std::string ibuf_;
+      std::string obuf_;
+      bool        closed_;
+      bool        sending_;
+      bool        keep_alive_;
+      int         file_fd_;
+      off_t       file_offset_;
+      size_t      file_remaining_;
+    };
+  } // namespace server
+} // namespace http
+
+#endif // __cover_connection_h__
@@ -12,106 +12,449 @@
 
 #include "album.h"
 #include "track.h"
+#include "thumbnail.h"
+#include "base64.h"
 
 // ----------------------------------------------------------------------------
-#include <base64.h>
+#include <algorithm>
 
 // ----------------------------------------------------------------------------
 namespace dm
 {
-  kvstore* album_cover::kvstore_ = nullptr;
-  kvstore* album::kvstore_       = nullptr;
+  kvstore*    album_cover::kvstore_         = nullptr;
+  blob_store* album_cover::blob_store_      = nullptr;
+  work_queue* album_cover::thumbnail_queue_ = nullptr;
+  kvstore*    album::kvstore_               = nullptr;
 
   const std::string id_member      = "id";
   const std::string title_member   = "title";
   const std::string tracks_member  = "tracks";
   const std::string no_disc_id     = "";
 
+  const std::string format_member  = "image_format";
+  const std::string data_member    = "image_data";
+  const std::string blob_member    = "image_blob";
+  const std::string size_member    = "image_size";
+  const std::string thumbs_member  = "thumbnails";
+
+  // Pixels on the longest side of the thumbnails made of each cover.
+  const unsigned thumbnail_sizes[] = { 64, 200, 600 };
+
+  const std::string artist_title_index = "album/artist_title";
+  const std::string cover_blob_index   = "cover/blob";
+
+  // Album keys are base62 counters starting at al0000. Covers are kept in
+  // a range of their own, so scanning albums does not read the images.
+  const std::string album_prefix = "al";
+  const std::string cover_prefix = "cover/";
+
+  // The blobs a cover record refers to, the image and its thumbnails.
+  static std::vector<std::string> cover_blob_ids(const json::object& obj)
+  {
+    std::vector<std::string> ids;
+
+    if ( obj.has_member(blob_member) && obj.at(blob_member).is_string() ) {
+      ids.push_back(obj.at(blob_member).as_string());
+    }
+
+    if ( obj.has_member(thumbs_member) && obj.at(thumbs_member).is_object() )
+    {
+      for ( auto& thumbnail : obj.at(thumbs_member).as_object() )
+      {
+        if ( thumbnail.second.is_string() ) {
+          ids.push_back(thumbnail.second.as_string());
+        }
+      }
+    }
+    return ids;
+  }
+
+  static std::string artist_title_value(const std::string& artist_id, const std::string& title)
+  {
+    std::string value(artist_id);
+
+    value.push_back('\0');
+    value.append(title);
+
+    return value;
+  }
+
+  void album_cover::init(blob_store* store, work_queue* thumbnail_queue)
+  {
+    album_cover::blob_store_      = store;
+    album_cover::thumbnail_queue_ = thumbnail_queue;
+  }
+
   album_cover::album_cover(const album& album)
     :
-    key_(album.id()+"/cover")
+    key_(cover_prefix+album.id())
   {
   }
 
   album_cover::album_cover(const std::string& key, json::object&& data)
     :
+    data_(std::move(data)),
+    image_(),
     key_(key)
   {
-    data_ = std::move(data);
   }
 
-  album_cover::album_cover(const album_cover& other) : data_(other.data_)
+  album_cover::album_cover(const album_cover& other)
+    :
+    data_(other.data_),
+    image_(other.image_),
+    key_(other.key_)
   {
   }
 
-  album_cover::album_cover(album_cover&& other) : data_(std::move(other.data_))
+  album_cover::album_cover(album_cover&& other)
+    :
+    data_(std::move(other.data_)),
+    image_(std::move(other.image_)),
+    key_(std::move(other.key_))
   {
   }
 
   album_cover& album_cover::operator=(dm::album_cover& rhs)
   {
-    data_ = rhs.data_;
+    data_  = rhs.data_;
+    image_ = rhs.image_;
+    key_   = rhs.key_;
     return *this;
   }
 
   album_cover& album_cover::operator=(dm::album_cover&& rhs)
   {
-    data_ = std::move(rhs.data_);
+    data_  = std::move(rhs.data_);
+    image_ = std::move(rhs.image_);
+    key_   = std::move(rhs.key_);
     return *this;
   }
 
   bool album_cover::is_null()
   {
-    return data_.empty();
+    return !image_ && blob_id().empty();
   }
 
   bool album::id_is_null()
   {
-    return data_["id"].is_null();
+    auto& obj = data_.get();
+    return !obj.has_member(id_member) || obj.at(id_member).is_null();
+  }
+
+  const std::string& album_cover::format() const
+  {
+    static const std::string no_format;
+
+    if ( data_.has_member(format_member) && data_.at(format_member).is_string() ) {
+      return data_.at(format_member).as_string();
+    }
+    else {
+      return no_format;
+    }
+  }
+
+  const std::string& album_cover::blob_id(unsigned size) const
+  {
+    static const std::string no_blob;
+
+    // The smallest thumbnail at least size pixels, if there is one.
+    if ( size > 0 && data_.has_member(thumbs_member) && data_.at(thumbs_member).is_object() )
+    {
+      auto& thumbnails = data_.at(thumbs_member).as_object();
+
+      for ( auto thumbnail_size : thumbnail_sizes )
+      {
+        auto name = std::to_string(thumbnail_size);
+
+        if ( thumbnail_size >= size && thumbnails.has_member(name) && thumbnails.at(name).is_string() ) {
+          return thumbnails.at(name).as_string();
+        }
+      }
+    }
+
+    if ( data_.has_member(blob_member) && data_.at(blob_member).is_string() ) {
+      return data_.at(blob_member).as_string();
+    }
+    else {
+      return no_blob;
+    }
+  }
+
+  blob_store::blob_ptr album_cover::image(unsigned size) const
+  {
+    if ( blob_id(size) != blob_id() ) {
+      return blob_store_->get(blob_id(size));
+    }
+
+    // Read when first used, the image is not needed to send the file.
+    if ( !image_ && !blob_id().empty() ) {
+      image_ = blob_store_->get(blob_id());
+    }
+    return image_;
+  }
+
+  std::string album_cover::image_filename(unsigned size) const
+  {
+    return blob_id(size).empty() ? std::string() : blob_store_->filename(blob_id(size));
   }
 
   void album_cover::format(const std::string& v)
   {
-    data_["image_format"] = v;
+    data_[format_member] = v;
   }
 
   void album_cover::data(const char* v, size_t len)
   {
-    data_["image_data"] = base64::encode(v, len);
+    image_ = std::make_shared<const std::string>(v, len);
   }
 
   void album_cover::data(json::object&& data)
   {
-    data_ = std::move(data);
+    if ( data.has_member(format_member) && data.at(format_member).is_string() ) {
+      format(data.at(format_member).as_string());
+    }
+
+    if ( data.has_member(data_member) && data.at(data_member).is_string() )
+    {
+      auto& encoded = data.at(data_member).as_string();
+      image_ = std::make_shared<const std::string>(base64::decode(encoded.data(), encoded.length()));
+    }
   }
 
   void album_cover::save()
   {
+    if ( is_null() ) {
+      return;
+    }
+
+    // The image is put and the record set in one transaction, as release
+    // removes blobs in one. Otherwise a blob put finds already stored can
+    // be removed before the record refers to it.
+    kvstore::transaction transaction(*kvstore_);
+
+    auto old_ids = cover_blob_ids(data_);
+
+    if ( image_ )
+    {
+      auto id = blob_store_->put(image_->data(), image_->size());
+
+      // Thumbnails of another image.
+      if ( id != blob_id() ) {
+        data_[thumbs_member] = json::value();
+      }
+
+      data_[blob_member] = id;
+      data_[size_member] = static_cast<int64_t>(image_->size());
+    }
+
     kvstore_->set(key_, data_);
+
+    auto ids = cover_blob_ids(data_);
+
+    for ( auto& id : old_ids )
+    {
+      if ( std::find(ids.begin(), ids.end(), id) == ids.end() ) {
+        release_blob(id);
+      }
+    }
+
+    transaction.commit();
+
+    if ( !data_.has_member(thumbs_member) || !data_.at(thumbs_member).is_object() ) {
+      queue_thumbnails(key_, blob_id());
+    }
   }
 
   void album_cover::erase()
   {
+    kvstore::transaction transaction(*kvstore_);
+
     kvstore_->remove(key_);
+
+    for ( auto& id : cover_blob_ids(data_) ) {
+      release_blob(id);
+    }
+
+    transaction.commit();
   }
 
   album_cover album_cover::find_by_album_id(const std::string& id)
   {
-    auto key  = id+"/cover";
-    auto data = kvstore_->get(key);
+    auto key    = cover_prefix+id;
+    auto record = kvstore_->get_shared(key);
 
-    if ( !data.is_null() ) {
-      return album_cover(key, std::move(data.as_object()));
-    }
-    else {
+    if ( !record || !record->is_object() ) {
       return album_cover(key, json::object{});
     }
+
+    auto& obj = record->as_object();
+
+    album_cover cover(key, json::object{});
+
+    if ( obj.has_member(blob_member) && obj.at(blob_member).is_string() )
+    {
+      cover.data_ = obj;
+    }
+    else if ( obj.has_member(data_member) )
+    {
+      // Stored in the record by earlier versions, moved to the blob store.
+      cover.data(json::object(obj));
+      cover.save();
+    }
+    return cover;
+  }
+
+  json::value album_cover::data(unsigned size)
+  {
+    auto image = this->image(size);
+
+    if ( !image ) {
+      return json::object{};
+    }
+
+    return json::object{
+      { format_member, format() },
+      { data_member,   base64::encode(image->data(), image->size()) }
+    };
+  }
+
+  size_t album_cover::make_missing_thumbnails()
+  {
+    std::vector<std::string> legacy_keys;
+    std::vector<std::string> keys;
+    std::vector<std::string> ids;
+
+    kvstore_->each(cover_prefix, { blob_member, thumbs_member, data_member }, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+    {
+      if ( fields[0].is_string() && !fields[1].is_object() )
+      {
+        keys.push_back(key);
+        ids.push_back(fields[0].as_string());
+      }
+      else if ( fields[2].is_string() )
+      {
+        legacy_keys.push_back(key);
+      }
+      return true;
+    });
+
+    // Moved to the blob store and queued when found.
+    for ( auto& key : legacy_keys ) {
+      find_by_album_id(key.substr(cover_prefix.length()));
+    }
+
+    for ( size_t i = 0; i < keys.size(); ++i ) {
+      queue_thumbnails(keys[i], ids[i]);
+    }
+
+    return legacy_keys.size() + keys.size();
+  }
+
+  // Remove a blob no cover refers to anymore, once the transaction it is
+  // released in commits. A rollback restores the records referring to it.
+  // Blobs are put and the records referring to them set in a transaction,
+  // and the check is made after the commit with the write lock held, so
+  // none is referred to between the check and the removal. A cover saved
+  // later in the same transaction may refer to it again.
+  void album_cover::release_blob(const std::string& id)
+  {
+    kvstore::transaction transaction(*kvstore_);
+
+    kvstore_->after_commit([id]()
+    {
+      if ( kvstore_->find(cover_blob_index, id).empty() ) {
+        blob_store_->remove(id);
+      }
+    });
+
+    transaction.commit();
+  }
+
+  void album_cover::queue_thumbnails(const std::string& key, const std::string& id)
+  {
+    if ( thumbnail_queue_ && !id.empty() ) {
+      thumbnail_queue_->push(std::bind(&album_cover::make_thumbnails, key, id));
+    }
+  }
+
+  void album_cover::make_thumbnails(const std::string& key, const std::string& id)
+  {
+    auto image = blob_store_->get(id);
+
+    if ( !image ) {
+      return;
+    }
+
+    // Empty if the image is not a jpeg or is already small, so it is not
+    // tried again.
+    std::vector<std::pair<unsigned, std::string>> made;
+    std::string                                   thumbnail;
+
+    for ( auto size : thumbnail_sizes )
+    {
+      if ( make_thumbnail(*image, size, thumbnail) ) {
+        made.emplace_back(size, std::move(thumbnail));
+      }
+    }
+
+    // Put and referred to in one transaction, see save.
+    kvstore::transaction transaction(*kvstore_);
+
+    json::object thumbnails;
+
+    for ( auto& t : made ) {
+      thumbnails[std::to_string(t.first)] = blob_store_->put(t.second.data(), t.second.size());
+    }
+
+    auto record = kvstore_->get(key);
+
+    // Unless the image was changed while the thumbnails were made.
+    if ( record.is_object() && cover_blob_ids(record.as_object()) == std::vector<std::string>{ id } )
+    {
+      record.as_object()[thumbs_member] = thumbnails;
+      kvstore_->set(key, record);
+    }
+    else
+    {
+      for ( auto& thumbnail : thumbnails ) {
+        release_blob(thumbnail.second.as_string());
+      }
+    }
+
+    transaction.commit();
   }
 
   void album::init(kvstore* store)
   {
     album_cover::kvstore_ = store;
     album::kvstore_       = store;
+
+    kvstore_->index(cover_blob_index, cover_prefix, [](const json::value& record, std::vector<std::string>& values)
+    {
+      values = cover_blob_ids(record.as_object());
+    }, 2);
+
+    kvstore_->index(artist_title_index, album_prefix, [](const json::value& record, std::vector<std::string>& values)
+    {
+      auto& obj = record.as_object();
+
+      if ( !obj.has_member("artist") || !obj.has_member(title_member) ) {
+        return;
+      }
+
+      auto& artist = obj.at("artist");
+      auto& title  = obj.at(title_member);
+
+      if ( artist.is_object() && artist.as_object().has_member(id_member) && title.is_string() )
+      {
+        auto& artist_id = artist.as_object().at(id_member);
+
+        if ( artist_id.is_string() ) {
+          values.push_back(artist_title_value(artist_id.as_string(), title.as_string()));
+        }
+      }
+    });
   }
 
   album::album()
@@ -143,41 +486,46 @@ namespace dm
     data_ = std::move(data);
   }
 
+  album::album(record_cache::record_ptr record)
+  {
+    data_ = std::move(record);
+  }
+
   bool album::is_null()
   {
-    return data_.empty();
+    return data_.get().empty();
   }
 
   const std::string& album::id() const
   {
-    return data_.at(id_member).as_string();
+    return data_.get().at(id_member).as_string();
   }
 
   const std::string& album::title() const
   {
-    return data_.at(title_member).as_string();
+    return data_.get().at(title_member).as_string();
   }
 
   void album::title(const std::string& v)
   {
-    data_[title_member] = v;
+    data_.get_mutable()[title_member] = v;
   }
 
-  album::track_id_list album::track_ids() const
+  const json::array& album::track_ids() const
   {
-    track_id_list result;
+    static const json::array no_tracks;
+
+    auto& obj = data_.get();
 
-    if ( data_.has_member(tracks_member) )
+    if ( obj.has_member(tracks_member) )
     {
-      auto& tracks = data_.at(tracks_member);
+      auto& tracks = obj.at(tracks_member);
 
       assert(tracks.is_array());
 
-      for ( auto& track : tracks.as_array() ) {
-        result.push_back(track);
-      }
+      return tracks.as_array();
     }
-    return result;
+    return no_tracks;
   }
 
 #if 0
@@ -189,7 +537,7 @@ namespace dm
 
   void album::add_track(const track& track)
   {
-    auto& jtracks = data_[tracks_member];
+    auto& jtracks = data_.get_mutable()[tracks_member];
 
     if ( jtracks.is_array() )
     {
@@ -209,7 +557,7 @@ namespace dm
 
   void album::remove_track(const track& track)
   {
-    auto& jtracks = data_[tracks_member];
+    auto& jtracks = data_.get_mutable()[tracks_member];
 
     if ( jtracks.is_array() )
     {
@@ -219,7 +567,7 @@ namespace dm
       for ( auto& jtrack : tracks )
       {
         if ( jtrack.as_string() != track.id() ) {
-          new_tracks.push_back(jtrack);
+          new_tracks.push_back(std::move(jtrack));
         }
       }
       jtracks = std::move(new_tracks);
@@ -228,18 +576,19 @@ namespace dm
 
   void album::member(const std::string& key, json::value&& value)
   {
-    data_[key] = std::move(value);
+    data_.get_mutable()[key] = std::move(value);
   }
 
   void album::save()
   {
-    auto& id = data_[id_member];
+    auto& obj = data_.get_mutable();
+    auto& id  = obj[id_member];
 
     if ( id.is_null() ) {
       id = album::kvstore_->create_album_key();
     }
 
-    kvstore_->set(id.as_string(), data_);
+    kvstore_->set(id.as_string(), obj);
   }
 
   void album::data(json::object&& data)
@@ -252,11 +601,9 @@ namespace dm
     // Make sure to remove album references from artists before calling
     // album::erase.
 
-    auto& id = data_[id_member];
-
-    if ( !id.is_null() )
+    if ( !id_is_null() )
     {
-      kvstore_->remove(id);
+      kvstore_->remove(id());
     }
   }
 
@@ -264,7 +611,7 @@ namespace dm
   {
     for ( auto& id : track_ids() )
     {
-      auto track = dm::track::find_by_id(id);
+      auto track = dm::track::find_by_id(id.as_string());
 
       if ( !track.is_null() )
       {
@@ -285,7 +632,7 @@ namespace dm
   {
     for ( auto& id : track_ids() )
     {
-      auto track = dm::track::find_by_id(id);
+      auto track = dm::track::find_by_id(id.as_string());
 
       if ( !track.is_null() )
       {
@@ -306,7 +653,7 @@ namespace dm
   {
     for ( auto& id : track_ids() )
     {
-      auto track = dm::track::find_by_id(id);
+      auto track = dm::track::find_by_id(id.as_string());
 
       if ( !track.is_null() ) {
         value_cb(track);
@@ -318,39 +665,56 @@ namespace dm
   {
     json::array res;
 
-    album::each([&](json::value& value) -> bool
-    {
-      res.push_back(std::move(value));
-      return true;
-    });
+    // Not torn by writes made while it runs.
+    kvstore::snapshot snapshot(*kvstore_);
+
+    // Decoded in parallel, listed in key order.
+    kvstore_->parallel_each(
+      album_prefix,
+      [](json::value& value) -> bool
+      {
+        return value.is_object();
+      },
+      [&](json::value& value) -> bool
+      {
+        res.push_back(std::move(value));
+        return true;
+      },
+      kvstore::order::key
+    );
 
     return std::move(res);
   }
 
   album album::find_by_id(const std::string& id)
   {
-    auto data = kvstore_->get(id);
+    auto record = kvstore_->get_shared(id);
 
-    if ( !data.is_null() ) {
-      return album(std::move(data.as_object()));
+    if ( record && record->is_object() ) {
+      return album(std::move(record));
     }
     else {
       return album();
     }
   }
 
+  album album::find_by_artist_and_title(const std::string& artist_id, const std::string& title)
+  {
+    for ( auto& id : kvstore_->find(artist_title_index, artist_title_value(artist_id, title)) )
+    {
+      auto result = find_by_id(id);
+
+      if ( !result.is_null() ) {
+        return result;
+      }
+    }
+    return album();
+  }
+
   void album::each(std::function<bool(json::value& value)> value_cb)
   {
     kvstore_->each(
-      [](const std::string& key) -> bool
-      {
-        if ( key.length() == 6 && key[0] == 'a' && key[1] == 'l' ) {
-          return true;
-        }
-        else {
-          return false;
-        }
-      },
+      album_prefix,
       [&](json::value& value) -> bool
       {
         if ( value.is_object() ) {
@@ -14,6 +14,9 @@
 
 // ----------------------------------------------------------------------------
 #include "kvstore.h"
+#include "shared_object.h"
+#include "blob_store.h"
+#include "work_queue.h"
 
 // ----------------------------------------------------------------------------
 #include <json/json.h>
@@ -24,9 +27,19 @@ namespace dm
   class track;
   class album;
 
+  // The cover record of an album holds the image format and the id of the
+  // image in the blob store. Albums with the same image share the blob.
+  //
+  // When a jpeg image is saved, thumbnails of 64, 200 and 600 pixels are
+  // made in the background and stored in the blob store as well. Getters
+  // given a size use the smallest thumbnail at least that size, or the
+  // image if there is none.
   class album_cover
   {
     friend class album;
+  public:
+    // No thumbnails are made without a queue to make them on.
+    static void init(blob_store* store, work_queue* thumbnail_queue = nullptr);
   private:
     album_cover(const album& album);
   private:
@@ -39,10 +52,18 @@ namespace dm
     album_cover& operator=(dm::album_cover&& rhs);
   public:
     bool is_null();
+  public:
+    // Getters.
+    const std::string&   format() const;
+    const std::string&   blob_id(unsigned size = 0) const;
+    blob_store::blob_ptr image(unsigned size = 0) const;
+    // The file the image is stored in, empty if there is no image.
+    std::string          image_filename(unsigned size = 0) const;
   public:
     // Setters.
     void format(const std::string& v);
     void data(const char* v, size_t len);
+    // Image as sent by clients, with the image data base64 encoded.
     void data(json::object&& data);
   public:
     void save();
@@ -50,18 +71,29 @@ namespace dm
   public:
     static album_cover find_by_album_id(const std::string& id);
   public:
-    json::value data() { return std::move(data_); }
+    // Image format and base64 encoded image data.
+    json::value data(unsigned size = 0);
+  public:
+    // Queue thumbnails of the covers saved before they were made. Returns
+    // the number of covers queued.
+    static size_t make_missing_thumbnails();
+  private:
+    static void release_blob(const std::string& id);
+    static void queue_thumbnails(const std::string& key, const std::string& id);
+    static void make_thumbnails(const std::string& key, const std::string& id);
   private:
-    json::object data_;
+    json::object                 data_;
+    mutable blob_store::blob_ptr image_;
   private:
     std::string key_;
   private:
-    static kvstore* kvstore_;
+    static kvstore*    kvstore_;
+    static blob_store* blob_store_;
+    static work_queue* thumbnail_queue_;
   };
 
   class album
   {
-    using track_id_list = std::vector<std::string>;
   public:
     static void init(kvstore* store);
   public:
@@ -74,6 +106,7 @@ namespace dm
     album& operator=(dm::album&& rhs);
   private:
     album(json::object&& data);
+    album(record_cache::record_ptr record);
   public:
     bool is_null();
     bool id_is_null();
@@ -81,7 +114,7 @@ namespace dm
     // Getters.
     const std::string& id()        const;
     const std::string& title()     const;
-    track_id_list      track_ids() const;
+    const json::array& track_ids() const;
     //album_cover        cover()     const;
   public:
     // Setters.
@@ -94,7 +127,8 @@ namespace dm
     void save();
     void erase();
   public:
-    json::value to_json() { return data_; }
+    json::value to_json() const & { return data_.get(); }
+    json::value to_json() && { return data_.release(); }
   public:
     track find_track_by_disc_and_track_number(unsigned disc_number, unsigned track_number);
     track find_track_by_title_and_number(const std::string& title, unsigned track_number);
@@ -104,11 +138,12 @@ namespace dm
     static json::array find_all();
   public:
     static album find_by_id(const std::string& id);
+    static album find_by_artist_and_title(const std::string& artist_id, const std::string& title);
     public:
     static void each(std::function<bool(json::value& value)> value_cb);
     static void each(std::function<bool(album& album)> value_cb);
   private:
-    json::object data_;
+    shared_object data_;
   private:
     static kvstore* kvstore_;
   };
@@ -17,9 +17,24 @@ namespace dm
 {
   kvstore* artist::kvstore_ = nullptr;
 
+  // Artist keys are base62 counters starting at ar0000, so all artists
+  // are one range of the store.
+  const std::string artist_prefix = "ar";
+
+  const std::string name_index = "artist/name";
+
   void artist::init(kvstore* store)
   {
     artist::kvstore_ = store;
+
+    kvstore_->index(name_index, artist_prefix, [](const json::value& record, std::vector<std::string>& values)
+    {
+      auto& obj = record.as_object();
+
+      if ( obj.has_member("name") && obj.at("name").is_string() ) {
+        values.push_back(obj.at("name").as_string());
+      }
+    });
   }
 
   artist::artist()
@@ -51,47 +66,51 @@ namespace dm
     data_ = std::move(data);
   }
 
+  artist::artist(record_cache::record_ptr record)
+  {
+    data_ = std::move(record);
+  }
+
   bool artist::is_null()
   {
-    return data_.empty();
+    return data_.get().empty();
   }
 
   const std::string& artist::id() const
   {
-    return data_.at("id").as_string();
+    return data_.get().at("id").as_string();
   }
 
   const std::string& artist::name() const
   {
-    return data_.at("name").as_string();
+    return data_.get().at("name").as_string();
   }
 
-  artist::album_id_list artist::album_ids() const
+  const json::array& artist::album_ids() const
   {
-    album_id_list result;
+    static const json::array no_albums;
 
-    if ( data_.has_member("albums") )
+    auto& obj = data_.get();
+
+    if ( obj.has_member("albums") )
     {
-      auto& albums = data_.at("albums");
+      auto& albums = obj.at("albums");
 
-      if ( albums.is_array() )
-      {
-        for ( auto& album : albums.as_array() ) {
-          result.push_back(album);
-        }
+      if ( albums.is_array() ) {
+        return albums.as_array();
       }
     }
-    return result;
+    return no_albums;
   }
 
   void artist::name(const std::string& v)
   {
-    data_["name"] = v;
+    data_.get_mutable()["name"] = v;
   }
 
   void artist::add_album(const album& album)
   {
-    auto& jalbums = data_["albums"];
+    auto& jalbums = data_.get_mutable()["albums"];
 
     if ( jalbums.is_array() )
     {
@@ -113,7 +132,7 @@ namespace dm
 
   void artist::remove_album(const album& album)
   {
-    auto& jalbums = data_["albums"];
+    auto& jalbums = data_.get_mutable()["albums"];
 
     if ( jalbums.is_array() )
     {
@@ -123,7 +142,7 @@ namespace dm
       for ( auto& jalbum : albums )
       {
         if ( jalbum.as_string() != album.id() ) {
-          remaining_albums.push_back(jalbum.as_string());
+          remaining_albums.push_back(std::move(jalbum));
         }
       }
       jalbums = std::move(remaining_albums);
@@ -132,41 +151,26 @@ namespace dm
 
   void artist::save()
   {
-    auto& id = data_["id"];
+    auto& obj = data_.get_mutable();
+    auto& id  = obj["id"];
 
     if ( id.is_null() ) {
       id = artist::kvstore_->create_artist_key();
     }
 
-    kvstore_->set(id.as_string(), data_);
+    kvstore_->set(id.as_string(), obj);
   }
 
   album artist::find_album_by_title(const std::string& title)
   {
-    for ( auto& id : album_ids() )
-    {
-      auto album = dm::album::find_by_id(id);
-
-      if ( !album.is_null() )
-      {
-        if ( album.title() == title ) {
-          return album;
-        }
-      }
-      else
-      {
-        // TODO: ERROR!
-        std::cerr << "invalid album!" << std::endl;
-      }
-    }
-    return album();
+    return album::find_by_artist_and_title(id(), title);
   }
 
   void artist::each_album(std::function<bool(album& album)> value_cb)
   {
     for ( auto& id : album_ids() )
     {
-      auto album = dm::album::find_by_id(id);
+      auto album = dm::album::find_by_id(id.as_string());
       value_cb(album);
     }
   }
@@ -175,22 +179,34 @@ namespace dm
   {
     json::array res;
 
-    each([&](json::value& value) -> bool
-    {
-      res.push_back(std::move(value));
-      return true;
-    });
+    // Not torn by writes made while it runs.
+    kvstore::snapshot snapshot(*kvstore_);
+
+    // Decoded in parallel, listed in key order.
+    kvstore_->parallel_each(
+      artist_prefix,
+      [](json::value& value) -> bool
+      {
+        return value.is_object();
+      },
+      [&](json::value& value) -> bool
+      {
+        res.push_back(std::move(value));
+        return true;
+      },
+      kvstore::order::key
+    );
 
     return std::move(res);
   }
 
   artist artist::find_by_id(const std::string& id)
   {
-    auto data = kvstore_->get(id);
+    auto record = kvstore_->get_shared(id);
 
-    if ( !data.is_null() )
+    if ( record && record->is_object() )
     {
-      return artist(std::move(data.as_object()));
+      return artist(std::move(record));
     }
     else
     {
@@ -200,39 +216,21 @@ namespace dm
 
   artist artist::find_by_name(const std::string& name)
   {
-    artist result;
-
-    each([&](json::value& value) -> bool
+    for ( auto& id : kvstore_->find(name_index, name) )
     {
-      auto& a           = value.as_object();
-      auto& artist_name = a["name"];
+      auto result = find_by_id(id);
 
-      if ( artist_name.as_string() == name )
-      {
-        result = std::move(a);
-        return false;
-      }
-      else
-      {
-        return true;
+      if ( !result.is_null() ) {
+        return result;
       }
-    });
-
-    return result;
+    }
+    return artist();
   }
 
   void artist::each(std::function<bool(json::value& value)> value_cb)
   {
     kvstore_->each(
-      [](const std::string& key) -> bool
-      {
-        if ( key.length() == 6 && key[0] == 'a' && key[1] == 'r' ) {
-          return true;
-        }
-        else {
-          return false;
-        }
-      },
+      artist_prefix,
       [&](json::value& value) -> bool
       {
         if ( value.is_object() ) {
@@ -251,4 +249,10 @@ namespace dm
       return value_cb(v);
     });
   }
-}
\ No newline at end of file
+
+  void artist::each(const std::vector<std::string>& fields,
+                    std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb)
+  {
+    kvstore_->each(artist_prefix, fields, value_cb);
+  }
+}
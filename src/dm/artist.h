@@ -14,6 +14,7 @@
 
 // ----------------------------------------------------------------------------
 #include "kvstore.h"
+#include "shared_object.h"
 
 // ----------------------------------------------------------------------------
 #include <json/json.h>
@@ -25,7 +26,6 @@ namespace dm
 
   class artist
   {
-    using album_id_list = std::vector<std::string>;
   public:
     static void init(kvstore* store);
   public:
@@ -38,13 +38,14 @@ namespace dm
     artist& operator=(dm::artist&& rhs);
   private:
     artist(json::object&& data);
+    artist(record_cache::record_ptr record);
   public:
     bool is_null();
   public:
     // Getters.
     const std::string& id()        const;
     const std::string& name()      const;
-    album_id_list      album_ids() const;
+    const json::array& album_ids() const;
   public:
     // Setters.
     void name(const std::string& v);
@@ -64,8 +65,10 @@ namespace dm
   public:
     static void each(std::function<bool(json::value& value)> value_cb);
     static void each(std::function<bool(artist& artist)> value_cb);
+    static void each(const std::vector<std::string>& fields,
+                     std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb);
   private:
-    json::object data_;
+    shared_object data_;
   private:
     static kvstore* kvstore_;
   };
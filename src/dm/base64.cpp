@@ -9,7 +9,7 @@
 //
 //
 // ----------------------------------------------------------------------------
-#include <base64.h>
+#include "base64.h"
 
 // ----------------------------------------------------------------------------
 #include <iostream>
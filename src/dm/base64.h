@@ -9,8 +9,8 @@
 //
 //
 // ----------------------------------------------------------------------------
-#ifndef __base64_h__
-#define __base64_h__
+#ifndef __dm__base64_h__
+#define __dm__base64_h__
 
 // ----------------------------------------------------------------------------
 #include <string>
@@ -22,4 +22,4 @@ namespace base64
   std::string decode(const void* data, size_t len);
 }
 
-#endif // __base64_h__
\ No newline at end of file
+#endif // __dm__base64_h__
\ No newline at end of file
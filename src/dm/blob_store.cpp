@@ -0,0 +1,180 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : blob_store.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "blob_store.h"
+#include "sha256.h"
+#include "mapped_file.h"
+
+// ----------------------------------------------------------------------------
+#include <stdexcept>
+#include <cerrno>
+#include <cstdlib>
+
+// ----------------------------------------------------------------------------
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  blob_store::blob_store(const std::string& directory, size_t cache_capacity)
+    :
+    directory_(directory),
+    capacity_(cache_capacity),
+    size_(0),
+    hits_(0),
+    misses_(0)
+  {
+    if ( mkdir(directory_.c_str(), 0755) < 0 && errno != EEXIST ) {
+      throw std::runtime_error("blob store directory error");
+    }
+  }
+
+  std::string blob_store::put(const char* data, size_t len)
+  {
+    auto id   = sha256::hex_digest(data, len);
+    auto name = filename(id);
+
+    struct stat st;
+
+    if ( stat(name.c_str(), &st) == 0 ) {
+      return id;
+    }
+
+    // Written to a temporary file first, so a blob file is always whole.
+    mapped_file::write(name, data, len);
+
+    return id;
+  }
+
+  blob_store::blob_ptr blob_store::get(const std::string& id)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      auto it = entries_.find(id);
+
+      if ( it != entries_.end() )
+      {
+        hits_++;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->blob;
+      }
+      misses_++;
+    }
+
+    // The data of an id never changes, so a blob read while it is removed
+    // is still valid to cache.
+    auto blob = read(id);
+
+    if ( blob ) {
+      cache_insert(id, blob);
+    }
+    return blob;
+  }
+
+  void blob_store::remove(const std::string& id)
+  {
+    cache_erase(id);
+    unlink(filename(id).c_str());
+  }
+
+  std::string blob_store::filename(const std::string& id) const
+  {
+    return directory_ + "/" + id;
+  }
+
+  blob_store::statistics blob_store::stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics{ hits_, misses_, entries_.size(), size_ };
+  }
+
+  blob_store::blob_ptr blob_store::read(const std::string& id)
+  {
+    int fd = open(filename(id).c_str(), O_RDONLY);
+
+    if ( fd < 0 ) {
+      return nullptr;
+    }
+
+    struct stat st;
+
+    if ( fstat(fd, &st) < 0 )
+    {
+      close(fd);
+      return nullptr;
+    }
+
+    auto   data = std::make_shared<std::string>(st.st_size, '\0');
+    size_t done = 0;
+
+    while ( done < data->size() )
+    {
+      auto res = pread(fd, &(*data)[done], data->size() - done, done);
+
+      if ( res < 0 && errno == EINTR ) {
+        continue;
+      }
+      else if ( res <= 0 )
+      {
+        close(fd);
+        throw std::runtime_error("blob store read error");
+      }
+      done += res;
+    }
+
+    close(fd);
+
+    return data;
+  }
+
+  void blob_store::cache_insert(const std::string& id, blob_ptr blob)
+  {
+    if ( blob->size() > capacity_ ) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if ( entries_.count(id) > 0 ) {
+      return;
+    }
+
+    size_ += blob->size();
+    lru_.push_front(entry{ id, std::move(blob) });
+    entries_.emplace(id, lru_.begin());
+
+    while ( size_ > capacity_ )
+    {
+      auto& last = lru_.back();
+
+      size_ -= last.blob->size();
+      entries_.erase(last.id);
+      lru_.pop_back();
+    }
+  }
+
+  void blob_store::cache_erase(const std::string& id)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(id);
+
+    if ( it != entries_.end() )
+    {
+      size_ -= it->second->blob->size();
+      lru_.erase(it->second);
+      entries_.erase(it);
+    }
+  }
+}
@@ -0,0 +1,83 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : blob_store.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Content addressed store of binary data, like album cover images. A blob
+//   is kept as a file in the store directory, named by the sha-256 digest of
+//   its data, so the same data stored by several records is kept once.
+//
+//   Blobs are read with pread and the most recently used are kept in memory,
+//   up to a capacity in bytes. A blob is never changed once written, so a
+//   cached blob is valid until it is removed.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__blob_store_h__
+#define __dm__blob_store_h__
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class blob_store
+  {
+  public:
+    using blob_ptr = std::shared_ptr<const std::string>;
+  public:
+    struct statistics
+    {
+      uint64_t hits;
+      uint64_t misses;
+      size_t   blobs;
+      size_t   size;
+    };
+  public:
+    blob_store(const std::string& directory, size_t cache_capacity = 16*1024*1024);
+  public:
+    // Store data unless already stored. Returns the id of the blob.
+    std::string put(const char* data, size_t len);
+    // Data of the blob or nullptr if not found.
+    blob_ptr get(const std::string& id);
+  public:
+    void remove(const std::string& id);
+  public:
+    // The file of the blob, for reading it directly.
+    std::string filename(const std::string& id) const;
+  public:
+    statistics stats() const;
+  private:
+    blob_ptr read(const std::string& id);
+  private:
+    void cache_insert(const std::string& id, blob_ptr blob);
+    void cache_erase(const std::string& id);
+  private:
+    struct entry
+    {
+      std::string id;
+      blob_ptr    blob;
+    };
+  private:
+    std::string directory_;
+  private:
+    mutable std::mutex                                          mutex_;
+    std::list<entry>                                            lru_;
+    std::unordered_map<std::string, std::list<entry>::iterator> entries_;
+    size_t                                                      capacity_;
+    size_t                                                      size_;
+    uint64_t                                                    hits_;
+    uint64_t                                                    misses_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__blob_store_h__
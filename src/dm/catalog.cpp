@@ -0,0 +1,1299 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : catalog.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "catalog.h"
+
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <unordered_map>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  namespace
+  {
+    const std::string artist_prefix = "ar";
+    const std::string album_prefix  = "al";
+    const std::string track_prefix  = "t";
+
+    const std::vector<std::string> artist_fields = { "name", "albums" };
+    const std::vector<std::string> album_fields  = { "title", "artist", "tracks" };
+    const std::vector<std::string> track_fields  = { "title", "tn", "dn", "duration", "tags", "artist", "album" };
+
+    bool starts_with(const std::string& key, const std::string& prefix)
+    {
+      return key.compare(0, prefix.length(), prefix) == 0;
+    }
+
+    // Members of a record in the order of names, null if it has no such
+    // member, as kvstore::each with fields gives them.
+    std::vector<json::value> fields(const json::value& record, const std::vector<std::string>& names)
+    {
+      std::vector<json::value> result(names.size());
+
+      auto& obj = record.as_object();
+
+      for ( size_t i = 0; i < names.size(); ++i )
+      {
+        if ( obj.has_member(names[i]) ) {
+          result[i] = obj.at(names[i]);
+        }
+      }
+      return result;
+    }
+
+    // Member of an embedded artist or album, null if there is none.
+    const json::value& member(const json::value& value, const std::string& name)
+    {
+      static const json::value none;
+
+      if ( !value.is_object() || !value.as_object().has_member(name) ) {
+        return none;
+      }
+      return value.as_object().at(name);
+    }
+
+    unsigned number(const json::value& value, unsigned max)
+    {
+      if ( !value.is_integer() || value.as_integer() < 0 ) {
+        return 0;
+      }
+      return static_cast<unsigned>(std::min<int64_t>(value.as_integer(), max));
+    }
+
+    bool contains(std::string_view text, const std::string& lower)
+    {
+      auto it = std::search(text.begin(), text.end(), lower.begin(), lower.end(), [](char a, char b)
+      {
+        return std::tolower(static_cast<unsigned char>(a)) == b;
+      });
+      return it != text.end();
+    }
+
+    template <typename T> size_t memory(const std::vector<T>& v)
+    {
+      return v.capacity() * sizeof(T);
+    }
+
+    size_t memory(const std::vector<std::vector<uint32_t>>& v)
+    {
+      size_t result = v.capacity() * sizeof(std::vector<uint32_t>);
+
+      for ( auto& list : v ) {
+        result += list.capacity() * sizeof(uint32_t);
+      }
+      return result;
+    }
+
+    // Header of the catalog file, followed by the sections.
+    const char     file_magic[8] = { 'm', 'b', 'o', 'x', 'c', 'a', 't', '\0' };
+    // Version 1 placed interned strings by std::hash, version 2 did not
+    // tell which database the file was written from.
+    const uint64_t file_version  = 3;
+    const size_t   header_size   = 6 * sizeof(uint64_t);
+
+    // Fewest unused strings the pool is compacted for.
+    const size_t compact_min_unused = 1024;
+
+    uint64_t checksum(const char* data, size_t len)
+    {
+      return string_pool::hash(data, len);
+    }
+
+    // Sections are a 64 bit length followed by the data, padded to 8
+    // bytes, so arrays in the mapped file are aligned.
+    class file_writer
+    {
+    public:
+      file_writer(std::string& out) : out_(out) {}
+    public:
+      void word(uint64_t value)
+      {
+        out_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+      }
+
+      void bytes(const char* data, size_t len)
+      {
+        word(len);
+        out_.append(data, len);
+        out_.append((8 - len % 8) % 8, '\0');
+      }
+
+      void array(const std::vector<uint32_t>& values)
+      {
+        word(values.size());
+        out_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(uint32_t));
+        out_.append(values.size() % 2 * sizeof(uint32_t), '\0');
+      }
+
+      // Lists as the offset each ends at, and their values.
+      void lists(const std::vector<std::vector<uint32_t>>& lists)
+      {
+        std::vector<uint32_t> ends;
+        std::vector<uint32_t> values;
+
+        for ( auto& list : lists )
+        {
+          values.insert(values.end(), list.begin(), list.end());
+          ends.push_back(static_cast<uint32_t>(values.size()));
+        }
+
+        array(ends);
+        array(values);
+      }
+    private:
+      std::string& out_;
+    };
+
+    class file_reader
+    {
+    public:
+      file_reader(const char* data, size_t len) : p_(data), end_(data + len) {}
+    public:
+      uint64_t word()
+      {
+        uint64_t value;
+        memcpy(&value, take(sizeof(value)), sizeof(value));
+        return value;
+      }
+
+      const char* bytes(size_t& len)
+      {
+        len = word();
+
+        if ( len > size_t(end_ - p_) ) {
+          throw std::runtime_error("catalog file truncated");
+        }
+
+        auto data = take(len);
+        take((8 - len % 8) % 8);
+        return data;
+      }
+
+      // Values left in the mapped file.
+      const uint32_t* array(size_t& count)
+      {
+        count = word();
+
+        if ( count > size_t(end_ - p_) / sizeof(uint32_t) ) {
+          throw std::runtime_error("catalog file truncated");
+        }
+
+        auto data = reinterpret_cast<const uint32_t*>(take(count * sizeof(uint32_t)));
+        take(count % 2 * sizeof(uint32_t));
+        return data;
+      }
+
+      std::vector<uint32_t> array()
+      {
+        size_t count;
+        auto   data = array(count);
+        return std::vector<uint32_t>(data, data + count);
+      }
+
+      std::vector<std::vector<uint32_t>> lists()
+      {
+        auto ends   = array();
+        auto values = array();
+
+        std::vector<std::vector<uint32_t>> result(ends.size());
+
+        uint32_t begin = 0;
+
+        for ( size_t i = 0; i < ends.size(); ++i )
+        {
+          if ( ends[i] < begin || ends[i] > values.size() ) {
+            throw std::runtime_error("catalog file error");
+          }
+          result[i].assign(values.begin() + begin, values.begin() + ends[i]);
+          begin = ends[i];
+        }
+        return result;
+      }
+
+      bool at_end() const { return p_ == end_; }
+    private:
+      const char* take(size_t len)
+      {
+        if ( len > size_t(end_ - p_) ) {
+          throw std::runtime_error("catalog file truncated");
+        }
+
+        auto data = p_;
+        p_ += len;
+        return data;
+      }
+    private:
+      const char* p_;
+      const char* end_;
+    };
+
+    // Throws unless the values are below limit, or are none if allowed.
+    void check(const std::vector<uint32_t>& values, size_t limit, bool none)
+    {
+      for ( auto v : values )
+      {
+        if ( v >= limit && !(none && v == string_pool::none) ) {
+          throw std::runtime_error("catalog file error");
+        }
+      }
+    }
+
+    void check(const std::vector<std::vector<uint32_t>>& lists, size_t limit)
+    {
+      for ( auto& list : lists ) {
+        check(list, limit, false);
+      }
+    }
+  }
+
+  catalog::catalog(kvstore& store, const std::string& filename)
+    :
+    store_(store),
+    filename_(filename),
+    subscription_(0),
+    store_id_(0),
+    tag_sets_(1),
+    change_(0),
+    from_file_(false),
+    load_time_(0)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    // Before the lock, the store's write lock is not taken with it held.
+    if ( !filename_.empty() )
+    {
+      auto token = store_.token();
+      store_id_ = string_pool::hash(token.data(), token.length());
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    // Commits made while the records are loaded wait for the lock, and are
+    // applied after.
+    subscription_ = store_.subscribe_commits([this](const std::vector<kvstore::change>& changes)
+    {
+      apply(changes);
+    });
+
+    size_t replayed = 0;
+
+    from_file_ = !filename_.empty() && load_file(replayed);
+
+    if ( !from_file_ ) {
+      load();
+    }
+
+    load_time_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // So the next start need not load the records, or apply the changes
+    // again.
+    if ( !filename_.empty() && (!from_file_ || replayed > 0) )
+    {
+      try
+      {
+        compact();
+        write_file();
+      }
+      catch ( std::exception& e )
+      {
+        std::cerr << "catalog write error " << e.what() << std::endl;
+      }
+    }
+  }
+
+  catalog::~catalog()
+  {
+    store_.unsubscribe(subscription_);
+  }
+
+  json::array catalog::artists() const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    json::array result;
+
+    for ( auto slot : artist_slots_.order ) {
+      result.push_back(artist_json(slot));
+    }
+    return result;
+  }
+
+  json::array catalog::albums() const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    json::array result;
+
+    for ( auto slot : album_slots_.order ) {
+      result.push_back(album_json(slot));
+    }
+    return result;
+  }
+
+  json::array catalog::tracks() const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    json::array result;
+
+    for ( auto slot : track_slots_.order ) {
+      result.push_back(track_json(slot));
+    }
+    return result;
+  }
+
+  json::value catalog::album_tracks(const std::string& album_id) const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    auto album = find_slot(albums_, strings_.find(album_id));
+
+    if ( album == string_pool::none ) {
+      return json::value();
+    }
+
+    json::array result;
+
+    for ( auto id : albums_.tracks[album] )
+    {
+      auto track = find_slot(tracks_, id);
+
+      if ( track != string_pool::none ) {
+        result.push_back(track_json(track));
+      }
+    }
+    return result;
+  }
+
+  json::array catalog::index() const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    json::array result;
+
+    for ( auto artist : artist_slots_.order )
+    {
+      json::array jalbums;
+
+      for ( auto album_id : artists_.albums[artist] )
+      {
+        auto album = find_slot(albums_, album_id);
+
+        if ( album == string_pool::none ) {
+          continue;
+        }
+
+        json::array jtracks;
+
+        for ( auto track_id : albums_.tracks[album] )
+        {
+          auto track = find_slot(tracks_, track_id);
+
+          if ( track != string_pool::none ) {
+            jtracks.push_back(index_track_json(track));
+          }
+        }
+
+        jalbums.push_back(json::object{
+          { "id",     string(album_id) },
+          { "title",  string(albums_.title[album]) },
+          { "tracks", std::move(jtracks) }
+        });
+      }
+
+      if ( jalbums.size() > 0 )
+      {
+        result.push_back(json::object{
+          { "id",     string(artists_.id[artist]) },
+          { "name",   string(artists_.name[artist]) },
+          { "albums", std::move(jalbums) }
+        });
+      }
+    }
+    return result;
+  }
+
+  std::vector<std::string> catalog::track_ids() const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    std::vector<std::string> result;
+
+    result.reserve(track_slots_.order.size());
+
+    for ( auto slot : track_slots_.order ) {
+      result.emplace_back(strings_.get(tracks_.id[slot]));
+    }
+    return result;
+  }
+
+  std::vector<std::string> catalog::track_ids_by_tag(const std::string& tag) const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    std::vector<std::string> result;
+
+    auto ordinal = strings_.find(tag);
+
+    if ( ordinal == string_pool::none ) {
+      return result;
+    }
+
+    // Each set is looked at once, not once for every track.
+    std::vector<bool> has_tag(tag_sets_.size());
+
+    for ( size_t i = 0; i < tag_sets_.size(); ++i )
+    {
+      auto& set = tag_sets_[i];
+      has_tag[i] = std::find(set.begin(), set.end(), ordinal) != set.end();
+    }
+
+    for ( auto slot : track_slots_.order )
+    {
+      if ( has_tag[tracks_.tags[slot]] ) {
+        result.emplace_back(strings_.get(tracks_.id[slot]));
+      }
+    }
+    return result;
+  }
+
+  json::array catalog::search(const std::string& text, size_t limit) const
+  {
+    std::string lower(text);
+
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+    {
+      return std::tolower(c);
+    });
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    json::array result;
+
+    // Names and titles are interned, each is matched once.
+    std::unordered_map<uint32_t, bool> matches;
+
+    auto match = [&](uint32_t ordinal) -> bool
+    {
+      if ( ordinal == string_pool::none ) {
+        return false;
+      }
+
+      auto it = matches.find(ordinal);
+
+      if ( it == matches.end() ) {
+        it = matches.emplace(ordinal, contains(strings_.get(ordinal), lower)).first;
+      }
+      return it->second;
+    };
+
+    for ( auto slot : track_slots_.order )
+    {
+      if ( result.size() >= limit ) {
+        break;
+      }
+
+      if ( contains(strings_.get(tracks_.title[slot]), lower) ||
+           match(tracks_.artist_name[slot]) ||
+           match(tracks_.album_title[slot]) )
+      {
+        result.push_back(track_json(slot));
+      }
+    }
+    return result;
+  }
+
+  catalog::statistics catalog::stats() const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    statistics result;
+
+    result.artists  = artist_slots_.order.size();
+    result.albums   = album_slots_.order.size();
+    result.tracks   = track_slots_.order.size();
+    result.strings  = strings_.size();
+    result.tag_sets = tag_sets_.size();
+
+    size_t size = strings_.memory();
+
+    size += memory(artists_.id) + memory(artists_.name) + memory(artists_.albums);
+
+    size += memory(albums_.id) + memory(albums_.title) + memory(albums_.artist_id) +
+      memory(albums_.artist_name) + memory(albums_.tracks);
+
+    size += memory(tracks_.id) + memory(tracks_.title) + memory(tracks_.numbers) +
+      memory(tracks_.tags) + memory(tracks_.artist_id) + memory(tracks_.artist_name) +
+      memory(tracks_.album_id) + memory(tracks_.album_title);
+
+    size += memory(slot_of_);
+
+    for ( auto kind : { &artist_slots_, &album_slots_, &track_slots_ } ) {
+      size += memory(kind->order) + memory(kind->free);
+    }
+
+    size += memory(tag_sets_) + tag_set_index_.size() * (sizeof(tag_set_map::value_type) + 4*sizeof(void*));
+
+    result.size                = size;
+    result.size_per_10k_tracks = result.tracks > 0 ? size * 10000 / result.tracks : 0;
+    result.from_file           = from_file_;
+    result.load_time           = load_time_;
+
+    return result;
+  }
+
+  void catalog::load()
+  {
+    // Records as of one commit.
+    kvstore::snapshot snapshot(store_);
+
+    change_ = snapshot.last_change();
+
+    store_.parallel_each(artist_prefix, artist_fields, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+    {
+      set_artist(add_slot(artists_, artist_slots_, strings_.intern(key)), fields);
+      return true;
+    }, kvstore::order::key);
+
+    store_.parallel_each(album_prefix, album_fields, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+    {
+      set_album(add_slot(albums_, album_slots_, strings_.intern(key)), fields);
+      return true;
+    }, kvstore::order::key);
+
+    store_.parallel_each(track_prefix, track_fields, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+    {
+      set_track(add_slot(tracks_, track_slots_, strings_.intern(key)), fields);
+      return true;
+    }, kvstore::order::key);
+  }
+
+  void catalog::save()
+  {
+    if ( filename_.empty() ) {
+      return;
+    }
+
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+
+      compact();
+    }
+
+    // Readers need not wait while the file is written.
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    write_file();
+  }
+
+  void catalog::apply(const std::vector<kvstore::change>& changes)
+  {
+    auto values = read_values(changes);
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    apply(changes, values);
+  }
+
+  std::vector<json::value> catalog::read_values(const std::vector<kvstore::change>& changes)
+  {
+    std::vector<json::value> values(changes.size());
+
+    // Read before the lock is taken, readers only wait while the columns
+    // are written.
+    for ( size_t i = 0; i < changes.size(); ++i )
+    {
+      auto& key = changes[i].key;
+
+      if ( changes[i].op == kvstore::change_op::set &&
+           (starts_with(key, artist_prefix) || starts_with(key, album_prefix) || starts_with(key, track_prefix)) )
+      {
+        values[i] = store_.get(key);
+      }
+    }
+    return values;
+  }
+
+  void catalog::apply(const std::vector<kvstore::change>& changes, const std::vector<json::value>& values)
+  {
+    for ( size_t i = 0; i < changes.size(); ++i )
+    {
+      if ( values[i].is_object() ) {
+        set(changes[i].key, values[i]);
+      }
+      else {
+        remove(changes[i].key);
+      }
+    }
+
+    if ( !changes.empty() ) {
+      change_ = std::max(change_, changes.back().seq);
+    }
+  }
+
+  void catalog::write_file() const
+  {
+    std::string payload;
+    file_writer out(payload);
+
+    std::string           chars;
+    std::vector<uint32_t> ends;
+    std::vector<uint32_t> table;
+
+    strings_.save(chars, ends, table);
+
+    out.bytes(chars.data(), chars.length());
+    out.array(ends);
+    out.array(table);
+
+    out.array(artists_.id);
+    out.array(artists_.name);
+    out.lists(artists_.albums);
+
+    out.array(albums_.id);
+    out.array(albums_.title);
+    out.array(albums_.artist_id);
+    out.array(albums_.artist_name);
+    out.lists(albums_.tracks);
+
+    out.array(tracks_.id);
+    out.array(tracks_.title);
+    out.array(tracks_.numbers);
+    out.array(tracks_.tags);
+    out.array(tracks_.artist_id);
+    out.array(tracks_.artist_name);
+    out.array(tracks_.album_id);
+    out.array(tracks_.album_title);
+
+    for ( auto kind : { &artist_slots_, &album_slots_, &track_slots_ } )
+    {
+      out.array(kind->order);
+      out.array(kind->free);
+    }
+
+    out.array(slot_of_);
+    out.lists(tag_sets_);
+
+    std::string data(file_magic, sizeof(file_magic));
+    file_writer header(data);
+
+    header.word(file_version);
+    header.word(store_id_);
+    header.word(change_);
+    header.word(payload.length());
+    header.word(checksum(payload.data(), payload.length()));
+
+    data.append(payload);
+
+    mapped_file::write(filename_, data);
+  }
+
+  bool catalog::load_file(size_t& replayed)
+  {
+    try
+    {
+      std::shared_ptr<const mapped_file> file;
+
+      try
+      {
+        file = std::make_shared<mapped_file>(filename_);
+      }
+      catch ( std::exception& e )
+      {
+        // Not written yet.
+        return false;
+      }
+
+      if ( file->size() < header_size || memcmp(file->data(), file_magic, sizeof(file_magic)) != 0 ) {
+        throw std::runtime_error("not a catalog file");
+      }
+
+      file_reader header(file->data() + sizeof(file_magic), header_size - sizeof(file_magic));
+
+      auto version = header.word();
+      auto store   = header.word();
+      auto change  = header.word();
+      auto size    = header.word();
+      auto sum     = header.word();
+
+      if ( version != file_version ) {
+        throw std::runtime_error("catalog file version " + std::to_string(version));
+      }
+
+      if ( size != file->size() - header_size || checksum(file->data() + header_size, size) != sum ) {
+        throw std::runtime_error("catalog file checksum error");
+      }
+
+      if ( store != store_id_ ) {
+        throw std::runtime_error("catalog file of another database");
+      }
+
+      // Commits since it was written, if the log still has them.
+      std::vector<kvstore::change> changes;
+
+      if ( !store_.changes(change, SIZE_MAX, false, changes) ) {
+        return false;
+      }
+
+      file_reader in(file->data() + header_size, size);
+
+      size_t len;
+      auto   chars = in.bytes(len);
+      size_t count;
+      auto   ends  = in.array(count);
+
+      strings_.load(file, chars, len, ends, count, in.array());
+
+      artists_.id     = in.array();
+      artists_.name   = in.array();
+      artists_.albums = in.lists();
+
+      albums_.id          = in.array();
+      albums_.title       = in.array();
+      albums_.artist_id   = in.array();
+      albums_.artist_name = in.array();
+      albums_.tracks      = in.lists();
+
+      tracks_.id          = in.array();
+      tracks_.title       = in.array();
+      tracks_.numbers     = in.array();
+      tracks_.tags        = in.array();
+      tracks_.artist_id   = in.array();
+      tracks_.artist_name = in.array();
+      tracks_.album_id    = in.array();
+      tracks_.album_title = in.array();
+
+      for ( auto kind : { &artist_slots_, &album_slots_, &track_slots_ } )
+      {
+        kind->order = in.array();
+        kind->free  = in.array();
+      }
+
+      slot_of_  = in.array();
+      tag_sets_ = in.lists();
+
+      if ( !in.at_end() ) {
+        throw std::runtime_error("catalog file error");
+      }
+
+      validate();
+
+      for ( size_t i = 1; i < tag_sets_.size(); ++i ) {
+        tag_set_index_.emplace(tag_sets_[i], static_cast<uint32_t>(i));
+      }
+
+      change_ = change;
+
+      apply(changes, read_values(changes));
+
+      replayed = changes.size();
+
+      return true;
+    }
+    catch ( std::exception& e )
+    {
+      std::cerr << "catalog file not used, " << e.what() << std::endl;
+    }
+
+    clear();
+
+    return false;
+  }
+
+  void catalog::validate() const
+  {
+    auto strings = strings_.size();
+
+    auto same_size = [](std::initializer_list<size_t> sizes)
+    {
+      if ( std::adjacent_find(sizes.begin(), sizes.end(), std::not_equal_to<size_t>()) != sizes.end() ) {
+        throw std::runtime_error("catalog file error");
+      }
+    };
+
+    same_size({ artists_.id.size(), artists_.name.size(), artists_.albums.size() });
+    same_size({ albums_.id.size(), albums_.title.size(), albums_.artist_id.size(), albums_.artist_name.size(), albums_.tracks.size() });
+    same_size({
+      tracks_.id.size(), tracks_.title.size(), tracks_.numbers.size(), tracks_.tags.size(),
+      tracks_.artist_id.size(), tracks_.artist_name.size(), tracks_.album_id.size(), tracks_.album_title.size()
+    });
+
+    for ( auto column : {
+        &artists_.id, &artists_.name,
+        &albums_.id, &albums_.title, &albums_.artist_id, &albums_.artist_name,
+        &tracks_.id, &tracks_.title, &tracks_.artist_id, &tracks_.artist_name, &tracks_.album_id, &tracks_.album_title } )
+    {
+      check(*column, strings, true);
+    }
+
+    check(artists_.albums, strings);
+    check(albums_.tracks, strings);
+    check(tag_sets_, strings);
+    check(tracks_.tags, tag_sets_.size(), false);
+
+    check(artist_slots_.order, artists_.id.size(), false);
+    check(artist_slots_.free, artists_.id.size(), false);
+    check(album_slots_.order, albums_.id.size(), false);
+    check(album_slots_.free, albums_.id.size(), false);
+    check(track_slots_.order, tracks_.id.size(), false);
+    check(track_slots_.free, tracks_.id.size(), false);
+
+    check(slot_of_, std::max({ artists_.id.size(), albums_.id.size(), tracks_.id.size() }), true);
+
+    if ( tag_sets_.empty() || !tag_sets_[0].empty() ) {
+      throw std::runtime_error("catalog file error");
+    }
+  }
+
+  void catalog::clear()
+  {
+    strings_       = string_pool();
+    artists_       = artist_columns();
+    albums_        = album_columns();
+    tracks_        = track_columns();
+    artist_slots_  = slots();
+    album_slots_   = slots();
+    track_slots_   = slots();
+    slot_of_.clear();
+    tag_sets_.assign(1, std::vector<uint32_t>());
+    tag_set_index_.clear();
+    change_        = 0;
+  }
+
+  void catalog::compact()
+  {
+    std::vector<bool> used(strings_.size());
+    std::vector<bool> used_sets(tag_sets_.size());
+
+    auto use = [&](uint32_t ordinal)
+    {
+      if ( ordinal != string_pool::none ) {
+        used[ordinal] = true;
+      }
+    };
+
+    auto use_all = [&](const std::vector<uint32_t>& ordinals)
+    {
+      for ( auto ordinal : ordinals ) {
+        use(ordinal);
+      }
+    };
+
+    for ( auto slot : artist_slots_.order )
+    {
+      use(artists_.id[slot]);
+      use(artists_.name[slot]);
+      use_all(artists_.albums[slot]);
+    }
+
+    for ( auto slot : album_slots_.order )
+    {
+      use(albums_.id[slot]);
+      use(albums_.title[slot]);
+      use(albums_.artist_id[slot]);
+      use(albums_.artist_name[slot]);
+      use_all(albums_.tracks[slot]);
+    }
+
+    for ( auto slot : track_slots_.order )
+    {
+      use(tracks_.id[slot]);
+      use(tracks_.title[slot]);
+      use(tracks_.artist_id[slot]);
+      use(tracks_.artist_name[slot]);
+      use(tracks_.album_id[slot]);
+      use(tracks_.album_title[slot]);
+      used_sets[tracks_.tags[slot]] = true;
+    }
+
+    for ( size_t i = 1; i < tag_sets_.size(); ++i )
+    {
+      if ( used_sets[i] ) {
+        use_all(tag_sets_[i]);
+      }
+    }
+
+    auto unused = static_cast<size_t>(std::count(used.begin(), used.end(), false));
+
+    if ( unused < compact_min_unused || unused * 4 < used.size() ) {
+      return;
+    }
+
+    // New ordinals of the strings, in the same order. Interned strings are
+    // interned again, the others added.
+    string_pool           strings;
+    std::vector<uint32_t> ordinals(used.size(), string_pool::none);
+
+    for ( uint32_t i = 0; i < used.size(); ++i )
+    {
+      if ( used[i] )
+      {
+        auto s = strings_.get(i);
+        ordinals[i] = strings_.find(s) == i ? strings.intern(s) : strings.add(s);
+      }
+    }
+
+    auto renumber = [&](std::vector<uint32_t>& column)
+    {
+      for ( auto& ordinal : column )
+      {
+        if ( ordinal != string_pool::none ) {
+          ordinal = ordinals[ordinal];
+        }
+      }
+    };
+
+    // Free slots hold none and empty lists.
+    for ( auto column : {
+        &artists_.id, &artists_.name,
+        &albums_.id, &albums_.title, &albums_.artist_id, &albums_.artist_name,
+        &tracks_.id, &tracks_.title, &tracks_.artist_id, &tracks_.artist_name, &tracks_.album_id, &tracks_.album_title } )
+    {
+      renumber(*column);
+    }
+
+    for ( auto& list : artists_.albums ) {
+      renumber(list);
+    }
+    for ( auto& list : albums_.tracks ) {
+      renumber(list);
+    }
+
+    // Tag sets in use keep their order, the empty set is still 0.
+    std::vector<uint32_t> set_ordinals(tag_sets_.size(), 0);
+    std::vector<std::vector<uint32_t>> tag_sets(1);
+
+    tag_set_index_.clear();
+
+    for ( size_t i = 1; i < tag_sets_.size(); ++i )
+    {
+      if ( used_sets[i] )
+      {
+        renumber(tag_sets_[i]);
+        set_ordinals[i] = static_cast<uint32_t>(tag_sets.size());
+        tag_set_index_.emplace(tag_sets_[i], set_ordinals[i]);
+        tag_sets.push_back(std::move(tag_sets_[i]));
+      }
+    }
+
+    for ( auto& set : tracks_.tags ) {
+      set = set_ordinals[set];
+    }
+
+    std::vector<uint32_t> slot_of(strings.size(), string_pool::none);
+
+    for ( auto slot : artist_slots_.order ) {
+      slot_of[artists_.id[slot]] = slot;
+    }
+    for ( auto slot : album_slots_.order ) {
+      slot_of[albums_.id[slot]] = slot;
+    }
+    for ( auto slot : track_slots_.order ) {
+      slot_of[tracks_.id[slot]] = slot;
+    }
+
+    strings_  = std::move(strings);
+    tag_sets_ = std::move(tag_sets);
+    slot_of_  = std::move(slot_of);
+  }
+
+  void catalog::set(const std::string& key, const json::value& value)
+  {
+    if ( starts_with(key, artist_prefix) ) {
+      set_artist(add_slot(artists_, artist_slots_, strings_.intern(key)), fields(value, artist_fields));
+    }
+    else if ( starts_with(key, album_prefix) ) {
+      set_album(add_slot(albums_, album_slots_, strings_.intern(key)), fields(value, album_fields));
+    }
+    else if ( starts_with(key, track_prefix) ) {
+      set_track(add_slot(tracks_, track_slots_, strings_.intern(key)), fields(value, track_fields));
+    }
+  }
+
+  void catalog::remove(const std::string& key)
+  {
+    auto id = strings_.find(key);
+
+    if ( id == string_pool::none ) {
+      return;
+    }
+
+    if ( starts_with(key, artist_prefix) ) {
+      remove_slot(artists_, artist_slots_, id);
+    }
+    else if ( starts_with(key, album_prefix) ) {
+      remove_slot(albums_, album_slots_, id);
+    }
+    else if ( starts_with(key, track_prefix) ) {
+      remove_slot(tracks_, track_slots_, id);
+    }
+  }
+
+  void catalog::set_artist(uint32_t slot, const std::vector<json::value>& fields)
+  {
+    artists_.name[slot] = intern(fields[0]);
+    intern_ids(fields[1], artists_.albums[slot]);
+  }
+
+  void catalog::set_album(uint32_t slot, const std::vector<json::value>& fields)
+  {
+    albums_.title[slot] = intern(fields[0]);
+
+    albums_.artist_id[slot]   = intern(member(fields[1], "id"));
+    albums_.artist_name[slot] = intern(member(fields[1], "name"));
+
+    intern_ids(fields[2], albums_.tracks[slot]);
+  }
+
+  void catalog::set_track(uint32_t slot, const std::vector<json::value>& fields)
+  {
+    tracks_.title[slot]   = title(tracks_.title[slot], fields[0]);
+    tracks_.numbers[slot] = pack(fields[1], fields[2], fields[3]);
+    tracks_.tags[slot]    = intern_tags(fields[4]);
+    tracks_.artist_id[slot]   = intern(member(fields[5], "id"));
+    tracks_.artist_name[slot] = intern(member(fields[5], "name"));
+    tracks_.album_id[slot]    = intern(member(fields[6], "id"));
+    tracks_.album_title[slot] = intern(member(fields[6], "title"));
+  }
+
+  template <typename Columns> uint32_t catalog::find_slot(const Columns& columns, uint32_t id) const
+  {
+    if ( id >= slot_of_.size() ) {
+      return string_pool::none;
+    }
+
+    auto slot = slot_of_[id];
+
+    // The key may be of another kind of record.
+    if ( slot >= columns.id.size() || columns.id[slot] != id ) {
+      return string_pool::none;
+    }
+    return slot;
+  }
+
+  template <typename Columns> uint32_t catalog::add_slot(Columns& columns, slots& kind, uint32_t id)
+  {
+    auto slot = find_slot(columns, id);
+
+    if ( slot != string_pool::none ) {
+      return slot;
+    }
+
+    if ( kind.free.empty() )
+    {
+      slot = static_cast<uint32_t>(columns.id.size());
+      columns.resize(slot + 1);
+    }
+    else
+    {
+      slot = kind.free.back();
+      kind.free.pop_back();
+    }
+
+    columns.clear(slot);
+    columns.id[slot] = id;
+
+    if ( id >= slot_of_.size() ) {
+      slot_of_.resize(std::max<size_t>(id + 1, slot_of_.size() * 2), string_pool::none);
+    }
+    slot_of_[id] = slot;
+
+    // Records are loaded in key order, most keys made later are larger.
+    auto key = strings_.get(id);
+
+    if ( kind.order.empty() || strings_.get(columns.id[kind.order.back()]) < key ) {
+      kind.order.push_back(slot);
+    }
+    else
+    {
+      auto pos = std::lower_bound(kind.order.begin(), kind.order.end(), key, [&](uint32_t s, std::string_view k)
+      {
+        return strings_.get(columns.id[s]) < k;
+      });
+      kind.order.insert(pos, slot);
+    }
+    return slot;
+  }
+
+  template <typename Columns> void catalog::remove_slot(Columns& columns, slots& kind, uint32_t id)
+  {
+    auto slot = find_slot(columns, id);
+
+    if ( slot == string_pool::none ) {
+      return;
+    }
+
+    auto key = strings_.get(id);
+
+    auto pos = std::lower_bound(kind.order.begin(), kind.order.end(), key, [&](uint32_t s, std::string_view k)
+    {
+      return strings_.get(columns.id[s]) < k;
+    });
+
+    kind.order.erase(pos);
+    slot_of_[id] = string_pool::none;
+    kind.free.push_back(slot);
+
+    columns.clear(slot);
+  }
+
+  uint32_t catalog::intern(const json::value& value)
+  {
+    return value.is_string() ? strings_.intern(value.as_string()) : string_pool::none;
+  }
+
+  uint32_t catalog::title(uint32_t current, const json::value& value)
+  {
+    if ( !value.is_string() ) {
+      return string_pool::none;
+    }
+
+    // Records are written again by every scan, mostly unchanged.
+    if ( current != string_pool::none && strings_.get(current) == value.as_string() ) {
+      return current;
+    }
+    return strings_.add(value.as_string());
+  }
+
+  void catalog::intern_ids(const json::value& value, std::vector<uint32_t>& ids)
+  {
+    ids.clear();
+
+    if ( !value.is_array() ) {
+      return;
+    }
+
+    for ( auto& id : value.as_array() )
+    {
+      if ( id.is_string() ) {
+        ids.push_back(strings_.intern(id.as_string()));
+      }
+    }
+    ids.shrink_to_fit();
+  }
+
+  uint32_t catalog::intern_tags(const json::value& value)
+  {
+    std::vector<uint32_t> set;
+
+    if ( value.is_array() )
+    {
+      for ( auto& tag : value.as_array() )
+      {
+        if ( tag.is_string() ) {
+          set.push_back(strings_.intern(tag.as_string()));
+        }
+      }
+    }
+
+    if ( set.empty() ) {
+      return 0;
+    }
+
+    auto it = tag_set_index_.find(set);
+
+    if ( it != tag_set_index_.end() ) {
+      return it->second;
+    }
+
+    auto ordinal = static_cast<uint32_t>(tag_sets_.size());
+
+    tag_sets_.push_back(set);
+    tag_set_index_.emplace(std::move(set), ordinal);
+
+    return ordinal;
+  }
+
+  // Duration in seconds in the upper 16 bits, disc number in 6 bits and
+  // track number in the lower 10. Larger numbers are clamped.
+  uint32_t catalog::pack(const json::value& tn, const json::value& dn, const json::value& duration)
+  {
+    return number(duration, 0xffff) << 16 | number(dn, 0x3f) << 10 | number(tn, 0x3ff);
+  }
+
+  json::value catalog::string(uint32_t ordinal) const
+  {
+    if ( ordinal == string_pool::none ) {
+      return json::value();
+    }
+    return std::string(strings_.get(ordinal));
+  }
+
+  json::value catalog::ref(uint32_t id, const char* name, uint32_t text) const
+  {
+    if ( id == string_pool::none ) {
+      return json::value();
+    }
+    return json::object{ { "id", string(id) }, { name, string(text) } };
+  }
+
+  json::array catalog::ids(const std::vector<uint32_t>& ids) const
+  {
+    json::array result;
+
+    for ( auto id : ids ) {
+      result.push_back(string(id));
+    }
+    return result;
+  }
+
+  json::object catalog::artist_json(uint32_t slot) const
+  {
+    return json::object{
+      { "id",     string(artists_.id[slot]) },
+      { "name",   string(artists_.name[slot]) },
+      { "albums", ids(artists_.albums[slot]) }
+    };
+  }
+
+  json::object catalog::album_json(uint32_t slot) const
+  {
+    return json::object{
+      { "id",     string(albums_.id[slot]) },
+      { "title",  string(albums_.title[slot]) },
+      { "artist", ref(albums_.artist_id[slot], "name", albums_.artist_name[slot]) },
+      { "tracks", ids(albums_.tracks[slot]) }
+    };
+  }
+
+  json::object catalog::track_json(uint32_t slot) const
+  {
+    auto result = index_track_json(slot);
+
+    result["artist"] = ref(tracks_.artist_id[slot], "name", tracks_.artist_name[slot]);
+    result["album"]  = ref(tracks_.album_id[slot], "title", tracks_.album_title[slot]);
+
+    return result;
+  }
+
+  json::object catalog::index_track_json(uint32_t slot) const
+  {
+    auto numbers = tracks_.numbers[slot];
+
+    return json::object{
+      { "id",       string(tracks_.id[slot]) },
+      { "title",    string(tracks_.title[slot]) },
+      { "tn",       numbers & 0x3ff },
+      { "dn",       numbers >> 10 & 0x3f },
+      { "duration", numbers >> 16 },
+      { "tags",     ids(tag_sets_[tracks_.tags[slot]]) }
+    };
+  }
+}
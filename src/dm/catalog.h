@@ -0,0 +1,265 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : catalog.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Artists, albums and tracks kept in memory, for listings and queries
+//   that would otherwise decode every record. Loaded when it is made and
+//   kept up to date with each commit to the store, so readers see whole
+//   commits.
+//
+//   Each kind of record is kept as columns, one value per record, by slot.
+//   Ids, names and titles are 32 bit ordinals in a string pool. Names of
+//   artists, titles of albums and tags are interned, so they are stored
+//   once however many tracks have them. The tags of a track are interned
+//   as a set, and its track, disc number and duration packed in 32 bits.
+//   Slots of removed records are used again.
+//
+//   Only the members listed are kept, the full records are in the store:
+//
+//     artist: id, name, albums
+//     album:  id, title, artist, tracks
+//     track:  id, title, tn, dn, duration, tags, artist, album
+//
+//   Strings of removed records and changed titles are left in the pool.
+//   When the catalog is saved and they are a quarter of it, the pool is
+//   made again from the strings in use and the columns renumbered.
+//
+//   The catalog is saved to its file after scans and imports, and when it
+//   is loaded from the records. When the catalog is made it is loaded
+//   from the file if it is valid, instead of the records: the file is
+//   mapped, its checksum checked, and the columns copied from it, while
+//   the strings are left in the mapped file. Commits made since the file
+//   was written are applied from the change log. If the log no longer has
+//   them, the file is not valid, or was written from another database,
+//   the records are loaded.
+//
+//   The file is a header, a magic string and 64 bit words for the version,
+//   a hash of the token of the store, see kvstore::token, the last change
+//   applied, the size and checksum of the rest, followed by the string
+//   pool, the columns, slots and tag sets. Each is an array of bytes or 32
+//   bit values, its length in a 64 bit word, padded to 8 bytes. There are
+//   no pointers in it, it is read wherever it is mapped. Words are in the
+//   byte order of the host.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__catalog_h__
+#define __dm__catalog_h__
+
+// ----------------------------------------------------------------------------
+#include "kvstore.h"
+#include "string_pool.h"
+
+// ----------------------------------------------------------------------------
+#include <map>
+#include <vector>
+#include <shared_mutex>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class catalog
+  {
+  public:
+    struct statistics
+    {
+      size_t artists;
+      size_t albums;
+      size_t tracks;
+      size_t strings;
+      size_t tag_sets;
+      // Bytes taken by the columns, strings and indexes, and per 10000
+      // tracks.
+      size_t size;
+      size_t size_per_10k_tracks;
+      // True if loaded from the file, and the seconds loading took.
+      bool   from_file;
+      double load_time;
+    };
+  public:
+    // Without a filename the catalog is not saved.
+    catalog(kvstore& store, const std::string& filename = std::string());
+  public:
+    ~catalog();
+  public:
+    // All artists, albums or tracks in key order, as the listed members of
+    // their records.
+    json::array artists() const;
+    json::array albums() const;
+    json::array tracks() const;
+    // Tracks of the album, in the order of the album. Null if there is no
+    // such album.
+    json::value album_tracks(const std::string& album_id) const;
+    // Artists with their albums, and the tracks of each album, as db/index
+    // gives them. Artists without albums are left out.
+    json::array index() const;
+  public:
+    std::vector<std::string> track_ids() const;
+    std::vector<std::string> track_ids_by_tag(const std::string& tag) const;
+    // Tracks with the text in their title, or in the name of their artist
+    // or title of their album, ignoring case. At most limit of them, in key
+    // order.
+    json::array search(const std::string& text, size_t limit) const;
+  public:
+    statistics stats() const;
+  public:
+    // Write the catalog to its file, compacting the string pool first if
+    // enough of it is unused. Throws std::runtime_error if it cannot be
+    // written.
+    void save();
+  private:
+    struct artist_columns
+    {
+      std::vector<uint32_t>              id;
+      std::vector<uint32_t>              name;
+      std::vector<std::vector<uint32_t>> albums;
+
+      void resize(size_t n)
+      {
+        id.resize(n); name.resize(n); albums.resize(n);
+      }
+
+      void clear(uint32_t slot)
+      {
+        id[slot] = name[slot] = string_pool::none;
+        std::vector<uint32_t>().swap(albums[slot]);
+      }
+    };
+
+    struct album_columns
+    {
+      std::vector<uint32_t>              id;
+      std::vector<uint32_t>              title;
+      std::vector<uint32_t>              artist_id;
+      std::vector<uint32_t>              artist_name;
+      std::vector<std::vector<uint32_t>> tracks;
+
+      void resize(size_t n)
+      {
+        id.resize(n); title.resize(n); artist_id.resize(n); artist_name.resize(n); tracks.resize(n);
+      }
+
+      void clear(uint32_t slot)
+      {
+        id[slot] = title[slot] = artist_id[slot] = artist_name[slot] = string_pool::none;
+        std::vector<uint32_t>().swap(tracks[slot]);
+      }
+    };
+
+    struct track_columns
+    {
+      std::vector<uint32_t>              id;
+      std::vector<uint32_t>              title;
+      // Track number, disc number and duration, see pack.
+      std::vector<uint32_t>              numbers;
+      std::vector<uint32_t>              tags;
+      std::vector<uint32_t>              artist_id;
+      std::vector<uint32_t>              artist_name;
+      std::vector<uint32_t>              album_id;
+      std::vector<uint32_t>              album_title;
+
+      void resize(size_t n)
+      {
+        id.resize(n); title.resize(n); numbers.resize(n); tags.resize(n);
+        artist_id.resize(n); artist_name.resize(n); album_id.resize(n); album_title.resize(n);
+      }
+
+      void clear(uint32_t slot)
+      {
+        id[slot] = title[slot] = string_pool::none;
+        artist_id[slot] = artist_name[slot] = album_id[slot] = album_title[slot] = string_pool::none;
+        numbers[slot] = tags[slot] = 0;
+      }
+    };
+
+    // Slots in key order and free slots, of one kind of record.
+    struct slots
+    {
+      std::vector<uint32_t> order;
+      std::vector<uint32_t> free;
+    };
+  private:
+    void load();
+    void apply(const std::vector<kvstore::change>& changes);
+    // Records written by the changes, null if removed or not a kind kept.
+    std::vector<json::value> read_values(const std::vector<kvstore::change>& changes);
+  private:
+    // Called with the lock held.
+    void apply(const std::vector<kvstore::change>& changes, const std::vector<json::value>& values);
+    void write_file() const;
+    // Returns false, with the catalog empty, if the file is not used.
+    bool load_file(size_t& replayed);
+    // Throws std::runtime_error unless the loaded columns refer to strings,
+    // slots and tag sets that exist.
+    void validate() const;
+    void clear();
+    // Make the string pool again from the strings in use, and the tag sets
+    // from those in use, if enough of the pool is not.
+    void compact();
+  private:
+    // Called with the lock held.
+    void set(const std::string& key, const json::value& value);
+    void remove(const std::string& key);
+    // Fields are the members listed for the kind of record, in order.
+    void set_artist(uint32_t slot, const std::vector<json::value>& fields);
+    void set_album(uint32_t slot, const std::vector<json::value>& fields);
+    void set_track(uint32_t slot, const std::vector<json::value>& fields);
+  private:
+    // Slot of the record with the key interned as id, none if there is
+    // no such record.
+    template <typename Columns> uint32_t find_slot(const Columns& columns, uint32_t id) const;
+    // Slot of id, a new one at the end of the columns or a free one if
+    // there is none.
+    template <typename Columns> uint32_t add_slot(Columns& columns, slots& kind, uint32_t id);
+    template <typename Columns> void remove_slot(Columns& columns, slots& kind, uint32_t id);
+  private:
+    uint32_t intern(const json::value& value);
+    // Ordinal of the title of the record, kept if it did not change.
+    uint32_t title(uint32_t current, const json::value& value);
+    void     intern_ids(const json::value& value, std::vector<uint32_t>& ids);
+    uint32_t intern_tags(const json::value& value);
+  private:
+    static uint32_t pack(const json::value& tn, const json::value& dn, const json::value& duration);
+  private:
+    json::value string(uint32_t ordinal) const;
+    json::value ref(uint32_t id, const char* name, uint32_t text) const;
+    json::array ids(const std::vector<uint32_t>& ids) const;
+    json::object artist_json(uint32_t slot) const;
+    json::object album_json(uint32_t slot) const;
+    json::object track_json(uint32_t slot) const;
+    json::object index_track_json(uint32_t slot) const;
+  private:
+    using tag_set_map = std::map<std::vector<uint32_t>, uint32_t>;
+  private:
+    kvstore&                           store_;
+    std::string                        filename_;
+    unsigned                           subscription_;
+    // Hash of the token of the store, written to the file.
+    uint64_t                           store_id_;
+    mutable std::shared_mutex          mutex_;
+    string_pool                        strings_;
+    artist_columns                     artists_;
+    album_columns                      albums_;
+    track_columns                      tracks_;
+    slots                              artist_slots_;
+    slots                              album_slots_;
+    slots                              track_slots_;
+    // Slot of each record by the ordinal of its key, none if there is no
+    // record. Keys of the kinds of records differ by their prefix.
+    std::vector<uint32_t>              slot_of_;
+    // Tag sets by ordinal, the empty set is 0.
+    std::vector<std::vector<uint32_t>> tag_sets_;
+    tag_set_map                        tag_set_index_;
+    // Number of the last change applied.
+    uint64_t                           change_;
+    bool                               from_file_;
+    double                             load_time_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__catalog_h__
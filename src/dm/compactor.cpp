@@ -0,0 +1,150 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : compactor.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "compactor.h"
+
+// ----------------------------------------------------------------------------
+#include <iostream>
+#include <algorithm>
+#include <exception>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  compactor::compactor(kvstore& store)
+    :
+    compactor(store, settings())
+  {
+  }
+
+  compactor::compactor(kvstore& store, const settings& config)
+    :
+    store_(store),
+    settings_(config),
+    stop_(false),
+    stats_(),
+    first_pass_(true),
+    pass_change_(0),
+    pass_steps_(0),
+    done_steps_(0),
+    next_checkpoint_(std::chrono::steady_clock::now() + config.checkpoint_interval)
+  {
+    stats_.size = store_.size();
+    thread_ = std::thread(&compactor::run, this);
+  }
+
+  compactor::~compactor()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    stopped_.notify_all();
+    thread_.join();
+  }
+
+  compactor::statistics compactor::stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  void compactor::run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while ( !stopped_.wait_for(lock, settings_.pause, [this]() { return stop_; }) )
+    {
+      lock.unlock();
+
+      // An error must not end compaction for good, the next slice tries
+      // again.
+      try
+      {
+        slice();
+      }
+      catch ( std::exception& e )
+      {
+        std::cerr << "compactor error " << e.what() << std::endl;
+      }
+
+      lock.lock();
+    }
+  }
+
+  void compactor::slice()
+  {
+    auto now = std::chrono::steady_clock::now();
+
+    if ( now >= next_checkpoint_ )
+    {
+      // Tried again after the next slice if a transaction is active.
+      if ( store_.checkpoint() )
+      {
+        next_checkpoint_ = now + settings_.checkpoint_interval;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.checkpoints++;
+      }
+    }
+
+    if ( pass_steps_ == 0 )
+    {
+      auto last_change = store_.last_change();
+
+      if ( !first_pass_ && last_change - pass_change_ < settings_.changes_per_pass ) {
+        return;
+      }
+
+      first_pass_  = false;
+      pass_change_ = last_change;
+      pass_steps_  = std::max<int64_t>(store_.count(), 1);
+      done_steps_  = 0;
+
+      auto size = store_.size();
+
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      stats_.running         = true;
+      stats_.progress        = 0;
+      stats_.size            = size;
+      stats_.pass_start_size = size;
+    }
+
+    auto steps = store_.defrag(settings_.slice, settings_.steps);
+
+    if ( steps == 0 ) {
+      return;
+    }
+
+    done_steps_ += steps;
+
+    auto size = store_.size();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    stats_.slices++;
+    stats_.size = size;
+
+    if ( done_steps_ < pass_steps_ )
+    {
+      stats_.progress = double(done_steps_) / pass_steps_;
+      return;
+    }
+
+    stats_.running   = false;
+    stats_.progress  = 1;
+    stats_.passes++;
+    stats_.reclaimed += std::max<int64_t>(stats_.pass_start_size - size, 0);
+
+    pass_steps_ = 0;
+  }
+}
@@ -0,0 +1,92 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : compactor.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Keeps the database file compact and checkpointed, on a thread of its
+//   own. Removed and rewritten records leave free space behind, it is
+//   defragged in short slices of time with pauses in between, so neither
+//   rpc clients nor the player wait on it for long.
+//
+//   A pass goes once over the records. One is made when the store is
+//   opened, and again after every changes_per_pass changes to the records.
+//   How far a pass has come is estimated from the number of records.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__compactor_h__
+#define __dm__compactor_h__
+
+// ----------------------------------------------------------------------------
+#include "kvstore.h"
+
+// ----------------------------------------------------------------------------
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class compactor
+  {
+  public:
+    struct settings
+    {
+      // Time spent defragging at a time, and the pause after it.
+      std::chrono::milliseconds slice{5};
+      std::chrono::milliseconds pause{45};
+      // Records defragged by each call to the storage engine.
+      int64_t                   steps{64};
+      // Changes to the records that start another pass.
+      uint64_t                  changes_per_pass{10000};
+      // Time between checkpoints of the store.
+      std::chrono::milliseconds checkpoint_interval{10000};
+    };
+  public:
+    struct statistics
+    {
+      // True while a pass is being made, progress of it from 0 to 1.
+      bool     running;
+      double   progress;
+      uint64_t passes;
+      uint64_t slices;
+      uint64_t checkpoints;
+      // Bytes taken by the records now and when the last pass started, and
+      // the bytes given back by all passes.
+      int64_t  size;
+      int64_t  pass_start_size;
+      int64_t  reclaimed;
+    };
+  public:
+    compactor(kvstore& store);
+    compactor(kvstore& store, const settings& config);
+  public:
+    ~compactor();
+  public:
+    statistics stats() const;
+  private:
+    void run();
+    void slice();
+  private:
+    kvstore&                              store_;
+    settings                              settings_;
+    mutable std::mutex                    mutex_;
+    std::condition_variable               stopped_;
+    bool                                  stop_;
+    statistics                            stats_;
+    bool                                  first_pass_;
+    uint64_t                              pass_change_;
+    int64_t                               pass_steps_;
+    int64_t                               done_steps_;
+    std::chrono::steady_clock::time_point next_checkpoint_;
+    std::thread                           thread_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__compactor_h__
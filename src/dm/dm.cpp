@@ -12,18 +12,122 @@
 
 #include "dm.h"
 
+// ----------------------------------------------------------------------------
+#include <chrono>
+#include <iostream>
+
+// ----------------------------------------------------------------------------
+#include <sys/stat.h>
+
 // ----------------------------------------------------------------------------
 namespace dm
 {
-  std::unique_ptr<kvstore> kvstore_;
+  std::unique_ptr<kvstore>    kvstore_;
+  std::unique_ptr<blob_store> covers_;
+  // Destroyed before the stores, so queued thumbnails are made before they close.
+  std::unique_ptr<work_queue> thumbnails_;
+  std::unique_ptr<compactor>  compactor_;
+  std::unique_ptr<catalog>    catalog_;
+  double                      open_time_;
+
+  static bool file_exists(const std::string& filename)
+  {
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0;
+  }
 
-  void init()
+  void init(kvstore::durability durability, storage_engine::type engine, bool journal)
   {
-    kvstore_.reset(new kvstore("mboxd.kdb"));
+    auto filename = engine == storage_engine::type::lmdb ? "mboxd.mdb" : "mboxd.kct";
+
+    // Records used to be kept in a hash database. It is copied once to the
+    // ordered database and left as it was.
+    bool import = !file_exists(filename) && file_exists("mboxd.kdb");
+
+    // Includes recovering the file after a crash.
+    auto start = std::chrono::steady_clock::now();
+
+    kvstore_.reset(new kvstore(filename, durability, engine, journal));
+
+    open_time_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if ( import ) {
+      kvstore_->import("mboxd.kdb");
+    }
 
+    compactor_.reset(new compactor(*kvstore_));
+    catalog_.reset(new catalog(*kvstore_, "mboxd.catalog"));
+
+    covers_.reset(new blob_store("mboxd.covers"));
+    thumbnails_.reset(new work_queue);
+
+    dm::album_cover::init(covers_.get(), thumbnails_.get());
     dm::artist::init(kvstore_.get());
     dm::album::init(kvstore_.get());
     dm::track::init(kvstore_.get());
     dm::source_local::init(kvstore_.get());
   }
+
+  kvstore::transaction transaction()
+  {
+    return kvstore::transaction(*kvstore_);
+  }
+
+  record_cache::statistics cache_stats()
+  {
+    return kvstore_->cache_stats();
+  }
+
+  blob_store::statistics cover_stats()
+  {
+    return covers_->stats();
+  }
+
+  const catalog& get_catalog()
+  {
+    return *catalog_;
+  }
+
+  void save_catalog()
+  {
+    // The catalog is loaded from the records if it is not saved.
+    try
+    {
+      catalog_->save();
+    }
+    catch ( std::exception& e )
+    {
+      std::cerr << "catalog save error " << e.what() << std::endl;
+    }
+  }
+
+  compactor::statistics compaction_stats()
+  {
+    return compactor_->stats();
+  }
+
+  double open_time()
+  {
+    return open_time_;
+  }
+
+  bool changes(uint64_t since, size_t limit, bool values, std::vector<kvstore::change>& result)
+  {
+    return kvstore_->changes(since, limit, values, result);
+  }
+
+  uint64_t last_change()
+  {
+    return kvstore_->last_change();
+  }
+
+  size_t migrate()
+  {
+    auto converted = kvstore_->migrate();
+
+    // Covers saved before thumbnails were made get them in the background.
+    dm::album_cover::make_missing_thumbnails();
+
+    return converted;
+  }
 }
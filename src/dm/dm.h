@@ -14,6 +14,8 @@
 
 // ----------------------------------------------------------------------------
 #include "kvstore.h"
+#include "compactor.h"
+#include "catalog.h"
 #include "artist.h"
 #include "album.h"
 #include "track.h"
@@ -22,7 +24,31 @@
 // ----------------------------------------------------------------------------
 namespace dm
 {
-  void init();
+  void init(kvstore::durability durability = kvstore::durability::soft,
+            storage_engine::type engine = storage_engine::type::kyoto,
+            bool journal = false);
+  // Group the writes made while the transaction is alive into one commit.
+  kvstore::transaction transaction();
+  // Counters of the record cache.
+  record_cache::statistics cache_stats();
+  // Counters of the cache of cover images.
+  blob_store::statistics cover_stats();
+  // Artists, albums and tracks in memory, for listings and queries.
+  const catalog& get_catalog();
+  // Save the catalog, so the next start loads it rather than the records.
+  void save_catalog();
+  // Compaction and checkpoints of the database file.
+  compactor::statistics compaction_stats();
+  // Seconds it took to open the database, recovering it after a crash
+  // included.
+  double open_time();
+  // Changes to the records after since, see kvstore::changes.
+  bool changes(uint64_t since, size_t limit, bool values, std::vector<kvstore::change>& result);
+  uint64_t last_change();
+  // Convert records stored by earlier versions to the current encoding.
+  // Can run while the database is in use. Returns the number of records
+  // converted.
+  size_t migrate();
 }
 
 // ----------------------------------------------------------------------------
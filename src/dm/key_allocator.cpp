@@ -0,0 +1,64 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : key_allocator.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "key_allocator.h"
+
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <stdexcept>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  key_allocator::key_allocator(int64_t mark, reserve_func reserve, int64_t batch)
+    :
+    reserve_(reserve),
+    batch_(std::max<int64_t>(1, batch)),
+    next_(mark + 1),
+    end_(mark)
+  {
+  }
+
+  int64_t key_allocator::next()
+  {
+    auto key = next_.fetch_add(1);
+
+    if ( key <= end_.load() ) {
+      return key;
+    }
+
+    // Threads running past the end at the same time each reserve a range.
+    // The ranges follow each other, so the end is the last mark returned.
+    while ( key > end_.load() )
+    {
+      auto end  = end_.load();
+      auto mark = reserve_(batch_);
+
+      if ( mark <= end || (mark - end) % batch_ != 0 ) {
+        throw std::runtime_error("key counter changed");
+      }
+
+      while ( end < mark && !end_.compare_exchange_weak(end, mark) ) {
+      }
+    }
+    return key;
+  }
+
+  int64_t key_allocator::reserved() const
+  {
+    return end_.load();
+  }
+
+  int64_t key_allocator::unused() const
+  {
+    return std::max<int64_t>(0, end_.load() - next_.load() + 1);
+  }
+}
@@ -0,0 +1,57 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : key_allocator.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Hands out increasing numbers from ranges reserved in one step. Reserving
+//   stores the new high-water mark, the last number of the range, before
+//   any number in it is handed out. After a crash counting starts over from
+//   the stored mark, so a number is never handed out twice, at the cost of
+//   a gap of at most one range.
+//
+//   Numbers are taken from the current range with an atomic increment,
+//   only threads that run past the end of it reserve another range. They
+//   do so without holding any lock, so reserving can take locks of the
+//   store that a thread taking a number may already hold.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__key_allocator_h__
+#define __dm__key_allocator_h__
+
+// ----------------------------------------------------------------------------
+#include <functional>
+#include <atomic>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class key_allocator
+  {
+  public:
+    // Add count to the stored mark and return the new mark. Can be called
+    // by several threads at once.
+    using reserve_func = std::function<int64_t(int64_t count)>;
+  public:
+    // The first number handed out is mark + 1.
+    key_allocator(int64_t mark, reserve_func reserve, int64_t batch = 256);
+  public:
+    int64_t next();
+  public:
+    // Last number of the reserved ranges.
+    int64_t reserved() const;
+    // Numbers reserved, but not handed out.
+    int64_t unused() const;
+  private:
+    reserve_func         reserve_;
+    int64_t              batch_;
+    std::atomic<int64_t> next_;
+    std::atomic<int64_t> end_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__key_allocator_h__
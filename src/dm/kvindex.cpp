@@ -0,0 +1,156 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : kvindex.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "kvindex.h"
+
+// ----------------------------------------------------------------------------
+#include <stdexcept>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  const std::string token_key = "__token__";
+  const std::string clean_key = "__clean__";
+  const std::string built_key = "__built__/";
+
+  kvindex::kvindex(std::unique_ptr<storage_engine> db, const std::string& token)
+    :
+    db_(std::move(db))
+  {
+    std::string stored_token;
+    std::string clean;
+
+    bool valid =
+      db_->get(token_key, &stored_token) && stored_token == token &&
+      db_->get(clean_key, &clean) && clean == "1";
+
+    if ( !valid )
+    {
+      db_->clear();
+      db_->set(token_key, token);
+    }
+
+    // Until closed, a crash may leave the index behind the records.
+    db_->remove(clean_key);
+    db_->synchronize();
+  }
+
+  kvindex::~kvindex()
+  {
+    db_->set(clean_key, "1");
+  }
+
+  bool kvindex::is_built(const std::string& index, unsigned version)
+  {
+    std::string value;
+    return db_->get(built_key+index, &value) && value == std::to_string(version);
+  }
+
+  void kvindex::set_built(const std::string& index, unsigned version)
+  {
+    db_->set(built_key+index, std::to_string(version));
+  }
+
+  void kvindex::clear(const std::string& index)
+  {
+    auto prefix = index + '\0';
+    auto cur    = db_->make_cursor();
+
+    cur->jump(prefix);
+
+    std::string              ckey;
+    std::vector<std::string> keys;
+
+    while ( cur->get_key(&ckey, true) && ckey.compare(0, prefix.length(), prefix) == 0 ) {
+      keys.push_back(ckey);
+    }
+
+    cur.reset();
+
+    for ( auto& key : keys ) {
+      db_->remove(key);
+    }
+
+    db_->remove(built_key+index);
+  }
+
+  bool kvindex::add(const std::string& index, const std::string& value, const std::string& key)
+  {
+    return db_->set(entry_prefix(index, value)+key, "");
+  }
+
+  bool kvindex::remove(const std::string& index, const std::string& value, const std::string& key)
+  {
+    return db_->remove(entry_prefix(index, value)+key);
+  }
+
+  std::vector<std::string> kvindex::find(const std::string& index, const std::string& value)
+  {
+    std::vector<std::string> result;
+
+    auto prefix = entry_prefix(index, value);
+    auto cur    = db_->make_cursor();
+
+    cur->jump(prefix);
+
+    std::string ckey;
+
+    while ( cur->get_key(&ckey, true) && ckey.compare(0, prefix.length(), prefix) == 0 ) {
+      result.push_back(ckey.substr(prefix.length()));
+    }
+
+    return result;
+  }
+
+  void kvindex::begin()
+  {
+    if ( !db_->begin_transaction() ) {
+      throw std::runtime_error("kvindex begin transaction error");
+    }
+  }
+
+  void kvindex::commit()
+  {
+    db_->end_transaction(true);
+  }
+
+  void kvindex::abort()
+  {
+    db_->end_transaction(false);
+  }
+
+  // Entries are index \0 value \0 key. A nul or \1 in the value is escaped,
+  // so the prefix of one value is never the prefix of another.
+  std::string kvindex::entry_prefix(const std::string& index, const std::string& value)
+  {
+    std::string prefix;
+
+    prefix.reserve(index.length()+value.length()+2);
+    prefix.append(index);
+    prefix.push_back('\0');
+
+    for ( auto c : value )
+    {
+      if ( c == '\0' ) {
+        prefix.append("\1\1", 2);
+      }
+      else if ( c == '\1' ) {
+        prefix.append("\1\2", 2);
+      }
+      else {
+        prefix.push_back(c);
+      }
+    }
+    prefix.push_back('\0');
+
+    return prefix;
+  }
+}
@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : kvindex.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Persistent secondary indexes of the kvstore records. Each entry maps a
+//   value of an index to the key of a record, several records can have the
+//   same value. Entries are kept in a b+ tree ordered by index, value and
+//   key, so the keys for a value are found with a single range lookup.
+//
+//   The index file belongs to one record database, identified by a token
+//   stored in both. If the token does not match, or the index was not
+//   closed cleanly, it is cleared and every index must be built again. An
+//   index is also built again when the version of its definition changes.
+//
+//   Entries are kept in a storage engine of the same type as the records.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__kvindex_h__
+#define __dm__kvindex_h__
+
+// ----------------------------------------------------------------------------
+#include "storage_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class kvindex
+  {
+  public:
+    kvindex(std::unique_ptr<storage_engine> db, const std::string& token);
+  public:
+    ~kvindex();
+  public:
+    // True if the index has been built, with the given version of its
+    // definition, since the index file was last cleared.
+    bool is_built(const std::string& index, unsigned version);
+    void set_built(const std::string& index, unsigned version);
+  public:
+    // Remove every entry of index.
+    void clear(const std::string& index);
+  public:
+    bool add(const std::string& index, const std::string& value, const std::string& key);
+    bool remove(const std::string& index, const std::string& value, const std::string& key);
+  public:
+    // Keys of the records with value in index, in key order.
+    std::vector<std::string> find(const std::string& index, const std::string& value);
+  public:
+    // Group updates so they are applied all or nothing.
+    void begin();
+    void commit();
+    void abort();
+  private:
+    static std::string entry_prefix(const std::string& index, const std::string& value);
+  private:
+    std::unique_ptr<storage_engine> db_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__kvindex_h__
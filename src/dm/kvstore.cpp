@@ -11,8 +11,22 @@
 // ----------------------------------------------------------------------------
 #include "kvstore.h"
 
+// ----------------------------------------------------------------------------
+#include <kchashdb.h>
+
 // ----------------------------------------------------------------------------
 #include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <random>
+#include <algorithm>
+#include <set>
+#include <map>
+#include <thread>
+#include <condition_variable>
+#include <exception>
 
 // ----------------------------------------------------------------------------
 namespace dm
@@ -72,120 +86,1256 @@ namespace dm
     return result;
   }
 
-  kvstore::kvstore(const std::string filename)
+  // Table of interned member names used by the binary records.
+  const std::string keys_key = "__keys__";
+  // Ties the index file to this database.
+  const std::string index_token_key = "__index_token__";
+
+  // Encoded size of the records held by the record cache.
+  const size_t cache_capacity = 32*1024*1024;
+  // Keys reserved by each increment of a key counter.
+  const int64_t key_batch = 256;
+  // Changes are logged with keys of the prefix and the number of the
+  // change, as fixed width hex, so they are kept in order.
+  const std::string changes_prefix = "__changes/";
+  // Changes kept in the log. Older changes are removed a batch at a time.
+  const uint64_t change_log_size  = 100000;
+  const uint64_t change_log_slack = 1000;
+
+  static bool is_internal_key(const char* key, size_t len)
+  {
+    return len >= 2 && key[0] == '_' && key[1] == '_';
+  }
+
+  static std::string change_key(uint64_t seq)
   {
-    using namespace kyotocabinet;
+    char buf[17];
+
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(seq));
+
+    return changes_prefix + buf;
+  }
+
+  static uint64_t change_seq(const std::string& key)
+  {
+    return strtoull(key.c_str() + changes_prefix.length(), nullptr, 16);
+  }
+
+  static std::string new_token()
+  {
+    std::random_device rd;
+    std::string        token;
+
+    for ( int i = 0; i < 4; ++i ) {
+      token += base62_encode(rd());
+    }
+    return token;
+  }
+
+  kvstore::transaction::transaction(kvstore& store)
+    :
+    store_(store),
+    lock_(store.write_mutex_),
+    done_(false)
+  {
+    store_.begin();
+  }
+
+  kvstore::transaction::~transaction()
+  {
+    if ( !done_ ) {
+      store_.end(false);
+    }
+  }
+
+  void kvstore::transaction::commit()
+  {
+    if ( done_ ) {
+      throw std::runtime_error("kvstore transaction already ended");
+    }
+
+    done_ = true;
+    store_.end(true);
+  }
+
+  // Snapshots pinned by the calling thread, outermost first.
+  static thread_local std::vector<kvstore::snapshot*> pinned_snapshots;
 
-    if (!db_.open(filename, HashDB::OWRITER | HashDB::OCREATE)) {
-      throw std::runtime_error("kvstore open error");
+  kvstore::snapshot::snapshot(kvstore& store)
+    :
+    store_(store),
+    change_(0)
+  {
+    auto outer = store_.pinned_snapshot();
+
+    if ( !outer )
+    {
+      // Taken first, so the changes up to it are seen.
+      change_      = store_.committed_change_.load();
+      db_snapshot_ = store_.db_->make_snapshot();
+
+      if ( !db_snapshot_ ) {
+        throw std::runtime_error("kvstore snapshot error");
+      }
+    }
+    else
+    {
+      for ( auto pinned : pinned_snapshots )
+      {
+        if ( &pinned->store_ == &store_ && pinned->db_snapshot_ ) {
+          change_ = pinned->change_;
+        }
+      }
     }
 
+    pinned_snapshots.push_back(this);
+  }
+
+  kvstore::snapshot::~snapshot()
+  {
+    pinned_snapshots.erase(std::find(pinned_snapshots.begin(), pinned_snapshots.end(), this));
+  }
+
+  kvstore::kvstore(const std::string filename, durability level, storage_engine::type engine, bool journal)
+    :
+    db_(storage_engine::open(engine, filename, journal)),
+    filename_(filename),
+    engine_(engine),
+    journal_(journal),
+    cache_(cache_capacity),
+    durability_(level),
+    depth_(0),
+    rollback_(false),
+    artist_keys_{ "__artist_key__", nullptr },
+    album_keys_{ "__album_key__", nullptr },
+    track_keys_{ "__track_key__", nullptr },
+    first_change_(1),
+    last_change_(0),
+    committed_change_(0),
+    next_subscriber_(1)
+  {
     if ( count() == 0 )
     {
-      db_.increment("__artist_key__", base62_decode("ar0000"));
-      db_.increment("__album_key__", base62_decode("al0000"));
-      db_.increment("__track_key__", base62_decode("t00000"));
+      db_->increment(artist_keys_.key, base62_decode("ar0000"));
+      db_->increment(album_keys_.key, base62_decode("al0000"));
+      db_->increment(track_keys_.key, base62_decode("t00000"));
+    }
+
+    load_key_counters();
+    load_changes();
+
+    std::string keys_s;
+
+    if ( db_->get(keys_key, &keys_s) ) {
+      codec_.keys(json::view(keys_s).to_value());
     }
+
+    // Cover images are base64 in the records.
+    codec_.binary_member("image_data");
   }
 
   kvstore::~kvstore()
   {
-    db_.close();
+    store_key_counters(true);
+    index_.reset();
   }
 
   int64_t kvstore::count()
   {
-    return db_.count();
+    return db_->count();
+  }
+
+  int64_t kvstore::size()
+  {
+    return db_->size();
+  }
+
+  bool kvstore::checkpoint()
+  {
+    std::unique_lock<std::recursive_mutex> lock(write_mutex_, std::try_to_lock);
+
+    // A transaction on this thread owns the lock as well.
+    if ( !lock.owns_lock() || depth_ > 0 ) {
+      return false;
+    }
+
+    if ( !db_->synchronize(durability_ == durability::hard) ) {
+      throw std::runtime_error("kvstore checkpoint error");
+    }
+    return true;
+  }
+
+  int64_t kvstore::defrag(std::chrono::milliseconds duration, int64_t steps)
+  {
+    std::unique_lock<std::recursive_mutex> lock(write_mutex_, std::try_to_lock);
+
+    if ( !lock.owns_lock() || depth_ > 0 ) {
+      return 0;
+    }
+
+    auto    until  = std::chrono::steady_clock::now() + duration;
+    int64_t result = 0;
+
+    do
+    {
+      if ( !db_->defrag(steps) ) {
+        throw std::runtime_error("kvstore defrag error");
+      }
+      result += steps;
+    }
+    while ( std::chrono::steady_clock::now() < until );
+
+    return result;
   }
 
   bool kvstore::set(const std::string& key, const json::value& value)
   {
-    return db_.set(key, to_string(value));
+    // The record, its index entries and its change are written together,
+    // in a transaction of their own outside of one. Rolled back if the
+    // record or its change cannot be written.
+    transaction transaction(*this);
+
+    std::string value_s;
+
+    encode(value, value_s);
+
+    bool result;
+
+    if ( !has_index(key) ) {
+      result = db_->set(key, value_s);
+    }
+    else {
+      result = write_indexed(key, value, [&]() { return db_->set(key, value_s); });
+    }
+
+    // After the write, so this thread does not read the record from the
+    // cache as it was. Erased again when the transaction commits.
+    cache_.erase(key);
+
+    if ( !result || !log_change(change_op::set, key) ) {
+      return false;
+    }
+
+    transaction.commit();
+
+    return true;
   }
 
   bool kvstore::remove(const std::string& key)
   {
-    return db_.remove(key);
+    // See set. Nothing is written if there is no such record, the
+    // transaction is committed.
+    transaction transaction(*this);
+
+    bool result;
+
+    if ( !has_index(key) ) {
+      result = db_->remove(key);
+    }
+    else {
+      result = write_indexed(key, json::value(), [&]() { return db_->remove(key); });
+    }
+
+    cache_.erase(key);
+
+    if ( result && !log_change(change_op::remove, key) ) {
+      return false;
+    }
+
+    transaction.commit();
+
+    return result;
   }
 
   json::value kvstore::get(const std::string& key)
   {
     std::string value_s;
 
-    if ( db_.get(key, &value_s) )
+    auto snapshot = pinned_snapshot();
+
+    if ( snapshot ? snapshot->get(key, &value_s) : db_->get(key, &value_s) )
+    {
+      return decode(value_s);
+    }
+    else
     {
-      json::value  value;
-      json::parser parser(value);
+      return json::value();
+    }
+  }
 
-      size_t consumed = parser.parse(value_s.c_str(), value_s.length());
+  record_cache::record_ptr kvstore::get_shared(const std::string& key)
+  {
+    // The cache has the records as they are now.
+    if ( auto snapshot = pinned_snapshot() )
+    {
+      std::string value_s;
 
-      if ( consumed < value_s.length() )
-      {
-        std::cout << "error! retrieving value" << std::endl;
+      if ( !snapshot->get(key, &value_s) ) {
+        return nullptr;
       }
+      return std::make_shared<const json::value>(decode(value_s));
+    }
+
+    uint64_t ticket;
+
+    auto record = cache_.find(key, ticket);
+
+    if ( record ) {
+      return record;
+    }
+
+    std::string value_s;
+
+    if ( !db_->get(key, &value_s) ) {
+      return nullptr;
+    }
+
+    record = std::make_shared<const json::value>(decode(value_s));
+    cache_.insert(key, record, value_s.length(), ticket);
+
+    return record;
+  }
+
+  void kvstore::each(key_match_func key_match, std::function<bool(json::value&)> value_cb)
+  {
+    scan("", key_match, [&](const std::string& key, const std::string& data) -> bool
+    {
+      json::value value = decode(data);
+      return value_cb(value);
+    });
+  }
+
+  void kvstore::each(key_match_func key_match,
+                     const std::vector<std::string>& fields,
+                     std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb)
+  {
+    each_fields("", key_match, fields, value_cb);
+  }
+
+  void kvstore::each(const std::string& prefix, std::function<bool(json::value&)> value_cb)
+  {
+    scan(prefix, nullptr, [&](const std::string& key, const std::string& data) -> bool
+    {
+      json::value value = decode(data);
+      return value_cb(value);
+    });
+  }
+
+  void kvstore::each(const std::string& prefix,
+                     const std::vector<std::string>& fields,
+                     std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb)
+  {
+    each_fields(prefix, nullptr, fields, value_cb);
+  }
+
+  void kvstore::each_fields(const std::string& prefix,
+                            key_match_func key_match,
+                            const std::vector<std::string>& fields,
+                            std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb)
+  {
+    std::vector<json::value> values;
 
-      return std::move(value);
+    scan(prefix, key_match, [&](const std::string& key, const std::string& data) -> bool
+    {
+      bool is_object;
+
+      project(data, fields, values, is_object);
+
+      return !is_object || value_cb(key, values);
+    });
+  }
+
+  void kvstore::project(const std::string& data, const std::vector<std::string>& fields, std::vector<json::value>& values, bool& is_object)
+  {
+    if ( record_codec::is_binary(data) )
+    {
+      is_object = codec_.project(data.data(), data.length(), fields, values);
     }
     else
     {
-      return json::value();
+      json::view              record(data);
+      std::vector<json::view> views;
+
+      is_object = record.is_object();
+
+      record.project(fields, views);
+      values.resize(views.size());
+
+      for ( size_t i = 0; i < views.size(); ++i ) {
+        values[i] = views[i].to_value();
+      }
     }
   }
 
-  void kvstore::each(std::function<bool(const std::string&)> key_match, std::function<bool(json::value&)> value_cb)
+  void kvstore::parallel_each(const std::string& prefix,
+                              std::function<bool(json::value&)> filter,
+                              std::function<bool(json::value&)> value_cb,
+                              order ordering)
   {
-    kyotocabinet::DB::Cursor* cur = db_.cursor();
+    parallel_scan(
+      prefix,
+      [&](const std::string& data, scan_item& item) -> bool
+      {
+        item.value = decode(data);
+        return filter(item.value);
+      },
+      [&](scan_item& item) -> bool
+      {
+        return value_cb(item.value);
+      },
+      ordering
+    );
+  }
 
-    cur->jump();
+  void kvstore::parallel_each(const std::string& prefix,
+                              const std::vector<std::string>& fields,
+                              std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb,
+                              order ordering)
+  {
+    parallel_scan(
+      prefix,
+      [&](const std::string& data, scan_item& item) -> bool
+      {
+        bool is_object;
 
-    std::string ckey;
+        project(data, fields, item.fields, is_object);
 
-    while ( cur->get_key(&ckey, false) )
-    {
-      if ( key_match(ckey) )
+        return is_object;
+      },
+      [&](scan_item& item) -> bool
       {
-        std::string cvalue;
+        return value_cb(item.key, item.fields);
+      },
+      ordering
+    );
+  }
+
+  void kvstore::parallel_scan(const std::string& prefix, produce_func produce, consume_func consume, order ordering)
+  {
+    using chunk = std::vector<scan_item>;
 
-        if ( cur->get_value(&cvalue) )
+    const size_t   chunk_size  = 256;
+    const unsigned num_workers = std::max(1u, std::thread::hardware_concurrency());
+    // Chunks decoded ahead of the calling thread.
+    const size_t   window      = 4*num_workers;
+
+    std::mutex              mutex;
+    std::condition_variable produced;
+    std::condition_variable consumed;
+    std::map<size_t, chunk> ready;
+    size_t                  next_chunk = 0;
+    size_t                  num_consumed = 0;
+    unsigned                num_done = 0;
+    bool                    at_end = false;
+    bool                    stop = false;
+    std::exception_ptr      error;
+
+    auto cur = make_cursor();
+
+    if ( prefix.empty() ) {
+      cur->jump();
+    }
+    else {
+      cur->jump(prefix);
+    }
+
+    auto worker = [&]()
+    {
+      std::vector<std::pair<std::string, std::string>> records;
+
+      try
+      {
+        for ( ;; )
         {
-          json::value  value;
-          json::parser parser(value);
+          size_t seq;
+
+          records.clear();
+
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            consumed.wait(lock, [&]() { return stop || at_end || next_chunk < num_consumed + window; });
+
+            if ( stop || at_end ) {
+              break;
+            }
+
+            seq = next_chunk++;
+
+            std::string ckey;
+            std::string cvalue;
 
-          size_t consumed = parser.parse(cvalue.c_str(), cvalue.length());
+            while ( records.size() < chunk_size )
+            {
+              if ( !cur->get(&ckey, &cvalue, true) || ckey.compare(0, prefix.length(), prefix) != 0 )
+              {
+                at_end = true;
+                break;
+              }
+              records.emplace_back(std::move(ckey), std::move(cvalue));
+            }
+          }
+
+          chunk items;
+
+          items.reserve(records.size());
+
+          for ( auto& record : records )
+          {
+            scan_item item;
+
+            item.key = std::move(record.first);
+
+            if ( produce(record.second, item) ) {
+              items.push_back(std::move(item));
+            }
+          }
 
-          if ( consumed < cvalue.length() )
           {
-            std::cout << "error! retrieving value" << std::endl;
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.emplace(seq, std::move(items));
+          }
+          produced.notify_all();
+        }
+      }
+      catch ( ... )
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if ( !error ) {
+          error = std::current_exception();
+        }
+        stop = true;
+        consumed.notify_all();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        num_done++;
+      }
+      produced.notify_all();
+    };
+
+    std::vector<std::thread> workers;
+
+    for ( unsigned i = 0; i < num_workers; ++i ) {
+      workers.emplace_back(worker);
+    }
+
+    bool               done = false;
+    std::exception_ptr consume_error;
+
+    try
+    {
+      while ( !done )
+      {
+        chunk items;
+
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+
+          // In key order the chunks are taken by sequence number.
+          auto next = [&]() { return ordering == order::key ? ready.find(num_consumed) : ready.begin(); };
+
+          produced.wait(lock, [&]() { return error || next() != ready.end() || num_done == num_workers; });
+
+          auto it = next();
+
+          if ( error || it == ready.end() ) {
+            break;
           }
 
-          bool continue_ = value_cb(value);
+          items = std::move(it->second);
+          ready.erase(it);
+          num_consumed++;
+        }
+        consumed.notify_all();
 
-          if ( !continue_ ) {
+        for ( auto& item : items )
+        {
+          if ( !consume(item) )
+          {
+            done = true;
             break;
           }
         }
       }
-      cur->step();
+    }
+    catch ( ... )
+    {
+      consume_error = std::current_exception();
     }
 
-    delete cur;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    consumed.notify_all();
+
+    for ( auto& worker : workers ) {
+      worker.join();
+    }
+
+    if ( consume_error ) {
+      std::rethrow_exception(consume_error);
+    }
+
+    if ( error ) {
+      std::rethrow_exception(error);
+    }
   }
 
-  std::string kvstore::create_artist_key()
+  storage_engine::snapshot* kvstore::pinned_snapshot()
   {
-    auto new_key = db_.increment("__artist_key__", 1);
-    return std::move(base62_encode(new_key));
+    for ( auto pinned : pinned_snapshots )
+    {
+      if ( &pinned->store_ == this ) {
+        return pinned->db_snapshot_.get();
+      }
+    }
+    return nullptr;
   }
 
-  std::string kvstore::create_album_key()
+  std::unique_ptr<storage_engine::cursor> kvstore::make_cursor()
   {
-    auto new_key = db_.increment("__album_key__", 1);
-    return std::move(base62_encode(new_key));
+    auto snapshot = pinned_snapshot();
+
+    return snapshot ? snapshot->make_cursor() : db_->make_cursor();
   }
 
-  std::string kvstore::create_track_key()
+  void kvstore::scan(const std::string& prefix,
+                     key_match_func key_match,
+                     std::function<bool(const std::string& key, const std::string& data)> record_cb)
+  {
+    auto cur = make_cursor();
+
+    if ( prefix.empty() ) {
+      cur->jump();
+    }
+    else {
+      cur->jump(prefix);
+    }
+
+    std::string ckey;
+    std::string cvalue;
+
+    while ( cur->get_key(&ckey, false) )
+    {
+      // Keys are ordered, so the range ends at the first key without the
+      // prefix.
+      if ( ckey.compare(0, prefix.length(), prefix) != 0 ) {
+        break;
+      }
+
+      if ( !key_match || key_match(ckey) )
+      {
+        if ( cur->get_value(&cvalue) && !record_cb(ckey, cvalue) ) {
+          break;
+        }
+      }
+      cur->step();
+    }
+  }
+
+  void kvstore::index(const std::string& name, const std::string& prefix, index_func values_cb, unsigned version)
+  {
+    std::lock_guard<std::recursive_mutex> lock(write_mutex_);
+
+    if ( depth_ > 0 ) {
+      throw std::runtime_error("kvstore index defined in a transaction");
+    }
+
+    // Built from the records as they are now.
+    if ( pinned_snapshot() ) {
+      throw std::runtime_error("kvstore index defined in a snapshot");
+    }
+
+    if ( !index_ ) {
+      index_.reset(new kvindex(storage_engine::open(engine_, filename_+".idx", journal_), token()));
+    }
+
+    index_defs_.push_back(index_def{ name, prefix, values_cb });
+
+    if ( index_->is_built(name, version) ) {
+      return;
+    }
+
+    index_->begin();
+    index_->clear(name);
+
+    // Records are decoded on the pool, the entries added here.
+    parallel_scan(
+      prefix,
+      [&](const std::string& data, scan_item& item) -> bool
+      {
+        std::vector<std::string> values;
+
+        values_cb(decode(data), values);
+
+        for ( auto& value : values ) {
+          item.fields.push_back(std::move(value));
+        }
+        return !values.empty();
+      },
+      [&](scan_item& item) -> bool
+      {
+        for ( auto& value : item.fields ) {
+          index_->add(name, value.as_string(), item.key);
+        }
+        return true;
+      },
+      order::unordered
+    );
+
+    index_->set_built(name, version);
+    index_->commit();
+  }
+
+  std::string kvstore::token()
+  {
+    std::lock_guard<std::recursive_mutex> lock(write_mutex_);
+
+    std::string token;
+
+    if ( !db_->get(index_token_key, &token) )
+    {
+      token = new_token();
+
+      if ( !db_->set(index_token_key, token) ) {
+        throw std::runtime_error("kvstore token write error");
+      }
+    }
+    return token;
+  }
+
+    std::vector<std::string> kvstore::find(const std::string& index, const std::string& value)
+  {
+    if ( !index_ ) {
+      return {};
+    }
+    return index_->find(index, value);
+  }
+
+  void kvstore::begin()
+  {
+    if ( depth_++ > 0 ) {
+      return;
+    }
+
+    if ( !db_->begin_transaction(durability_ == durability::hard) )
+    {
+      depth_ = 0;
+      throw std::runtime_error("kvstore begin transaction error");
+    }
+
+    if ( index_ ) {
+      index_->begin();
+    }
+    rollback_ = false;
+  }
+
+  void kvstore::end(bool commit)
+  {
+    if ( !commit ) {
+      rollback_ = true;
+    }
+
+    if ( --depth_ > 0 ) {
+      return;
+    }
+
+    // The index is committed after the records, so it never has entries
+    // of writes that were not.
+    bool failed = false;
+
+    if ( !rollback_ )
+    {
+      if ( db_->end_transaction(true) )
+      {
+        if ( index_ ) {
+          index_->commit();
+        }
+
+        // Until the commit other readers still read the records as they
+        // were, and may have cached them since the writes.
+        for ( auto& change : pending_changes_ ) {
+          cache_.erase(change.key);
+        }
+
+        publish_changes();
+
+        std::vector<done_func> done_cbs;
+
+        done_cbs.swap(done_cbs_);
+
+        for ( auto& done_cb : done_cbs ) {
+          done_cb();
+        }
+        return;
+      }
+      failed = true;
+    }
+    else
+    {
+      db_->end_transaction(false);
+    }
+
+    // Numbers of the changes rolled back are used again.
+    pending_changes_.clear();
+    done_cbs_.clear();
+    last_change_ = committed_change_.load();
+
+    if ( index_ ) {
+      index_->abort();
+    }
+
+    // Other readers may have cached records written by the transaction.
+    cache_.clear();
+
+    // Names added during the transaction are still used by the codec.
+    db_->set(keys_key, to_string(codec_.keys()));
+
+    // Keys reserved during the transaction may have been handed out.
+    store_key_counters(false);
+
+    if ( failed ) {
+      throw std::runtime_error("kvstore commit error");
+    }
+
+    if ( commit ) {
+      throw std::runtime_error("kvstore transaction rolled back");
+    }
+  }
+
+  bool kvstore::has_index(const std::string& key)
+  {
+    for ( auto& def : index_defs_ )
+    {
+      if ( key.compare(0, def.prefix.length(), def.prefix) == 0 ) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Called in a transaction, the index entries are committed along with
+  // it. The entries removed are those of the record as it is now, not as
+  // a snapshot pinned by the writer sees it.
+  bool kvstore::write_indexed(const std::string& key, const json::value& value, std::function<bool()> write)
+  {
+    std::string current;
+
+    update_indexes(key, db_->get(key, &current) ? decode(current) : json::value(), value);
+    return write();
+  }
+
+  void kvstore::update_indexes(const std::string& key, const json::value& old_value, const json::value& new_value)
+  {
+    std::vector<std::string> old_values;
+    std::vector<std::string> new_values;
+
+    for ( auto& def : index_defs_ )
+    {
+      if ( key.compare(0, def.prefix.length(), def.prefix) != 0 ) {
+        continue;
+      }
+
+      old_values.clear();
+      new_values.clear();
+
+      if ( !old_value.is_null() ) {
+        def.values_cb(old_value, old_values);
+      }
+
+      if ( !new_value.is_null() ) {
+        def.values_cb(new_value, new_values);
+      }
+
+      std::set<std::string> keep(new_values.begin(), new_values.end());
+
+      for ( auto& value : old_values )
+      {
+        if ( keep.count(value) == 0 ) {
+          index_->remove(def.name, value, key);
+        }
+      }
+
+      for ( auto& value : new_values ) {
+        index_->add(def.name, value, key);
+      }
+    }
+  }
+
+  bool kvstore::changes(uint64_t since, size_t limit, bool values, std::vector<change>& result)
+  {
+    // Changes of a transaction are in the database before it commits.
+    auto last = committed_change_.load();
+
+    // A position in some other log.
+    if ( since > last ) {
+      return false;
+    }
+
+    auto cur = db_->make_cursor();
+
+    cur->jump(change_key(since + 1));
+
+    std::string ckey;
+    std::string cvalue;
+
+    // The change right after since must still be in the log.
+    if ( since < last && !(cur->get_key(&ckey) && ckey == change_key(since + 1)) )
+    {
+      return false;
+    }
+
+    while ( result.size() < limit && cur->get(&ckey, &cvalue, true) )
+    {
+      if ( ckey.compare(0, changes_prefix.length(), changes_prefix) != 0 || cvalue.empty() ) {
+        break;
+      }
+
+      auto seq = change_seq(ckey);
+
+      if ( seq > last ) {
+        break;
+      }
+
+      auto op  = cvalue[0] == 'r' ? change_op::remove : change_op::set;
+      auto key = cvalue.substr(1);
+
+      result.push_back(change{ seq, op, key, values && op == change_op::set ? get(key) : json::value() });
+    }
+
+    return true;
+  }
+
+  unsigned kvstore::subscribe(change_func change_cb)
+  {
+    return subscribe_commits([change_cb](const std::vector<change>& changes)
+    {
+      for ( auto& change : changes ) {
+        change_cb(change);
+      }
+    });
+  }
+
+  unsigned kvstore::subscribe_commits(commit_func commit_cb)
+  {
+    std::lock_guard<std::recursive_mutex> lock(write_mutex_);
+
+    auto id = next_subscriber_++;
+
+    subscribers_[id] = commit_cb;
+
+    return id;
+  }
+
+  void kvstore::unsubscribe(unsigned id)
+  {
+    std::lock_guard<std::recursive_mutex> lock(write_mutex_);
+
+    subscribers_.erase(id);
+  }
+
+  void kvstore::after_commit(std::function<void()> done_cb)
+  {
+    std::lock_guard<std::recursive_mutex> lock(write_mutex_);
+
+    if ( depth_ == 0 ) {
+      throw std::runtime_error("kvstore after_commit outside a transaction");
+    }
+
+    done_cbs_.push_back(std::move(done_cb));
+  }
+
+  void kvstore::load_changes()
+  {
+    auto cur = db_->make_cursor();
+
+    std::string ckey;
+
+    // The first key after the log.
+    auto end = changes_prefix;
+    end.back()++;
+
+    if ( cur->jump_back(end) && cur->get_key(&ckey) && ckey.compare(0, changes_prefix.length(), changes_prefix) == 0 )
+    {
+      last_change_ = change_seq(ckey);
+
+      cur->jump(changes_prefix);
+      cur->get_key(&ckey);
+
+      first_change_ = change_seq(ckey);
+    }
+    else
+    {
+      first_change_ = last_change_ + 1;
+    }
+
+    committed_change_ = last_change_;
+  }
+
+  bool kvstore::log_change(change_op op, const std::string& key)
+  {
+    if ( is_internal_key(key.data(), key.length()) ) {
+      return true;
+    }
+
+    auto seq = ++last_change_;
+
+    if ( !db_->set(change_key(seq), (op == change_op::remove ? "r" : "s") + key) ) {
+      return false;
+    }
+
+    // Published when the transaction it is written in commits.
+    pending_changes_.push_back(change{ seq, op, key, json::value() });
+
+    return true;
+  }
+
+  void kvstore::publish_changes()
+  {
+    if ( pending_changes_.empty() ) {
+      return;
+    }
+
+    committed_change_ = last_change_;
+
+    for ( auto& subscriber : subscribers_ ) {
+      subscriber.second(pending_changes_);
+    }
+
+    pending_changes_.clear();
+
+    trim_changes();
+  }
+
+  void kvstore::trim_changes()
+  {
+    if ( last_change_ - first_change_ + 1 <= change_log_size + change_log_slack ) {
+      return;
+    }
+
+    auto first = last_change_ - change_log_size + 1;
+
+    for ( auto seq = first_change_; seq < first; ++seq ) {
+      db_->remove(change_key(seq));
+    }
+
+    first_change_ = first;
+  }
+
+  size_t kvstore::import(const std::string& filename)
+  {
+    using namespace kyotocabinet;
+
+    bool in_use = false;
+
+    scan("", nullptr, [&](const std::string& key, const std::string& data) -> bool
+    {
+      in_use = !is_internal_key(key.data(), key.length());
+      return !in_use;
+    });
+
+    if ( in_use ) {
+      throw std::runtime_error("kvstore import into a store in use");
+    }
+
+    HashDB src;
+
+    if ( !src.open(filename, HashDB::OREADER) ) {
+      throw std::runtime_error("kvstore import open error");
+    }
+
+    DB::Cursor* cur = src.cursor();
+
+    cur->jump();
+
+    std::string ckey;
+    std::string cvalue;
+    size_t      imported = 0;
+
+    // Records are copied as they are, binary records along with the key
+    // table they were encoded with.
+    while ( cur->get(&ckey, &cvalue, true) )
+    {
+      if ( ckey == index_token_key ) {
+        continue;
+      }
+
+      auto cover = ckey.rfind("/cover");
+
+      if ( cover != std::string::npos && cover+6 == ckey.length() ) {
+        ckey = "cover/" + ckey.substr(0, cover);
+      }
+
+      db_->set(ckey, cvalue);
+      imported++;
+    }
+
+    delete cur;
+
+    src.close();
+
+    std::string keys_s;
+
+    if ( db_->get(keys_key, &keys_s) ) {
+      codec_.keys(json::view(keys_s).to_value());
+    }
+
+    load_key_counters();
+
+    return imported;
+  }
+
+  size_t kvstore::migrate()
+  {
+    auto cur = db_->make_cursor();
+
+    cur->jump();
+
+    std::string ckey;
+    std::string cvalue;
+    std::string encoded;
+    size_t      converted = 0;
+
+    while ( cur->get(&ckey, &cvalue, false) )
+    {
+      if ( !is_internal_key(ckey.data(), ckey.length()) && !record_codec::is_binary(cvalue) )
+      {
+        json::value  value;
+        json::parser parser(value, json::parser::default_max_depth, json::utf8_mode::replace);
+        bool         valid;
+
+        try
+        {
+          parser.parse(cvalue.data(), cvalue.length());
+          valid = parser.complete();
+        }
+        catch ( const json::error& )
+        {
+          valid = false;
+        }
+
+        if ( valid )
+        {
+          // Replaced unless it has changed since it was read. Writers of
+          // records hold the write lock.
+          std::lock_guard<std::recursive_mutex> lock(write_mutex_);
+
+          encode(value, encoded);
+
+          std::string current;
+
+          if ( db_->get(ckey, &current) && current == cvalue && db_->set(ckey, encoded) ) {
+            converted++;
+          }
+        }
+        else
+        {
+          std::cout << "error! migrating record " << ckey << std::endl;
+        }
+      }
+      cur->step();
+    }
+
+    return converted;
+  }
+
+  void kvstore::encode(const json::value& value, std::string& buf)
+  {
+    // Names new to the key table must be stored before any record using
+    // them. The write lock is held, so the table is written in the
+    // transaction of the writer, or in one of its own with no other
+    // writer waited for.
+    if ( codec_.encode(value, buf) ) {
+      db_->set(keys_key, to_string(codec_.keys()));
+    }
+  }
+
+  json::value kvstore::decode(const std::string& data)
+  {
+    if ( record_codec::is_binary(data) ) {
+      return codec_.decode(data);
+    }
+
+    // Records written before strings were checked may have bytes that
+    // are not utf-8, they are read rather than lost.
+    json::value  value;
+    json::parser parser(value, json::parser::default_max_depth, json::utf8_mode::replace);
+
+    size_t consumed = parser.parse(data.c_str(), data.length());
+
+    if ( consumed < data.length() )
+    {
+      std::cout << "error! retrieving value" << std::endl;
+    }
+
+    return value;
+  }
+
+  std::string kvstore::create_artist_key()
+  {
+    return create_key(artist_keys_);
+  }
+
+  std::string kvstore::create_album_key()
+  {
+    return create_key(album_keys_);
+  }
+
+  std::string kvstore::create_track_key()
+  {
+    return create_key(track_keys_);
+  }
+
+  void kvstore::load_key_counters()
+  {
+    for ( auto counter : { &artist_keys_, &album_keys_, &track_keys_ } )
+    {
+      auto& key = counter->key;
+
+      counter->allocator.reset(new key_allocator(db_->increment(key, 0), [this, &key](int64_t count)
+      {
+        // Committed before any key in the range is handed out, or part
+        // of the transaction the key is created in.
+        transaction transaction(*this);
+
+        auto mark = db_->increment(key, count);
+
+        if ( mark == INT64_MIN ) {
+          throw std::runtime_error("kvstore key counter error");
+        }
+
+        transaction.commit();
+
+        return mark;
+      }, key_batch));
+    }
+  }
+
+  // Store the marks of the key allocators. Unused keys can only be given
+  // back when no more keys are created.
+  void kvstore::store_key_counters(bool give_back)
+  {
+    std::lock_guard<std::recursive_mutex> lock(write_mutex_);
+
+    begin();
+
+    for ( auto counter : { &artist_keys_, &album_keys_, &track_keys_ } )
+    {
+      auto& allocator = counter->allocator;
+      auto  mark      = allocator->reserved() - (give_back ? allocator->unused() : 0);
+
+      db_->increment(counter->key, mark - db_->increment(counter->key, 0));
+    }
+
+    end(true);
+  }
+
+  std::string kvstore::create_key(key_counter& counter)
   {
-    auto new_key = db_.increment("__track_key__", 1);
-    return std::move(base62_encode(new_key));
+    return base62_encode(counter.allocator->next());
   }
 }
\ No newline at end of file
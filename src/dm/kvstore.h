@@ -7,6 +7,15 @@
 //
 // --- Description: -----------------------------------------------------------
 //
+//   Records are kept in a b+ tree ordered by key. Keys of each kind of
+//   record share a prefix, so the records of one kind are a single range:
+//
+//     __*       internal, key counters, key table, index token, change log
+//     al*       albums
+//     ar*       artists
+//     cover/*   album covers, by album key, images are in the blob store
+//     source/*  sources
+//     t*        tracks
 //
 // ----------------------------------------------------------------------------
 #ifndef __dm__kvstore_h__
@@ -14,13 +23,23 @@
 
 // ----------------------------------------------------------------------------
 //#include "collection.h"
-#include <json/json.h>
+#include "record_codec.h"
+#include "record_cache.h"
+#include "kvindex.h"
+#include "key_allocator.h"
+#include "storage_engine.h"
 
 // ----------------------------------------------------------------------------
-#include <kchashdb.h>
+#include <json/json.h>
 
 // ----------------------------------------------------------------------------
 #include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <map>
+#include <atomic>
+#include <chrono>
 
 // ----------------------------------------------------------------------------
 namespace dm
@@ -28,24 +47,306 @@ namespace dm
   class kvstore
   {
   public:
-    kvstore(const std::string filename);
+    using key_match_func = std::function<bool(const std::string& key)>;
+    using index_func     = std::function<void(const json::value& record, std::vector<std::string>& values)>;
+  public:
+    // Order records of a parallel scan are given in.
+    enum class order
+    {
+      // As soon as they are decoded.
+      unordered,
+      // In key order, as each does.
+      key
+    };
+  public:
+    // How far a committed transaction is written before commit returns.
+    enum class durability
+    {
+      // To the operating system, it survives the process crashing.
+      soft,
+      // To the device, it also survives the system crashing.
+      hard
+    };
+  public:
+    // Groups the writes made while it is alive into one atomic commit. The
+    // writes are applied when commit is called, and rolled back if the
+    // transaction is destroyed before that. Other writers wait until the
+    // transaction ends. A transaction started while another is alive, on
+    // the same thread, is part of that one and only the outermost commits.
+    // commit throws std::runtime_error, with the writes rolled back, if
+    // they cannot be committed.
+    class transaction
+    {
+    public:
+      transaction(kvstore& store);
+    public:
+      ~transaction();
+    public:
+      void commit();
+    private:
+      kvstore&                               store_;
+      std::unique_lock<std::recursive_mutex> lock_;
+      bool                                   done_;
+    };
+  public:
+    // Pins a snapshot of the records, see storage_engine, for the thread
+    // taking it. While it is alive get, get_shared, each and parallel_each
+    // on that thread see the records as of the last commit before it was
+    // taken. Long readers see a consistent store while it is written, and
+    // keep no writer waiting. A snapshot taken while another is alive, on
+    // the same thread, is part of that one. find reads the index as it is
+    // now. Records read through a snapshot must not be written back.
+    class snapshot
+    {
+    public:
+      snapshot(kvstore& store);
+    public:
+      ~snapshot();
+    public:
+      // Changes up to this number are seen, later ones may be as well.
+      uint64_t last_change() const { return change_; }
+    private:
+      friend class kvstore;
+    private:
+      kvstore&                                  store_;
+      std::unique_ptr<storage_engine::snapshot> db_snapshot_;
+      uint64_t                                  change_;
+    };
+  public:
+    enum class change_op
+    {
+      set,
+      remove
+    };
+  public:
+    // A write to the records, as kept in the change log. Writes are
+    // numbered in the order they are committed. The value is the record
+    // as it is now, when asked for, not as it was written.
+    struct change
+    {
+      uint64_t    seq;
+      change_op   op;
+      std::string key;
+      json::value value;
+    };
+  public:
+    using change_func = std::function<void(const change& change)>;
+    using commit_func = std::function<void(const std::vector<change>& changes)>;
+  public:
+    // See storage_engine::open for journal.
+    kvstore(const std::string filename,
+            durability level = durability::soft,
+            storage_engine::type engine = storage_engine::type::kyoto,
+            bool journal = false);
   public:
     ~kvstore();
   public:
     int64_t count();
+    // Bytes taken by the records, see storage_engine::size.
+    int64_t size();
   public:
+    // Write the writes cached by the storage engine to the file, so a crash
+    // does not lose them. Returns false, doing nothing, while a transaction
+    // is active.
+    bool checkpoint();
+    // Defrag the records, steps at a time, see storage_engine::defrag,
+    // until duration has passed. Writers wait until it returns, readers
+    // only for each step. Returns the number of steps, 0 while a
+    // transaction is active.
+    int64_t defrag(std::chrono::milliseconds duration, int64_t steps);
+  public:
+    // The record and its change are written together, or neither is.
+    // Returns false if they are not written, rolling back the transaction
+    // they are written in.
     bool set(const std::string& key, const json::value& value);
     bool remove(const std::string& key);
   public:
+    // Decoded record, owned by the caller. Not cached, for records about to
+    // be modified or too large to keep around.
     json::value get(const std::string& key);
+    // Shared, immutable record from the record cache, nullptr if there is
+    // none.
+    record_cache::record_ptr get_shared(const std::string& key);
+  public:
+    record_cache::statistics cache_stats() const { return cache_.stats(); }
+  public:
+    // Every set and remove of a record is logged, along with the records,
+    // so the log is committed and rolled back with them. Only the last
+    // changes are kept.
+    //
+    // Changes after since, oldest first, at most limit of them. Returns
+    // false if some of the changes after since are no longer in the log,
+    // the reader must then start over from the records.
+    bool changes(uint64_t since, size_t limit, bool values, std::vector<change>& result);
+    // Number of the last committed change.
+    uint64_t last_change() const { return committed_change_.load(); }
+  public:
+    // Call change_cb with each change once it is committed, in order. It
+    // is called on the writing thread, while other writers wait, and must
+    // not write to the store.
+    unsigned subscribe(change_func change_cb);
+    // Like subscribe, but commit_cb is called once for each commit, with
+    // all of its changes.
+    unsigned subscribe_commits(commit_func commit_cb);
+    void     unsubscribe(unsigned id);
+    // Call done_cb once the transaction it is called in commits, after the
+    // changes are published, and not at all if it is rolled back. For work
+    // outside the store that must wait for the records, like removing
+    // files they no longer refer to. Throws std::runtime_error outside of a
+    // transaction.
+    void     after_commit(std::function<void()> done_cb);
+  public:
+    // Iterate the records with keys matching key_match. Visits every
+    // record in the store.
+    void each(key_match_func key_match, std::function<bool(json::value&)> value_cb);
+    // Like each, but only the fields listed are decoded. They are given to
+    // value_cb in the same order, null if the record has no such member,
+    // along with the key of the record. Records that are not objects are
+    // skipped.
+    void each(key_match_func key_match,
+              const std::vector<std::string>& fields,
+              std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb);
+  public:
+    // Iterate the records with keys starting with prefix. Records are kept
+    // in key order, so only those records are visited.
+    void each(const std::string& prefix, std::function<bool(json::value&)> value_cb);
+    void each(const std::string& prefix,
+              const std::vector<std::string>& fields,
+              std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb);
   public:
-    void each(std::function<bool(const std::string&)> key_match, std::function<bool(json::value&)> value_cb);
+    // Like each, but the records are decoded by a pool of threads, one per
+    // core. Each thread takes the next chunk of records from a shared
+    // cursor. filter is called on those threads, concurrently, and can
+    // modify the record or drop it by returning false. value_cb is called
+    // on the calling thread only, with the records that are kept, and stops
+    // the scan by returning false.
+    void parallel_each(const std::string& prefix,
+                       std::function<bool(json::value&)> filter,
+                       std::function<bool(json::value&)> value_cb,
+                       order ordering = order::unordered);
+    // Like each with fields, the fields are read by the pool of threads.
+    void parallel_each(const std::string& prefix,
+                       const std::vector<std::string>& fields,
+                       std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb,
+                       order ordering = order::unordered);
   public:
+    // Define a secondary index over the records with keys starting with
+    // prefix. values_cb gives the values a record is found by. The index
+    // is kept up to date by set and remove, and is built from the stored
+    // records if it has not been before. Changing what values_cb gives
+    // for a record requires a new version, so the index is built again.
+    void index(const std::string& name, const std::string& prefix, index_func values_cb, unsigned version = 1);
+    // Keys of the records that have value in the index.
+    std::vector<std::string> find(const std::string& index, const std::string& value);
+  public:
+    // Random token telling this database from others, made when first
+    // asked for. Files kept along with the records, like the index file,
+    // store it so they are not used with another database. Not copied by
+    // import.
+    std::string token();
+  public:
+    // Copy the records of a database written before records were kept in
+    // key order into this, empty, store. Returns the number of records
+    // copied.
+    size_t import(const std::string& filename);
+  public:
+    // Rewrite records still stored as json text in the binary encoding.
+    // Each record is converted on its own, so the store can be used while
+    // this runs. Returns the number of records converted.
+    size_t migrate();
+  public:
+    // New keys are taken from ranges reserved in the key counters, see
+    // key_allocator. Keys not handed out are given back when the store is
+    // closed.
     std::string create_artist_key();
     std::string create_album_key();
     std::string create_track_key();
   private:
-    kyotocabinet::HashDB db_;
+    struct key_counter
+    {
+      std::string                    key;
+      std::unique_ptr<key_allocator> allocator;
+    };
+  private:
+    void load_key_counters();
+    void store_key_counters(bool give_back);
+    std::string create_key(key_counter& counter);
+    // Called with the write lock held.
+    void        encode(const json::value& value, std::string& buf);
+    json::value decode(const std::string& data);
+  private:
+    struct index_def
+    {
+      std::string name;
+      std::string prefix;
+      index_func  values_cb;
+    };
+  private:
+    struct scan_item
+    {
+      std::string              key;
+      json::value              value;
+      std::vector<json::value> fields;
+    };
+  private:
+    using produce_func = std::function<bool(const std::string& data, scan_item& item)>;
+    using consume_func = std::function<bool(scan_item& item)>;
+  private:
+    void parallel_scan(const std::string& prefix, produce_func produce, consume_func consume, order ordering);
+    void project(const std::string& data, const std::vector<std::string>& fields, std::vector<json::value>& values, bool& is_object);
+  private:
+    // Snapshot pinned by the calling thread, nullptr if none, and a cursor
+    // over it or the records.
+    storage_engine::snapshot*               pinned_snapshot();
+    std::unique_ptr<storage_engine::cursor> make_cursor();
+  private:
+    void scan(const std::string& prefix,
+              key_match_func key_match,
+              std::function<bool(const std::string& key, const std::string& data)> record_cb);
+    void each_fields(const std::string& prefix,
+                     key_match_func key_match,
+                     const std::vector<std::string>& fields,
+                     std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb);
+  private:
+    void begin();
+    void end(bool commit);
+  private:
+    bool has_index(const std::string& key);
+    bool write_indexed(const std::string& key, const json::value& value, std::function<bool()> write);
+    void update_indexes(const std::string& key, const json::value& old_value, const json::value& new_value);
+  private:
+    using subscriber_map = std::map<unsigned, commit_func>;
+    using done_func      = std::function<void()>;
+  private:
+    void load_changes();
+    // Called in a transaction. Returns false if the change could not be
+    // written.
+    bool log_change(change_op op, const std::string& key);
+    void publish_changes();
+    void trim_changes();
+  private:
+    std::unique_ptr<storage_engine> db_;
+    std::string                     filename_;
+    storage_engine::type            engine_;
+    bool                            journal_;
+    record_codec                    codec_;
+    record_cache                    cache_;
+    std::unique_ptr<kvindex>        index_;
+    std::vector<index_def>          index_defs_;
+    std::recursive_mutex            write_mutex_;
+    durability                      durability_;
+    unsigned                        depth_;
+    bool                            rollback_;
+    key_counter                     artist_keys_;
+    key_counter                     album_keys_;
+    key_counter                     track_keys_;
+    uint64_t                        first_change_;
+    uint64_t                        last_change_;
+    std::atomic<uint64_t>           committed_change_;
+    std::vector<change>             pending_changes_;
+    std::vector<done_func>          done_cbs_;
+    subscriber_map                  subscribers_;
+    unsigned                        next_subscriber_;
   };
 }
 
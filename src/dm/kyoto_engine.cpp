@@ -0,0 +1,160 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : kyoto_engine.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "kyoto_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <stdexcept>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class kyoto_cursor : public storage_engine::cursor
+  {
+  public:
+    kyoto_cursor(kyotocabinet::TreeDB& db)
+      :
+      cur_(db.cursor())
+    {
+    }
+  public:
+    ~kyoto_cursor()
+    {
+      delete cur_;
+    }
+  public:
+    bool jump() override
+    {
+      return cur_->jump();
+    }
+
+    bool jump(const std::string& key) override
+    {
+      return cur_->jump(key);
+    }
+
+    bool jump_back(const std::string& key) override
+    {
+      return cur_->jump_back(key);
+    }
+
+    bool step() override
+    {
+      return cur_->step();
+    }
+
+    bool step_back() override
+    {
+      return cur_->step_back();
+    }
+  public:
+    bool get(std::string* key, std::string* value, bool step) override
+    {
+      if ( key && value ) {
+        return cur_->get(key, value, step);
+      }
+      else if ( key ) {
+        return cur_->get_key(key, step);
+      }
+      else {
+        return cur_->get_value(value, step);
+      }
+    }
+  private:
+    kyotocabinet::DB::Cursor* cur_;
+  };
+
+  kyoto_engine::kyoto_engine(const std::string& filename, bool journal)
+  {
+    using namespace kyotocabinet;
+
+    uint32_t mode = TreeDB::OWRITER | TreeDB::OCREATE;
+
+    if ( journal ) {
+      mode |= TreeDB::OAUTOTRAN;
+    }
+
+    if ( !db_.open(filename, mode) ) {
+      throw std::runtime_error("kyoto engine open error " + filename);
+    }
+  }
+
+  kyoto_engine::~kyoto_engine()
+  {
+    db_.close();
+  }
+
+  int64_t kyoto_engine::count()
+  {
+    return db_.count();
+  }
+
+  int64_t kyoto_engine::size()
+  {
+    return db_.size();
+  }
+
+  bool kyoto_engine::get(const std::string& key, std::string* value)
+  {
+    return db_.get(key, value);
+  }
+
+  bool kyoto_engine::set(const std::string& key, const std::string& value)
+  {
+    return db_.set(key, value);
+  }
+
+  bool kyoto_engine::remove(const std::string& key)
+  {
+    return db_.remove(key);
+  }
+
+  bool kyoto_engine::clear()
+  {
+    return db_.clear();
+  }
+
+  int64_t kyoto_engine::increment(const std::string& key, int64_t num)
+  {
+    auto result = db_.increment(key, num);
+
+    if ( result == INT64_MIN ) {
+      throw std::runtime_error("kyoto engine increment error");
+    }
+    return result;
+  }
+
+  std::unique_ptr<storage_engine::cursor> kyoto_engine::make_cursor()
+  {
+    return std::unique_ptr<cursor>(new kyoto_cursor(db_));
+  }
+
+  bool kyoto_engine::begin_transaction(bool hard)
+  {
+    return db_.begin_transaction(hard);
+  }
+
+  bool kyoto_engine::end_transaction(bool commit)
+  {
+    return db_.end_transaction(commit);
+  }
+
+  bool kyoto_engine::synchronize(bool hard)
+  {
+    return db_.synchronize(hard);
+  }
+
+  bool kyoto_engine::defrag(int64_t steps)
+  {
+    return db_.defrag(steps);
+  }
+}
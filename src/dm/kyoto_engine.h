@@ -0,0 +1,60 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : kyoto_engine.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Storage engine on a kyotocabinet b+ tree file. Writes of an active
+//   transaction are seen by every reader. No snapshots.
+//
+//   Journaled files are opened with auto transactions, every write outside
+//   a transaction is one of its own.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__kyoto_engine_h__
+#define __dm__kyoto_engine_h__
+
+// ----------------------------------------------------------------------------
+#include "storage_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <kchashdb.h>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class kyoto_engine : public storage_engine
+  {
+  public:
+    kyoto_engine(const std::string& filename, bool journal);
+  public:
+    ~kyoto_engine();
+  public:
+    int64_t count() override;
+    int64_t size() override;
+  public:
+    bool get(const std::string& key, std::string* value) override;
+    bool set(const std::string& key, const std::string& value) override;
+    bool remove(const std::string& key) override;
+    bool clear() override;
+  public:
+    int64_t increment(const std::string& key, int64_t num) override;
+  public:
+    std::unique_ptr<cursor> make_cursor() override;
+  public:
+    bool begin_transaction(bool hard) override;
+    bool end_transaction(bool commit) override;
+  public:
+    bool synchronize(bool hard) override;
+  public:
+    bool defrag(int64_t steps) override;
+  private:
+    kyotocabinet::TreeDB db_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__kyoto_engine_h__
@@ -0,0 +1,448 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : lmdb_engine.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "lmdb_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <stdexcept>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+#include <sys/stat.h>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  const size_t map_size = size_t(4) << 30;
+
+  static MDB_val to_val(const std::string& s)
+  {
+    return MDB_val{ s.length(), const_cast<char*>(s.data()) };
+  }
+
+  static void check(int rc, const char* what)
+  {
+    if ( rc != MDB_SUCCESS ) {
+      throw std::runtime_error(std::string(what) + " " + mdb_strerror(rc));
+    }
+  }
+
+  // Over a transaction of its own, a snapshot's, or the active one when
+  // made on its thread. The active transaction closes its cursors when it
+  // ends, after that the cursor finds nothing.
+  class lmdb_cursor : public storage_engine::cursor
+  {
+  public:
+    lmdb_cursor(lmdb_engine* engine, MDB_txn* txn, MDB_dbi dbi, bool own_txn)
+      :
+      engine_(engine),
+      txn_(txn),
+      cur_(nullptr),
+      own_txn_(own_txn),
+      generation_(engine ? engine->generation_.load() : 0),
+      valid_(false)
+    {
+      int rc = mdb_cursor_open(txn_, dbi, &cur_);
+
+      if ( rc != MDB_SUCCESS )
+      {
+        if ( own_txn_ ) {
+          mdb_txn_abort(txn_);
+        }
+        check(rc, "lmdb cursor open error");
+      }
+    }
+  public:
+    ~lmdb_cursor()
+    {
+      if ( alive() ) {
+        mdb_cursor_close(cur_);
+      }
+
+      if ( own_txn_ ) {
+        mdb_txn_abort(txn_);
+      }
+    }
+  public:
+    bool jump() override
+    {
+      return move(nullptr, MDB_FIRST);
+    }
+
+    bool jump(const std::string& key) override
+    {
+      if ( key.empty() ) {
+        return jump();
+      }
+
+      auto k = to_val(key);
+      return move(&k, MDB_SET_RANGE);
+    }
+
+    bool jump_back(const std::string& key) override
+    {
+      MDB_val k = to_val(key);
+
+      if ( key.empty() || !move(&k, MDB_SET_RANGE) ) {
+        return move(nullptr, MDB_LAST);
+      }
+
+      if ( k.mv_size == key.length() && memcmp(k.mv_data, key.data(), key.length()) == 0 ) {
+        return true;
+      }
+      return move(nullptr, MDB_PREV);
+    }
+
+    bool step() override
+    {
+      return valid_ && move(nullptr, MDB_NEXT);
+    }
+
+    bool step_back() override
+    {
+      return valid_ && move(nullptr, MDB_PREV);
+    }
+  public:
+    bool get(std::string* key, std::string* value, bool step) override
+    {
+      MDB_val k;
+      MDB_val v;
+
+      if ( !valid_ || !alive() || mdb_cursor_get(cur_, &k, &v, MDB_GET_CURRENT) != MDB_SUCCESS ) {
+        return false;
+      }
+
+      if ( key ) {
+        key->assign(static_cast<const char*>(k.mv_data), k.mv_size);
+      }
+
+      if ( value ) {
+        value->assign(static_cast<const char*>(v.mv_data), v.mv_size);
+      }
+
+      if ( step ) {
+        move(nullptr, MDB_NEXT);
+      }
+      return true;
+    }
+  private:
+    bool alive() const
+    {
+      return !engine_ || engine_->generation_.load() == generation_;
+    }
+
+    bool move(MDB_val* key, MDB_cursor_op op)
+    {
+      MDB_val k = key ? *key : MDB_val{ 0, nullptr };
+      MDB_val v;
+
+      valid_ = alive() && mdb_cursor_get(cur_, &k, &v, op) == MDB_SUCCESS;
+
+      if ( valid_ && key ) {
+        *key = k;
+      }
+      return valid_;
+    }
+  private:
+    // Set when over the active transaction.
+    lmdb_engine* engine_;
+    MDB_txn*     txn_;
+    MDB_cursor*  cur_;
+    bool         own_txn_;
+    uint64_t     generation_;
+    bool         valid_;
+  };
+
+  class lmdb_snapshot : public storage_engine::snapshot
+  {
+  public:
+    lmdb_snapshot(MDB_env* env, MDB_dbi dbi)
+      :
+      dbi_(dbi)
+    {
+      check(mdb_txn_begin(env, nullptr, MDB_RDONLY, &txn_), "lmdb snapshot error");
+    }
+  public:
+    ~lmdb_snapshot()
+    {
+      mdb_txn_abort(txn_);
+    }
+  public:
+    bool get(const std::string& key, std::string* value) override
+    {
+      MDB_val k = to_val(key);
+      MDB_val v;
+
+      if ( key.empty() || mdb_get(txn_, dbi_, &k, &v) != MDB_SUCCESS ) {
+        return false;
+      }
+
+      if ( value ) {
+        value->assign(static_cast<const char*>(v.mv_data), v.mv_size);
+      }
+      return true;
+    }
+
+    std::unique_ptr<storage_engine::cursor> make_cursor() override
+    {
+      return std::unique_ptr<storage_engine::cursor>(new lmdb_cursor(nullptr, txn_, dbi_, false));
+    }
+  private:
+    MDB_txn* txn_;
+    MDB_dbi  dbi_;
+  };
+
+  lmdb_engine::lmdb_engine(const std::string& filename)
+    :
+    filename_(filename),
+    env_(nullptr),
+    dbi_(0),
+    txn_(nullptr),
+    owner_(std::thread::id()),
+    generation_(0),
+    hard_(false)
+  {
+    check(mdb_env_create(&env_), "lmdb create error");
+
+    int rc = mdb_env_set_mapsize(env_, map_size);
+
+    // Readers are not tied to threads, a thread can read while it runs a
+    // transaction and cursors can be handed between threads.
+    if ( rc == MDB_SUCCESS ) {
+      rc = mdb_env_open(env_, filename.c_str(), MDB_NOSUBDIR | MDB_NOSYNC | MDB_NOTLS, 0644);
+    }
+
+    if ( rc == MDB_SUCCESS )
+    {
+      MDB_txn* txn;
+
+      rc = mdb_txn_begin(env_, nullptr, 0, &txn);
+
+      if ( rc == MDB_SUCCESS )
+      {
+        rc = mdb_dbi_open(txn, nullptr, 0, &dbi_);
+
+        if ( rc == MDB_SUCCESS ) {
+          rc = mdb_txn_commit(txn);
+        }
+        else {
+          mdb_txn_abort(txn);
+        }
+      }
+    }
+
+    if ( rc != MDB_SUCCESS )
+    {
+      mdb_env_close(env_);
+      throw std::runtime_error("lmdb engine open error " + filename + " " + mdb_strerror(rc));
+    }
+  }
+
+  lmdb_engine::~lmdb_engine()
+  {
+    if ( txn_ ) {
+      mdb_txn_abort(txn_);
+    }
+    mdb_env_sync(env_, 1);
+    mdb_env_close(env_);
+  }
+
+  int64_t lmdb_engine::count()
+  {
+    MDB_stat st;
+
+    check(read([&](MDB_txn* txn) { return mdb_stat(txn, dbi_, &st); }), "lmdb stat error");
+
+    return st.ms_entries;
+  }
+
+  int64_t lmdb_engine::size()
+  {
+    struct stat st;
+
+    if ( stat(filename_.c_str(), &st) != 0 ) {
+      return 0;
+    }
+    return st.st_size;
+  }
+
+  bool lmdb_engine::get(const std::string& key, std::string* value)
+  {
+    if ( key.empty() ) {
+      return false;
+    }
+
+    // Copied before a transaction of its own ends.
+    int rc = read([&](MDB_txn* txn)
+    {
+      MDB_val k = to_val(key);
+      MDB_val v;
+
+      int rc = mdb_get(txn, dbi_, &k, &v);
+
+      if ( rc == MDB_SUCCESS && value ) {
+        value->assign(static_cast<const char*>(v.mv_data), v.mv_size);
+      }
+      return rc;
+    });
+
+    return rc == MDB_SUCCESS;
+  }
+
+  bool lmdb_engine::set(const std::string& key, const std::string& value)
+  {
+    if ( key.empty() ) {
+      return false;
+    }
+
+    return write([&](MDB_txn* txn)
+    {
+      MDB_val k = to_val(key);
+      MDB_val v = to_val(value);
+
+      return mdb_put(txn, dbi_, &k, &v, 0);
+    }) == MDB_SUCCESS;
+  }
+
+  bool lmdb_engine::remove(const std::string& key)
+  {
+    if ( key.empty() ) {
+      return false;
+    }
+
+    return write([&](MDB_txn* txn)
+    {
+      MDB_val k = to_val(key);
+
+      return mdb_del(txn, dbi_, &k, nullptr);
+    }) == MDB_SUCCESS;
+  }
+
+  bool lmdb_engine::clear()
+  {
+    return write([&](MDB_txn* txn) { return mdb_drop(txn, dbi_, 0); }) == MDB_SUCCESS;
+  }
+
+  std::unique_ptr<storage_engine::cursor> lmdb_engine::make_cursor()
+  {
+    if ( in_transaction() ) {
+      return std::unique_ptr<cursor>(new lmdb_cursor(this, txn_, dbi_, false));
+    }
+
+    MDB_txn* txn;
+
+    check(mdb_txn_begin(env_, nullptr, MDB_RDONLY, &txn), "lmdb cursor error");
+
+    return std::unique_ptr<cursor>(new lmdb_cursor(nullptr, txn, dbi_, true));
+  }
+
+  std::unique_ptr<storage_engine::snapshot> lmdb_engine::make_snapshot()
+  {
+    return std::unique_ptr<snapshot>(new lmdb_snapshot(env_, dbi_));
+  }
+
+  bool lmdb_engine::begin_transaction(bool hard)
+  {
+    if ( in_transaction() ) {
+      return false;
+    }
+
+    MDB_txn* txn;
+
+    // Waits for the writer running now, if any.
+    if ( mdb_txn_begin(env_, nullptr, 0, &txn) != MDB_SUCCESS ) {
+      return false;
+    }
+
+    txn_   = txn;
+    hard_  = hard;
+    owner_ = std::this_thread::get_id();
+
+    return true;
+  }
+
+  bool lmdb_engine::end_transaction(bool commit)
+  {
+    if ( !in_transaction() ) {
+      return false;
+    }
+
+    auto txn = txn_;
+
+    txn_   = nullptr;
+    owner_ = std::thread::id();
+    generation_++;
+
+    if ( !commit )
+    {
+      mdb_txn_abort(txn);
+      return true;
+    }
+
+    if ( mdb_txn_commit(txn) != MDB_SUCCESS ) {
+      return false;
+    }
+    return !hard_ || mdb_env_sync(env_, 1) == MDB_SUCCESS;
+  }
+
+  bool lmdb_engine::synchronize(bool hard)
+  {
+    return mdb_env_sync(env_, 1) == MDB_SUCCESS;
+  }
+
+  bool lmdb_engine::in_transaction() const
+  {
+    return owner_.load() == std::this_thread::get_id();
+  }
+
+  int lmdb_engine::read(std::function<int(MDB_txn* txn)> func)
+  {
+    if ( in_transaction() ) {
+      return func(txn_);
+    }
+
+    MDB_txn* txn;
+    int      rc = mdb_txn_begin(env_, nullptr, MDB_RDONLY, &txn);
+
+    if ( rc != MDB_SUCCESS ) {
+      return rc;
+    }
+
+    rc = func(txn);
+    mdb_txn_abort(txn);
+
+    return rc;
+  }
+
+  int lmdb_engine::write(std::function<int(MDB_txn* txn)> func)
+  {
+    if ( in_transaction() ) {
+      return func(txn_);
+    }
+
+    MDB_txn* txn;
+    int      rc = mdb_txn_begin(env_, nullptr, 0, &txn);
+
+    if ( rc != MDB_SUCCESS ) {
+      return rc;
+    }
+
+    rc = func(txn);
+
+    if ( rc == MDB_SUCCESS ) {
+      rc = mdb_txn_commit(txn);
+    }
+    else {
+      mdb_txn_abort(txn);
+    }
+    return rc;
+  }
+}
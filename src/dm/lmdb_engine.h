@@ -0,0 +1,82 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : lmdb_engine.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Storage engine on an lmdb file. Reads run in read only lmdb
+//   transactions of their own, and see the last committed records. Only
+//   the thread running a transaction reads its writes. Writes outside a
+//   transaction are committed one by one.
+//
+//   Commits are not synced, except those of hard transactions, so they
+//   survive the process crashing but not the system. The file is mapped
+//   into a 4 GB range of the address space.
+//
+//   A snapshot is a read only lmdb transaction, kept open until the
+//   snapshot, and the cursors made from it, are destroyed.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__lmdb_engine_h__
+#define __dm__lmdb_engine_h__
+
+// ----------------------------------------------------------------------------
+#include "storage_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <lmdb.h>
+
+// ----------------------------------------------------------------------------
+#include <thread>
+#include <atomic>
+#include <functional>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class lmdb_engine : public storage_engine
+  {
+  public:
+    lmdb_engine(const std::string& filename);
+  public:
+    ~lmdb_engine();
+  public:
+    int64_t count() override;
+    int64_t size() override;
+  public:
+    bool get(const std::string& key, std::string* value) override;
+    bool set(const std::string& key, const std::string& value) override;
+    bool remove(const std::string& key) override;
+    bool clear() override;
+  public:
+    std::unique_ptr<cursor>   make_cursor() override;
+    std::unique_ptr<snapshot> make_snapshot() override;
+  public:
+    bool begin_transaction(bool hard) override;
+    bool end_transaction(bool commit) override;
+  public:
+    bool synchronize(bool hard) override;
+  private:
+    bool in_transaction() const;
+    // Run func in the active transaction on its thread, otherwise in a
+    // transaction of its own.
+    int read(std::function<int(MDB_txn* txn)> func);
+    int write(std::function<int(MDB_txn* txn)> func);
+  private:
+    friend class lmdb_cursor;
+  private:
+    std::string                  filename_;
+    MDB_env*                     env_;
+    MDB_dbi                      dbi_;
+    MDB_txn*                     txn_;
+    std::atomic<std::thread::id> owner_;
+    std::atomic<uint64_t>        generation_;
+    bool                         hard_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__lmdb_engine_h__
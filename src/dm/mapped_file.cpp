@@ -0,0 +1,98 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : mapped_file.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "mapped_file.h"
+
+// ----------------------------------------------------------------------------
+#include <stdexcept>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  mapped_file::mapped_file(const std::string& filename)
+    :
+    data_(nullptr),
+    size_(0)
+  {
+    int fd = open(filename.c_str(), O_RDONLY);
+
+    if ( fd < 0 ) {
+      throw std::runtime_error("mapped file open error");
+    }
+
+    struct stat st;
+
+    if ( fstat(fd, &st) < 0 || st.st_size == 0 )
+    {
+      close(fd);
+      throw std::runtime_error("mapped file size error");
+    }
+
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps the file open.
+    close(fd);
+
+    if ( p == MAP_FAILED ) {
+      throw std::runtime_error("mapped file map error");
+    }
+
+    data_ = static_cast<const char*>(p);
+    size_ = st.st_size;
+  }
+
+  mapped_file::~mapped_file()
+  {
+    munmap(const_cast<char*>(data_), size_);
+  }
+
+  void mapped_file::write(const std::string& filename, const char* data, size_t len)
+  {
+    std::string tmpname = filename + ".XXXXXX";
+
+    int fd = mkstemp(&tmpname[0]);
+
+    if ( fd < 0 ) {
+      throw std::runtime_error("mapped file open error");
+    }
+
+    size_t written = 0;
+
+    while ( written < len )
+    {
+      auto res = ::write(fd, data + written, len - written);
+
+      if ( res < 0 && errno == EINTR ) {
+        continue;
+      }
+      else if ( res < 0 )
+      {
+        close(fd);
+        unlink(tmpname.c_str());
+        throw std::runtime_error("mapped file write error");
+      }
+      written += res;
+    }
+
+    if ( fchmod(fd, 0644) < 0 || fsync(fd) < 0 || close(fd) < 0 || rename(tmpname.c_str(), filename.c_str()) < 0 )
+    {
+      unlink(tmpname.c_str());
+      throw std::runtime_error("mapped file write error");
+    }
+  }
+}
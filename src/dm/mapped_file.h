@@ -0,0 +1,51 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : mapped_file.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   A file mapped read-only into memory, for the lifetime of the object.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__mapped_file_h__
+#define __dm__mapped_file_h__
+
+// ----------------------------------------------------------------------------
+#include <string>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class mapped_file
+  {
+  public:
+    // Throws std::runtime_error if the file cannot be opened or mapped.
+    mapped_file(const std::string& filename);
+  public:
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+  public:
+    ~mapped_file();
+  public:
+    const char* data() const { return data_; }
+    size_t      size() const { return size_; }
+  public:
+    // Replace the file with data. Written to a temporary file that is
+    // renamed, so the file is always whole. Throws std::runtime_error if it
+    // cannot be written.
+    static void write(const std::string& filename, const char* data, size_t len);
+    static void write(const std::string& filename, const std::string& data)
+    {
+      write(filename, data.data(), data.length());
+    }
+  private:
+    const char* data_;
+    size_t      size_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__mapped_file_h__
@@ -0,0 +1,344 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : memory_engine.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "memory_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <mutex>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  // Finds its position again for every move, so records can be written
+  // while it is used. Over a snapshot the map does not change, and no
+  // lock is needed.
+  class memory_cursor : public storage_engine::cursor
+  {
+  public:
+    memory_cursor(std::shared_mutex* mutex, std::shared_ptr<memory_engine::record_map>* live, std::shared_ptr<const memory_engine::record_map> fixed)
+      :
+      mutex_(mutex),
+      live_(live),
+      fixed_(fixed),
+      valid_(false)
+    {
+    }
+  public:
+    bool jump() override
+    {
+      return locked([&](const memory_engine::record_map& records)
+      {
+        return at(records.begin(), records);
+      });
+    }
+
+    bool jump(const std::string& key) override
+    {
+      return locked([&](const memory_engine::record_map& records)
+      {
+        return at(records.lower_bound(key), records);
+      });
+    }
+
+    bool jump_back(const std::string& key) override
+    {
+      return locked([&](const memory_engine::record_map& records)
+      {
+        auto it = records.upper_bound(key);
+
+        if ( it == records.begin() ) {
+          return valid_ = false;
+        }
+        return at(--it, records);
+      });
+    }
+
+    bool step() override
+    {
+      return locked([&](const memory_engine::record_map& records)
+      {
+        return valid_ && at(records.upper_bound(key_), records);
+      });
+    }
+
+    bool step_back() override
+    {
+      return locked([&](const memory_engine::record_map& records)
+      {
+        auto it = records.lower_bound(key_);
+
+        if ( !valid_ || it == records.begin() ) {
+          return valid_ = false;
+        }
+        return at(--it, records);
+      });
+    }
+  public:
+    bool get(std::string* key, std::string* value, bool step) override
+    {
+      return locked([&](const memory_engine::record_map& records)
+      {
+        if ( !valid_ ) {
+          return false;
+        }
+
+        // The record may have been removed since the cursor moved to it.
+        auto it = records.lower_bound(key_);
+
+        if ( !at(it, records) ) {
+          return false;
+        }
+
+        if ( key ) {
+          *key = it->first;
+        }
+
+        if ( value ) {
+          *value = it->second;
+        }
+
+        if ( step ) {
+          at(++it, records);
+        }
+        return true;
+      });
+    }
+  private:
+    template <typename F> bool locked(F func)
+    {
+      if ( fixed_ ) {
+        return func(*fixed_);
+      }
+
+      std::shared_lock<std::shared_mutex> lock(*mutex_);
+      return func(**live_);
+    }
+
+    bool at(memory_engine::record_map::const_iterator it, const memory_engine::record_map& records)
+    {
+      valid_ = it != records.end();
+
+      if ( valid_ ) {
+        key_ = it->first;
+      }
+      return valid_;
+    }
+  private:
+    std::shared_mutex*                               mutex_;
+    std::shared_ptr<memory_engine::record_map>*      live_;
+    std::shared_ptr<const memory_engine::record_map> fixed_;
+    std::string                                      key_;
+    bool                                             valid_;
+  };
+
+  class memory_snapshot : public storage_engine::snapshot
+  {
+  public:
+    memory_snapshot(std::shared_ptr<const memory_engine::record_map> records)
+      :
+      records_(records)
+    {
+    }
+  public:
+    bool get(const std::string& key, std::string* value) override
+    {
+      auto it = records_->find(key);
+
+      if ( it == records_->end() ) {
+        return false;
+      }
+
+      if ( value ) {
+        *value = it->second;
+      }
+      return true;
+    }
+
+    std::unique_ptr<storage_engine::cursor> make_cursor() override
+    {
+      return std::unique_ptr<storage_engine::cursor>(new memory_cursor(nullptr, nullptr, records_));
+    }
+  private:
+    std::shared_ptr<const memory_engine::record_map> records_;
+  };
+
+  memory_engine::memory_engine()
+    :
+    records_(std::make_shared<record_map>()),
+    in_transaction_(false)
+  {
+  }
+
+  int64_t memory_engine::count()
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return records_->size();
+  }
+
+  int64_t memory_engine::size()
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    int64_t result = 0;
+
+    for ( auto& record : *records_ ) {
+      result += record.first.length() + record.second.length();
+    }
+    return result;
+  }
+
+  bool memory_engine::get(const std::string& key, std::string* value)
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    auto it = records_->find(key);
+
+    if ( it == records_->end() ) {
+      return false;
+    }
+
+    if ( value ) {
+      *value = it->second;
+    }
+    return true;
+  }
+
+  bool memory_engine::set(const std::string& key, const std::string& value)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    before_write(key);
+    (*records_)[key] = value;
+
+    return true;
+  }
+
+  bool memory_engine::remove(const std::string& key)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    if ( records_->count(key) == 0 ) {
+      return false;
+    }
+
+    before_write(key);
+    records_->erase(key);
+
+    return true;
+  }
+
+  bool memory_engine::clear()
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    if ( in_transaction_ )
+    {
+      for ( auto& record : *records_ ) {
+        undo_.emplace(record.first, undo{ true, record.second });
+      }
+    }
+
+    records_ = std::make_shared<record_map>();
+
+    return true;
+  }
+
+  std::unique_ptr<storage_engine::cursor> memory_engine::make_cursor()
+  {
+    return std::unique_ptr<cursor>(new memory_cursor(&mutex_, &records_, nullptr));
+  }
+
+  std::unique_ptr<storage_engine::snapshot> memory_engine::make_snapshot()
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    if ( undo_.empty() ) {
+      return std::unique_ptr<snapshot>(new memory_snapshot(records_));
+    }
+
+    // Without the writes of the active transaction.
+    auto records = std::make_shared<record_map>(*records_);
+
+    for ( auto& entry : undo_ )
+    {
+      if ( entry.second.existed ) {
+        (*records)[entry.first] = entry.second.value;
+      }
+      else {
+        records->erase(entry.first);
+      }
+    }
+    return std::unique_ptr<snapshot>(new memory_snapshot(records));
+  }
+
+  bool memory_engine::begin_transaction(bool hard)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    if ( in_transaction_ ) {
+      return false;
+    }
+
+    in_transaction_ = true;
+    return true;
+  }
+
+  bool memory_engine::end_transaction(bool commit)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    if ( !in_transaction_ ) {
+      return false;
+    }
+
+    in_transaction_ = false;
+
+    if ( !commit )
+    {
+      for ( auto& entry : undo_ )
+      {
+        before_write(entry.first);
+
+        if ( entry.second.existed ) {
+          (*records_)[entry.first] = entry.second.value;
+        }
+        else {
+          records_->erase(entry.first);
+        }
+      }
+    }
+
+    undo_.clear();
+
+    return true;
+  }
+
+  // Called with the lock held, before key is written.
+  void memory_engine::before_write(const std::string& key)
+  {
+    // Shared with a snapshot.
+    if ( records_.use_count() > 1 ) {
+      records_ = std::make_shared<record_map>(*records_);
+    }
+
+    if ( in_transaction_ && undo_.count(key) == 0 )
+    {
+      auto it = records_->find(key);
+
+      if ( it != records_->end() ) {
+        undo_.emplace(key, undo{ true, it->second });
+      }
+      else {
+        undo_.emplace(key, undo{ false, std::string() });
+      }
+    }
+  }
+}
@@ -0,0 +1,71 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : memory_engine.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Storage engine keeping the records in a std::map, nothing is stored.
+//   For tests and benchmarks.
+//
+//   Snapshots share the map until it is written, the first write after a
+//   snapshot is taken copies it. One taken during a transaction is a copy
+//   with the records it wrote put back. A transaction keeps the value each record
+//   had before it was first written, to put back if it is rolled back.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__memory_engine_h__
+#define __dm__memory_engine_h__
+
+// ----------------------------------------------------------------------------
+#include "storage_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <map>
+#include <shared_mutex>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class memory_engine : public storage_engine
+  {
+  public:
+    using record_map = std::map<std::string, std::string>;
+  public:
+    memory_engine();
+  public:
+    int64_t count() override;
+    int64_t size() override;
+  public:
+    bool get(const std::string& key, std::string* value) override;
+    bool set(const std::string& key, const std::string& value) override;
+    bool remove(const std::string& key) override;
+    bool clear() override;
+  public:
+    std::unique_ptr<cursor>   make_cursor() override;
+    std::unique_ptr<snapshot> make_snapshot() override;
+  public:
+    bool begin_transaction(bool hard) override;
+    bool end_transaction(bool commit) override;
+  public:
+    bool synchronize(bool hard) override { return true; }
+  private:
+    void before_write(const std::string& key);
+  private:
+    struct undo
+    {
+      bool        existed;
+      std::string value;
+    };
+  private:
+    std::shared_mutex           mutex_;
+    std::shared_ptr<record_map> records_;
+    bool                        in_transaction_;
+    std::map<std::string, undo> undo_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__memory_engine_h__
@@ -0,0 +1,137 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : record_cache.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "record_cache.h"
+
+// ----------------------------------------------------------------------------
+#include <functional>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  record_cache::record_cache(size_t capacity, size_t num_shards)
+    :
+    shard_capacity_(capacity / num_shards),
+    shards_(num_shards)
+  {
+    for ( auto& shard : shards_ )
+    {
+      shard.size      = 0;
+      shard.epoch     = 0;
+      shard.hits      = 0;
+      shard.misses    = 0;
+      shard.evictions = 0;
+    }
+  }
+
+  record_cache::record_ptr record_cache::find(const std::string& key, uint64_t& ticket)
+  {
+    auto& shard = shard_of(key);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+
+    if ( it == shard.entries.end() )
+    {
+      shard.misses++;
+      ticket = shard.epoch;
+      return nullptr;
+    }
+
+    shard.hits++;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+
+    return it->second->record;
+  }
+
+  void record_cache::insert(const std::string& key, record_ptr record, size_t size, uint64_t ticket)
+  {
+    if ( size > shard_capacity_ ) {
+      return;
+    }
+
+    auto& shard = shard_of(key);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if ( ticket != shard.epoch || shard.entries.count(key) > 0 ) {
+      return;
+    }
+
+    shard.lru.push_front(entry{ key, std::move(record), size });
+    shard.entries.emplace(key, shard.lru.begin());
+    shard.size += size;
+
+    while ( shard.size > shard_capacity_ )
+    {
+      auto& last = shard.lru.back();
+
+      shard.size -= last.size;
+      shard.entries.erase(last.key);
+      shard.lru.pop_back();
+      shard.evictions++;
+    }
+  }
+
+  void record_cache::erase(const std::string& key)
+  {
+    auto& shard = shard_of(key);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    shard.epoch++;
+
+    auto it = shard.entries.find(key);
+
+    if ( it != shard.entries.end() )
+    {
+      shard.size -= it->second->size;
+      shard.lru.erase(it->second);
+      shard.entries.erase(it);
+    }
+  }
+
+  void record_cache::clear()
+  {
+    for ( auto& shard : shards_ )
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+
+      shard.epoch++;
+      shard.entries.clear();
+      shard.lru.clear();
+      shard.size = 0;
+    }
+  }
+
+  record_cache::statistics record_cache::stats() const
+  {
+    statistics result{ 0, 0, 0, 0, 0 };
+
+    for ( auto& shard : shards_ )
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+
+      result.hits      += shard.hits;
+      result.misses    += shard.misses;
+      result.evictions += shard.evictions;
+      result.records   += shard.entries.size();
+      result.size      += shard.size;
+    }
+    return result;
+  }
+
+  record_cache::shard& record_cache::shard_of(const std::string& key)
+  {
+    return shards_[std::hash<std::string>()(key) % shards_.size()];
+  }
+}
@@ -0,0 +1,94 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : record_cache.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Least recently used cache of decoded kvstore records. Records are
+//   immutable once cached and handed out as shared pointers, so any number
+//   of threads can use the same record without copying it.
+//
+//   Keys are spread over shards by hash, each with its own lock and lru
+//   list, so concurrent lookups of different records rarely wait for each
+//   other. The size of a record is the length of its encoding, and each
+//   shard evicts until it holds no more than its part of the capacity.
+//
+//   A record read from the database must not be cached if it was written
+//   while it was read. find hands out a ticket that insert checks, any
+//   erase in the shard in between makes the insert a no-op.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__record_cache_h__
+#define __dm__record_cache_h__
+
+// ----------------------------------------------------------------------------
+#include <json/json.h>
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class record_cache
+  {
+  public:
+    using record_ptr = std::shared_ptr<const json::value>;
+  public:
+    struct statistics
+    {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t evictions;
+      size_t   records;
+      size_t   size;
+    };
+  public:
+    record_cache(size_t capacity, size_t num_shards = 16);
+  public:
+    // Cached record or nullptr. On a miss ticket must be given to the
+    // insert of the record read from the database.
+    record_ptr find(const std::string& key, uint64_t& ticket);
+    void       insert(const std::string& key, record_ptr record, size_t size, uint64_t ticket);
+  public:
+    void erase(const std::string& key);
+    void clear();
+  public:
+    statistics stats() const;
+  private:
+    struct entry
+    {
+      std::string key;
+      record_ptr  record;
+      size_t      size;
+    };
+  private:
+    struct shard
+    {
+      mutable std::mutex                                          mutex;
+      std::list<entry>                                            lru;
+      std::unordered_map<std::string, std::list<entry>::iterator> entries;
+      size_t                                                      size;
+      uint64_t                                                    epoch;
+      uint64_t                                                    hits;
+      uint64_t                                                    misses;
+      uint64_t                                                    evictions;
+    };
+  private:
+    shard& shard_of(const std::string& key);
+  private:
+    size_t             shard_capacity_;
+    std::vector<shard> shards_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__record_cache_h__
@@ -0,0 +1,478 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : record_codec.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "record_codec.h"
+#include "base64.h"
+
+// ----------------------------------------------------------------------------
+#include <stdexcept>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  enum tag : uint8_t
+  {
+    tag_null    = 0x00,
+    tag_false   = 0x01,
+    tag_true    = 0x02,
+    tag_integer = 0x03,
+    tag_number  = 0x04,
+    tag_string  = 0x05,
+    tag_bytes   = 0x06,
+    tag_array   = 0x07,
+    tag_object  = 0x08
+  };
+
+  static void put_varint(std::string& buf, uint64_t v)
+  {
+    while ( v >= 0x80 )
+    {
+      buf.push_back(static_cast<char>(v | 0x80));
+      v >>= 7;
+    }
+    buf.push_back(static_cast<char>(v));
+  }
+
+  static void put_u32(std::string& buf, size_t pos, uint32_t v)
+  {
+    for ( int i = 0; i < 4; ++i ) {
+      buf[pos+i] = static_cast<char>(v >> (8*i));
+    }
+  }
+
+  static void put_string(std::string& buf, uint8_t tag, const char* s, size_t len)
+  {
+    buf.push_back(tag);
+    put_varint(buf, len);
+    buf.append(s, len);
+  }
+
+  // Bounds checked reading of an encoded record.
+  class reader
+  {
+  public:
+    reader(const char* pb, const char* pe) : it_(pb), pe_(pe) {}
+  public:
+    bool at_end() const { return it_ >= pe_; }
+  public:
+    uint8_t byte()
+    {
+      need(1);
+      return static_cast<uint8_t>(*it_++);
+    }
+  public:
+    uint64_t varint()
+    {
+      uint64_t v = 0;
+
+      for ( int shift = 0; shift < 64; shift += 7 )
+      {
+        uint8_t b = byte();
+
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+
+        if ( (b & 0x80) == 0 ) {
+          return v;
+        }
+      }
+      throw std::runtime_error("corrupt record, invalid varint");
+    }
+  public:
+    uint32_t u32()
+    {
+      need(4);
+
+      uint32_t v = 0;
+
+      for ( int i = 0; i < 4; ++i ) {
+        v |= static_cast<uint32_t>(static_cast<uint8_t>(it_[i])) << (8*i);
+      }
+      it_ += 4;
+      return v;
+    }
+  public:
+    const char* bytes(size_t n)
+    {
+      need(n);
+
+      const char* p = it_;
+      it_ += n;
+      return p;
+    }
+  public:
+    void skip_value()
+    {
+      switch ( byte() )
+      {
+        case tag_null:
+        case tag_false:
+        case tag_true:
+          break;
+        case tag_integer:
+          varint();
+          break;
+        case tag_number:
+          bytes(8);
+          break;
+        case tag_string:
+        case tag_bytes:
+          bytes(varint());
+          break;
+        case tag_array:
+        case tag_object:
+          bytes(u32());
+          break;
+        default:
+          throw std::runtime_error("corrupt record, unknown tag");
+      }
+    }
+  private:
+    void need(size_t n)
+    {
+      if ( static_cast<size_t>(pe_-it_) < n ) {
+        throw std::runtime_error("corrupt record, truncated");
+      }
+    }
+  private:
+    const char* it_;
+    const char* pe_;
+  };
+
+  static json::value decode_value(reader& r, const std::vector<std::string>& names)
+  {
+    switch ( r.byte() )
+    {
+      case tag_null:
+        return json::value();
+      case tag_false:
+        return json::value(false);
+      case tag_true:
+        return json::value(true);
+      case tag_integer:
+      {
+        uint64_t z = r.varint();
+        return json::value(static_cast<long long>((z >> 1) ^ -(z & 1)));
+      }
+      case tag_number:
+      {
+        const char* p = r.bytes(8);
+        uint64_t    bits = 0;
+        double      v;
+
+        for ( int i = 0; i < 8; ++i ) {
+          bits |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8*i);
+        }
+        memcpy(&v, &bits, sizeof(v));
+        return json::value(v);
+      }
+      case tag_string:
+      {
+        size_t len = r.varint();
+        return json::value(std::string(r.bytes(len), len));
+      }
+      case tag_bytes:
+      {
+        size_t len = r.varint();
+        return json::value(base64::encode(r.bytes(len), len));
+      }
+      case tag_array:
+      {
+        size_t      size  = r.u32();
+        json::array result;
+        size_t      count = r.varint();
+
+        if ( count > size ) {
+          throw std::runtime_error("corrupt record, invalid element count");
+        }
+
+        result.reserve(count);
+
+        for ( size_t i = 0; i < count; ++i ) {
+          result.push_back(decode_value(r, names));
+        }
+        return json::value(std::move(result));
+      }
+      case tag_object:
+      {
+        r.u32();
+
+        json::object result;
+        size_t       count = r.varint();
+
+        for ( size_t i = 0; i < count; ++i )
+        {
+          uint64_t id = r.varint();
+
+          if ( id >= names.size() ) {
+            throw std::runtime_error("corrupt record, unknown key id");
+          }
+          result.member(names[id], decode_value(r, names));
+        }
+        return json::value(std::move(result));
+      }
+      default:
+        throw std::runtime_error("corrupt record, unknown tag");
+    }
+  }
+
+  void record_codec::binary_member(const std::string& name)
+  {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    binary_members_.insert(name);
+  }
+
+  bool record_codec::is_binary(const char* data, size_t len)
+  {
+    return len >= 2 && static_cast<uint8_t>(data[0]) == marker;
+  }
+
+  bool record_codec::encode(const json::value& value, std::string& buf)
+  {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+
+    buf.clear();
+    buf.push_back(marker);
+    buf.push_back(version);
+
+    return encode_value(value, false, buf);
+  }
+
+  bool record_codec::encode_value(const json::value& value, bool binary, std::string& buf)
+  {
+    bool added = false;
+
+    switch ( value.type_id() )
+    {
+      case json::type::nul:
+        buf.push_back(tag_null);
+        break;
+      case json::type::fal:
+        buf.push_back(tag_false);
+        break;
+      case json::type::tru:
+        buf.push_back(tag_true);
+        break;
+      case json::type::i64:
+      {
+        int64_t v = value.as_integer();
+        buf.push_back(tag_integer);
+        put_varint(buf, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+        break;
+      }
+      case json::type::num:
+      {
+        double   v = value.as_number();
+        uint64_t bits;
+
+        memcpy(&bits, &v, sizeof(v));
+        buf.push_back(tag_number);
+
+        for ( int i = 0; i < 8; ++i ) {
+          buf.push_back(static_cast<char>(bits >> (8*i)));
+        }
+        break;
+      }
+      case json::type::str:
+      {
+        auto& s = value.as_string();
+
+        if ( binary )
+        {
+          // Only strings that are base64 exactly as encode writes it can be
+          // given back unchanged.
+          try
+          {
+            auto bytes = base64::decode(s.data(), s.length());
+
+            if ( base64::encode(bytes.data(), bytes.length()) == s )
+            {
+              put_string(buf, tag_bytes, bytes.data(), bytes.length());
+              break;
+            }
+          }
+          catch ( const std::runtime_error& )
+          {
+          }
+        }
+        put_string(buf, tag_string, s.data(), s.length());
+        break;
+      }
+      case json::type::arr:
+      {
+        auto& arr = value.as_array();
+
+        buf.push_back(tag_array);
+
+        size_t size_pos = buf.length();
+
+        buf.append(4, '\0');
+        put_varint(buf, arr.size());
+
+        for ( auto& element : arr ) {
+          added |= encode_value(element, false, buf);
+        }
+
+        put_u32(buf, size_pos, buf.length()-size_pos-4);
+        break;
+      }
+      case json::type::obj:
+      {
+        auto& obj = value.as_object();
+
+        buf.push_back(tag_object);
+
+        size_t size_pos = buf.length();
+
+        buf.append(4, '\0');
+        put_varint(buf, obj.size());
+
+        for ( auto& member : obj )
+        {
+          put_varint(buf, key_id(member.first, added));
+          added |= encode_value(member.second, binary_members_.count(member.first) > 0, buf);
+        }
+
+        put_u32(buf, size_pos, buf.length()-size_pos-4);
+        break;
+      }
+    }
+    return added;
+  }
+
+  uint32_t record_codec::key_id(const std::string& name, bool& added)
+  {
+    auto it = ids_.find(name);
+
+    if ( it != ids_.end() ) {
+      return it->second;
+    }
+
+    uint32_t id = names_.size();
+
+    names_.push_back(name);
+    ids_.emplace(name, id);
+    added = true;
+
+    return id;
+  }
+
+  json::value record_codec::decode(const char* data, size_t len) const
+  {
+    if ( !is_binary(data, len) ) {
+      throw std::runtime_error("not a binary record");
+    }
+
+    if ( static_cast<uint8_t>(data[1]) != version ) {
+      throw std::runtime_error("unsupported record version");
+    }
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    reader r(data+2, data+len);
+    return decode_value(r, names_);
+  }
+
+  bool record_codec::project(const char* data, size_t len, const std::vector<std::string>& fields, std::vector<json::value>& values) const
+  {
+    values.assign(fields.size(), json::value());
+
+    if ( !is_binary(data, len) || static_cast<uint8_t>(data[1]) != version ) {
+      throw std::runtime_error("not a binary record");
+    }
+
+    reader r(data+2, data+len);
+
+    if ( r.byte() != tag_object ) {
+      return false;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    // Names that have no id can not be in any record.
+    std::vector<int64_t> field_ids(fields.size(), -1);
+    size_t               remaining = 0;
+
+    for ( size_t i = 0; i < fields.size(); ++i )
+    {
+      auto it = ids_.find(fields[i]);
+
+      if ( it != ids_.end() )
+      {
+        field_ids[i] = it->second;
+        remaining++;
+      }
+    }
+
+    r.u32();
+
+    size_t count = r.varint();
+
+    for ( size_t n = 0; n < count && remaining > 0; ++n )
+    {
+      int64_t id    = r.varint();
+      bool    found = false;
+
+      for ( size_t i = 0; i < fields.size(); ++i )
+      {
+        if ( field_ids[i] == id )
+        {
+          values[i] = decode_value(r, names_);
+          field_ids[i] = -1;
+          remaining--;
+          found = true;
+          break;
+        }
+      }
+
+      if ( !found ) {
+        r.skip_value();
+      }
+    }
+    return true;
+  }
+
+  json::value record_codec::keys() const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    json::array result;
+
+    result.reserve(names_.size());
+
+    for ( auto& name : names_ ) {
+      result.push_back(name);
+    }
+    return json::value(std::move(result));
+  }
+
+  void record_codec::keys(const json::value& names)
+  {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+
+    names_.clear();
+    ids_.clear();
+
+    if ( !names.is_array() ) {
+      return;
+    }
+
+    for ( auto& name : names.as_array() )
+    {
+      if ( !name.is_string() ) {
+        throw std::runtime_error("invalid key table");
+      }
+
+      ids_.emplace(name.as_string(), names_.size());
+      names_.push_back(name.as_string());
+    }
+  }
+}
@@ -0,0 +1,99 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : record_codec.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Binary encoding of the records kept in the kvstore.
+//
+//     record  := 0xff version value
+//     value   := null | false | true | integer | number | string | bytes
+//              | array | object
+//     null    := 0x00
+//     false   := 0x01
+//     true    := 0x02
+//     integer := 0x03 varint (zigzag)
+//     number  := 0x04 double (8 bytes, little endian)
+//     string  := 0x05 varint length, utf-8 bytes
+//     bytes   := 0x06 varint length, bytes
+//     array   := 0x07 size, varint count, value*
+//     object  := 0x08 size, varint count, (varint key id, value)*
+//
+//   size is the number of bytes following it in the container, as 4 bytes
+//   little endian, so a container can be skipped without decoding it.
+//   Member names are interned, a record only holds the id of each name.
+//   The table mapping ids to names is kept by the codec and must be stored
+//   along with the records.
+//
+//   Strings of the members registered as binary members are expected to
+//   be base64 and are stored decoded as bytes. They are base64 encoded
+//   again when decoded, so the records given back are the same as those
+//   stored.
+//
+//   Stored json text never starts with 0xff, as it is not valid utf-8, so
+//   both kinds of records can be told apart and read.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__record_codec_h__
+#define __dm__record_codec_h__
+
+// ----------------------------------------------------------------------------
+#include <json/json.h>
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class record_codec
+  {
+  public:
+    static const uint8_t marker  = 0xff;
+    static const uint8_t version = 1;
+  public:
+    // Register a member whose string values are stored as bytes.
+    void binary_member(const std::string& name);
+  public:
+    static bool is_binary(const char* data, size_t len);
+    static bool is_binary(const std::string& data) { return is_binary(data.data(), data.length()); }
+  public:
+    // Encode value into buf, replacing its contents. Returns true if names
+    // not seen before were added to the key table, in which case it must
+    // be stored again before the record is.
+    bool encode(const json::value& value, std::string& buf);
+  public:
+    json::value decode(const char* data, size_t len) const;
+    json::value decode(const std::string& data) const { return decode(data.data(), data.length()); }
+  public:
+    // Decode the members named in fields, skipping everything else.
+    // values is resized to fields.size() and values[i] is set to the
+    // member named fields[i], or null if there is none. Returns false if
+    // the record is not an object.
+    bool project(const char* data, size_t len, const std::vector<std::string>& fields, std::vector<json::value>& values) const;
+  public:
+    // The key table, a json array of names indexed by id.
+    json::value keys() const;
+    void        keys(const json::value& names);
+  private:
+    bool     encode_value(const json::value& value, bool binary, std::string& buf);
+    uint32_t key_id(const std::string& name, bool& added);
+  private:
+    // Records are decoded concurrently, the tables only change on encode.
+    mutable std::shared_mutex                 mutex_;
+    std::vector<std::string>                  names_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::set<std::string>                     binary_members_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__record_codec_h__
@@ -1,44 +1,44 @@
 // ----------------------------------------------------------------------------
 //
-//     Filename   : track_alt_index.h
+//     Filename   : sha256.h
 //
 //     Author     : Benny Bach <benny.bach@gmail.com>
 //                  Copyright (C) 2014
 //
 // --- Description: -----------------------------------------------------------
 //
+//   SHA-256 digest (FIPS 180-4), used to name blobs by their content.
 //
 // ----------------------------------------------------------------------------
-#ifndef __dm__track_alt_index_h__
-#define __dm__track_alt_index_h__
-
-// ----------------------------------------------------------------------------
-#include <kcdbext.h>
+#ifndef __dm__sha256_h__
+#define __dm__sha256_h__
 
 // ----------------------------------------------------------------------------
 #include <string>
+#include <cstdint>
 
 // ----------------------------------------------------------------------------
 namespace dm
 {
-  class track_alt_index
+  class sha256
   {
   public:
-    track_alt_index();
-  public:
-    ~track_alt_index();
+    sha256();
   public:
-    int64_t count();
-  public:
-    bool set(const std::string& key, const std::string& track_id);
-    //bool remove(const std::string& key);
-  public:
-    bool get(const std::string& key, std::string* value);
+    void update(const char* data, size_t len);
+    // Digest of the data given to update, as 64 lower case hex digits.
+    std::string hex_digest();
   public:
+    static std::string hex_digest(const char* data, size_t len);
+  private:
+    void transform(const uint8_t* block);
   private:
-    kyotocabinet::IndexDB db_;
+    uint32_t state_[8];
+    uint8_t  block_[64];
+    size_t   block_len_;
+    uint64_t total_len_;
   };
 }
 
 // ----------------------------------------------------------------------------
-#endif // __dm__track_alt_index_h__
+#endif // __dm__sha256_h__
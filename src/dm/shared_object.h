@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : shared_object.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Data of an artist, album or track. Found records share the immutable
+//   record of the kvstore record cache, which is only copied the first time
+//   the data is modified.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__shared_object_h__
+#define __dm__shared_object_h__
+
+// ----------------------------------------------------------------------------
+#include "record_cache.h"
+
+// ----------------------------------------------------------------------------
+#include <json/json.h>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class shared_object
+  {
+  public:
+    shared_object() : record_(), data_()
+    {
+    }
+  public:
+    shared_object(json::object&& data) : record_(), data_(std::move(data))
+    {
+    }
+  public:
+    // record must be an object.
+    shared_object(record_cache::record_ptr record) : record_(std::move(record)), data_()
+    {
+    }
+  public:
+    const json::object& get() const
+    {
+      return record_ ? record_->as_object() : data_;
+    }
+  public:
+    json::object& get_mutable()
+    {
+      if ( record_ )
+      {
+        data_ = record_->as_object();
+        record_.reset();
+      }
+      return data_;
+    }
+  public:
+    json::object release()
+    {
+      return std::move(get_mutable());
+    }
+  private:
+    record_cache::record_ptr record_;
+    json::object             data_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__shared_object_h__
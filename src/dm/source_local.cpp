@@ -20,6 +20,9 @@
 #include <taglib/flacfile.h>
 #include <taglib/xiphcomment.h>
 
+#include <chrono>
+#include <memory>
+
 namespace dm
 {
   kvstore* source_local::kvstore_ = nullptr;
@@ -27,6 +30,10 @@ namespace dm
   const std::string source_local_key = "source/local";
   const std::string directories_key  = "directories";
 
+  // The writes of this many files are committed together, instead of
+  // synchronizing the database for every record.
+  const size_t files_per_commit = 64;
+
   void source_local::init(kvstore* store)
   {
     source_local::kvstore_ = store;
@@ -84,20 +91,18 @@ namespace dm
 
     std::map<std::string, bool> local_track_ids;
 
-    dm::track::each([&](dm::track& track) -> bool
-    {
-      auto source = track.find_source("local");
-
-      if ( !source.is_null() ) {
-        local_track_ids[track.id()] = false;
-      }
-
-      return true;
-    });
+    for ( auto& id : dm::track::find_ids_by_source("local") ) {
+      local_track_ids[id] = false;
+    }
 
     /////
     // Scan local source directories.
 
+    auto   start = std::chrono::steady_clock::now();
+    size_t files = 0;
+
+    std::unique_ptr<kvstore::transaction> transaction;
+
     for ( auto& dirname : directories() )
     {
       auto dir = file_system::directory{dirname};
@@ -106,6 +111,10 @@ namespace dm
       {
         if ( file_system::extension(filename) == "flac" )
         {
+          if ( !transaction ) {
+            transaction.reset(new kvstore::transaction(*kvstore_));
+          }
+
           auto track = scan_flac_file(filename);
 
           if ( !track.is_null() )
@@ -116,10 +125,20 @@ namespace dm
           {
             // Invalid file?
           }
+
+          if ( ++files % files_per_commit == 0 )
+          {
+            transaction->commit();
+            transaction.reset();
+          }
         }
       });
     }
 
+    if ( !transaction ) {
+      transaction.reset(new kvstore::transaction(*kvstore_));
+    }
+
     /////
     // Remove local source from the track ids remaining in the
     // local_tracks list.
@@ -135,6 +154,14 @@ namespace dm
         track.source_remove("local");
       }
     }
+
+    transaction->commit();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+    std::cerr
+      << "scanned " << files << " files in " << elapsed << " s, "
+      << (files / elapsed) << " files/s" << std::endl;
   }
 
   dm::track source_local::scan_flac_file(const std::string& filename)
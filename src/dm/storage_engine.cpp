@@ -0,0 +1,87 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : storage_engine.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "storage_engine.h"
+#include "kyoto_engine.h"
+#include "lmdb_engine.h"
+#include "memory_engine.h"
+#include "versioned_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <stdexcept>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  std::unique_ptr<storage_engine> storage_engine::open(type engine, const std::string& filename, bool journal)
+  {
+    switch ( engine )
+    {
+      case type::kyoto:
+      {
+        std::unique_ptr<storage_engine> db(new kyoto_engine(filename, journal));
+        return std::unique_ptr<storage_engine>(new versioned_engine(std::move(db)));
+      }
+      case type::lmdb:
+        return std::unique_ptr<storage_engine>(new lmdb_engine(filename));
+      case type::memory:
+        return std::unique_ptr<storage_engine>(new memory_engine());
+    }
+    throw std::runtime_error("unknown storage engine");
+  }
+
+  storage_engine::type storage_engine::parse_type(const std::string& name)
+  {
+    if ( name == "kyoto" ) {
+      return type::kyoto;
+    }
+    else if ( name == "lmdb" ) {
+      return type::lmdb;
+    }
+    else if ( name == "memory" ) {
+      return type::memory;
+    }
+    else {
+      throw std::runtime_error("unknown storage engine " + name);
+    }
+  }
+
+  int64_t storage_engine::increment(const std::string& key, int64_t num)
+  {
+    std::string value;
+    uint64_t    n = 0;
+
+    if ( get(key, &value) )
+    {
+      if ( value.length() != 8 ) {
+        throw std::runtime_error("storage engine increment of a record that is not a number");
+      }
+
+      for ( auto c : value ) {
+        n = (n << 8) | static_cast<unsigned char>(c);
+      }
+    }
+
+    n += static_cast<uint64_t>(num);
+
+    value.assign(8, '\0');
+
+    for ( int i = 0; i < 8; ++i ) {
+      value[i] = static_cast<char>(n >> (56 - 8*i));
+    }
+
+    if ( !set(key, value) ) {
+      throw std::runtime_error("storage engine increment error");
+    }
+
+    return static_cast<int64_t>(n);
+  }
+}
@@ -0,0 +1,134 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : storage_engine.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Ordered key value storage the kvstore and its indexes are kept in.
+//   Records are ordered by key, byte by byte, and visited with cursors.
+//
+//   One transaction is active at a time. The writes made while it is are
+//   applied all or nothing. Other writers wait, or must be kept out by the
+//   caller. Readers are not kept out, what they see of the writes of an
+//   active transaction depends on the engine.
+//
+//   A file opened with journal set journals every write, also those made
+//   outside a transaction, so after a crash opening it rolls back the
+//   interrupted write instead of repairing the whole file.
+//
+//   A snapshot is a read only view of the records as they were at the last
+//   commit before it was taken. Writes of the active transaction are not
+//   seen, nor are writes made after it was taken. Engines that cannot take
+//   one return nullptr, open gives them snapshots with versioned_engine.
+//
+//   Engines:
+//
+//     kyoto   kyotocabinet b+ tree file, the default. Needs defrag to reuse
+//             the space of removed and rewritten records. Snapshots are
+//             kept by versioned_engine.
+//     lmdb    lmdb memory mapped b+ tree file. Readers see the last committed
+//             records, except on the thread running the transaction. Keys
+//             are at most 511 bytes. Always journaled, free pages are reused
+//             as it writes.
+//     memory  std::map, nothing is stored. For tests and benchmarks.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__storage_engine_h__
+#define __dm__storage_engine_h__
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <memory>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class storage_engine
+  {
+  public:
+    enum class type
+    {
+      kyoto,
+      lmdb,
+      memory
+    };
+  public:
+    // Cursors are not safe to use from several threads at once.
+    class cursor
+    {
+    public:
+      virtual ~cursor() {}
+    public:
+      // Move to the first record, or the first with a key not less than
+      // key.
+      virtual bool jump() = 0;
+      virtual bool jump(const std::string& key) = 0;
+      // Move to the last record with a key not greater than key.
+      virtual bool jump_back(const std::string& key) = 0;
+      // Move to the next, or the previous, record.
+      virtual bool step() = 0;
+      virtual bool step_back() = 0;
+    public:
+      // Key and value, either may be nullptr, of the record the cursor is
+      // at. Moves to the next record after if step is true.
+      virtual bool get(std::string* key, std::string* value, bool step = false) = 0;
+    public:
+      bool get_key(std::string* key, bool step = false) { return get(key, nullptr, step); }
+      bool get_value(std::string* value, bool step = false) { return get(nullptr, value, step); }
+    };
+  public:
+    class snapshot
+    {
+    public:
+      virtual ~snapshot() {}
+    public:
+      virtual bool get(const std::string& key, std::string* value) = 0;
+      virtual std::unique_ptr<cursor> make_cursor() = 0;
+    };
+  public:
+    // Open, or create, the file of an engine of the given type.
+    static std::unique_ptr<storage_engine> open(type engine, const std::string& filename, bool journal = false);
+    // Type by name, kyoto, lmdb or memory.
+    static type parse_type(const std::string& name);
+  public:
+    virtual ~storage_engine() {}
+  public:
+    virtual int64_t count() = 0;
+    // Bytes taken, the size of the file for engines that keep one.
+    virtual int64_t size() = 0;
+  public:
+    virtual bool get(const std::string& key, std::string* value) = 0;
+    virtual bool set(const std::string& key, const std::string& value) = 0;
+    virtual bool remove(const std::string& key) = 0;
+    // Remove every record.
+    virtual bool clear() = 0;
+  public:
+    // Add num to the number stored at key, 0 if there is none, and return
+    // the sum. Stored as 8 bytes big endian, as kyotocabinet does. Callers
+    // must keep other writers of key out.
+    virtual int64_t increment(const std::string& key, int64_t num);
+  public:
+    virtual std::unique_ptr<cursor>   make_cursor() = 0;
+    virtual std::unique_ptr<snapshot> make_snapshot() { return nullptr; }
+  public:
+    // Writes of a hard transaction are on the device when it commits.
+    virtual bool begin_transaction(bool hard = false) = 0;
+    virtual bool end_transaction(bool commit = true) = 0;
+  public:
+    // Write everything to the file, and to the device if hard.
+    virtual bool synchronize(bool hard = false) = 0;
+  public:
+    // Move records into the space left by removed and rewritten ones, steps
+    // records at a time. Each call continues where the last stopped, and
+    // starts over at the beginning after the end of the file. Must not be
+    // called in a transaction.
+    virtual bool defrag(int64_t steps) { return true; }
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__storage_engine_h__
@@ -0,0 +1,216 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : string_pool.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "string_pool.h"
+
+// ----------------------------------------------------------------------------
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  static const size_t chunk_size = 64*1024;
+
+  string_pool::string_pool()
+    :
+    chunks_(),
+    chunk_bytes_(0),
+    chunk_used_(chunk_size),
+    strings_(),
+    table_(),
+    interned_(0),
+    mapped_(),
+    mapped_bytes_(0)
+  {
+  }
+
+  uint32_t string_pool::intern(std::string_view s)
+  {
+    if ( (interned_ + 1) * 2 > table_.size() ) {
+      grow();
+    }
+
+    auto pos = position(s);
+
+    if ( table_[pos] != none ) {
+      return table_[pos];
+    }
+
+    auto ordinal = add(s);
+
+    table_[pos] = ordinal;
+    interned_++;
+
+    return ordinal;
+  }
+
+  uint32_t string_pool::add(std::string_view s)
+  {
+    auto ordinal = static_cast<uint32_t>(strings_.size());
+
+    strings_.emplace_back(copy(s), s.length());
+
+    return ordinal;
+  }
+
+  uint32_t string_pool::find(std::string_view s) const
+  {
+    return table_.empty() ? none : table_[position(s)];
+  }
+
+  size_t string_pool::memory() const
+  {
+    return chunk_bytes_ + mapped_bytes_ +
+      strings_.capacity() * sizeof(std::string_view) +
+      table_.capacity() * sizeof(uint32_t);
+  }
+
+  void string_pool::save(std::string& chars, std::vector<uint32_t>& ends, std::vector<uint32_t>& table) const
+  {
+    ends.reserve(strings_.size());
+
+    for ( auto& s : strings_ )
+    {
+      chars.append(s.data(), s.length());
+
+      if ( chars.length() > UINT32_MAX ) {
+        throw std::runtime_error("string pool too large");
+      }
+      ends.push_back(static_cast<uint32_t>(chars.length()));
+    }
+
+    table = table_;
+  }
+
+  void string_pool::load(std::shared_ptr<const mapped_file> file,
+                         const char* chars, size_t size,
+                         const uint32_t* ends, size_t count,
+                         std::vector<uint32_t> table)
+  {
+    std::vector<std::string_view> strings;
+
+    strings.reserve(count);
+
+    size_t begin = 0;
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+      if ( ends[i] < begin || ends[i] > size ) {
+        throw std::runtime_error("string pool load error");
+      }
+      strings.emplace_back(chars + begin, ends[i] - begin);
+      begin = ends[i];
+    }
+
+    size_t interned = 0;
+
+    if ( (table.size() & (table.size() - 1)) != 0 ) {
+      throw std::runtime_error("string pool load error");
+    }
+
+    for ( auto ordinal : table )
+    {
+      if ( ordinal != none && ordinal >= count ) {
+        throw std::runtime_error("string pool load error");
+      }
+      interned += ordinal != none;
+    }
+
+    if ( !table.empty() && interned * 2 > table.size() ) {
+      throw std::runtime_error("string pool load error");
+    }
+
+    chunks_.clear();
+    chunk_bytes_  = 0;
+    chunk_used_   = chunk_size;
+    strings_      = std::move(strings);
+    table_        = std::move(table);
+    interned_     = interned;
+    mapped_       = std::move(file);
+    mapped_bytes_ = size;
+  }
+
+  uint64_t string_pool::hash(const char* data, size_t len)
+  {
+    uint64_t hash = 14695981039346656037ull;
+
+    for ( size_t i = 0; i < len; ++i )
+    {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  size_t string_pool::position(std::string_view s) const
+  {
+    auto mask = table_.size() - 1;
+
+    for ( auto pos = hash(s.data(), s.length()) & mask;; pos = (pos + 1) & mask )
+    {
+      auto ordinal = table_[pos];
+
+      if ( ordinal == none || strings_[ordinal] == s ) {
+        return pos;
+      }
+    }
+  }
+
+  void string_pool::grow()
+  {
+    std::vector<uint32_t> old(std::max<size_t>(table_.size() * 2, 1024), none);
+
+    old.swap(table_);
+
+    for ( auto ordinal : old )
+    {
+      if ( ordinal != none ) {
+        table_[position(strings_[ordinal])] = ordinal;
+      }
+    }
+  }
+
+  const char* string_pool::copy(std::string_view s)
+  {
+    if ( s.empty() ) {
+      return "";
+    }
+
+    // Long strings get a chunk of their own.
+    if ( s.length() > chunk_size / 4 )
+    {
+      chunks_.emplace_back(new char[s.length()]);
+      chunk_bytes_ += s.length();
+      chunk_used_   = chunk_size;
+
+      auto p = chunks_.back().get();
+
+      memcpy(p, s.data(), s.length());
+      return p;
+    }
+
+    if ( chunk_used_ + s.length() > chunk_size )
+    {
+      chunks_.emplace_back(new char[chunk_size]);
+      chunk_bytes_ += chunk_size;
+      chunk_used_   = 0;
+    }
+
+    auto p = chunks_.back().get() + chunk_used_;
+
+    memcpy(p, s.data(), s.length());
+    chunk_used_ += s.length();
+
+    return p;
+  }
+}
@@ -0,0 +1,98 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : string_pool.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Strings referred to by 32 bit ordinals. The characters are copied to
+//   chunks that are never moved or freed, so the views given out stay
+//   valid as long as the pool. Interned strings are also found by their
+//   text, adding an equal string again gives the same ordinal. They are
+//   found in an open addressed table of ordinals, 8 bytes or less per
+//   string, rather than a map of nodes.
+//
+//   A pool saved to a file can be loaded with its characters left in the
+//   mapped file, see load.
+//
+//   Not thread safe.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__string_pool_h__
+#define __dm__string_pool_h__
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+#include "mapped_file.h"
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class string_pool
+  {
+  public:
+    // Ordinal of no string.
+    static constexpr uint32_t none = UINT32_MAX;
+  public:
+    string_pool();
+  public:
+    // Ordinal of s, added if it is not in the pool.
+    uint32_t intern(std::string_view s);
+    // Ordinal of a new copy of s, not found by its text. For strings
+    // rarely equal to others, like titles of tracks.
+    uint32_t add(std::string_view s);
+    // Ordinal of s if it is interned, none otherwise.
+    uint32_t find(std::string_view s) const;
+  public:
+    std::string_view get(uint32_t ordinal) const { return strings_[ordinal]; }
+  public:
+    size_t size() const { return strings_.size(); }
+    // Bytes taken by the pool, mapped characters included.
+    size_t memory() const;
+  public:
+    // FNV-1a hash of the characters. The same on every build, so a table
+    // of interned strings saved by one can be loaded by another.
+    static uint64_t hash(const char* data, size_t len);
+  public:
+    // The strings as one block of characters and the offset each of them
+    // ends at, and the table of interned strings.
+    void save(std::string& chars, std::vector<uint32_t>& ends, std::vector<uint32_t>& table) const;
+    // Replace the strings with those saved, in the block of characters of
+    // length size. The characters are not copied, file is kept as long as
+    // the pool. Throws std::runtime_error if they are not valid.
+    void load(std::shared_ptr<const mapped_file> file,
+              const char* chars, size_t size,
+              const uint32_t* ends, size_t count,
+              std::vector<uint32_t> table);
+  private:
+    const char* copy(std::string_view s);
+    // Position of s in the table, or of the empty entry it would take.
+    size_t      position(std::string_view s) const;
+    void        grow();
+  private:
+    using chunk_ptr = std::unique_ptr<char[]>;
+  private:
+    std::vector<chunk_ptr>             chunks_;
+    size_t                             chunk_bytes_;
+    size_t                             chunk_used_;
+    std::vector<std::string_view>      strings_;
+    // Ordinals of the interned strings, none if the entry is empty. At
+    // most half of the entries are used.
+    std::vector<uint32_t>              table_;
+    size_t                             interned_;
+    // File the loaded characters are in.
+    std::shared_ptr<const mapped_file> mapped_;
+    size_t                             mapped_bytes_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__string_pool_h__
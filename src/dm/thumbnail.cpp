@@ -0,0 +1,219 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : thumbnail.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "thumbnail.h"
+
+// ----------------------------------------------------------------------------
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <csetjmp>
+
+// ----------------------------------------------------------------------------
+#include <jpeglib.h>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  const int thumbnail_quality = 85;
+
+  // libjpeg exits on errors unless error_exit returns some other way.
+  struct jpeg_error
+  {
+    struct jpeg_error_mgr mgr;
+    jmp_buf               jump;
+  };
+
+  static void jpeg_error_exit(j_common_ptr cinfo)
+  {
+    longjmp(reinterpret_cast<jpeg_error*>(cinfo->err)->jump, 1);
+  }
+
+  static void jpeg_no_output(j_common_ptr cinfo)
+  {
+  }
+
+  struct rgb_image
+  {
+    unsigned                   width;
+    unsigned                   height;
+    std::vector<unsigned char> rgb;
+  };
+
+  // Decode at 1/1, 1/2, 1/4 or 1/8, the smallest that is at least size
+  // pixels on the longest side.
+  static bool decode(const std::string& jpeg, unsigned size, rgb_image& result)
+  {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error             error;
+
+    cinfo.err = jpeg_std_error(&error.mgr);
+    error.mgr.error_exit     = jpeg_error_exit;
+    error.mgr.output_message = jpeg_no_output;
+
+    if ( setjmp(error.jump) )
+    {
+      jpeg_destroy_decompress(&cinfo);
+      return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, reinterpret_cast<unsigned char*>(const_cast<char*>(jpeg.data())), jpeg.size());
+
+    if ( jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK )
+    {
+      jpeg_destroy_decompress(&cinfo);
+      return false;
+    }
+
+    auto longest = std::max(cinfo.image_width, cinfo.image_height);
+
+    if ( longest <= size || cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK )
+    {
+      jpeg_destroy_decompress(&cinfo);
+      return false;
+    }
+
+    unsigned denom = 1;
+
+    while ( denom < 8 && longest / (denom * 2) >= size ) {
+      denom *= 2;
+    }
+
+    cinfo.scale_num       = 1;
+    cinfo.scale_denom     = denom;
+    cinfo.out_color_space = JCS_RGB;
+
+    jpeg_start_decompress(&cinfo);
+
+    result.width  = cinfo.output_width;
+    result.height = cinfo.output_height;
+    result.rgb.resize(size_t(result.width) * result.height * 3);
+
+    while ( cinfo.output_scanline < cinfo.output_height )
+    {
+      JSAMPROW row = &result.rgb[size_t(cinfo.output_scanline) * result.width * 3];
+      jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return true;
+  }
+
+  // Each pixel is the average of the source pixels it covers.
+  static rgb_image scale(const rgb_image& src, unsigned width, unsigned height)
+  {
+    rgb_image dst{ width, height, std::vector<unsigned char>(size_t(width) * height * 3) };
+
+    for ( unsigned y = 0; y < height; ++y )
+    {
+      unsigned y0 = size_t(y) * src.height / height;
+      unsigned y1 = std::max<unsigned>(y0 + 1, size_t(y + 1) * src.height / height);
+
+      for ( unsigned x = 0; x < width; ++x )
+      {
+        unsigned x0 = size_t(x) * src.width / width;
+        unsigned x1 = std::max<unsigned>(x0 + 1, size_t(x + 1) * src.width / width);
+
+        unsigned sum[3] = { 0, 0, 0 };
+
+        for ( unsigned sy = y0; sy < y1; ++sy )
+        {
+          auto p = &src.rgb[(size_t(sy) * src.width + x0) * 3];
+
+          for ( unsigned sx = x0; sx < x1; ++sx, p += 3 )
+          {
+            sum[0] += p[0];
+            sum[1] += p[1];
+            sum[2] += p[2];
+          }
+        }
+
+        unsigned n = (y1 - y0) * (x1 - x0);
+        auto     d = &dst.rgb[(size_t(y) * width + x) * 3];
+
+        d[0] = (sum[0] + n / 2) / n;
+        d[1] = (sum[1] + n / 2) / n;
+        d[2] = (sum[2] + n / 2) / n;
+      }
+    }
+    return dst;
+  }
+
+  static bool encode(const rgb_image& img, std::string& jpeg)
+  {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error           error;
+    unsigned char*              buf = nullptr;
+    unsigned long               len = 0;
+
+    cinfo.err = jpeg_std_error(&error.mgr);
+    error.mgr.error_exit     = jpeg_error_exit;
+    error.mgr.output_message = jpeg_no_output;
+
+    if ( setjmp(error.jump) )
+    {
+      jpeg_destroy_compress(&cinfo);
+      free(buf);
+      return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &buf, &len);
+
+    cinfo.image_width      = img.width;
+    cinfo.image_height     = img.height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space   = JCS_RGB;
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, thumbnail_quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    while ( cinfo.next_scanline < cinfo.image_height )
+    {
+      JSAMPROW row = const_cast<unsigned char*>(&img.rgb[size_t(cinfo.next_scanline) * img.width * 3]);
+      jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    jpeg.assign(reinterpret_cast<char*>(buf), len);
+    free(buf);
+
+    return true;
+  }
+
+  bool make_thumbnail(const std::string& jpeg, unsigned size, std::string& thumbnail)
+  {
+    rgb_image src;
+
+    if ( size == 0 || !decode(jpeg, size, src) ) {
+      return false;
+    }
+
+    unsigned width  = size;
+    unsigned height = size;
+
+    if ( src.width > src.height ) {
+      height = std::max<unsigned>(1, (size_t(src.height) * size + src.width / 2) / src.width);
+    }
+    else if ( src.height > src.width ) {
+      width = std::max<unsigned>(1, (size_t(src.width) * size + src.height / 2) / src.height);
+    }
+
+    return encode(scale(src, width, height), thumbnail);
+  }
+}
@@ -0,0 +1,31 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : thumbnail.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Scaled down copies of jpeg images. The image is decoded at the smallest
+//   of the scales libjpeg can decode at directly that is still larger than
+//   the thumbnail, and averaged down from there.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__thumbnail_h__
+#define __dm__thumbnail_h__
+
+// ----------------------------------------------------------------------------
+#include <string>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  // Jpeg of the image scaled to fit in size x size pixels, keeping the
+  // aspect ratio. Returns false if the image is not a jpeg that can be
+  // decoded, or already fits.
+  bool make_thumbnail(const std::string& jpeg, unsigned size, std::string& thumbnail);
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__thumbnail_h__
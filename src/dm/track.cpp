@@ -14,59 +14,105 @@
 
 namespace dm
 {
-  kvstore*        track::kvstore_ = nullptr;
-  track_alt_index track::index_;
+  kvstore* track::kvstore_ = nullptr;
+
+  // Track keys are base62 counters starting at t00000.
+  const std::string track_prefix = "t";
+
+  const std::string tag_index    = "track/tag";
+  const std::string source_index = "track/source";
+  const std::string alt_id_index = "track/alt_id";
 
   track_source::track_source()
     :
-    data_()
+    null_(true),
+    name_(),
+    uri_()
   {
   }
 
-  track_source::track_source(json::object data)
+  track_source::track_source(const json::object& data)
     :
-    data_(std::move(data))
+    null_(data.empty()),
+    name_(),
+    uri_()
   {
+    if ( data.has_member("name") && data.at("name").is_string() ) {
+      name_ = data.at("name").as_string();
+    }
+    if ( data.has_member("uri") && data.at("uri").is_string() ) {
+      uri_ = data.at("uri").as_string();
+    }
   }
 
   bool track_source::is_null()
   {
-    return data_.empty();
+    return null_;
   }
 
   const std::string& track_source::name() const
   {
-    return data_.at("name").as_string();
+    return name_;
   }
 
   const std::string& track_source::uri() const
   {
-    return data_.at("uri").as_string();
+    return uri_;
   }
 
   void track::init(kvstore* store)
   {
     track::kvstore_ = store;
 
-    // Build alt id index.
-    track::each([&](json::object& value) -> bool
+    kvstore_->index(tag_index, track_prefix, [](const json::value& record, std::vector<std::string>& values)
     {
-      auto& alt_ids = value["alt_ids"];
+      auto& obj = record.as_object();
 
-      if ( alt_ids.is_array() )
+      if ( obj.has_member("tags") && obj.at("tags").is_array() )
       {
-        for ( auto& alt_id : alt_ids.as_array() )
+        for ( auto& tag : obj.at("tags").as_array() )
         {
-          index_.set(alt_id, value["id"]);
+          if ( tag.is_string() ) {
+            values.push_back(tag.as_string());
+          }
+        }
+      }
+    });
+
+    kvstore_->index(source_index, track_prefix, [](const json::value& record, std::vector<std::string>& values)
+    {
+      auto& obj = record.as_object();
+
+      if ( obj.has_member("sources") && obj.at("sources").is_array() )
+      {
+        for ( auto& source : obj.at("sources").as_array() )
+        {
+          if ( source.is_object() && source.as_object().has_member("name") && source.as_object().at("name").is_string() ) {
+            values.push_back(source.as_object().at("name").as_string());
+          }
+        }
+      }
+    });
+
+    kvstore_->index(alt_id_index, track_prefix, [](const json::value& record, std::vector<std::string>& values)
+    {
+      auto& obj = record.as_object();
+
+      if ( obj.has_member("alt_ids") && obj.at("alt_ids").is_array() )
+      {
+        for ( auto& alt_id : obj.at("alt_ids").as_array() )
+        {
+          if ( alt_id.is_string() ) {
+            values.push_back(alt_id.as_string());
+          }
         }
       }
-      return true;
     });
 
 #if 0
     track::each([&](track& track) -> bool
     {
-      auto& sources = track.data_["sources"];
+      auto& sources = track.data_.get_mutable()["sources"];
 
       if ( sources.is_array() )
       {
@@ -108,6 +154,11 @@ namespace dm
     data_ = std::move(data);
   }
 
+  track::track(record_cache::record_ptr record)
+  {
+    data_ = std::move(record);
+  }
+
   track& track::operator= (const track& rhs)
   {
     data_ = rhs.data_;
@@ -122,71 +173,67 @@ namespace dm
 
   bool track::is_null()
   {
-    return data_.empty();
+    return data_.get().empty();
   }
 
   bool track::id_is_null()
   {
-    return data_["id"].is_null();
+    auto& obj = data_.get();
+    return !obj.has_member("id") || obj.at("id").is_null();
   }
 
-  bool track::has_tag(std::string tag)
+  bool track::has_tag(const std::string& tag) const
   {
-    if ( data_.has_member("tags") )
-    {
-      auto& tags = data_["tags"].as_array();
-
-      for ( auto& track_tag : tags ) {
-        if ( track_tag.is_string() && track_tag.as_string() == tag ) {
-            return true;
-        }
+    for ( auto& track_tag : tags() ) {
+      if ( track_tag.is_string() && track_tag.as_string() == tag ) {
+          return true;
       }
-
-      return false;
-    }
-    else {
-      return false;
     }
+    return false;
   }
 
   const std::string& track::id() const
   {
-    return data_.at("id").as_string();
+    return data_.get().at("id").as_string();
   }
 
   const std::string& track::title() const
   {
-    return data_.at("title").as_string();
+    return data_.get().at("title").as_string();
   }
 
   const unsigned track::track_number() const
   {
-    return data_.at("tn").as_number();
+    return data_.get().at("tn").as_integer();
   }
 
   const unsigned track::disc_number() const
   {
-    return data_.at("dn").as_number();
+    return data_.get().at("dn").as_integer();
   }
 
   const unsigned track::duration() const
   {
-    return data_.at("duration").as_number();
+    return data_.get().at("duration").as_integer();
   }
 
-  const json::array track::tags() const
+  const json::array& track::tags() const
   {
-    if ( data_.has_member("tags") ) {
-      return data_.at("tags");
+    static const json::array no_tags;
+
+    auto& obj = data_.get();
+
+    if ( obj.has_member("tags") && obj.at("tags").is_array() ) {
+      return obj.at("tags").as_array();
     }
     else {
-      return json::array();
+      return no_tags;
     }
   }
 
   void track::alt_id(const std::string& id)
   {
-    auto& alt_ids = data_["alt_ids"];
+    auto& alt_ids = data_.get_mutable()["alt_ids"];
 
     if ( alt_ids.is_array() )
     {
@@ -202,55 +249,55 @@ namespace dm
     }
     else
     {
-      data_["alt_ids"] = json::array{id};
+      alt_ids = json::array{id};
     }
   }
 
   void track::title(const std::string& v)
   {
-    data_["title"] = v;
+    data_.get_mutable()["title"] = v;
   }
 
   dm::artist track::artist() const
   {
-    auto& artist_obj = data_.at("artist").as_object();
+    auto& artist_obj = data_.get().at("artist").as_object();
     return dm::artist::find_by_id(artist_obj.at("id").as_string());
   }
 
   dm::album track::album() const
   {
-    auto& album_obj = data_.at("album").as_object();
+    auto& album_obj = data_.get().at("album").as_object();
     return dm::album::find_by_id(album_obj.at("id").as_string());
   }
 
   void track::track_number(unsigned v)
   {
-    data_["tn"] = v;
+    data_.get_mutable()["tn"] = v;
   }
 
   void track::disc_number(unsigned v)
   {
-    data_["dn"] = v;
+    data_.get_mutable()["dn"] = v;
   }
 
   void track::duration(unsigned v)
   {
-    data_["duration"] = v;
+    data_.get_mutable()["duration"] = v;
   }
 
   void track::tags(json::array v)
   {
-    data_["tags"] = std::move(v);
+    data_.get_mutable()["tags"] = std::move(v);
   }
 
   void track::artist(const dm::artist& v)
   {
-    data_["artist"] = json::object{ { "id", v.id() }, { "name", v.name() } };
+    data_.get_mutable()["artist"] = json::object{ { "id", v.id() }, { "name", v.name() } };
   }
 
   void track::album(const dm::album& v)
   {
-    data_["album"] = json::object{ { "id", v.id() }, { "title", v.title() } };
+    data_.get_mutable()["album"] = json::object{ { "id", v.id() }, { "title", v.title() } };
   }
 
   void track::source(json::object&& jsource)
@@ -265,7 +312,7 @@ namespace dm
       throw std::runtime_error("track source name must be a string");
     }
 
-    auto& data_sources = data_["sources"];
+    auto& data_sources = data_.get_mutable()["sources"];
 
     if ( data_sources.is_array() )
     {
@@ -292,7 +339,7 @@ namespace dm
 
   void track::source_remove(const std::string& name)
   {
-    auto& sources = data_["sources"];
+    auto& sources = data_.get_mutable()["sources"];
 
     if ( sources.is_array() )
     {
@@ -304,11 +351,11 @@ namespace dm
 
         if ( !s.empty() && s["name"].as_string() != name )
         {
-          new_sources.push_back(s);
+          new_sources.push_back(std::move(obj));
         }
       }
       // Replace sources.
-      data_["sources"] = new_sources;
+      sources = std::move(new_sources);
       // Save track changes.
       save();
     }
@@ -316,40 +363,40 @@ namespace dm
 
   void track::save()
   {
-    auto& id = data_["id"];
+    auto& obj = data_.get_mutable();
+    auto& id  = obj["id"];
 
     if ( id.is_null() )
     {
       id = track::kvstore_->create_track_key();
     }
 
-    kvstore_->set(id.as_string(), data_);
+    kvstore_->set(id.as_string(), obj);
   }
 
   void track::erase()
   {
-    auto& id = data_["id"];
-
-    if ( !id.is_null() )
+    if ( !id_is_null() )
     {
-      kvstore_->remove(id.as_string());
+      kvstore_->remove(id());
     }
   }
 
   track_source track::find_source(const std::string& name)
   {
-    auto& jsources = data_["sources"];
+    // The data may be shared with other tracks, it must not be modified.
+    auto& data = data_.get();
 
-    if ( jsources.is_array() )
+    if ( data.has_member("sources") && data.at("sources").is_array() )
     {
-      auto& sources = jsources.as_array();
+      auto& sources = data.at("sources").as_array();
 
       if ( name.length() > 0 )
       {
         for ( auto& source : sources )
         {
           auto& obj = source.as_object();
-          if ( !obj.empty() && obj["name"].as_string() == name ) {
+          if ( !obj.empty() && obj.at("name").as_string() == name ) {
             return track_source{obj};
           }
         }
@@ -375,22 +422,34 @@ namespace dm
   {
     json::array res;
 
-    track::each([&](json::object& value) -> bool
-    {
-      res.push_back(std::move(value));
-      return true;
-    });
+    // Not torn by writes made while it runs.
+    kvstore::snapshot snapshot(*kvstore_);
+
+    // Decoded in parallel, listed in key order.
+    kvstore_->parallel_each(
+      track_prefix,
+      [](json::value& value) -> bool
+      {
+        return value.is_object();
+      },
+      [&](json::value& value) -> bool
+      {
+        res.push_back(std::move(value));
+        return true;
+      },
+      kvstore::order::key
+    );
 
     return res;
   }
 
   track track::find_by_id(const std::string& id)
   {
-    auto data = kvstore_->get(id);
+    auto record = kvstore_->get_shared(id);
 
-    if ( !data.is_null() )
+    if ( record && record->is_object() )
     {
-      return track(std::move(data.as_object()));
+      return track(std::move(record));
     }
     else
     {
@@ -400,28 +459,30 @@ namespace dm
 
   track track::find_by_alt_id(const std::string& alt_id)
   {
-    std::string id;
+    auto ids = kvstore_->find(alt_id_index, alt_id);
 
-    if ( index_.get(alt_id, &id) ) {
-      return find_by_id(id);
+    if ( ids.size() > 0 ) {
+      return find_by_id(ids[0]);
     }
     else {
       return track();
     }
   }
 
+  std::vector<std::string> track::find_ids_by_tag(const std::string& tag)
+  {
+    return kvstore_->find(tag_index, tag);
+  }
+
+  std::vector<std::string> track::find_ids_by_source(const std::string& name)
+  {
+    return kvstore_->find(source_index, name);
+  }
+
   void track::each(std::function<bool(json::object& value)> value_cb)
   {
     kvstore_->each(
-      [](const std::string& key) -> bool
-      {
-        if ( key.length() == 6 && key[0] == 't' ) {
-          return true;
-        }
-        else {
-          return false;
-        }
-      },
+      track_prefix,
       [&](json::value& value) -> bool
       {
         if ( value.is_object() ) {
@@ -441,4 +502,10 @@ namespace dm
       return value_cb(v);
     });
   }
-}
\ No newline at end of file
+
+  void track::each(const std::vector<std::string>& fields,
+                   std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb)
+  {
+    kvstore_->each(track_prefix, fields, value_cb);
+  }
+}
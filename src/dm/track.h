@@ -14,7 +14,7 @@
 
 // ----------------------------------------------------------------------------
 #include "kvstore.h"
-#include "track_alt_index.h"
+#include "shared_object.h"
 #include "artist.h"
 #include "album.h"
 
@@ -24,18 +24,22 @@
 // ----------------------------------------------------------------------------
 namespace dm
 {
+  // A source entry of a track. The name and uri are copied, so it stays
+  // valid when the track is modified or destroyed.
   class track_source
   {
   public:
     track_source();
-    track_source(json::object data);
+    track_source(const json::object& data);
   public:
     bool is_null();
   public:
     const std::string& name() const;
     const std::string& uri() const;
   private:
-    json::object data_;
+    bool        null_;
+    std::string name_;
+    std::string uri_;
   };
 
   class track
@@ -49,6 +53,7 @@ namespace dm
     track(track&& other);
   private:
     track(json::object&& data);
+    track(record_cache::record_ptr record);
   public:
     track& operator= (const track& rhs);
     track& operator= (track&& rhs);
@@ -56,7 +61,7 @@ namespace dm
     bool is_null();
     bool id_is_null();
   public:
-    bool has_tag(std::string tag);
+    bool has_tag(const std::string& tag) const;
   public:
     // Getters.
     const std::string& id() const;
@@ -64,7 +69,7 @@ namespace dm
     const unsigned track_number() const;
     const unsigned disc_number() const;
     const unsigned duration() const;
-    const json::array tags() const;
+    const json::array& tags() const;
     dm::artist artist() const;
     dm::album album() const;
   public:
@@ -83,7 +88,8 @@ namespace dm
     void save();
     void erase();
   public:
-    json::value to_json() const { return data_; }
+    json::value to_json() const & { return data_.get(); }
+    json::value to_json() && { return data_.release(); }
   public:
     track_source find_source(const std::string& name="");
   public:
@@ -91,14 +97,19 @@ namespace dm
   public:
     static track find_by_id(const std::string& id);
     static track find_by_alt_id(const std::string& alt_id);
+  public:
+    // Ids of the tracks with a tag or a source, from the secondary indexes.
+    static std::vector<std::string> find_ids_by_tag(const std::string& tag);
+    static std::vector<std::string> find_ids_by_source(const std::string& name);
   public:
     static void each(std::function<bool(json::object& value)> value_cb);
     static void each(std::function<bool(track& track)> value_cb);
+    static void each(const std::vector<std::string>& fields,
+                     std::function<bool(const std::string& key, std::vector<json::value>& fields)> value_cb);
   private:
-    json::object data_;
+    shared_object data_;
   private:
-    static kvstore*        kvstore_;
-    static track_alt_index index_;
+    static kvstore* kvstore_;
   };
 }
 
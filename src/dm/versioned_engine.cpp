@@ -0,0 +1,491 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : versioned_engine.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "versioned_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <mutex>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  // Merges the records with the versions kept, as the snapshot sees them.
+  // Finds its position again for every move, so records can be written
+  // while it is used.
+  class versioned_cursor : public storage_engine::cursor
+  {
+  public:
+    versioned_cursor(versioned_engine& engine, uint64_t seq)
+      :
+      engine_(engine),
+      seq_(seq),
+      live_(engine.db_->make_cursor()),
+      valid_(false)
+    {
+    }
+  public:
+    bool jump() override
+    {
+      return seek(std::string(), true);
+    }
+
+    bool jump(const std::string& key) override
+    {
+      return seek(key, true);
+    }
+
+    bool jump_back(const std::string& key) override
+    {
+      return seek_back(key, true);
+    }
+
+    bool step() override
+    {
+      return valid_ && seek(key_, false);
+    }
+
+    bool step_back() override
+    {
+      return valid_ && seek_back(key_, false);
+    }
+  public:
+    bool get(std::string* key, std::string* value, bool step) override
+    {
+      if ( !valid_ ) {
+        return false;
+      }
+
+      if ( key ) {
+        *key = key_;
+      }
+
+      if ( value ) {
+        *value = value_;
+      }
+
+      if ( step ) {
+        this->step();
+      }
+      return true;
+    }
+  private:
+    // First record after key, or at it if inclusive.
+    bool seek(std::string key, bool inclusive)
+    {
+      std::shared_lock<std::shared_mutex> lock(engine_.mutex_);
+
+      auto& versions = engine_.versions_;
+
+      for ( ;; )
+      {
+        std::string live_key;
+        std::string live_value;
+
+        bool has_live = key.empty() && inclusive ? live_->jump() : live_->jump(key);
+
+        has_live = has_live && live_->get(&live_key, &live_value);
+
+        if ( has_live && !inclusive && live_key == key ) {
+          has_live = live_->step() && live_->get(&live_key, &live_value);
+        }
+
+        auto it = inclusive ? versions.lower_bound(key) : versions.upper_bound(key);
+
+        if ( !has_live && it == versions.end() ) {
+          return valid_ = false;
+        }
+
+        if ( it == versions.end() || (has_live && live_key <= it->first) ) {
+          key = live_key;
+        }
+        else {
+          key = it->first;
+        }
+
+        if ( at(key, has_live && live_key == key, live_value) ) {
+          return true;
+        }
+        inclusive = false;
+      }
+    }
+
+    // Last record before key, or at it if inclusive.
+    bool seek_back(std::string key, bool inclusive)
+    {
+      std::shared_lock<std::shared_mutex> lock(engine_.mutex_);
+
+      auto& versions = engine_.versions_;
+
+      for ( ;; )
+      {
+        std::string live_key;
+        std::string live_value;
+
+        bool has_live = live_->jump_back(key) && live_->get(&live_key, &live_value);
+
+        if ( has_live && !inclusive && live_key == key ) {
+          has_live = live_->step_back() && live_->get(&live_key, &live_value);
+        }
+
+        auto it = inclusive ? versions.upper_bound(key) : versions.lower_bound(key);
+
+        bool has_version = it != versions.begin();
+
+        if ( has_version ) {
+          --it;
+        }
+
+        if ( !has_live && !has_version ) {
+          return valid_ = false;
+        }
+
+        if ( !has_version || (has_live && live_key >= it->first) ) {
+          key = live_key;
+        }
+        else {
+          key = it->first;
+        }
+
+        if ( at(key, has_live && live_key == key, live_value) ) {
+          return true;
+        }
+        inclusive = false;
+      }
+    }
+
+    // Moves to key if the snapshot sees a record there.
+    bool at(const std::string& key, bool is_live, const std::string& live_value)
+    {
+      auto version = engine_.find_version(key, seq_);
+
+      if ( version )
+      {
+        if ( !version->exists ) {
+          return false;
+        }
+        value_ = version->value;
+      }
+      else if ( is_live ) {
+        value_ = live_value;
+      }
+      else {
+        return false;
+      }
+
+      key_   = key;
+      valid_ = true;
+
+      return true;
+    }
+  private:
+    versioned_engine&                       engine_;
+    uint64_t                                seq_;
+    std::unique_ptr<storage_engine::cursor> live_;
+    std::string                             key_;
+    std::string                             value_;
+    bool                                    valid_;
+  };
+
+  class versioned_snapshot : public storage_engine::snapshot
+  {
+  public:
+    versioned_snapshot(versioned_engine& engine, uint64_t seq)
+      :
+      engine_(engine),
+      seq_(seq)
+    {
+    }
+  public:
+    ~versioned_snapshot()
+    {
+      engine_.release(seq_);
+    }
+  public:
+    bool get(const std::string& key, std::string* value) override
+    {
+      std::shared_lock<std::shared_mutex> lock(engine_.mutex_);
+
+      auto version = engine_.find_version(key, seq_);
+
+      if ( !version ) {
+        return engine_.db_->get(key, value);
+      }
+
+      if ( version->exists && value ) {
+        *value = version->value;
+      }
+      return version->exists;
+    }
+
+    std::unique_ptr<storage_engine::cursor> make_cursor() override
+    {
+      return std::unique_ptr<storage_engine::cursor>(new versioned_cursor(engine_, seq_));
+    }
+  private:
+    versioned_engine& engine_;
+    uint64_t          seq_;
+  };
+
+  versioned_engine::versioned_engine(std::unique_ptr<storage_engine> db)
+    :
+    db_(std::move(db)),
+    committed_(0),
+    collected_(0),
+    in_transaction_(false)
+  {
+  }
+
+  int64_t versioned_engine::count()
+  {
+    return db_->count();
+  }
+
+  int64_t versioned_engine::size()
+  {
+    return db_->size();
+  }
+
+  bool versioned_engine::get(const std::string& key, std::string* value)
+  {
+    return db_->get(key, value);
+  }
+
+  bool versioned_engine::set(const std::string& key, const std::string& value)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    save_version(key);
+
+    bool result = db_->set(key, value);
+
+    written();
+
+    return result;
+  }
+
+  bool versioned_engine::remove(const std::string& key)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    save_version(key);
+
+    bool result = db_->remove(key);
+
+    written();
+
+    return result;
+  }
+
+  bool versioned_engine::clear()
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    if ( in_transaction_ || !pinned_.empty() )
+    {
+      auto        cur = db_->make_cursor();
+      std::string key;
+
+      cur->jump();
+
+      while ( cur->get_key(&key, true) ) {
+        save_version(key);
+      }
+    }
+
+    bool result = db_->clear();
+
+    written();
+
+    return result;
+  }
+
+  int64_t versioned_engine::increment(const std::string& key, int64_t num)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    save_version(key);
+
+    auto result = db_->increment(key, num);
+
+    written();
+
+    return result;
+  }
+
+  std::unique_ptr<storage_engine::cursor> versioned_engine::make_cursor()
+  {
+    return db_->make_cursor();
+  }
+
+  std::unique_ptr<storage_engine::snapshot> versioned_engine::make_snapshot()
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    pinned_.insert(committed_);
+
+    return std::unique_ptr<snapshot>(new versioned_snapshot(*this, committed_));
+  }
+
+  bool versioned_engine::begin_transaction(bool hard)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    if ( !db_->begin_transaction(hard) ) {
+      return false;
+    }
+
+    in_transaction_ = true;
+    return true;
+  }
+
+  bool versioned_engine::end_transaction(bool commit)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    bool result = db_->end_transaction(commit);
+
+    in_transaction_ = false;
+
+    if ( commit ) {
+      committed_++;
+    }
+    else
+    {
+      // The records are as they were at the last commit again.
+      for ( auto it = versions_.begin(); it != versions_.end(); )
+      {
+        auto& list = it->second;
+
+        if ( list.back().seq > committed_ ) {
+          list.pop_back();
+        }
+
+        if ( list.empty() ) {
+          it = versions_.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+    }
+
+    collect();
+
+    return result;
+  }
+
+  bool versioned_engine::synchronize(bool hard)
+  {
+    return db_->synchronize(hard);
+  }
+
+  bool versioned_engine::defrag(int64_t steps)
+  {
+    return db_->defrag(steps);
+  }
+
+  size_t versioned_engine::num_versioned()
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return versions_.size();
+  }
+
+  void versioned_engine::save_version(const std::string& key)
+  {
+    auto     it    = versions_.find(key);
+    uint64_t after = it == versions_.end() ? 0 : it->second.back().seq;
+
+    // The value as of the last commit is kept already.
+    if ( after > committed_ ) {
+      return;
+    }
+
+    // Needed by snapshots taken since the last version kept, and by those
+    // taken before a transaction commits. Outside a transaction the write
+    // is committed before a snapshot can be taken.
+    if ( !in_transaction_ && (pinned_.empty() || *pinned_.rbegin() < after) ) {
+      return;
+    }
+
+    version v{ committed_ + 1, false, std::string() };
+
+    v.exists = db_->get(key, &v.value);
+
+    versions_[key].push_back(std::move(v));
+  }
+
+  void versioned_engine::written()
+  {
+    if ( !in_transaction_ )
+    {
+      committed_++;
+      collect();
+    }
+  }
+
+  void versioned_engine::collect()
+  {
+    // Snapshots see the first version numbered after them, the oldest
+    // does not need those up to it.
+    auto oldest = pinned_.empty() ? committed_ : *pinned_.begin();
+
+    if ( oldest == collected_ ) {
+      return;
+    }
+
+    for ( auto it = versions_.begin(); it != versions_.end(); )
+    {
+      auto& list = it->second;
+      auto  end  = list.begin();
+
+      while ( end != list.end() && end->seq <= oldest ) {
+        ++end;
+      }
+
+      list.erase(list.begin(), end);
+
+      if ( list.empty() ) {
+        it = versions_.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+
+    collected_ = oldest;
+  }
+
+  const versioned_engine::version* versioned_engine::find_version(const std::string& key, uint64_t seq) const
+  {
+    auto it = versions_.find(key);
+
+    if ( it == versions_.end() ) {
+      return nullptr;
+    }
+
+    for ( auto& v : it->second )
+    {
+      if ( v.seq > seq ) {
+        return &v;
+      }
+    }
+    return nullptr;
+  }
+
+  void versioned_engine::release(uint64_t seq)
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    pinned_.erase(pinned_.find(seq));
+
+    collect();
+  }
+}
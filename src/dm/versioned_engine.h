@@ -0,0 +1,101 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : versioned_engine.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Gives an engine without snapshots of its own, kyoto, snapshots by
+//   keeping the versions of the records they still need.
+//
+//   Commits are numbered, a write outside a transaction is a commit of its
+//   own. A snapshot sees the records as of the last commit before it was
+//   taken. Before a record is first written after that commit, the value
+//   it had is kept as a version, numbered with the commit writing it. The
+//   snapshot reads the first version of a record numbered after it, or the
+//   record itself if there is none.
+//
+//   Versions are kept while the writes of the active transaction may be
+//   rolled back, or a snapshot may need them. Writers wait on readers of
+//   a snapshot only while they read a single record.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__versioned_engine_h__
+#define __dm__versioned_engine_h__
+
+// ----------------------------------------------------------------------------
+#include "storage_engine.h"
+
+// ----------------------------------------------------------------------------
+#include <map>
+#include <set>
+#include <vector>
+#include <shared_mutex>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class versioned_engine : public storage_engine
+  {
+  public:
+    versioned_engine(std::unique_ptr<storage_engine> db);
+  public:
+    int64_t count() override;
+    int64_t size() override;
+  public:
+    bool get(const std::string& key, std::string* value) override;
+    bool set(const std::string& key, const std::string& value) override;
+    bool remove(const std::string& key) override;
+    bool clear() override;
+  public:
+    int64_t increment(const std::string& key, int64_t num) override;
+  public:
+    std::unique_ptr<cursor>   make_cursor() override;
+    std::unique_ptr<snapshot> make_snapshot() override;
+  public:
+    bool begin_transaction(bool hard) override;
+    bool end_transaction(bool commit) override;
+  public:
+    bool synchronize(bool hard) override;
+  public:
+    bool defrag(int64_t steps) override;
+  public:
+    // Records with versions kept, for tests.
+    size_t num_versioned();
+  private:
+    struct version
+    {
+      // Number of the commit that wrote the record after this.
+      uint64_t    seq;
+      bool        exists;
+      std::string value;
+    };
+  private:
+    using version_map = std::map<std::string, std::vector<version>>;
+  private:
+    // Called with the lock held.
+    void save_version(const std::string& key);
+    void written();
+    void collect();
+    // Version of key seen by a snapshot taken at seq, nullptr if it sees
+    // the record itself. Called with the lock held.
+    const version* find_version(const std::string& key, uint64_t seq) const;
+    void release(uint64_t seq);
+  private:
+    friend class versioned_snapshot;
+    friend class versioned_cursor;
+  private:
+    std::unique_ptr<storage_engine> db_;
+    std::shared_mutex               mutex_;
+    uint64_t                        committed_;
+    uint64_t                        collected_;
+    bool                            in_transaction_;
+    version_map                     versions_;
+    std::multiset<uint64_t>         pinned_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__versioned_engine_h__
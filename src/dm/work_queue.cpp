@@ -0,0 +1,101 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : work_queue.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include "work_queue.h"
+
+// ----------------------------------------------------------------------------
+#include <iostream>
+#include <algorithm>
+#include <exception>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  work_queue::work_queue(unsigned num_threads)
+    :
+    running_(0),
+    stop_(false)
+  {
+    if ( num_threads == 0 ) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for ( unsigned i = 0; i < num_threads; ++i ) {
+      threads_.emplace_back(&work_queue::run, this);
+    }
+  }
+
+  work_queue::~work_queue()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    pushed_.notify_all();
+
+    for ( auto& thread : threads_ ) {
+      thread.join();
+    }
+  }
+
+  void work_queue::push(job job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(std::move(job));
+    }
+    pushed_.notify_one();
+  }
+
+  void work_queue::wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    idle_.wait(lock, [this]() { return jobs_.empty() && running_ == 0; });
+  }
+
+  void work_queue::run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while ( true )
+    {
+      pushed_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+
+      if ( jobs_.empty() ) {
+        return;
+      }
+
+      auto job = std::move(jobs_.front());
+
+      jobs_.pop_front();
+      running_++;
+
+      lock.unlock();
+
+      // A failed job must not take the thread with it.
+      try
+      {
+        job();
+      }
+      catch ( std::exception& e )
+      {
+        std::cerr << "work queue job error " << e.what() << std::endl;
+      }
+
+      lock.lock();
+
+      if ( --running_ == 0 && jobs_.empty() ) {
+        idle_.notify_all();
+      }
+    }
+  }
+}
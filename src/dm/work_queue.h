@@ -0,0 +1,57 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : work_queue.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   Runs jobs in the background on a pool of threads, in the order they are
+//   pushed. Jobs still queued when the work queue is destroyed are run
+//   before it returns.
+//
+// ----------------------------------------------------------------------------
+#ifndef __dm__work_queue_h__
+#define __dm__work_queue_h__
+
+// ----------------------------------------------------------------------------
+#include <functional>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------------
+namespace dm
+{
+  class work_queue
+  {
+  public:
+    using job = std::function<void()>;
+  public:
+    // One thread per core if num_threads is 0.
+    work_queue(unsigned num_threads = 0);
+  public:
+    ~work_queue();
+  public:
+    void push(job job);
+  public:
+    // Wait until every job pushed has been run.
+    void wait();
+  private:
+    void run();
+  private:
+    std::mutex               mutex_;
+    std::condition_variable  pushed_;
+    std::condition_variable  idle_;
+    std::deque<job>          jobs_;
+    size_t                   running_;
+    bool                     stop_;
+    std::vector<std::thread> threads_;
+  };
+}
+
+// ----------------------------------------------------------------------------
+#endif // __dm__work_queue_h__
@@ -0,0 +1,196 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : http.cpp
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//
+// ----------------------------------------------------------------------------
+#include <http.h>
+
+// ----------------------------------------------------------------------------
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+// ----------------------------------------------------------------------------
+namespace http
+{
+  static const char* days[]   = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+  static std::string lower(std::string s)
+  {
+    for ( auto& c : s ) {
+      c = std::tolower(static_cast<unsigned char>(c));
+    }
+    return s;
+  }
+
+  static std::string trim(const std::string& s)
+  {
+    auto first = s.find_first_not_of(" \t");
+
+    if ( first == std::string::npos ) {
+      return std::string();
+    }
+    return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+  }
+
+  bool request::parse(const std::string& head)
+  {
+    size_t pos = 0;
+    bool   first = true;
+
+    while ( pos < head.length() )
+    {
+      auto end = head.find("\r\n", pos);
+
+      if ( end == std::string::npos ) {
+        end = head.length();
+      }
+
+      auto line = head.substr(pos, end - pos);
+
+      pos = end + 2;
+
+      if ( first )
+      {
+        auto sp1 = line.find(' ');
+        auto sp2 = line.rfind(' ');
+
+        if ( sp1 == std::string::npos || sp1 == sp2 ) {
+          return false;
+        }
+
+        method_  = line.substr(0, sp1);
+        path_    = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        version_ = line.substr(sp2 + 1);
+        first    = false;
+
+        if ( method_.empty() || path_.empty() || version_.compare(0, 5, "HTTP/") != 0 ) {
+          return false;
+        }
+      }
+      else
+      {
+        auto colon = line.find(':');
+
+        if ( colon == std::string::npos || colon == 0 ) {
+          return false;
+        }
+
+        auto  name  = lower(line.substr(0, colon));
+        auto  value = trim(line.substr(colon + 1));
+        auto& field = headers_[name];
+
+        // Repeated headers are one list.
+        field = field.empty() ? value : field + ", " + value;
+      }
+    }
+    return !first;
+  }
+
+  const std::string& request::header(const std::string& name) const
+  {
+    static const std::string none;
+
+    auto it = headers_.find(lower(name));
+
+    if ( it != headers_.end() ) {
+      return it->second;
+    }
+    else {
+      return none;
+    }
+  }
+
+  bool request::keep_alive() const
+  {
+    auto connection = lower(header("connection"));
+
+    if ( version_ == "HTTP/1.0" ) {
+      return connection == "keep-alive";
+    }
+    else {
+      return connection != "close";
+    }
+  }
+
+  std::string format_date(time_t time)
+  {
+    struct tm tm;
+
+    gmtime_r(&time, &tm);
+
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+      days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900,
+      tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+    return buf;
+  }
+
+  time_t parse_date(const std::string& date)
+  {
+    char      day[4];
+    char      month[4];
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+
+    if ( sscanf(date.c_str(), "%3s, %d %3s %d %d:%d:%d GMT",
+           day, &tm.tm_mday, month, &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 7 )
+    {
+      return -1;
+    }
+
+    tm.tm_mon = -1;
+
+    for ( int i = 0; i < 12; ++i )
+    {
+      if ( strcmp(month, months[i]) == 0 ) {
+        tm.tm_mon = i;
+      }
+    }
+
+    if ( tm.tm_mon < 0 ) {
+      return -1;
+    }
+
+    tm.tm_year -= 1900;
+
+    return timegm(&tm);
+  }
+
+  bool etag_matches(const std::string& if_none_match, const std::string& etag)
+  {
+    size_t pos = 0;
+
+    while ( pos <= if_none_match.length() )
+    {
+      auto end = if_none_match.find(',', pos);
+
+      if ( end == std::string::npos ) {
+        end = if_none_match.length();
+      }
+
+      auto tag = trim(if_none_match.substr(pos, end - pos));
+
+      // Weak comparison, as for If-None-Match.
+      if ( tag.compare(0, 2, "W/") == 0 ) {
+        tag.erase(0, 2);
+      }
+
+      if ( tag == "*" || tag == etag ) {
+        return true;
+      }
+      pos = end + 1;
+    }
+    return false;
+  }
+}
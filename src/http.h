@@ -0,0 +1,61 @@
+// ----------------------------------------------------------------------------
+//
+//     Filename   : http.h
+//
+//     Author     : Benny Bach <benny.bach@gmail.com>
+//                  Copyright (C) 2014
+//
+// --- Description: -----------------------------------------------------------
+//
+//   The little of HTTP/1.1 needed to serve files to browsers: parsing the
+//   head of a request, and the dates and entity tags of conditional
+//   requests.
+//
+// ----------------------------------------------------------------------------
+#ifndef __http_h__
+#define __http_h__
+
+// ----------------------------------------------------------------------------
+#include <string>
+#include <map>
+
+// ----------------------------------------------------------------------------
+#include <ctime>
+
+// ----------------------------------------------------------------------------
+namespace http
+{
+  class request
+  {
+  public:
+    // Parse the request line and header lines, without the empty line
+    // ending them. Returns false if they are not valid.
+    bool parse(const std::string& head);
+  public:
+    const std::string& method()  const { return method_; }
+    const std::string& path()    const { return path_; }
+    const std::string& version() const { return version_; }
+  public:
+    // Value of a header, empty if not given. Names are case insensitive.
+    const std::string& header(const std::string& name) const;
+  public:
+    // True if the connection should be kept open after the response.
+    bool keep_alive() const;
+  private:
+    std::string                        method_;
+    std::string                        path_;
+    std::string                        version_;
+    std::map<std::string, std::string> headers_;
+  };
+
+  // Date as in headers, like "Sun, 06 Nov 1994 08:49:37 GMT".
+  std::string format_date(time_t time);
+  // Returns -1 if date is not in the format of format_date.
+  time_t parse_date(const std::string& date);
+
+  // True if the value of an If-None-Match header matches etag.
+  bool etag_matches(const std::string& if_none_match, const std::string& etag);
+}
+
+// ----------------------------------------------------------------------------
+#endif // __http_h__
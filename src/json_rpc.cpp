@@ -26,12 +26,42 @@ namespace jsonrpc
   {
   }
 
-  json_rpc_response service::execute(const json_rpc_request& request)
+  service::element_func service::find_element_func(const std::string& name) const
+  {
+    auto it = elements_.find(name);
+
+    if ( it != end(elements_) ) {
+      return (*it).second;
+    }
+    else {
+      return element_func();
+    }
+  }
+
+  json_rpc_response service::execute(json_rpc_request& request)
   {
     auto it = methods_.find(request.method());
 
     if ( it != end(methods_) )
     {
+      auto element = find_element_func(request.method());
+
+      if ( element && request.params().is_array() )
+      {
+        try
+        {
+          for ( auto& item : request.params().as_array() ) {
+            element(item);
+          }
+          request.params() = json::array();
+        }
+        catch (const std::exception& e)
+        {
+          json_rpc_response response{request};
+          response.invalid_params(e.what());
+          return response;
+        }
+      }
       return (*it).second(request);
     }
     else
@@ -68,4 +98,172 @@ namespace jsonrpc
     lock_guard lock(mutex_);
     connections_.erase(connection);
   }
+
+  request_reader::request_reader(const service& service)
+    :
+    service_(service),
+    value_(),
+    builder_(value_),
+    stream_(std::bind(&request_reader::element, this, std::placeholders::_1)),
+    depth_(0),
+    key_(),
+    element_func_(),
+    streaming_(false),
+    error_()
+  {
+  }
+
+  void request_reader::start_object()
+  {
+    if ( streaming_ ) {
+      stream_.start_object();
+    }
+    else {
+      depth_++;
+      builder_.start_object();
+    }
+  }
+
+  void request_reader::end_object()
+  {
+    if ( streaming_ ) {
+      stream_.end_object();
+    }
+    else {
+      depth_--;
+      builder_.end_object();
+    }
+  }
+
+  void request_reader::start_array()
+  {
+    if ( streaming_ )
+    {
+      stream_.start_array();
+    }
+    else if ( depth_ == 1 && key_ == "params" && element_func_ )
+    {
+      streaming_ = true;
+      stream_.start_array();
+    }
+    else
+    {
+      depth_++;
+      builder_.start_array();
+    }
+  }
+
+  void request_reader::end_array()
+  {
+    if ( streaming_ )
+    {
+      stream_.end_array();
+
+      if ( stream_.complete() )
+      {
+        // Leave an empty params array in the request.
+        streaming_ = false;
+        builder_.start_array();
+        builder_.end_array();
+      }
+    }
+    else
+    {
+      depth_--;
+      builder_.end_array();
+    }
+  }
+
+  void request_reader::key(std::string_view v)
+  {
+    if ( streaming_ ) {
+      stream_.key(v);
+      return;
+    }
+
+    if ( depth_ == 1 ) {
+      key_ = v;
+    }
+    builder_.key(v);
+  }
+
+  void request_reader::string(std::string_view v)
+  {
+    if ( streaming_ ) {
+      stream_.string(v);
+      return;
+    }
+
+    if ( depth_ == 1 && key_ == "method" ) {
+      element_func_ = service_.find_element_func(std::string(v));
+    }
+    builder_.string(v);
+  }
+
+  void request_reader::number(double v)
+  {
+    if ( streaming_ ) {
+      stream_.number(v);
+    }
+    else {
+      builder_.number(v);
+    }
+  }
+
+  void request_reader::integer(int64_t v)
+  {
+    if ( streaming_ ) {
+      stream_.integer(v);
+    }
+    else {
+      builder_.integer(v);
+    }
+  }
+
+  void request_reader::boolean(bool v)
+  {
+    if ( streaming_ ) {
+      stream_.boolean(v);
+    }
+    else {
+      builder_.boolean(v);
+    }
+  }
+
+  void request_reader::null()
+  {
+    if ( streaming_ ) {
+      stream_.null();
+    }
+    else {
+      builder_.null();
+    }
+  }
+
+  void request_reader::reset()
+  {
+    builder_.reset();
+    stream_.reset();
+    depth_ = 0;
+    key_.clear();
+    element_func_ = nullptr;
+    streaming_ = false;
+    error_.clear();
+  }
+
+  void request_reader::element(json::value& element)
+  {
+    if ( !error_.empty() ) {
+      return;
+    }
+
+    try
+    {
+      element_func_(element);
+    }
+    catch (const std::exception& e)
+    {
+      error_ = e.what();
+    }
+  }
 }
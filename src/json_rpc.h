@@ -45,11 +45,14 @@ public:
   const std::string& method()  const { return method_;  }
   const json::value& params()  const { return params_;  }
   const json::value& id()      const { return id_;      }
+public:
+  json::value& params() { return params_; }
 public:
   bool is_valid() const { return error_code_ == 0; }
 public:
   int error_code() const { return error_code_; }
 public:
+  // Params and id are moved out of v.
   static json_rpc_request from_json(json::value& v)
   {
     json_rpc_request self;
@@ -67,14 +70,14 @@ public:
       }
 
       if ( !o["params"].is_null() ) {
-        self.params_ = o["params"];
+        self.params_ = std::move(o["params"]);
       }
       else {
         self.params_ = json::value();
       }
 
       if ( !o["id"].is_null() ) {
-        self.id_ = o["id"];
+        self.id_ = std::move(o["id"]);
       }
 
       if ( self.is_valid() )
@@ -135,6 +138,16 @@ public:
   {
     error(-32602, "Invalid params");
   }
+public:
+  void invalid_params(std::string error_message)
+  {
+    error(-32602, std::move(error_message));
+  }
+public:
+  void write(json::writer& writer) const
+  {
+    writer.write(object_);
+  }
 private:
   json::object object_;
 };
@@ -152,9 +165,15 @@ class json_rpc_notification
 public:
   json_rpc_notification(const std::string& method, json::value params)
     :
-    object_{ { "jsonrpc", "2.0" }, { "method", method }, { "params", params } }
+    object_{ { "jsonrpc", "2.0" }, { "method", method } }
     {
+      object_.member("params", std::move(params));
     }
+public:
+  void write(json::writer& writer) const
+  {
+    writer.write(object_);
+  }
 private:
   json::object object_;
 };
@@ -177,6 +196,8 @@ namespace jsonrpc
   {
     using lock_guard = std::lock_guard<std::recursive_mutex>;
     using method_func = std::function<json_rpc_response(const json_rpc_request& request)>;
+  public:
+    using element_func = std::function<void(json::value& element)>;
   public:
     service();
   public:
@@ -187,7 +208,21 @@ namespace jsonrpc
       methods_.emplace(std::move(name), std::move(method));
     }
   public:
-    json_rpc_response execute(const json_rpc_request& request);
+    // Add a method taking an array of params that can be handled one at a
+    // time. element is called for each element of the params array, which
+    // is then left empty, before method is called. A connection streams
+    // the elements to element while the request is still being received.
+    void add_method(const std::string& name, method_func method, element_func element)
+    {
+      elements_.emplace(name, std::move(element));
+      methods_.emplace(std::move(name), std::move(method));
+    }
+  public:
+    element_func find_element_func(const std::string& name) const;
+  public:
+    // Elements of the params of a method with an element function are
+    // taken from the request.
+    json_rpc_response execute(json_rpc_request& request);
   public:
     void send_notification(json_rpc_notification notification);
   public:
@@ -195,13 +230,60 @@ namespace jsonrpc
     void detach_connection(std::shared_ptr<server::connection> connection);
   private:
     using method_map_t = std::map<std::string, method_func>;
+    using element_map_t = std::map<std::string, element_func>;
     using connection_ptr = std::weak_ptr<server::connection>;
     using connection_container = std::set<connection_ptr, std::owner_less<connection_ptr>>;
   private:
     method_map_t             methods_;
+    element_map_t            elements_;
     connection_container     connections_;
     std::recursive_mutex     mutex_;
   };
+
+  // Builds requests from parser events. If the method has an element
+  // function and "method" comes before "params" in the request, the params
+  // array is not built. Its elements are passed to the element function
+  // one at a time as they are read and the request gets an empty params
+  // array instead. If the element function throws, the remaining elements
+  // are skipped and error() holds the message.
+  class request_reader final : public json::handler
+  {
+  public:
+    request_reader(const service& service);
+  public:
+    void start_object() override;
+    void end_object() override;
+    void start_array() override;
+    void end_array() override;
+  public:
+    void key(std::string_view v) override;
+    void string(std::string_view v) override;
+    void number(double v) override;
+    void integer(int64_t v) override;
+    void boolean(bool v) override;
+    void null() override;
+  public:
+    json::value& value() { return value_; }
+  public:
+    const std::string& error() const { return error_; }
+  public:
+    void reset();
+  private:
+    void element(json::value& element);
+  private:
+    const service&        service_;
+    json::value           value_;
+    json::builder         builder_;
+    json::array_stream    stream_;
+    size_t                depth_;
+    std::string           key_;
+    service::element_func element_func_;
+    bool                  streaming_;
+    std::string           error_;
+  };
+
+  // Parser reporting to a request_reader without virtual calls.
+  using request_parser = json::basic_sax_parser<request_reader>;
 }
 
 // ----------------------------------------------------------------------------
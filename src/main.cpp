@@ -12,6 +12,7 @@
 #include <program_options.h>
 #include <dripcore/acceptor.h>
 #include <connection.h>
+#include <cover_connection.h>
 #include <player.h>
 #include <player_json_rpc.h>
 #include <local_source.h>
@@ -21,6 +22,7 @@
 // ----------------------------------------------------------------------------
 #include <iostream>
 #include <fstream>
+#include <thread>
 
 // ----------------------------------------------------------------------------
 #include <unistd.h>
@@ -31,7 +33,7 @@
 class options : public program_options::container
 {
 public:
-  options() : help(false), foreground(false), conf_filename()
+  options() : help(false), foreground(false), conf_filename(), db_durability(dm::kvstore::durability::soft), db_engine(dm::storage_engine::type::kyoto), db_journal(true)
   {
     add('h', "help", "display this message", help);
     add('F', "foreground", "do not detach from starting terminal", foreground);
@@ -48,6 +50,15 @@ public:
   std::string spotify_username;
   std::string spotify_password;
   std::string audio_device;
+
+  // Database transactions are synchronized to the device when "hard".
+  dm::kvstore::durability db_durability;
+  // Storage engine of the database, "kyoto" or "lmdb". Each keeps its own
+  // file, switching starts with an empty database.
+  dm::storage_engine::type db_engine;
+  // Journal every write, so the database is recovered quickly after a
+  // crash. Writes outside transactions are slower.
+  bool db_journal;
 };
 
 // ----------------------------------------------------------------------------
@@ -74,7 +85,27 @@ void sig_handler(int signum)
 // ----------------------------------------------------------------------------
 void run(const options& options)
 {
-  dm::init();
+  dm::init(options.db_durability, options.db_engine, options.db_journal);
+
+  // Records stored as json text by earlier versions are converted while
+  // serving requests.
+  std::thread migration([]()
+  {
+    try
+    {
+      auto converted = dm::migrate();
+
+      if ( converted > 0 ) {
+        std::cerr << "migrated " << converted << " records" << std::endl;
+      }
+    }
+    catch ( std::exception& e )
+    {
+      // Records not converted are read as they are, and converted on the
+      // next start.
+      std::cerr << "migration error " << e.what() << std::endl;
+    }
+  });
 
   loop_.reset(new dripcore::loop);
 
@@ -114,17 +145,20 @@ void run(const options& options)
   service.add_method("db/index",             std::bind(&json_rpc::index,                _1));
   service.add_method("db/save",              std::bind(&json_rpc::save,                 _1));
   service.add_method("db/delete",            std::bind(&json_rpc::erase,                _1));
-  service.add_method("db/import-tracks",     std::bind(&json_rpc::import_tracks,        _1));
+  service.add_method("db/import-tracks",     std::bind(&json_rpc::import_tracks,        _1), std::bind(&json_rpc::import_track, _1));
   service.add_method("db/cover",             std::bind(&json_rpc::cover,                _1));
   service.add_method("db/get/artists",       std::bind(&json_rpc::get_artists,          _1));
   service.add_method("db/get/albums",        std::bind(&json_rpc::get_albums,           _1));
   service.add_method("db/set/album",         std::bind(&json_rpc::set_album,            _1));
   service.add_method("db/get/album/tracks",  std::bind(&json_rpc::get_album_tracks,     _1));
   service.add_method("db/get/tracks",        std::bind(&json_rpc::get_tracks,           _1));
+  service.add_method("db/search",            std::bind(&json_rpc::search,               _1));
   service.add_method("db/get/source_local",  std::bind(&json_rpc::get_source_local,     _1));
   service.add_method("db/set/source_local",  std::bind(&json_rpc::set_source_local,     _1));
   service.add_method("sources/local/scan",   std::bind(&json_rpc::sources_local_scan,   _1));
   service.add_method("sources/spotify/uris", std::bind(&json_rpc::sources_spotify_uris, _1));
+  service.add_method("db/stats",             std::bind(&json_rpc::stats,                _1));
+  service.add_method("db/changes",           std::bind(&json_rpc::changes,              _1));
 
   /////
   // Setup callback to get player state info. Note that the callback is
@@ -134,14 +168,13 @@ void run(const options& options)
   //
   player.set_state_info_callback([&](const player_state_info& info)
   {
-    json::object params
-    {
-      { "state",  info.state },
-      { "track",  info.track.to_json() },
-      { "source", info.source }
-    };
+    json::object params;
+
+    params.member("state",  info.state);
+    params.member("track",  info.track.to_json());
+    params.member("source", info.source);
 
-    service.send_notification(json_rpc_notification("player/event", params));
+    service.send_notification(json_rpc_notification("player/event", std::move(params)));
   });
 
   auto acceptor = std::make_shared<dripcore::acceptor>("0.0.0.0", 8212,
@@ -149,12 +182,21 @@ void run(const options& options)
       loop_->start(std::make_shared<jsonrpc::server::connection>(service, std::move(client)));
     });
 
+  // Covers are served over http, so browsers can fetch and cache the
+  // images without going through json.
+  auto cover_acceptor = std::make_shared<dripcore::acceptor>("0.0.0.0", 8213,
+    [&](dripcore::socket client) {
+      loop_->start(std::make_shared<http::server::cover_connection>(std::move(client)));
+    });
+
   loop_->start(acceptor);
+  loop_->start(cover_acceptor);
   loop_->run();
 
   std::cerr << "shutdown player!" << std::endl;
 
   player.shutdown();
+  migration.join();
 }
 
 // ----------------------------------------------------------------------------
@@ -192,6 +234,40 @@ void load_configuration(const std::string& filename, options& options)
     if ( conf["audio_device"].is_string() ) {
       options.audio_device = conf["audio_device"].as_string();
     }
+
+    if ( conf["db_durability"].is_string() )
+    {
+      auto& durability = conf["db_durability"].as_string();
+
+      if ( durability == "soft" ) {
+        options.db_durability = dm::kvstore::durability::soft;
+      }
+      else if ( durability == "hard" ) {
+        options.db_durability = dm::kvstore::durability::hard;
+      }
+      else {
+        throw std::runtime_error("db_durability must be soft or hard");
+      }
+    }
+
+    if ( conf["db_engine"].is_string() )
+    {
+      auto& engine = conf["db_engine"].as_string();
+
+      if ( engine == "kyoto" ) {
+        options.db_engine = dm::storage_engine::type::kyoto;
+      }
+      else if ( engine == "lmdb" ) {
+        options.db_engine = dm::storage_engine::type::lmdb;
+      }
+      else {
+        throw std::runtime_error("db_engine must be kyoto or lmdb");
+      }
+    }
+
+    if ( conf["db_journal"].is_bool() ) {
+      options.db_journal = conf["db_journal"].is_true();
+    }
   }
   catch (const std::exception& e)
   {
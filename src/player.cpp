@@ -31,11 +31,7 @@ void player_ctbp_selector::init()
 {
   track_ids_.clear();
 
-  dm::track::each([&](dm::track& track) -> bool
-  {
-    track_ids_.push_back(track.id());
-    return true;
-  });
+  track_ids_ = dm::get_catalog().track_ids();
 
   rg_.reset(new random_generator(0, track_ids_.size()-1));
 
@@ -45,16 +41,7 @@ void player_ctbp_selector::init()
 // ----------------------------------------------------------------------------
 void player_ctbp_selector::init_by_tag(std::string tag)
 {
-  track_ids_.clear();
-
-  dm::track::each([&](dm::track& track) -> bool
-  {
-    if ( track.has_tag(tag) )
-    {
-      track_ids_.push_back(track.id());
-    }
-    return true;
-  });
+  track_ids_ = dm::get_catalog().track_ids_by_tag(tag);
 
   rg_.reset(new random_generator(0, track_ids_.size()-1));
 
@@ -360,7 +347,7 @@ void player::play_from_queue()
 {
   if ( play_queue_.size() > 0 )
   {
-    auto track = play_queue_.front();
+    auto track = play_queue_.pop();
     auto src   = track.find_source();
 
     if ( !src.is_null() )
@@ -378,12 +365,10 @@ void player::play_from_queue()
       }
 
       play_source(src);
-      play_queue_.pop();
     }
     else
     {
       std::cerr << "play_from_queue id=" << track.id() << ", title='" << track.title() << "', NO SOURCE!" << std::endl;
-      play_queue_.pop();
       play_from_queue();
     }
   }
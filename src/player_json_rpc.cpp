@@ -15,6 +15,10 @@
 #include "local_source.h"
 #include "dm/dm.h"
 
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <climits>
+
 // ----------------------------------------------------------------------------
 namespace json_rpc
 {
@@ -131,14 +135,13 @@ namespace json_rpc
 
     auto info = player.get_state_info();
 
-    json::object params
-    {
-      { "state",  info.state },
-      { "track",  info.track.to_json() },
-      { "source", info.source }
-    };
+    json::object params;
 
-    response.set_result(params);
+    params.member("state",  std::move(info.state));
+    params.member("track",  std::move(info.track).to_json());
+    params.member("source", std::move(info.source));
+
+    response.set_result(std::move(params));
 
     return response;
   }
@@ -152,13 +155,16 @@ namespace json_rpc
     {
       auto& params = request.params().as_object();
       auto& album_id = params["album_id"];
+      auto& size     = params["size"];
 
-      if ( album_id.is_string() )
+      if ( album_id.is_string() && (size.is_null() || (size.is_integer() && size.as_integer() >= 0)) )
       {
         auto cover = dm::album_cover::find_by_album_id(album_id);
+        // The smallest thumbnail of at least size pixels, or the image.
+        auto pixels = size.is_null() ? 0u : static_cast<unsigned>(std::min<int64_t>(size.as_integer(), UINT_MAX));
 
-        if ( !cover.is_null() ) {
-          response.set_result(cover.data());
+        if ( !cover.is_null() && cover.image(pixels) ) {
+          response.set_result(cover.data(pixels));
         }
         else {
           response.error(1, "not found");
@@ -182,58 +188,11 @@ namespace json_rpc
   {
     json_rpc_response response{request};
 
+    // Built from the catalog, which readers see one commit at a time.
     json::object index{
-      { "artists", json::array() }
+      { "artists", dm::get_catalog().index() }
     };
 
-    auto& artists = index["artists"].as_array();
-    dm::artist::each([&](dm::artist& artist) -> bool
-    {
-      json::object jartist{
-        { "id",     artist.id() },
-        { "name",   artist.name() },
-        { "albums", json::array() }
-      };
-
-      auto& albums = jartist["albums"].as_array();
-      artist.each_album([&](dm::album& album) -> bool
-      {
-        json::object jalbum{
-          { "id",     album.id() },
-          { "title",  album.title() },
-          { "tracks", json::array() }
-        };
-
-        auto& jtracks = jalbum["tracks"].as_array();
-        album.each_track([&](dm::track& track) -> bool
-        {
-          json::object jtrack{
-            { "id",       track.id() },
-            { "title",    track.title() },
-            { "tn",       track.track_number() },
-            { "dn",       track.disc_number() },
-            { "duration", track.duration() },
-            //{ "rating",   -1 }
-            { "tags",     track.tags() }
-          };
-
-          jtracks.push_back(jtrack);
-          return true;
-        });
-
-        albums.push_back(jalbum);
-        return true;
-      });
-
-      // Don't include artists with no albums.
-      if ( albums.size() > 0 )
-      {
-        artists.push_back(jartist);
-      }
-
-      return true;
-    });
-
     response.set_result(std::move(index));
 
     return response;
@@ -319,7 +278,7 @@ save_error:
             auto album = dm::album::find_by_id(id);
 
             // For now only allow delete if album has no tracks.
-            auto tracks = album.track_ids();
+            auto& tracks = album.track_ids();
 
             if ( tracks.size() == 0 )
             {
@@ -331,11 +290,7 @@ save_error:
                 return true;
               });
               // Delete album cover
-              auto cover = dm::album_cover::find_by_album_id(album.id());
-              if ( !cover.is_null() )
-              {
-                cover.erase();
-              }
+              dm::album_cover::find_by_album_id(album.id()).erase();
               // Delete the album.
               album.erase();
             }
@@ -473,6 +428,9 @@ save_error:
     auto& track_artist_name = track_artist_obj["name"].as_string();
     auto& album_artist_name = album_artist_obj["name"].as_string();
 
+    // The artists, album, track and cover are committed together.
+    auto transaction = dm::transaction();
+
     /////
     // Update / create album artist.
 
@@ -533,9 +491,9 @@ save_error:
     }
 
     auto track_title    = track_obj["title"].as_string();
-    auto track_tn       = track_obj["tn"].as_number();
-    auto track_dn       = track_obj["dn"].as_number();
-    auto track_duration = track_obj["duration"].as_number();
+    auto track_tn       = track_obj["tn"].as_integer();
+    auto track_dn       = track_obj["dn"].as_integer();
+    auto track_duration = track_obj["duration"].as_integer();
 
     /////
     // Update / create track.
@@ -604,6 +562,21 @@ save_error:
     {
       std::cerr << "json no cover!" << std::endl;
     }
+
+    transaction.commit();
+  }
+
+  // --------------------------------------------------------------------------
+  void import_track(json::value& item)
+  {
+    if ( item.is_object() )
+    {
+      import_json_track(item.as_object());
+    }
+    else
+    {
+      // ERROR!
+    }
   }
 
   // --------------------------------------------------------------------------
@@ -611,21 +584,10 @@ save_error:
   {
     json_rpc_response response{request};
 
+    // The tracks have been handed to import_track one by one.
     if ( request.params().is_array() )
     {
-      auto& tracks_arr = request.params().as_array();
-
-      for ( auto& item : tracks_arr )
-      {
-        if ( item.is_object() )
-        {
-          import_json_track(item.as_object());
-        }
-        else
-        {
-          // ERROR!
-        }
-      }
+      dm::save_catalog();
       response.set_result("ok");
     }
     else
@@ -643,7 +605,7 @@ save_error:
 
     if ( request.params().is_null() )
     {
-      response.set_result(dm::artist::find_all());
+      response.set_result(dm::get_catalog().artists());
     }
     else
     {
@@ -660,7 +622,7 @@ save_error:
 
     if ( request.params().is_null() )
     {
-      response.set_result(dm::album::find_all());
+      response.set_result(dm::get_catalog().albums());
     }
     else
     {
@@ -711,19 +673,11 @@ save_error:
 
     if ( request.params().is_string() )
     {
-      auto album = dm::album::find_by_id(request.params().as_string());
+      auto tracks = dm::get_catalog().album_tracks(request.params().as_string());
 
-      if ( !album.is_null() )
+      if ( !tracks.is_null() )
       {
-        json::array res;
-
-        album.each_track([&](dm::track& track) -> bool
-        {
-          res.push_back(track.to_json());
-          return true;
-        });
-
-        response.set_result(std::move(res));
+        response.set_result(std::move(tracks));
       }
       else
       {
@@ -746,7 +700,37 @@ save_error:
 
     if ( request.params().is_null() )
     {
-      response.set_result(dm::track::find_all());
+      response.set_result(dm::get_catalog().tracks());
+    }
+    else
+    {
+      response.invalid_params();
+    }
+
+    return response;
+  }
+
+  // --------------------------------------------------------------------------
+  // Tracks with the text in their title, artist name or album title.
+  json_rpc_response search(const json_rpc_request& request)
+  {
+    json_rpc_response response{request};
+
+    if ( request.params().is_object() )
+    {
+      auto& params = request.params().as_object();
+      auto& text   = params["text"];
+      auto& limit  = params["limit"];
+
+      if ( text.is_string() && (limit.is_null() || (limit.is_integer() && limit.as_integer() > 0)) )
+      {
+        size_t max = limit.is_null() ? 100 : static_cast<size_t>(limit.as_integer());
+        response.set_result(dm::get_catalog().search(text.as_string(), max));
+      }
+      else
+      {
+        response.invalid_params();
+      }
     }
     else
     {
@@ -833,6 +817,8 @@ save_error:
 
     source_local.scan();
 
+    dm::save_catalog();
+
     std::cerr << "sources_local_scan end" << std::endl;
 
     response.set_result("ok");
@@ -846,18 +832,150 @@ save_error:
     json_rpc_response response{request};
     json::array uris;
 
-    dm::track::each([&](dm::track& track) -> bool
+    for ( auto& id : dm::track::find_ids_by_source("spotify") )
     {
-      auto src = track.find_source("spotify");
+      auto track = dm::track::find_by_id(id);
+      auto src   = track.find_source("spotify");
 
       if ( !src.is_null() )
       {
         uris.push_back(src.uri());
       }
-      return true;
+    }
+
+    response.set_result(std::move(uris));
+
+    return response;
+  }
+
+  // --------------------------------------------------------------------------
+  json_rpc_response stats(const json_rpc_request& request)
+  {
+    json_rpc_response response{request};
+
+    auto cache   = dm::cache_stats();
+    auto lookups = cache.hits + cache.misses;
+    auto covers  = dm::cover_stats();
+    auto compact = dm::compaction_stats();
+    auto catalog = dm::get_catalog().stats();
+
+    response.set_result(json::object{
+      { "cache", json::object{
+          { "hits",      static_cast<int64_t>(cache.hits) },
+          { "misses",    static_cast<int64_t>(cache.misses) },
+          { "hit_rate",  lookups > 0 ? double(cache.hits) / lookups : 0.0 },
+          { "evictions", static_cast<int64_t>(cache.evictions) },
+          { "records",   static_cast<int64_t>(cache.records) },
+          { "size",      static_cast<int64_t>(cache.size) }
+        }
+      },
+      { "covers", json::object{
+          { "hits",   static_cast<int64_t>(covers.hits) },
+          { "misses", static_cast<int64_t>(covers.misses) },
+          { "blobs",  static_cast<int64_t>(covers.blobs) },
+          { "size",   static_cast<int64_t>(covers.size) }
+        }
+      },
+      { "catalog", json::object{
+          { "artists",             static_cast<int64_t>(catalog.artists) },
+          { "albums",              static_cast<int64_t>(catalog.albums) },
+          { "tracks",              static_cast<int64_t>(catalog.tracks) },
+          { "strings",             static_cast<int64_t>(catalog.strings) },
+          { "tag_sets",            static_cast<int64_t>(catalog.tag_sets) },
+          { "size",                static_cast<int64_t>(catalog.size) },
+          { "size_per_10k_tracks", static_cast<int64_t>(catalog.size_per_10k_tracks) },
+          { "from_file",           catalog.from_file },
+          { "load_time",           catalog.load_time }
+        }
+      },
+      { "database", json::object{
+          { "size",        compact.size },
+          { "open_time",   dm::open_time() },
+          { "checkpoints", static_cast<int64_t>(compact.checkpoints) },
+          { "compaction",  json::object{
+              { "running",         compact.running },
+              { "progress",        compact.progress },
+              { "passes",          static_cast<int64_t>(compact.passes) },
+              { "slices",          static_cast<int64_t>(compact.slices) },
+              { "pass_start_size", compact.pass_start_size },
+              { "reclaimed",       compact.reclaimed }
+            }
+          }
+        }
+      }
     });
 
-    response.set_result(uris);
+    return response;
+  }
+
+  // --------------------------------------------------------------------------
+  // Changes to the records after the change numbered since, oldest first.
+  // If reset is true changes after since are no longer kept, the client
+  // must read everything again and continue from last, read before that.
+  json_rpc_response changes(const json_rpc_request& request)
+  {
+    json_rpc_response response{request};
+
+    json::value since;
+    json::value limit;
+    json::value values;
+
+    if ( request.params().is_object() )
+    {
+      auto& params = request.params().as_object();
+
+      since  = params["since"];
+      limit  = params["limit"];
+      values = params["values"];
+    }
+    else if ( !request.params().is_null() )
+    {
+      response.invalid_params();
+      return response;
+    }
+
+    bool valid =
+      (since.is_null() || (since.is_integer() && since.as_integer() >= 0)) &&
+      (limit.is_null() || (limit.is_integer() && limit.as_integer() > 0)) &&
+      (values.is_null() || values.is_bool());
+
+    if ( !valid )
+    {
+      response.invalid_params();
+      return response;
+    }
+
+    std::vector<dm::kvstore::change> changes;
+
+    auto last  = dm::last_change();
+    auto reset = !dm::changes(
+      since.is_null() ? 0 : since.as_integer(),
+      limit.is_null() ? 1000 : std::min<int64_t>(limit.as_integer(), 10000),
+      values.is_true(),
+      changes);
+
+    json::array result;
+
+    for ( auto& change : changes )
+    {
+      json::object item{
+        { "seq", static_cast<int64_t>(change.seq) },
+        { "op",  change.op == dm::kvstore::change_op::set ? "set" : "remove" },
+        { "key", change.key }
+      };
+
+      if ( values.is_true() && change.op == dm::kvstore::change_op::set ) {
+        item["value"] = std::move(change.value);
+      }
+
+      result.push_back(std::move(item));
+    }
+
+    response.set_result(json::object{
+      { "last",    static_cast<int64_t>(last) },
+      { "reset",   reset },
+      { "changes", std::move(result) }
+    });
 
     return response;
   }
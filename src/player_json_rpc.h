@@ -27,16 +27,20 @@ namespace json_rpc
   json_rpc_response index(const json_rpc_request& request);
   json_rpc_response save(const json_rpc_request& request);
   json_rpc_response erase(const json_rpc_request& request);
+  void              import_track(json::value& item);
   json_rpc_response import_tracks(const json_rpc_request& request);
   json_rpc_response get_artists(const json_rpc_request& request);
   json_rpc_response get_albums(const json_rpc_request& request);
   json_rpc_response set_album(const json_rpc_request& request);
   json_rpc_response get_album_tracks(const json_rpc_request& request);
   json_rpc_response get_tracks(const json_rpc_request& request);
+  json_rpc_response search(const json_rpc_request& request);
   json_rpc_response get_source_local(const json_rpc_request& request);
   json_rpc_response set_source_local(const json_rpc_request& request);
   json_rpc_response sources_local_scan(const json_rpc_request& request);
   json_rpc_response sources_spotify_uris(const json_rpc_request& request);
+  json_rpc_response stats(const json_rpc_request& request);
+  json_rpc_response changes(const json_rpc_request& request);
 #if 0
   json_rpc_response tags(player& player, const json_rpc_request& request);
   json_rpc_response export_tracks(player& player, const json_rpc_request& request);
@@ -56,7 +56,7 @@ public:
 public:
   size_t push(T value, unsigned priority=1)
   {
-    q_.emplace(begin(q_), element{value, priority});
+    q_.emplace(begin(q_), element{std::move(value), priority});
     std::stable_sort(q_.begin(), q_.end());
 
     auto pos = std::count_if(q_.begin(), q_.end(), [&](const element& elm) { return priority >= elm.priority; });
@@ -66,7 +66,7 @@ public:
 public:
   T pop()
   {
-    auto v = q_.back().value;
+    auto v = std::move(q_.back().value);
 
     q_.pop_back();
 
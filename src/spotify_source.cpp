@@ -16,7 +16,7 @@
 #include <memory>
 
 // ----------------------------------------------------------------------------
-#include <base64.h>
+#include <dm/base64.h>
 
 // ----------------------------------------------------------------------------
 class spotify_cover_loader : public std::enable_shared_from_this<spotify_cover_loader>
@@ -2,7 +2,7 @@
 #include "catch.hpp"
 
 // ----------------------------------------------------------------------------
-#include <base64.h>
+#include <dm/base64.h>
 
 // ----------------------------------------------------------------------------
 TEST_CASE("test base64 encode")
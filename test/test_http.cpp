@@ -0,0 +1,145 @@
+// ----------------------------------------------------------------------------
+#include "catch.hpp"
+
+// ----------------------------------------------------------------------------
+#include <http.h>
+#include <cover_connection.h>
+#include <dm/base64.h>
+
+// ----------------------------------------------------------------------------
+#include <thread>
+
+// ----------------------------------------------------------------------------
+#include <sys/socket.h>
+
+// ----------------------------------------------------------------------------
+TEST_CASE("http request head is parsed")
+{
+  http::request request;
+
+  REQUIRE( request.parse("GET /covers/al0001?size=200 HTTP/1.1\r\nHost: mbox\r\nIf-None-Match:  \"a\"\r\nif-none-match: \"b\"") );
+  REQUIRE( request.method() == "GET" );
+  REQUIRE( request.path() == "/covers/al0001?size=200" );
+  REQUIRE( request.version() == "HTTP/1.1" );
+  REQUIRE( request.header("host") == "mbox" );
+  // Names are case insensitive, and repeated headers are joined.
+  REQUIRE( request.header("If-None-Match") == "\"a\", \"b\"" );
+  REQUIRE( request.header("accept").empty() );
+  REQUIRE( request.keep_alive() );
+
+  http::request close;
+
+  REQUIRE( close.parse("GET / HTTP/1.1\r\nConnection: close") );
+  REQUIRE( !close.keep_alive() );
+
+  http::request old;
+
+  REQUIRE( old.parse("GET / HTTP/1.0") );
+  REQUIRE( !old.keep_alive() );
+
+  REQUIRE( !http::request().parse("") );
+  REQUIRE( !http::request().parse("GET /") );
+  REQUIRE( !http::request().parse("GET / FTP/1.0") );
+  REQUIRE( !http::request().parse("GET / HTTP/1.1\r\nno colon") );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("http dates and entity tags")
+{
+  REQUIRE( http::format_date(784111777) == "Sun, 06 Nov 1994 08:49:37 GMT" );
+  REQUIRE( http::parse_date("Sun, 06 Nov 1994 08:49:37 GMT") == 784111777 );
+  REQUIRE( http::parse_date("Sunday, 06-Nov-94 08:49:37 GMT") == -1 );
+  REQUIRE( http::parse_date("") == -1 );
+
+  REQUIRE( http::etag_matches("\"abc\"", "\"abc\"") );
+  REQUIRE( http::etag_matches("\"x\", W/\"abc\"", "\"abc\"") );
+  REQUIRE( http::etag_matches("*", "\"abc\"") );
+  REQUIRE( !http::etag_matches("\"abcd\"", "\"abc\"") );
+  REQUIRE( !http::etag_matches("", "\"abc\"") );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("http cover connection sends the image file")
+{
+  std::remove("test_http.kdb");
+  std::remove("test_http.kdb.idx");
+
+  dm::kvstore    kvstore("test_http.kdb");
+  dm::blob_store covers("test_http_blobs");
+
+  dm::album_cover::init(&covers);
+  dm::album::init(&kvstore);
+
+  // Larger than a socket buffer, so it is sent in several parts.
+  std::string image(1024*1024, '\0');
+
+  for ( size_t i = 0; i < image.size(); ++i ) {
+    image[i] = static_cast<char>(i * 7);
+  }
+
+  kvstore.set("cover/al0001", json::object{
+    { "image_format", "jpg" },
+    { "image_data",   base64::encode(image.data(), image.size()) }
+  });
+
+  // Moves the image to the blob store.
+  auto blob_id = dm::album_cover::find_by_album_id("al0001").blob_id();
+
+  int fds[2];
+
+  REQUIRE( socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0 );
+
+  dripcore::socket server(fds[0]);
+
+  server.nonblocking(true);
+
+  dripcore::loop loop;
+
+  loop.start(std::make_shared<http::server::cover_connection>(std::move(server)));
+
+  std::thread thread([&]() { loop.run(); });
+
+  std::string requests =
+    "GET /covers/al0001 HTTP/1.1\r\nHost: mbox\r\n\r\n"
+    "GET /covers/al0001 HTTP/1.1\r\nIf-None-Match: \"" + blob_id + "\"\r\n\r\n"
+    "GET /covers/al0002 HTTP/1.1\r\n\r\n"
+    "HEAD /covers/al0001 HTTP/1.1\r\nConnection: close\r\n\r\n";
+
+  REQUIRE( send(fds[1], requests.data(), requests.length(), 0) == static_cast<ssize_t>(requests.length()) );
+
+  // The connection is closed after the last response.
+  std::string response;
+  char        buf[4096];
+  ssize_t     res;
+
+  while ( (res = recv(fds[1], buf, sizeof(buf), 0)) > 0 ) {
+    response.append(buf, res);
+  }
+
+  close(fds[1]);
+  thread.join();
+
+  auto body = response.find("\r\n\r\n") + 4;
+
+  REQUIRE( response.compare(0, 17, "HTTP/1.1 200 OK\r\n") == 0 );
+  REQUIRE( response.find("ETag: \"" + blob_id + "\"\r\n") < body );
+  REQUIRE( response.find("Content-Type: image/jpeg\r\n") < body );
+  REQUIRE( response.find("Content-Length: 1048576\r\n") < body );
+  REQUIRE( response.compare(body, image.size(), image) == 0 );
+
+  auto rest = response.substr(body + image.size());
+
+  REQUIRE( rest.compare(0, 27, "HTTP/1.1 304 Not Modified\r\n") == 0 );
+  REQUIRE( rest.find("HTTP/1.1 404 Not Found\r\n") != std::string::npos );
+
+  auto head = rest.substr(rest.rfind("HTTP/1.1 "));
+
+  REQUIRE( head.compare(0, 17, "HTTP/1.1 200 OK\r\n") == 0 );
+  REQUIRE( head.find("Connection: close\r\n") != std::string::npos );
+  // No body for HEAD.
+  REQUIRE( head.substr(head.find("\r\n\r\n")) == "\r\n\r\n" );
+
+  dm::album_cover::find_by_album_id("al0001").erase();
+
+  std::remove("test_http_blobs");
+}
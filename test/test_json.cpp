@@ -0,0 +1,473 @@
+// ----------------------------------------------------------------------------
+#include "catch.hpp"
+
+// ----------------------------------------------------------------------------
+#include <json/json.h>
+#include <json/details/json_scan.h>
+
+// ----------------------------------------------------------------------------
+static json::value parse(const std::string& s)
+{
+  json::value  value;
+  json::parser parser(value);
+
+  parser.parse(s.data(), s.length());
+
+  return value;
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json writer writes scalars and containers")
+{
+  REQUIRE( to_string(json::array{ json::value(), true, false, "x" }) == "[null,true,false,\"x\"]" );
+  REQUIRE( to_string(json::array{}) == "[]" );
+  REQUIRE( to_string(json::object{}) == "{}" );
+  REQUIRE( to_string(json::object{ { "a", json::array{ 1 } } }) == "{\"a\":[1]}" );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json writer escapes strings")
+{
+  REQUIRE( to_string(json::value("plain text")) == "\"plain text\"" );
+  REQUIRE( to_string(json::value("a\"b\\c/d")) == "\"a\\\"b\\\\c\\/d\"" );
+  REQUIRE( to_string(json::value("\b\f\n\r\t")) == "\"\\b\\f\\n\\r\\t\"" );
+  REQUIRE( to_string(json::value(std::string("\x01\x1f", 2))) == "\"\\u0001\\u001f\"" );
+  REQUIRE( to_string(json::value("bl\xc3\xa5")) == "\"bl\xc3\xa5\"" );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json writer appends to a reused buffer")
+{
+  std::string  buf;
+  json::writer writer(buf);
+
+  writer.write(json::value("a"));
+  buf.push_back('\0');
+  writer.write(json::value("b"));
+
+  REQUIRE( buf == std::string("\"a\"\0\"b\"", 7) );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json writer output parses back")
+{
+  json::object track{
+    { "id",      "t00001" },
+    { "title",   "Dancing in the \"Dark\"" },
+    { "tn",      11 },
+    { "tags",    json::array{ "rock", "80s" } },
+    { "artist",  json::object{ { "id", "ar0001" }, { "name", "Bruce Springsteen" } } }
+  };
+
+  auto text  = to_string(track);
+  auto value = parse(text);
+
+  REQUIRE( value.is_object() );
+  REQUIRE( value.as_object().at("title").as_string() == "Dancing in the \"Dark\"" );
+  REQUIRE( to_string(value).length() == text.length() );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json integers are kept as int64")
+{
+  auto value = parse("[0, -7, 42, 9007199254740993, -9223372036854775808]");
+  auto& arr  = value.as_array();
+
+  REQUIRE( arr[0].is_integer() );
+  REQUIRE( arr[1].as_integer() == -7 );
+  REQUIRE( arr[2].as_integer() == 42 );
+  REQUIRE( arr[3].as_integer() == 9007199254740993LL );
+  REQUIRE( arr[4].as_integer() == INT64_MIN );
+
+  REQUIRE( to_string(value) == "[0,-7,42,9007199254740993,-9223372036854775808]" );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json numbers out of integer range are read as double")
+{
+  auto value = parse("[1.5, 1e3, 18446744073709551616]");
+  auto& arr  = value.as_array();
+
+  REQUIRE( arr[0].is_number() );
+  REQUIRE( !arr[0].is_integer() );
+  REQUIRE( arr[1].as_number() == 1000.0 );
+  REQUIRE( !arr[2].is_integer() );
+  REQUIRE( arr[2].as_number() == 18446744073709551616.0 );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json doubles are written in shortest round trip form")
+{
+  REQUIRE( to_string(json::array{ -7.23, 89.0, 0.1, 1.0/3 }) == "[-7.23,89,0.1,0.3333333333333333]" );
+  REQUIRE( to_string(json::array{ 5u, 123456789012345LL }) == "[5,123456789012345]" );
+
+  auto value = parse("[0.30000000000000004]");
+  REQUIRE( to_string(value) == "[0.30000000000000004]" );
+}
+
+// ----------------------------------------------------------------------------
+static std::vector<json::details::scan_level> scan_levels()
+{
+  return { json::details::scan_level::scalar, json::details::scan_level::sse2, json::details::scan_level::avx2 };
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json scan functions find the first special character at any offset")
+{
+  for ( auto level : scan_levels() )
+  {
+    json::details::select_scan_level(level);
+
+    for ( size_t pos = 0; pos < 70; ++pos )
+    {
+      std::string ws(80, ' ');
+      ws[pos] = 'x';
+      REQUIRE( json::details::skip_ws(ws.data(), ws.data()+ws.length()) == ws.data()+pos );
+
+      for ( char special : { '"', '\\', '\x01', '\x1f' } )
+      {
+        std::string str(80, 'a');
+        str[pos] = special;
+        str[pos+5] = '"';
+        REQUIRE( json::details::find_string_special(str.data(), str.data()+str.length()) == str.data()+pos );
+      }
+    }
+
+    std::string none(45, '\xc3');
+    REQUIRE( json::details::find_string_special(none.data(), none.data()+none.length()) == none.data()+none.length() );
+  }
+  json::details::select_scan_level(json::details::scan_level::avx2);
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json scan validates utf-8")
+{
+  for ( auto level : scan_levels() )
+  {
+    json::details::select_scan_level(level);
+
+    for ( size_t pos = 0; pos < 40; ++pos )
+    {
+      std::string ok(pos, 'a');
+      ok += "bl\xc3\xa5 \xe2\x82\xac \xf0\x9f\x8e\xb5";
+      ok += std::string(40, 'b');
+      REQUIRE( json::details::validate_utf8(ok.data(), ok.data()+ok.length()) );
+
+      for ( auto bad : { "\xc3", "\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xff" } )
+      {
+        std::string s = std::string(pos, 'a') + bad + "x";
+        REQUIRE( !json::details::validate_utf8(s.data(), s.data()+s.length()) );
+      }
+    }
+  }
+  json::details::select_scan_level(json::details::scan_level::avx2);
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json parser reads strings split at any chunk boundary")
+{
+  std::string text = "{ \"data\" : \"" + std::string(100, 'A') + "\\n\\\"bl\xc3\xa5\\\"" + std::string(50, 'B') + "\" }";
+
+  for ( size_t split = 1; split < text.length(); ++split )
+  {
+    json::value  value;
+    json::parser parser(value);
+
+    size_t consumed = parser.parse(text.data(), split);
+    consumed += parser.parse(text.data()+consumed, text.length()-consumed);
+
+    REQUIRE( parser.complete() );
+    REQUIRE( value.as_object().at("data").as_string() == std::string(100, 'A') + "\n\"bl\xc3\xa5\"" + std::string(50, 'B') );
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json parser rejects invalid utf-8 in strings")
+{
+  REQUIRE_THROWS_AS( parse("[\"\xc3\x28\"]"), json::error );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json parser replaces invalid utf-8 when asked to")
+{
+  std::string text = "{\"bl\xe5\": [\"\xc3\x28\", \"ok \xc3\xa5\"]}";
+
+  json::value  value;
+  json::parser parser(value, json::parser::default_max_depth, json::utf8_mode::replace);
+
+  parser.parse(text.data(), text.length());
+
+  REQUIRE( parser.complete() );
+  REQUIRE( value.as_object().has_member("bl\xef\xbf\xbd") );
+
+  auto& strings = value.as_object().at("bl\xef\xbf\xbd").as_array();
+
+  REQUIRE( strings[0].as_string() == "\xef\xbf\xbd(" );
+  REQUIRE( strings[1].as_string() == "ok \xc3\xa5" );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json parser resumes at any chunk boundary")
+{
+  std::string text =
+    "{ \"tracks\" : [ { \"id\": \"t00001\", \"tn\": 12, \"gain\": -7.25e0, \"tags\": [] },\n"
+    "                 { \"id\": \"t00002\", \"ok\": true, \"bad\": false, \"none\": null, \"u\": \"\\u00e5\\ud83c\\udfb5\" } ],\n"
+    "  \"count\" : 2 }";
+
+  json::value expected = parse(text);
+
+  for ( size_t split = 1; split < text.length(); ++split )
+  {
+    json::value  value;
+    json::parser parser(value);
+
+    // Feed one chunk and then the rest one character at a time.
+    size_t consumed = parser.parse(text.data(), split);
+
+    while ( consumed < text.length() && !parser.complete() ) {
+      consumed += parser.parse(text.data()+consumed, 1);
+    }
+
+    REQUIRE( parser.complete() );
+    REQUIRE( to_string(value) == to_string(expected) );
+  }
+
+  auto& tracks = expected.as_object().at("tracks").as_array();
+  REQUIRE( tracks[0].as_object().at("tn").as_integer() == 12 );
+  REQUIRE( tracks[0].as_object().at("gain").as_number() == -7.25 );
+  REQUIRE( tracks[1].as_object().at("none").is_null() );
+  REQUIRE( tracks[1].as_object().at("u").as_string() == "\xc3\xa5\xf0\x9f\x8e\xb5" );
+
+  REQUIRE( to_string(parse("// catalog\n" + text)) == to_string(expected) );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json parser can be reset and reused")
+{
+  json::value  value;
+  json::parser parser(value);
+  std::string  text = "[1]{\"a\":2}";
+
+  size_t consumed = parser.parse(text.data(), text.length());
+  REQUIRE( consumed == 3 );
+  REQUIRE( parser.complete() );
+  REQUIRE( to_string(value) == "[1]" );
+
+  parser.reset();
+  parser.parse(text.data()+consumed, text.length()-consumed);
+  REQUIRE( parser.complete() );
+  REQUIRE( to_string(value) == "{\"a\":2}" );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json parser limits nesting depth")
+{
+  json::value  value;
+  json::parser parser(value, 8);
+
+  REQUIRE_NOTHROW( parser.parse("[[[[[[[[]]]]]]]]", 16) );
+  parser.reset();
+  REQUIRE_THROWS_AS( parser.parse("[[[[[[[[[", 9), json::error );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json parser rejects malformed input")
+{
+  REQUIRE_THROWS_AS( parse("\"root string\""), json::error );
+  REQUIRE_THROWS_AS( parse("[tru]"), json::error );
+  REQUIRE_THROWS_AS( parse("[1 2]"), json::error );
+  REQUIRE_THROWS_AS( parse("{\"a\" 1}"), json::error );
+  REQUIRE_THROWS_AS( parse("{\"a\":1,}"), json::error );
+  REQUIRE_THROWS_AS( parse("[\"\\x\"]"), json::error );
+  REQUIRE_THROWS_AS( parse("[\"\\ud83c\"]"), json::error );
+  REQUIRE_THROWS_AS( parse("[1x]"), json::error );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json view field lookup")
+{
+  std::string text =
+    " {\"id\":\"t00001\", \"title\" : \"AC\\/DC \\u00e5\", \"tn\":12, \"gain\":-7.25,"
+    "  \"live\":true, \"none\":null, \"tags\":[\"rock\",\"live\",[1,{\"x\":\"]\"}]],"
+    "  \"album\":{\"id\":\"al0001\",\"title\":\"Back in \\\"Black\\\"\"}} \n";
+
+  json::view record(text);
+  std::string buf;
+
+  REQUIRE( record.is_object() );
+  REQUIRE( record["id"].as_string(buf) == "t00001" );
+  REQUIRE( record["title"].as_string() == "AC/DC \xc3\xa5" );
+  REQUIRE( record["tn"].is_integer() );
+  REQUIRE( record["tn"].as_integer() == 12 );
+  REQUIRE( record["gain"].is_number() );
+  REQUIRE( !record["gain"].is_integer() );
+  REQUIRE( record["gain"].as_number() == -7.25 );
+  REQUIRE( record["live"].as_bool() );
+  REQUIRE( record["none"] );
+  REQUIRE( record["none"].is_null() );
+  REQUIRE( !record["missing"] );
+  REQUIRE( record["missing"].is_null() );
+  REQUIRE( record["album"]["title"].as_string() == "Back in \"Black\"" );
+  REQUIRE( record["tags"][1].as_string() == "live" );
+  REQUIRE( record["tags"][2][1]["x"].as_string() == "]" );
+  REQUIRE( !record["tags"][3] );
+  REQUIRE( record["tags"].raw() == "[\"rock\",\"live\",[1,{\"x\":\"]\"}]]" );
+
+  std::vector<std::string> tags;
+
+  record["tags"].each([&](const json::view& tag) -> bool
+  {
+    if ( tag.is_string() ) {
+      tags.push_back(tag.as_string());
+    }
+    return true;
+  });
+
+  REQUIRE( tags.size() == 2 );
+  REQUIRE( tags[0] == "rock" );
+  REQUIRE( tags[1] == "live" );
+
+  std::vector<json::view> fields;
+
+  record.project({ "album", "nope", "tn" }, fields);
+
+  REQUIRE( fields.size() == 3 );
+  REQUIRE( fields[0]["id"].as_string() == "al0001" );
+  REQUIRE( !fields[1] );
+  REQUIRE( fields[2].as_integer() == 12 );
+
+  REQUIRE( to_string(record.to_value()) == to_string(parse(text)) );
+  REQUIRE( to_string(record["tags"].to_value()) == "[\"rock\",\"live\",[1,{\"x\":\"]\"}]]" );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json view errors")
+{
+  std::string             buf;
+  std::vector<json::view> fields;
+
+  REQUIRE( !json::view(" \n") );
+  REQUIRE_THROWS_AS( json::view("{\"a\":\"x").project({ "a" }, fields), json::error );
+  REQUIRE_THROWS_AS( json::view("{\"a\" 1}")["a"], json::error );
+  REQUIRE_THROWS_AS( json::view("[1 2]")[1], json::error );
+  REQUIRE_THROWS_AS( json::view("\"\\x\"").as_string(buf), json::error );
+  REQUIRE_THROWS_AS( json::view("12").as_string(buf), json::error );
+  REQUIRE_THROWS_AS( json::view("\"12\"").as_integer(), json::error );
+}
+
+// ----------------------------------------------------------------------------
+class event_recorder : public json::handler
+{
+public:
+  void start_object() override { events += "{"; }
+  void end_object() override { events += "}"; }
+  void start_array() override { events += "["; }
+  void end_array() override { events += "]"; }
+  void key(std::string_view v) override { events += "k:" + std::string(v) + " "; }
+  void string(std::string_view v) override { events += "s:" + std::string(v) + " "; }
+  void number(double v) override { events += "n:" + std::to_string(v) + " "; }
+  void integer(int64_t v) override { events += "i:" + std::to_string(v) + " "; }
+  void boolean(bool v) override { events += v ? "true " : "false "; }
+  void null() override { events += "null "; }
+public:
+  std::string events;
+};
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json sax parser reports events")
+{
+  std::string text = "{\"a\":[1,-2.5,\"x\\ty\",true,false,null,{}],\"b\":{\"c\":[]}}";
+  std::string expected = "{k:a [i:1 n:-2.500000 s:x\ty true false null {}]k:b {k:c []}}";
+
+  for ( size_t split = 0; split <= text.length(); ++split )
+  {
+    event_recorder   recorder;
+    json::sax_parser parser(recorder);
+
+    size_t consumed = parser.parse(text.data(), split);
+    consumed += parser.parse(text.data()+consumed, text.length()-consumed);
+
+    REQUIRE( consumed == text.length() );
+    REQUIRE( parser.complete() );
+    REQUIRE( recorder.events == expected );
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json array stream hands over one element at a time")
+{
+  std::vector<std::string> elements;
+
+  json::array_stream stream([&](json::value& element)
+  {
+    elements.push_back(to_string(element));
+  });
+
+  json::basic_sax_parser<json::array_stream> parser(stream);
+  std::string      text = "[ {\"id\":1,\"tags\":[\"a\",[]]}, 2, \"three\", [4,[5]], null ]";
+
+  for ( size_t i = 0; i < text.length(); ++i )
+  {
+    parser.parse(text.data()+i, 1);
+
+    // Nothing is handed over before the element is complete.
+    if ( i < text.find(',') ) {
+      REQUIRE( elements.empty() );
+    }
+  }
+
+  REQUIRE( parser.complete() );
+  REQUIRE( stream.complete() );
+  REQUIRE( elements.size() == 5 );
+  REQUIRE( elements[0].length() == std::string("{\"id\":1,\"tags\":[\"a\",[]]}").length() );
+  REQUIRE( elements[1] == "2" );
+  REQUIRE( elements[2] == "\"three\"" );
+  REQUIRE( elements[3] == "[4,[5]]" );
+  REQUIRE( elements[4] == "null" );
+
+  stream.reset();
+  parser.reset();
+
+  REQUIRE_THROWS_AS( parser.parse("{\"a\":1}", 7), json::error );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json value contents can be moved out")
+{
+  json::value obj = json::object{ { "tracks", json::array{ "t00001", "t00002" } } };
+  auto*       tracks_before = &obj.as_object()["tracks"].as_array()[0].as_string();
+
+  json::object o = std::move(obj).take_object();
+  json::array  a = std::move(o["tracks"]).take_array();
+
+  // The elements were moved, not copied.
+  REQUIRE( &a[0].as_string() == tracks_before );
+  REQUIRE( a.size() == 2 );
+  REQUIRE( o["tracks"].as_array().empty() );
+
+  json::value  s("some text");
+  std::string  str = std::move(s);
+
+  REQUIRE( str == "some text" );
+  REQUIRE( s.as_string().empty() );
+
+  json::value  copied("copied");
+  std::string  copy = copied;
+
+  REQUIRE( copy == "copied" );
+  REQUIRE( copied.as_string_view() == "copied" );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json const array iteration")
+{
+  const json::array arr{ 1, 2, 3 };
+  int64_t           sum = 0;
+
+  for ( auto& v : arr ) {
+    sum += v.as_integer();
+  }
+
+  REQUIRE( sum == 6 );
+  REQUIRE( arr[2].as_integer() == 3 );
+}
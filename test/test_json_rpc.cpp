@@ -0,0 +1,83 @@
+// ----------------------------------------------------------------------------
+#include "catch.hpp"
+
+// ----------------------------------------------------------------------------
+#include <json_rpc.h>
+
+// ----------------------------------------------------------------------------
+static json_rpc_response read_and_execute(jsonrpc::service& service, const std::string& text)
+{
+  jsonrpc::request_reader reader(service);
+  jsonrpc::request_parser parser(reader);
+
+  // Feed the request in small chunks like a connection would.
+  for ( size_t i = 0; i < text.length(); i += 7 ) {
+    parser.parse(text.data()+i, std::min<size_t>(7, text.length()-i));
+  }
+
+  REQUIRE( parser.complete() );
+
+  auto request = json_rpc_request::from_json(reader.value());
+
+  if ( reader.error().empty() )
+  {
+    return service.execute(request);
+  }
+  else
+  {
+    json_rpc_response response{request};
+    response.invalid_params(reader.error());
+    return response;
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("json rpc streams params to element function")
+{
+  jsonrpc::service   service;
+  std::vector<int>   elements;
+  size_t             params_size = 0;
+
+  service.add_method("import",
+    [&](const json_rpc_request& request) -> json_rpc_response
+    {
+      json_rpc_response response{request};
+      params_size = request.params().as_array().size();
+      response.set_result("ok");
+      return response;
+    },
+    [&](json::value& element)
+    {
+      if ( !element.is_integer() ) {
+        throw std::runtime_error("not an integer");
+      }
+      elements.push_back(element.as_integer());
+    }
+  );
+
+  SECTION("method before params is streamed")
+  {
+    auto response = read_and_execute(service, "{\"jsonrpc\":\"2.0\",\"method\":\"import\",\"params\":[1,2,3],\"id\":1}");
+
+    REQUIRE( to_string(response).find("\"result\":\"ok\"") != std::string::npos );
+    REQUIRE( elements.size() == 3 );
+    REQUIRE( params_size == 0 );
+  }
+
+  SECTION("params before method is handled by execute")
+  {
+    auto response = read_and_execute(service, "{\"params\":[1,2,3],\"jsonrpc\":\"2.0\",\"method\":\"import\",\"id\":1}");
+
+    REQUIRE( to_string(response).find("\"result\":\"ok\"") != std::string::npos );
+    REQUIRE( elements.size() == 3 );
+    REQUIRE( params_size == 0 );
+  }
+
+  SECTION("element error stops the import")
+  {
+    auto response = read_and_execute(service, "{\"jsonrpc\":\"2.0\",\"method\":\"import\",\"params\":[1,\"x\",3],\"id\":1}");
+
+    REQUIRE( to_string(response).find("not an integer") != std::string::npos );
+    REQUIRE( elements.size() == 1 );
+  }
+}
@@ -3,10 +3,27 @@
 #include <dm/artist.h>
 #include <dm/album.h>
 #include <dm/dm.h>
+#include <dm/sha256.h>
+#include <dm/thumbnail.h>
+#include <dm/work_queue.h>
+#include <dm/key_allocator.h>
+#include <dm/catalog.h>
+#include <dm/base64.h>
 
 // ----------------------------------------------------------------------------
 #include "catch.hpp"
 
+// ----------------------------------------------------------------------------
+#include <set>
+#include <thread>
+#include <future>
+#include <cstdio>
+#include <cstdlib>
+
+// ----------------------------------------------------------------------------
+#include <jpeglib.h>
+#include <kchashdb.h>
+
 // ----------------------------------------------------------------------------
 TEST_CASE("kvstore-create")
 {
@@ -24,6 +41,325 @@ TEST_CASE("kvstore-create-artist-key")
   REQUIRE( kvstore.create_artist_key() == "ar0002" );
 }
 
+// ----------------------------------------------------------------------------
+TEST_CASE("key-allocator")
+{
+  int64_t              stored    = 100;
+  size_t               reserving = 0;
+  std::recursive_mutex store;
+
+  // Serialized by a lock of the store, like the reserve of kvstore.
+  auto reserve = [&](int64_t count) -> int64_t
+  {
+    std::lock_guard<std::recursive_mutex> lock(store);
+
+    reserving++;
+    return stored += count;
+  };
+
+  {
+    dm::key_allocator keys(stored, reserve, 10);
+
+    for ( int64_t i = 101; i <= 125; ++i ) {
+      REQUIRE( keys.next() == i );
+    }
+
+    REQUIRE( reserving == 3 );
+    REQUIRE( stored == 130 );
+    REQUIRE( keys.reserved() == 130 );
+    REQUIRE( keys.unused() == 5 );
+  }
+
+  // Starting over from the stored mark, as after a crash, skips the unused
+  // keys instead of handing them out again.
+  dm::key_allocator keys(stored, reserve, 10);
+
+  REQUIRE( keys.next() == 131 );
+
+  // Keys taken concurrently are unique and leave no gaps.
+  std::vector<std::thread> threads;
+  std::vector<int64_t>     taken[4];
+
+  for ( auto& t : taken )
+  {
+    // Half the threads take keys holding the lock of the store, as writers
+    // in a transaction do.
+    bool locked = &t - taken < 2;
+
+    threads.emplace_back([&, locked]()
+    {
+      for ( int i = 0; i < 1000; ++i )
+      {
+        if ( locked )
+        {
+          std::lock_guard<std::recursive_mutex> lock(store);
+          t.push_back(keys.next());
+        }
+        else
+        {
+          t.push_back(keys.next());
+        }
+      }
+    });
+  }
+
+  for ( auto& thread : threads ) {
+    thread.join();
+  }
+
+  std::set<int64_t> all;
+
+  for ( auto& t : taken ) {
+    all.insert(t.begin(), t.end());
+  }
+
+  REQUIRE( all.size() == 4000 );
+  REQUIRE( *all.begin() == 132 );
+  REQUIRE( *all.rbegin() == 4131 );
+  REQUIRE( keys.reserved() == stored );
+  REQUIRE( keys.unused() == stored - 4131 );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-key-ranges")
+{
+  std::remove("test_keys.kdb");
+
+  {
+    dm::kvstore kvstore("test_keys.kdb");
+
+    REQUIRE( kvstore.create_album_key() == "al0001" );
+
+    {
+      dm::kvstore::transaction transaction(kvstore);
+
+      REQUIRE( kvstore.create_album_key() == "al0002" );
+      REQUIRE( kvstore.create_track_key() == "t00001" );
+    }
+
+    // Keys handed out in a transaction that is rolled back are not reused.
+    REQUIRE( kvstore.create_album_key() == "al0003" );
+    REQUIRE( kvstore.create_track_key() == "t00002" );
+  }
+
+  {
+    dm::kvstore kvstore("test_keys.kdb");
+
+    // Unused keys are given back when the store is closed.
+    REQUIRE( kvstore.create_album_key() == "al0004" );
+    REQUIRE( kvstore.create_track_key() == "t00003" );
+    REQUIRE( kvstore.create_artist_key() == "ar0001" );
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-snapshot")
+{
+  std::remove("test_snapshot.kct");
+  std::remove("test_snapshot.kct.idx");
+
+  {
+    dm::kvstore kvstore("test_snapshot.kct");
+
+    kvstore.set("al0001", json::object{ { "title", "One" }, { "tracks", json::array{ "t00001" } } });
+    kvstore.set("t00001", json::object{ { "title", "First" } });
+
+    auto num_tracks = [&]()
+    {
+      size_t n = 0;
+      kvstore.each("t", [&](json::value&) { n++; return true; });
+      return n;
+    };
+
+    std::promise<void> written;
+    std::promise<void> commit;
+    std::thread        scan;
+
+    {
+      dm::kvstore::snapshot snapshot(kvstore);
+
+      REQUIRE( snapshot.last_change() == 2 );
+
+      // A scan adding a track to the album, committed once this has read.
+      scan = std::thread([&]()
+      {
+        dm::kvstore::transaction transaction(kvstore);
+
+        kvstore.set("t00002", json::object{ { "title", "Second" } });
+        kvstore.set("al0001", json::object{ { "title", "One" }, { "tracks", json::array{ "t00001", "t00002" } } });
+
+        written.set_value();
+        commit.get_future().wait();
+
+        transaction.commit();
+      });
+
+      written.get_future().wait();
+
+      REQUIRE( kvstore.get("al0001").as_object()["tracks"].as_array().size() == 1 );
+      REQUIRE( kvstore.get("t00002").is_null() );
+      REQUIRE( kvstore.get_shared("t00002") == nullptr );
+      REQUIRE( num_tracks() == 1 );
+
+      commit.set_value();
+      scan.join();
+
+      REQUIRE( kvstore.last_change() == 4 );
+
+      {
+        dm::kvstore::snapshot nested(kvstore);
+
+        REQUIRE( nested.last_change() == 2 );
+        REQUIRE( kvstore.get_shared("al0001")->as_object().at("tracks").as_array().size() == 1 );
+      }
+
+      size_t albums = 0;
+
+      kvstore.parallel_each("al", [](json::value&) { return true; }, [&](json::value& value)
+      {
+        albums++;
+        REQUIRE( value.as_object()["tracks"].as_array().size() == 1 );
+        return true;
+      });
+
+      REQUIRE( albums == 1 );
+      REQUIRE( num_tracks() == 1 );
+      REQUIRE_THROWS( kvstore.index("title", "t", [](const json::value&, std::vector<std::string>&) {}) );
+
+      // Other threads read the records as they are.
+      std::thread([&]() { REQUIRE( !kvstore.get("t00002").is_null() ); }).join();
+    }
+
+    REQUIRE( kvstore.get("al0001").as_object()["tracks"].as_array().size() == 2 );
+    REQUIRE( num_tracks() == 2 );
+
+    // Writes while a snapshot is pinned update the index from the records
+    // as they are.
+    kvstore.index("title", "t", [](const json::value& record, std::vector<std::string>& values)
+    {
+      values.push_back(record.as_object().at("title").as_string());
+    });
+
+    {
+      dm::kvstore::snapshot snapshot(kvstore);
+
+      kvstore.set("t00001", json::object{ { "title", "Changed" } });
+      kvstore.set("t00001", json::object{ { "title", "Again" } });
+    }
+
+    REQUIRE( kvstore.find("title", "First").empty() );
+    REQUIRE( kvstore.find("title", "Changed").empty() );
+    REQUIRE( kvstore.find("title", "Again").size() == 1 );
+  }
+
+  std::remove("test_snapshot.kct");
+  std::remove("test_snapshot.kct.idx");
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-changes")
+{
+  std::remove("test_changes.kdb");
+  std::remove("test_changes.kdb.idx");
+
+  {
+    dm::kvstore kvstore("test_changes.kdb");
+
+    std::vector<uint64_t> published;
+
+    kvstore.subscribe([&](const dm::kvstore::change& change) {
+      published.push_back(change.seq);
+    });
+
+    REQUIRE( kvstore.last_change() == 0 );
+
+    kvstore.set("t00001", json::object{ { "title", "One" } });
+    kvstore.set("t00002", json::object{ { "title", "Two" } });
+    kvstore.remove("t00001");
+
+    REQUIRE( kvstore.last_change() == 3 );
+    REQUIRE( (published == std::vector<uint64_t>{ 1, 2, 3 }) );
+
+    std::vector<dm::kvstore::change> changes;
+
+    REQUIRE( kvstore.changes(0, 10, true, changes) );
+    REQUIRE( changes.size() == 3 );
+    REQUIRE( changes[0].op == dm::kvstore::change_op::set );
+    REQUIRE( changes[0].key == "t00001" );
+    // Values are read when the changes are.
+    REQUIRE( changes[0].value.is_null() );
+    REQUIRE( changes[1].value.as_object()["title"].as_string() == "Two" );
+    REQUIRE( changes[2].seq == 3 );
+    REQUIRE( changes[2].op == dm::kvstore::change_op::remove );
+
+    changes.clear();
+
+    REQUIRE( kvstore.changes(1, 1, false, changes) );
+    REQUIRE( changes.size() == 1 );
+    REQUIRE( changes[0].seq == 2 );
+    REQUIRE( changes[0].value.is_null() );
+
+    // Changes are published when committed, and forgotten when rolled back.
+    {
+      dm::kvstore::transaction transaction(kvstore);
+
+      kvstore.set("t00003", json::object{ { "title", "Three" } });
+
+      REQUIRE( published.size() == 3 );
+    }
+
+    REQUIRE( kvstore.last_change() == 3 );
+
+    {
+      dm::kvstore::transaction transaction(kvstore);
+
+      kvstore.set("t00004", json::object{ { "title", "Four" } });
+      kvstore.set("t00005", json::object{ { "title", "Five" } });
+
+      REQUIRE( published.size() == 3 );
+
+      transaction.commit();
+    }
+
+    REQUIRE( (published == std::vector<uint64_t>{ 1, 2, 3, 4, 5 }) );
+
+    changes.clear();
+
+    REQUIRE( kvstore.changes(3, 10, false, changes) );
+    REQUIRE( changes.size() == 2 );
+    REQUIRE( changes[0].key == "t00004" );
+
+    changes.clear();
+
+    // Nothing new.
+    REQUIRE( kvstore.changes(5, 10, false, changes) );
+    REQUIRE( changes.empty() );
+    // Not a position in this log.
+    REQUIRE( !kvstore.changes(6, 10, false, changes) );
+  }
+
+  {
+    dm::kvstore kvstore("test_changes.kdb");
+
+    REQUIRE( kvstore.last_change() == 5 );
+
+    kvstore.set("t00006", json::object{ { "title", "Six" } });
+
+    REQUIRE( kvstore.last_change() == 6 );
+
+    // Only the last changes are kept.
+    for ( int i = 0; i < 101000; ++i ) {
+      kvstore.set("t00007", json::object{ { "tn", i } });
+    }
+
+    std::vector<dm::kvstore::change> changes;
+
+    REQUIRE( !kvstore.changes(0, 10, false, changes) );
+    REQUIRE( kvstore.changes(kvstore.last_change() - 100, 1000, false, changes) );
+    REQUIRE( changes.size() == 100 );
+  }
+}
+
 // ----------------------------------------------------------------------------
 TEST_CASE("kvstore-artist")
 {
@@ -85,3 +421,1444 @@ TEST_CASE("kvstore-dm-init")
   dm::artist a1 = dm::artist::find_by_id(artist.id());
   REQUIRE( !a1.is_null() );
 }
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-each-fields")
+{
+  std::remove("test_each.kdb");
+
+  dm::kvstore kvstore("test_each.kdb");
+
+  kvstore.set("t00001", json::object{ { "id", "t00001" }, { "title", "One" }, { "tags", json::array{ "rock" } } });
+  kvstore.set("t00002", json::object{ { "id", "t00002" }, { "title", "Two" } });
+  kvstore.set("al0001", json::object{ { "id", "al0001" }, { "title", "Album" } });
+
+  std::map<std::string, std::string> titles;
+  size_t                              tagged = 0;
+
+  kvstore.each(
+    [](const std::string& key) -> bool
+    {
+      return key[0] == 't';
+    },
+    { "title", "tags" },
+    [&](const std::string& key, std::vector<json::value>& fields) -> bool
+    {
+      REQUIRE( fields.size() == 2 );
+      titles[key] = fields[0].as_string();
+
+      if ( fields[1].is_array() ) {
+        tagged++;
+      }
+      return true;
+    }
+  );
+
+  REQUIRE( titles.size() == 2 );
+  REQUIRE( titles["t00001"] == "One" );
+  REQUIRE( titles["t00002"] == "Two" );
+  REQUIRE( tagged == 1 );
+
+  size_t visited = 0;
+
+  kvstore.each(
+    [](const std::string& key) -> bool
+    {
+      return key[0] == 't';
+    },
+    { "id" },
+    [&](const std::string& key, std::vector<json::value>& fields) -> bool
+    {
+      visited++;
+      return false;
+    }
+  );
+
+  REQUIRE( visited == 1 );
+}
+
+// ----------------------------------------------------------------------------
+// Member order is not kept by json::object, so compare member by member.
+static bool same_value(const json::value& a, const json::value& b)
+{
+  if ( a.type_id() != b.type_id() ) {
+    return false;
+  }
+
+  if ( a.is_object() )
+  {
+    auto& ao = a.as_object();
+    auto& bo = b.as_object();
+
+    if ( ao.size() != bo.size() ) {
+      return false;
+    }
+
+    for ( auto& member : ao )
+    {
+      if ( !bo.has_member(member.first) || !same_value(member.second, bo.at(member.first)) ) {
+        return false;
+      }
+    }
+    return true;
+  }
+  else if ( a.is_array() )
+  {
+    auto& aa = a.as_array();
+    auto& ba = b.as_array();
+
+    if ( aa.size() != ba.size() ) {
+      return false;
+    }
+
+    for ( size_t i = 0; i < aa.size(); ++i )
+    {
+      if ( !same_value(aa[i], ba[i]) ) {
+        return false;
+      }
+    }
+    return true;
+  }
+  else
+  {
+    return to_string(a) == to_string(b);
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("record-codec-round-trip")
+{
+  dm::record_codec codec;
+
+  codec.binary_member("image_data");
+
+  json::value record = json::object{
+    { "id",         "t00001" },
+    { "title",      "Caf\u00e9 \"Live\"" },
+    { "tn",         7 },
+    { "negative",   -1234567890123LL },
+    { "gain",       -7.23 },
+    { "flags",      json::array{ true, false, json::value() } },
+    { "nested",     json::object{ { "id", "ar0001" }, { "empty", json::array{} } } },
+    { "image_data", "aGVsbG8gd29ybGQ=" }
+  };
+
+  std::string buf;
+
+  REQUIRE( codec.encode(record, buf) );
+  REQUIRE( dm::record_codec::is_binary(buf) );
+  // No new names the second time.
+  REQUIRE( !codec.encode(record, buf) );
+
+  auto decoded = codec.decode(buf);
+
+  REQUIRE( same_value(decoded, record) );
+  REQUIRE( decoded.as_object()["negative"].is_integer() );
+  REQUIRE( decoded.as_object()["gain"].as_number() == -7.23 );
+
+  // The base64 image is stored as its raw bytes.
+  REQUIRE( buf.find("hello world") != std::string::npos );
+  REQUIRE( buf.find("aGVsbG8gd29ybGQ=") == std::string::npos );
+
+  // Strings that are not base64 as written by base64::encode are kept.
+  record.as_object()["image_data"] = "not base64!";
+  codec.encode(record, buf);
+  REQUIRE( codec.decode(buf).as_object()["image_data"].as_string() == "not base64!" );
+
+  std::vector<json::value> fields;
+
+  REQUIRE( codec.project(buf.data(), buf.length(), { "tn", "missing", "nested" }, fields) );
+  REQUIRE( fields.size() == 3 );
+  REQUIRE( fields[0].as_integer() == 7 );
+  REQUIRE( fields[1].is_null() );
+  REQUIRE( fields[2].as_object()["id"].as_string() == "ar0001" );
+
+  // Truncated records are rejected.
+  REQUIRE_THROWS( codec.decode(buf.substr(0, buf.length()-3)) );
+
+  // A codec given the key table decodes the same records.
+  dm::record_codec other;
+
+  other.keys(codec.keys());
+  REQUIRE( same_value(other.decode(buf), codec.decode(buf)) );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-each-prefix")
+{
+  std::remove("test_each_prefix.kdb");
+
+  dm::kvstore kvstore("test_each_prefix.kdb");
+
+  kvstore.set("t00002", json::object{ { "id", "t00002" } });
+  kvstore.set("ar0001", json::object{ { "id", "ar0001" } });
+  kvstore.set("t00001", json::object{ { "id", "t00001" } });
+  kvstore.set("al0001", json::object{ { "id", "al0001" } });
+  kvstore.set("cover/al0001", json::object{ { "image_data", "AAEC" } });
+
+  std::vector<std::string> ids;
+
+  // Only the range of the prefix is visited, in key order.
+  kvstore.each("t", [&](json::value& value) -> bool
+  {
+    ids.push_back(value.as_object()["id"].as_string());
+    return true;
+  });
+
+  REQUIRE( ids.size() == 2 );
+  REQUIRE( ids[0] == "t00001" );
+  REQUIRE( ids[1] == "t00002" );
+
+  ids.clear();
+
+  kvstore.each("al", { "id" }, [&](const std::string& key, std::vector<json::value>& fields) -> bool
+  {
+    ids.push_back(key);
+    return true;
+  });
+
+  REQUIRE( ids.size() == 1 );
+  REQUIRE( ids[0] == "al0001" );
+
+  size_t visited = 0;
+
+  kvstore.each("t", [&](json::value& value) -> bool
+  {
+    visited++;
+    return false;
+  });
+
+  REQUIRE( visited == 1 );
+
+  kvstore.each("x", [&](json::value& value) -> bool
+  {
+    visited++;
+    return true;
+  });
+
+  REQUIRE( visited == 1 );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-parallel-each")
+{
+  std::remove("test_parallel.kdb");
+
+  dm::kvstore kvstore("test_parallel.kdb");
+
+  const int num_tracks = 3000;
+
+  for ( int i = 0; i < num_tracks; ++i )
+  {
+    auto id = "t" + std::to_string(100000+i).substr(1);
+    kvstore.set(id, json::object{ { "id", id }, { "tn", i } });
+  }
+  kvstore.set("al0001", json::object{ { "id", "al0001" }, { "tn", -1 } });
+
+  std::vector<std::string> ordered;
+
+  kvstore.each("t", [&](json::value& value) -> bool
+  {
+    ordered.push_back(value.as_object()["id"].as_string());
+    return true;
+  });
+
+  REQUIRE( ordered.size() == num_tracks );
+
+  std::vector<std::string> ids;
+
+  kvstore.parallel_each(
+    "t",
+    [](json::value& value) -> bool { return true; },
+    [&](json::value& value) -> bool
+    {
+      ids.push_back(value.as_object()["id"].as_string());
+      return true;
+    },
+    dm::kvstore::order::key
+  );
+
+  REQUIRE( (ids == ordered) );
+
+  // Unordered gives the same records, records are dropped by the filter.
+  std::set<std::string> even;
+
+  kvstore.parallel_each(
+    "t",
+    [](json::value& value) -> bool { return value.as_object()["tn"].as_integer() % 2 == 0; },
+    [&](json::value& value) -> bool
+    {
+      even.insert(value.as_object()["id"].as_string());
+      return true;
+    }
+  );
+
+  REQUIRE( even.size() == num_tracks / 2 );
+  REQUIRE( even.count("t00000") == 1 );
+  REQUIRE( even.count("t00001") == 0 );
+
+  // Fields in key order, stopped early.
+  std::vector<std::string> keys;
+
+  kvstore.parallel_each(
+    "t",
+    { "tn" },
+    [&](const std::string& key, std::vector<json::value>& fields) -> bool
+    {
+      REQUIRE( fields[0].as_integer() == static_cast<int64_t>(keys.size()) );
+      keys.push_back(key);
+      return keys.size() < 1000;
+    },
+    dm::kvstore::order::key
+  );
+
+  REQUIRE( keys.size() == 1000 );
+
+  // Errors on the pool are thrown on the calling thread.
+  REQUIRE_THROWS(
+    kvstore.parallel_each(
+      "t",
+      [](json::value& value) -> bool
+      {
+        if ( value.as_object()["tn"].as_integer() == 2000 ) {
+          throw std::runtime_error("filter error");
+        }
+        return true;
+      },
+      [](json::value& value) -> bool { return true; }
+    )
+  );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-import")
+{
+  std::remove("test_import.kdb");
+  std::remove("test_import.kct");
+
+  {
+    // Written the way earlier versions did.
+    kyotocabinet::HashDB db;
+
+    db.open("test_import.kdb", kyotocabinet::HashDB::OWRITER | kyotocabinet::HashDB::OCREATE);
+    db.set("ar0001", "{\"id\":\"ar0001\",\"name\":\"Tom Waits\"}");
+    db.set("al0001", "{\"id\":\"al0001\",\"title\":\"Rain Dogs\"}");
+    db.set("al0001/cover", "{\"image_data\":\"AAEC\"}");
+    db.increment("__track_key__", 50387305761LL); // t00001
+    db.close();
+  }
+
+  dm::kvstore kvstore("test_import.kct");
+
+  REQUIRE( kvstore.import("test_import.kdb") == 4 );
+
+  REQUIRE( kvstore.get("ar0001").as_object()["name"].as_string() == "Tom Waits" );
+  REQUIRE( kvstore.get("al0001").as_object()["title"].as_string() == "Rain Dogs" );
+  // Covers are moved out of the album range.
+  REQUIRE( kvstore.get("al0001/cover").is_null() );
+  REQUIRE( kvstore.get("cover/al0001").as_object()["image_data"].as_string() == "AAEC" );
+  // Key counters are kept.
+  REQUIRE( kvstore.create_track_key() == "t00002" );
+
+  REQUIRE_THROWS( kvstore.import("test_import.kdb") );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-migrate")
+{
+  std::remove("test_migrate.kdb");
+
+  std::string text_record = "{\"id\":\"t00001\",\"title\":\"One\",\"tn\":1}";
+
+  {
+    kyotocabinet::TreeDB db;
+
+    db.open("test_migrate.kdb", kyotocabinet::TreeDB::OWRITER | kyotocabinet::TreeDB::OCREATE);
+    db.set("t00001", text_record);
+    // Written before strings were checked, the title is not utf-8.
+    db.set("t00002", "{\"id\":\"t00002\",\"title\":\"Tw\xf8o\",\"tn\":2}");
+    db.close();
+  }
+
+  {
+    dm::kvstore kvstore("test_migrate.kdb");
+
+    // Records stored as text are read as before.
+    auto value = kvstore.get("t00001");
+    REQUIRE( value.as_object()["title"].as_string() == "One" );
+    REQUIRE( kvstore.get("t00002").as_object()["title"].as_string() == "Tw\xef\xbf\xbdo" );
+
+    size_t visited = 0;
+
+    kvstore.each(
+      [](const std::string& key) -> bool
+      {
+        return key[0] == 't';
+      },
+      { "tn" },
+      [&](const std::string& key, std::vector<json::value>& fields) -> bool
+      {
+        REQUIRE( fields[0].as_integer() == (key == "t00001" ? 1 : 2) );
+        visited++;
+        return true;
+      }
+    );
+
+    REQUIRE( visited == 2 );
+
+    // New records are binary, text records are converted once.
+    kvstore.set("t00003", json::object{ { "id", "t00003" }, { "title", "Three" } });
+
+    REQUIRE( kvstore.migrate() == 2 );
+    REQUIRE( kvstore.migrate() == 0 );
+
+    REQUIRE( kvstore.get("t00001").as_object()["title"].as_string() == "One" );
+    REQUIRE( kvstore.get("t00003").as_object()["title"].as_string() == "Three" );
+  }
+
+  {
+    kyotocabinet::TreeDB db;
+    std::string          value;
+
+    db.open("test_migrate.kdb", kyotocabinet::TreeDB::OWRITER);
+
+    REQUIRE( db.get("t00001", &value) );
+    REQUIRE( dm::record_codec::is_binary(value) );
+    REQUIRE( value.length() < text_record.length() );
+    db.close();
+  }
+
+  {
+    // The key table is stored, so the records can be read after reopening.
+    dm::kvstore kvstore("test_migrate.kdb");
+
+    REQUIRE( kvstore.get("t00002").as_object()["tn"].as_integer() == 2 );
+    REQUIRE( kvstore.get("t00002").as_object()["title"].as_string() == "Tw\xef\xbf\xbdo" );
+  }
+}
+
+// ----------------------------------------------------------------------------
+static void tag_values(const json::value& record, std::vector<std::string>& values)
+{
+  auto& obj = record.as_object();
+
+  if ( obj.has_member("tags") )
+  {
+    for ( auto& tag : obj.at("tags").as_array() ) {
+      values.push_back(tag.as_string());
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-index")
+{
+  std::remove("test_index.kdb");
+  std::remove("test_index.kdb.idx");
+
+  {
+    dm::kvstore kvstore("test_index.kdb");
+
+    // Records stored before the index is defined are indexed.
+    kvstore.set("t00001", json::object{ { "tags", json::array{ "rock", "live" } } });
+
+    kvstore.index("tag", "t", tag_values);
+
+    kvstore.set("t00002", json::object{ { "tags", json::array{ "rock" } } });
+    kvstore.set("al0001", json::object{ { "tags", json::array{ "rock" } } });
+
+    auto rock = kvstore.find("tag", "rock");
+
+    REQUIRE( rock.size() == 2 );
+    REQUIRE( rock[0] == "t00001" );
+    REQUIRE( rock[1] == "t00002" );
+    REQUIRE( kvstore.find("tag", "live").size() == 1 );
+    REQUIRE( kvstore.find("tag", "jazz").empty() );
+    // Values are not prefixes of each other.
+    REQUIRE( kvstore.find("tag", "roc").empty() );
+
+    // Updates replace the old entries.
+    kvstore.set("t00001", json::object{ { "tags", json::array{ "jazz" } } });
+
+    REQUIRE( kvstore.find("tag", "rock").size() == 1 );
+    REQUIRE( kvstore.find("tag", "live").empty() );
+    REQUIRE( kvstore.find("tag", "jazz").size() == 1 );
+
+    kvstore.remove("t00002");
+
+    REQUIRE( kvstore.find("tag", "rock").empty() );
+  }
+
+  {
+    // The index is persistent.
+    dm::kvstore kvstore("test_index.kdb");
+
+    kvstore.index("tag", "t", tag_values);
+
+    REQUIRE( kvstore.find("tag", "jazz").size() == 1 );
+  }
+
+  std::remove("test_index.kdb.idx");
+
+  {
+    // And built again if lost.
+    dm::kvstore kvstore("test_index.kdb");
+
+    kvstore.index("tag", "t", tag_values);
+
+    REQUIRE( kvstore.find("tag", "jazz").size() == 1 );
+  }
+
+  {
+    // A new version of the definition replaces the entries.
+    dm::kvstore kvstore("test_index.kdb");
+
+    kvstore.index("tag", "t", [](const json::value& record, std::vector<std::string>& values)
+    {
+      for ( auto& tag : record.as_object().at("tags").as_array() ) {
+        values.push_back("tag:"+tag.as_string());
+      }
+    }, 2);
+
+    REQUIRE( kvstore.find("tag", "jazz").empty() );
+    REQUIRE( kvstore.find("tag", "tag:jazz").size() == 1 );
+  }
+
+  std::remove("test_index.kdb");
+
+  {
+    // An index file of another database is not used.
+    dm::kvstore kvstore("test_index.kdb");
+
+    kvstore.index("tag", "t", tag_values);
+
+    REQUIRE( kvstore.find("tag", "jazz").empty() );
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-transaction")
+{
+  std::remove("test_transaction.kdb");
+  std::remove("test_transaction.kdb.idx");
+
+  {
+    dm::kvstore kvstore("test_transaction.kdb");
+
+    kvstore.index("tag", "t", tag_values);
+
+    {
+      dm::kvstore::transaction transaction(kvstore);
+
+      kvstore.set("t00001", json::object{ { "tags", json::array{ "rock" } } });
+      kvstore.set("t00002", json::object{ { "tags", json::array{ "rock" } } });
+
+      // Reads see the writes of the transaction.
+      REQUIRE( kvstore.find("tag", "rock").size() == 2 );
+
+      transaction.commit();
+    }
+
+    REQUIRE( kvstore.count() > 2 );
+    REQUIRE( kvstore.find("tag", "rock").size() == 2 );
+
+    {
+      dm::kvstore::transaction transaction(kvstore);
+
+      kvstore.set("t00003", json::object{ { "tags", json::array{ "jazz" } }, { "new_name", 1 } });
+      kvstore.remove("t00001");
+    }
+
+    // Not committed, so rolled back along with the index entries.
+    REQUIRE( kvstore.get("t00003").is_null() );
+    REQUIRE( !kvstore.get("t00001").is_null() );
+    REQUIRE( kvstore.find("tag", "jazz").empty() );
+    REQUIRE( kvstore.find("tag", "rock").size() == 2 );
+
+    {
+      // Nested transactions are part of the outer one.
+      dm::kvstore::transaction outer(kvstore);
+
+      {
+        dm::kvstore::transaction inner(kvstore);
+        kvstore.set("t00004", json::object{ { "new_name", 4 } });
+        inner.commit();
+      }
+
+      outer.commit();
+    }
+
+    {
+      dm::kvstore::transaction outer(kvstore);
+
+      {
+        dm::kvstore::transaction inner(kvstore);
+        kvstore.set("t00005", json::object{ { "tags", json::array{ "rock" } } });
+      }
+
+      REQUIRE_THROWS( outer.commit() );
+    }
+
+    REQUIRE( kvstore.get("t00005").is_null() );
+  }
+
+  {
+    // Names interned by a rolled back transaction are still in the key
+    // table.
+    dm::kvstore kvstore("test_transaction.kdb");
+
+    REQUIRE( kvstore.get("t00004").as_object()["new_name"].as_integer() == 4 );
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("record-cache")
+{
+  // One shard, room for two records of size 10.
+  dm::record_cache cache(25, 1);
+  uint64_t         ticket;
+
+  auto a = std::make_shared<const json::value>(json::object{ { "id", "a" } });
+  auto b = std::make_shared<const json::value>(json::object{ { "id", "b" } });
+  auto c = std::make_shared<const json::value>(json::object{ { "id", "c" } });
+
+  REQUIRE( cache.find("a", ticket) == nullptr );
+  cache.insert("a", a, 10, ticket);
+  REQUIRE( cache.find("b", ticket) == nullptr );
+  cache.insert("b", b, 10, ticket);
+
+  // The cached record itself is handed out.
+  REQUIRE( cache.find("a", ticket) == a );
+
+  // b is the least recently used.
+  REQUIRE( cache.find("c", ticket) == nullptr );
+  cache.insert("c", c, 10, ticket);
+
+  REQUIRE( cache.find("b", ticket) == nullptr );
+  REQUIRE( cache.find("a", ticket) == a );
+  REQUIRE( cache.find("c", ticket) == c );
+
+  // A record read before an erase is not cached.
+  REQUIRE( cache.find("b", ticket) == nullptr );
+  cache.erase("a");
+  cache.insert("b", b, 10, ticket);
+  REQUIRE( cache.find("b", ticket) == nullptr );
+  REQUIRE( cache.find("a", ticket) == nullptr );
+
+  // Nor is a record larger than the shard.
+  cache.insert("b", b, 30, ticket);
+  REQUIRE( cache.find("b", ticket) == nullptr );
+
+  auto stats = cache.stats();
+
+  REQUIRE( stats.hits == 3 );
+  REQUIRE( stats.misses == 8 );
+  REQUIRE( stats.evictions == 1 );
+  REQUIRE( stats.records == 1 );
+  REQUIRE( stats.size == 10 );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-record-cache")
+{
+  std::remove("test_cache.kdb");
+
+  dm::kvstore kvstore("test_cache.kdb");
+
+  dm::track::init(&kvstore);
+
+  kvstore.set("t00001", json::object{ { "id", "t00001" }, { "title", "One" }, { "tn", 1 }, { "dn", 1 } });
+
+  auto r1 = kvstore.get_shared("t00001");
+  auto r2 = kvstore.get_shared("t00001");
+
+  REQUIRE( r1 == r2 );
+  REQUIRE( kvstore.get_shared("t00002") == nullptr );
+
+  // Modifying a found track copies the record.
+  auto track = dm::track::find_by_id("t00001");
+
+  track.title("Uno");
+
+  REQUIRE( r1->as_object().at("title").as_string() == "One" );
+  REQUIRE( kvstore.get_shared("t00001") == r1 );
+
+  // Saving it replaces the cached record.
+  track.save();
+
+  auto r3 = kvstore.get_shared("t00001");
+
+  REQUIRE( r3 != r1 );
+  REQUIRE( r3->as_object().at("title").as_string() == "Uno" );
+  REQUIRE( dm::track::find_by_id("t00001").title() == "Uno" );
+
+  kvstore.remove("t00001");
+
+  REQUIRE( kvstore.get_shared("t00001") == nullptr );
+  REQUIRE( dm::track::find_by_id("t00001").is_null() );
+
+  auto stats = kvstore.cache_stats();
+
+  REQUIRE( stats.hits > 0 );
+  REQUIRE( stats.misses > 0 );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("string-pool")
+{
+  dm::string_pool pool;
+
+  auto a = pool.intern("Rock");
+  auto b = pool.add("Rock");
+
+  REQUIRE( pool.intern("Rock") == a );
+  REQUIRE( b != a );
+  REQUIRE( pool.find("Rock") == a );
+  REQUIRE( pool.find("Jazz") == dm::string_pool::none );
+
+  // Views stay valid as the pool grows.
+  auto view = pool.get(a);
+  std::string long_text(40000, 'x');
+
+  for ( int i = 0; i < 10000; ++i ) {
+    pool.intern("name " + std::to_string(i));
+  }
+  auto c = pool.intern(long_text);
+
+  REQUIRE( view == "Rock" );
+  REQUIRE( pool.get(b) == "Rock" );
+  REQUIRE( pool.get(c) == long_text );
+  REQUIRE( pool.get(pool.intern("")) == "" );
+  REQUIRE( pool.size() == 10004 );
+  REQUIRE( pool.memory() > 40000 );
+
+  // Saved tables place strings by a hash that does not change.
+  REQUIRE( dm::string_pool::hash("", 0) == 0xcbf29ce484222325ull );
+  REQUIRE( dm::string_pool::hash("a", 1) == 0xaf63dc4c8601ec8cull );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-catalog")
+{
+  std::remove("test_catalog.kct");
+  std::remove("test_catalog.kct.idx");
+
+  dm::kvstore kvstore("test_catalog.kct");
+
+  auto track = [](const std::string& id, const std::string& title, int tn, json::array tags) -> json::value
+  {
+    return json::object{
+      { "id",       id },
+      { "title",    title },
+      { "tn",       tn },
+      { "dn",       1 },
+      { "duration", 200 + tn },
+      { "tags",     std::move(tags) },
+      { "artist",   json::object{ { "id", "ar0001" }, { "name", "The Band" } } },
+      { "album",    json::object{ { "id", "al0001" }, { "title", "First Album" } } },
+      { "sources",  json::array{ json::object{ { "name", "local" } } } }
+    };
+  };
+
+  kvstore.set("ar0001", json::object{ { "id", "ar0001" }, { "name", "The Band" }, { "albums", json::array{ "al0001" } } });
+  kvstore.set("al0001", json::object{
+    { "id",     "al0001" },
+    { "title",  "First Album" },
+    { "artist", json::object{ { "id", "ar0001" }, { "name", "The Band" } } },
+    { "tracks", json::array{ "t00002", "t00001" } }
+  });
+  kvstore.set("t00001", track("t00001", "Opening", 1, json::array{ "rock", "live" }));
+  kvstore.set("t00002", track("t00002", "Closing", 2, json::array{ "rock" }));
+
+  // Loaded from the records.
+  dm::catalog catalog(kvstore);
+
+  auto tracks = catalog.tracks();
+
+  REQUIRE( tracks.size() == 2 );
+
+  auto& first = tracks[0].as_object();
+
+  REQUIRE( first["id"].as_string() == "t00001" );
+  REQUIRE( first["title"].as_string() == "Opening" );
+  REQUIRE( first["tn"].as_integer() == 1 );
+  REQUIRE( first["dn"].as_integer() == 1 );
+  REQUIRE( first["duration"].as_integer() == 201 );
+  REQUIRE( first["tags"].as_array().size() == 2 );
+  REQUIRE( first["artist"].as_object().at("name").as_string() == "The Band" );
+  REQUIRE( first["album"].as_object().at("title").as_string() == "First Album" );
+  REQUIRE( !first.has_member("sources") );
+
+  REQUIRE( catalog.artists()[0].as_object().at("albums").as_array().size() == 1 );
+  REQUIRE( catalog.albums()[0].as_object().at("artist").as_object().at("id").as_string() == "ar0001" );
+
+  // In the order of the album.
+  auto album_tracks = catalog.album_tracks("al0001");
+
+  REQUIRE( album_tracks.as_array().size() == 2 );
+  REQUIRE( album_tracks.as_array()[0].as_object().at("id").as_string() == "t00002" );
+  REQUIRE( catalog.album_tracks("al0002").is_null() );
+
+  auto index = catalog.index();
+
+  REQUIRE( index.size() == 1 );
+  REQUIRE( index[0].as_object().at("albums").as_array()[0].as_object().at("tracks").as_array().size() == 2 );
+
+  REQUIRE( (catalog.track_ids() == std::vector<std::string>{ "t00001", "t00002" }) );
+  REQUIRE( (catalog.track_ids_by_tag("rock") == std::vector<std::string>{ "t00001", "t00002" }) );
+  REQUIRE( (catalog.track_ids_by_tag("live") == std::vector<std::string>{ "t00001" }) );
+  REQUIRE( catalog.track_ids_by_tag("jazz").empty() );
+
+  REQUIRE( catalog.search("OPEN", 10).size() == 1 );
+  REQUIRE( catalog.search("band", 10).size() == 2 );
+  REQUIRE( catalog.search("band", 1).size() == 1 );
+  REQUIRE( catalog.search("nothing", 10).size() == 0 );
+
+  // Kept up to date by commits.
+  {
+    dm::kvstore::transaction transaction(kvstore);
+
+    kvstore.set("t00003", track("t00003", "Encore", 3, json::array{ "live" }));
+    kvstore.remove("t00002");
+    kvstore.set("t00001", track("t00001", "Opening", 1, json::array{}));
+
+    transaction.commit();
+  }
+
+  REQUIRE( (catalog.track_ids() == std::vector<std::string>{ "t00001", "t00003" }) );
+  REQUIRE( (catalog.track_ids_by_tag("live") == std::vector<std::string>{ "t00003" }) );
+  REQUIRE( catalog.album_tracks("al0001").as_array().size() == 1 );
+
+  // Nor by those rolled back.
+  {
+    dm::kvstore::transaction transaction(kvstore);
+    kvstore.remove("t00001");
+  }
+
+  REQUIRE( catalog.tracks().size() == 2 );
+
+  // The slot of a removed track is used again, the order is by key.
+  kvstore.set("t00000", track("t00000", "Intro", 0, json::array{}));
+
+  REQUIRE( (catalog.track_ids() == std::vector<std::string>{ "t00000", "t00001", "t00003" }) );
+
+  // Writing an unchanged title again adds no string.
+  auto strings = catalog.stats().strings;
+
+  kvstore.set("t00001", track("t00001", "Opening", 1, json::array{}));
+
+  auto stats = catalog.stats();
+
+  REQUIRE( stats.strings == strings );
+  REQUIRE( stats.artists == 1 );
+  REQUIRE( stats.albums == 1 );
+  REQUIRE( stats.tracks == 3 );
+  REQUIRE( stats.size > 0 );
+  REQUIRE( stats.size_per_10k_tracks == stats.size * 10000 / 3 );
+
+  // Durations and numbers too large for their bits are clamped.
+  auto long_track = track("t00004", "Long", 2000, json::array{});
+  long_track.as_object()["duration"] = 100000;
+  kvstore.set("t00004", long_track);
+
+  auto last = catalog.tracks()[3].as_object();
+
+  REQUIRE( last["tn"].as_integer() == 1023 );
+  REQUIRE( last["duration"].as_integer() == 65535 );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-catalog-file")
+{
+  std::remove("test_catalog_file.kct");
+  std::remove("test_catalog_file.kct.idx");
+  std::remove("test_catalog_file.catalog");
+
+  dm::kvstore kvstore("test_catalog_file.kct");
+
+  auto track = [](unsigned n, const std::string& tag) -> json::value
+  {
+    return json::object{
+      { "id",       "t" + std::to_string(100000+n).substr(1) },
+      { "title",    "Title " + std::to_string(n) },
+      { "tn",       n % 14 + 1 },
+      { "dn",       1 },
+      { "duration", 180 + n },
+      { "tags",     json::array{ tag } },
+      { "artist",   json::object{ { "id", "ar0001" }, { "name", "The Band" } } },
+      { "album",    json::object{ { "id", "al0001" }, { "title", "First Album" } } }
+    };
+  };
+
+  {
+    dm::kvstore::transaction transaction(kvstore);
+
+    kvstore.set("ar0001", json::object{ { "id", "ar0001" }, { "name", "The Band" }, { "albums", json::array{ "al0001" } } });
+
+    for ( unsigned n = 1; n <= 1000; ++n ) {
+      kvstore.set(track(n, "").as_object()["id"].as_string(), track(n, n % 2 ? "odd" : "even"));
+    }
+    transaction.commit();
+  }
+
+  std::string index;
+  std::string tracks;
+
+  {
+    // Loaded from the records, and written to the file.
+    dm::catalog catalog(kvstore, "test_catalog_file.catalog");
+
+    REQUIRE( !catalog.stats().from_file );
+
+    index  = to_string(catalog.index());
+    tracks = to_string(catalog.tracks());
+  }
+
+  {
+    dm::catalog catalog(kvstore, "test_catalog_file.catalog");
+
+    REQUIRE( catalog.stats().from_file );
+    REQUIRE( catalog.stats().tracks == 1000 );
+    REQUIRE( to_string(catalog.index()) == index );
+    REQUIRE( to_string(catalog.tracks()) == tracks );
+    REQUIRE( catalog.track_ids_by_tag("odd").size() == 500 );
+
+    // Strings are still added and interned after.
+    kvstore.set("t01001", track(1001, "odd"));
+
+    REQUIRE( catalog.track_ids_by_tag("odd").size() == 501 );
+    REQUIRE( catalog.search("title 1001", 10).size() == 1 );
+  }
+
+  // Commits made while no catalog was open are applied from the log.
+  kvstore.remove("t00002");
+  kvstore.set("t00003", track(3, "even"));
+
+  {
+    dm::catalog catalog(kvstore, "test_catalog_file.catalog");
+
+    REQUIRE( catalog.stats().from_file );
+    REQUIRE( catalog.stats().tracks == 1000 );
+    REQUIRE( catalog.track_ids_by_tag("odd").size() == 500 );
+    REQUIRE( catalog.track_ids_by_tag("even").size() == 500 );
+  }
+
+  // A damaged file is not used.
+  {
+    FILE* f = fopen("test_catalog_file.catalog", "r+b");
+
+    REQUIRE( f != nullptr );
+
+    fseek(f, 100, SEEK_SET);
+    fputc(fgetc(f) ^ 0xff, f);
+    fclose(f);
+  }
+
+  {
+    dm::catalog catalog(kvstore, "test_catalog_file.catalog");
+
+    REQUIRE( !catalog.stats().from_file );
+    REQUIRE( catalog.stats().tracks == 1000 );
+    REQUIRE( catalog.track_ids_by_tag("even").size() == 500 );
+
+    kvstore.remove("t00004");
+    catalog.save();
+  }
+
+  {
+    dm::catalog catalog(kvstore, "test_catalog_file.catalog");
+
+    REQUIRE( catalog.stats().from_file );
+    REQUIRE( catalog.stats().tracks == 999 );
+  }
+
+  // Strings of removed tracks and old titles are dropped when saved.
+  {
+    dm::catalog catalog(kvstore, "test_catalog_file.catalog");
+
+    {
+      dm::kvstore::transaction transaction(kvstore);
+
+      for ( unsigned n = 1; n <= 1001; ++n )
+      {
+        auto value = track(n, "odd");
+        auto key   = value.as_object()["id"].as_string();
+
+        if ( n % 2 == 0 ) {
+          kvstore.remove(key);
+        }
+        else
+        {
+          value.as_object()["title"] = "Retitled " + std::to_string(n);
+          kvstore.set(key, value);
+        }
+      }
+      transaction.commit();
+    }
+
+    auto strings = catalog.stats().strings;
+    auto sets    = catalog.stats().tag_sets;
+
+    index  = to_string(catalog.index());
+    tracks = to_string(catalog.tracks());
+
+    catalog.save();
+
+    REQUIRE( catalog.stats().strings < strings / 2 );
+    REQUIRE( catalog.stats().tag_sets == sets - 1 );
+    REQUIRE( to_string(catalog.index()) == index );
+    REQUIRE( to_string(catalog.tracks()) == tracks );
+    REQUIRE( catalog.track_ids_by_tag("odd").size() == 501 );
+    REQUIRE( catalog.track_ids_by_tag("even").empty() );
+
+    // Interned strings are still found, and added ones not.
+    auto added = catalog.stats().strings;
+
+    kvstore.set("t00001", track(1, "odd"));
+    kvstore.set("t00003", track(3, "odd"));
+
+    REQUIRE( catalog.stats().strings == added + 2 );
+    REQUIRE( catalog.search("title 3", 10).size() == 1 );
+
+    index  = to_string(catalog.index());
+    tracks = to_string(catalog.tracks());
+
+    catalog.save();
+  }
+
+  {
+    dm::catalog catalog(kvstore, "test_catalog_file.catalog");
+
+    REQUIRE( catalog.stats().from_file );
+    REQUIRE( catalog.stats().tracks == 501 );
+    REQUIRE( to_string(catalog.index()) == index );
+    REQUIRE( to_string(catalog.tracks()) == tracks );
+    REQUIRE( catalog.track_ids_by_tag("odd").size() == 501 );
+  }
+
+  // A file written from another database is not used, though its log has
+  // the change the file was written at.
+  std::remove("test_catalog_other.kct");
+  std::remove("test_catalog_other.kct.idx");
+
+  dm::kvstore other("test_catalog_other.kct");
+
+  {
+    dm::kvstore::transaction transaction(other);
+
+    for ( unsigned n = 1; n <= kvstore.last_change() + 1; ++n ) {
+      other.set(track(n, "").as_object()["id"].as_string(), track(n, "other"));
+    }
+    transaction.commit();
+  }
+
+  REQUIRE( other.last_change() > kvstore.last_change() );
+
+  {
+    dm::catalog catalog(other, "test_catalog_file.catalog");
+
+    REQUIRE( !catalog.stats().from_file );
+    REQUIRE( catalog.track_ids_by_tag("other").size() == catalog.stats().tracks );
+  }
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-dm-indexes")
+{
+  std::remove("test_dm_index.kdb");
+  std::remove("test_dm_index.kdb.idx");
+
+  dm::kvstore kvstore("test_dm_index.kdb");
+
+  dm::artist::init(&kvstore);
+  dm::album::init(&kvstore);
+  dm::track::init(&kvstore);
+
+  dm::artist artist;
+
+  artist.name("Tom Waits");
+  artist.save();
+
+  REQUIRE( dm::artist::find_by_name("Tom Waits").id() == artist.id() );
+  REQUIRE( dm::artist::find_by_name("Tom").is_null() );
+
+  dm::album album;
+
+  album.title("Rain Dogs");
+  album.member("artist", json::object{ { "id", artist.id() }, { "name", artist.name() } });
+  album.save();
+
+  artist.add_album(album);
+  artist.save();
+
+  REQUIRE( artist.find_album_by_title("Rain Dogs").id() == album.id() );
+  REQUIRE( artist.find_album_by_title("Swordfishtrombones").is_null() );
+
+  dm::track track;
+
+  track.title("Jockey Full of Bourbon");
+  track.tags(json::array{ "blues" });
+  track.source(json::object{ { "name", "local" }, { "uri", "/music/jockey.flac" } });
+  track.save();
+
+  auto blues = dm::track::find_ids_by_tag("blues");
+
+  REQUIRE( blues.size() == 1 );
+  REQUIRE( blues[0] == track.id() );
+  REQUIRE( dm::track::find_ids_by_source("local").size() == 1 );
+
+  // A source outlives changes to the track it was found in.
+  auto source = track.find_source("local");
+
+  track.source_remove("local");
+
+  REQUIRE( source.name() == "local" );
+  REQUIRE( source.uri() == "/music/jockey.flac" );
+
+  REQUIRE( dm::track::find_ids_by_source("local").empty() );
+
+  // Renaming an artist moves it in the index.
+  artist.name("Thomas Alan Waits");
+  artist.save();
+
+  REQUIRE( dm::artist::find_by_name("Tom Waits").is_null() );
+  REQUIRE( dm::artist::find_by_name("Thomas Alan Waits").id() == artist.id() );
+
+  // Alt ids are found as soon as the track is saved.
+  REQUIRE( dm::track::find_by_alt_id("8a0b6f0c/1/1").is_null() );
+
+  track.alt_id("8a0b6f0c/1/1");
+  track.save();
+
+  REQUIRE( dm::track::find_by_alt_id("8a0b6f0c/1/1").id() == track.id() );
+  REQUIRE( dm::track::find_by_alt_id("8a0b6f0c/1/2").is_null() );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("sha256")
+{
+  REQUIRE( dm::sha256::hex_digest("", 0) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" );
+  REQUIRE( dm::sha256::hex_digest("abc", 3) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" );
+
+  // Padding spills into a second block.
+  std::string two_blocks("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+
+  REQUIRE( dm::sha256::hex_digest(two_blocks.data(), two_blocks.length()) == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" );
+
+  // Data given in pieces.
+  std::string million(1000000, 'a');
+  dm::sha256  hash;
+
+  for ( size_t i = 0; i < million.length(); i += 999 ) {
+    hash.update(million.data()+i, std::min<size_t>(999, million.length()-i));
+  }
+
+  REQUIRE( hash.hex_digest() == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("blob-store")
+{
+  // Room for two blobs of 100 bytes in the cache.
+  dm::blob_store store("test_blobs", 250);
+
+  std::string a(100, 'a');
+  std::string b(100, 'b');
+  std::string c(100, 'c');
+
+  auto a_id = store.put(a.data(), a.size());
+  auto b_id = store.put(b.data(), b.size());
+  auto c_id = store.put(c.data(), c.size());
+
+  // The same data is stored once.
+  REQUIRE( store.put(a.data(), a.size()) == a_id );
+  REQUIRE( a_id != b_id );
+
+  REQUIRE( *store.get(a_id) == a );
+  REQUIRE( *store.get(b_id) == b );
+  REQUIRE( *store.get(a_id) == a );
+  REQUIRE( *store.get(c_id) == c );
+
+  auto stats = store.stats();
+
+  REQUIRE( stats.hits == 1 );
+  REQUIRE( stats.misses == 3 );
+  REQUIRE( stats.blobs == 2 );
+  REQUIRE( stats.size == 200 );
+
+  // b was evicted, and is read from its file again.
+  REQUIRE( *store.get(b_id) == b );
+  REQUIRE( store.stats().misses == 4 );
+
+  store.remove(a_id);
+  store.remove(b_id);
+  store.remove(c_id);
+
+  REQUIRE( store.get(a_id) == nullptr );
+
+  std::remove("test_blobs");
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-album-cover")
+{
+  std::remove("test_cover.kdb");
+  std::remove("test_cover.kdb.idx");
+
+  dm::kvstore    kvstore("test_cover.kdb");
+  dm::blob_store covers("test_cover_blobs");
+
+  dm::album_cover::init(&covers);
+  dm::album::init(&kvstore);
+
+  std::string image("\xff\xd8\xff\xe0 not really a jpeg");
+
+  // A cover stored by earlier versions, in the record itself.
+  kvstore.set("cover/al0001", json::object{
+    { "image_format", "jpg" },
+    { "image_data",   base64::encode(image.data(), image.size()) }
+  });
+
+  auto cover = dm::album_cover::find_by_album_id("al0001");
+
+  REQUIRE( !cover.is_null() );
+  REQUIRE( cover.format() == "jpg" );
+  REQUIRE( *cover.image() == image );
+  // Is moved to the blob store.
+  REQUIRE( !kvstore.get("cover/al0001").as_object().has_member("image_data") );
+
+  auto blob_id = kvstore.get("cover/al0001").as_object()["image_blob"].as_string();
+
+  REQUIRE( *covers.get(blob_id) == image );
+
+  // Clients get the image base64 encoded.
+  auto data = cover.data().as_object();
+
+  REQUIRE( data["image_format"].as_string() == "jpg" );
+  REQUIRE( data["image_data"].as_string() == base64::encode(image.data(), image.size()) );
+
+  // Another album with the same image shares the blob.
+  auto other = dm::album_cover::find_by_album_id("al0002");
+
+  REQUIRE( other.is_null() );
+
+  other.data(json::object{ { "image_format", "jpg" }, { "image_data", base64::encode(image.data(), image.size()) } });
+  other.save();
+
+  REQUIRE( kvstore.get("cover/al0002").as_object()["image_blob"].as_string() == blob_id );
+  REQUIRE( *dm::album_cover::find_by_album_id("al0002").image() == image );
+
+  // The blob is removed with the last cover using it.
+  cover.erase();
+
+  REQUIRE( dm::album_cover::find_by_album_id("al0001").is_null() );
+  REQUIRE( covers.get(blob_id) != nullptr );
+
+  // Not before the transaction it is released in commits, and not if the
+  // transaction is rolled back.
+  {
+    dm::kvstore::transaction transaction(kvstore);
+
+    other.erase();
+
+    REQUIRE( covers.get(blob_id) != nullptr );
+  }
+
+  REQUIRE( *dm::album_cover::find_by_album_id("al0002").image() == image );
+
+  // Nor if a cover saved later in the transaction uses it.
+  {
+    dm::kvstore::transaction transaction(kvstore);
+
+    other.erase();
+
+    auto third = dm::album_cover::find_by_album_id("al0003");
+
+    third.data(json::object{ { "image_format", "jpg" }, { "image_data", base64::encode(image.data(), image.size()) } });
+    third.save();
+
+    transaction.commit();
+  }
+
+  REQUIRE( covers.get(blob_id) != nullptr );
+
+  dm::album_cover::find_by_album_id("al0003").erase();
+
+  REQUIRE( covers.get(blob_id) == nullptr );
+
+  REQUIRE( covers.get(blob_id) == nullptr );
+
+  std::remove("test_cover_blobs");
+}
+
+// ----------------------------------------------------------------------------
+static std::string make_jpeg(unsigned width, unsigned height)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr       error;
+  unsigned char*              buf = nullptr;
+  unsigned long               len = 0;
+
+  cinfo.err = jpeg_std_error(&error);
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, &buf, &len);
+
+  cinfo.image_width      = width;
+  cinfo.image_height     = height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space   = JCS_RGB;
+
+  jpeg_set_defaults(&cinfo);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  std::vector<unsigned char> row(width * 3);
+
+  while ( cinfo.next_scanline < cinfo.image_height )
+  {
+    for ( unsigned x = 0; x < width; ++x )
+    {
+      row[x * 3 + 0] = x % 256;
+      row[x * 3 + 1] = cinfo.next_scanline % 256;
+      row[x * 3 + 2] = 128;
+    }
+
+    JSAMPROW p = row.data();
+    jpeg_write_scanlines(&cinfo, &p, 1);
+  }
+
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+
+  std::string jpeg(reinterpret_cast<char*>(buf), len);
+  free(buf);
+
+  return jpeg;
+}
+
+// ----------------------------------------------------------------------------
+static void jpeg_size(const std::string& jpeg, unsigned& width, unsigned& height)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr         error;
+
+  cinfo.err = jpeg_std_error(&error);
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, reinterpret_cast<unsigned char*>(const_cast<char*>(jpeg.data())), jpeg.size());
+  jpeg_read_header(&cinfo, TRUE);
+
+  width  = cinfo.image_width;
+  height = cinfo.image_height;
+
+  jpeg_destroy_decompress(&cinfo);
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("thumbnail")
+{
+  auto image = make_jpeg(1000, 500);
+
+  std::string thumbnail;
+  unsigned    width;
+  unsigned    height;
+
+  REQUIRE( dm::make_thumbnail(image, 64, thumbnail) );
+  jpeg_size(thumbnail, width, height);
+  REQUIRE( width == 64 );
+  REQUIRE( height == 32 );
+
+  REQUIRE( dm::make_thumbnail(image, 600, thumbnail) );
+  jpeg_size(thumbnail, width, height);
+  REQUIRE( width == 600 );
+  REQUIRE( height == 300 );
+
+  // Portrait.
+  REQUIRE( dm::make_thumbnail(make_jpeg(150, 300), 200, thumbnail) );
+  jpeg_size(thumbnail, width, height);
+  REQUIRE( width == 100 );
+  REQUIRE( height == 200 );
+
+  // Already fits.
+  REQUIRE( !dm::make_thumbnail(image, 1000, thumbnail) );
+  // Not a jpeg.
+  REQUIRE( !dm::make_thumbnail("\x89PNG not a jpeg", 64, thumbnail) );
+  REQUIRE( !dm::make_thumbnail(image.substr(0, 100), 64, thumbnail) );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("kvstore-album-cover-thumbnails")
+{
+  std::remove("test_thumbs.kdb");
+  std::remove("test_thumbs.kdb.idx");
+
+  dm::kvstore    kvstore("test_thumbs.kdb");
+  dm::blob_store covers("test_thumbs_blobs");
+  dm::work_queue queue(2);
+
+  dm::album_cover::init(&covers, &queue);
+  dm::album::init(&kvstore);
+
+  auto image = make_jpeg(800, 800);
+
+  auto cover = dm::album_cover::find_by_album_id("al0001");
+
+  cover.data(json::object{ { "image_format", "jpg" }, { "image_data", base64::encode(image.data(), image.size()) } });
+  cover.save();
+  queue.wait();
+
+  cover = dm::album_cover::find_by_album_id("al0001");
+
+  auto original = cover.blob_id();
+
+  REQUIRE( kvstore.get("cover/al0001").as_object()["thumbnails"].as_object().size() == 3 );
+  REQUIRE( cover.blob_id(1000) == original );
+  REQUIRE( cover.blob_id(600) != original );
+  REQUIRE( cover.blob_id(200) != cover.blob_id(600) );
+  REQUIRE( cover.blob_id(64) != cover.blob_id(200) );
+  // The smallest that is at least as large.
+  REQUIRE( cover.blob_id(100) == cover.blob_id(200) );
+  REQUIRE( cover.blob_id(0) == original );
+
+  unsigned width;
+  unsigned height;
+
+  jpeg_size(*cover.image(200), width, height);
+  REQUIRE( width == 200 );
+  REQUIRE( height == 200 );
+
+  std::vector<std::string> ids{ original, cover.blob_id(64), cover.blob_id(200), cover.blob_id(600) };
+
+  // Clients can ask for a thumbnail instead of the full image.
+  auto data = cover.data(64).as_object();
+
+  REQUIRE( data["image_data"].as_string() == base64::encode(cover.image(64)->data(), cover.image(64)->size()) );
+
+  // Covers stored before thumbnails are made by migrate.
+  auto other_image = make_jpeg(300, 300);
+  auto other_id    = covers.put(other_image.data(), other_image.size());
+
+  kvstore.set("cover/al0002", json::object{ { "image_format", "jpg" }, { "image_blob", other_id } });
+
+  REQUIRE( dm::album_cover::make_missing_thumbnails() == 1 );
+  queue.wait();
+
+  auto other = dm::album_cover::find_by_album_id("al0002");
+
+  REQUIRE( other.blob_id(64) != other_id );
+  REQUIRE( other.blob_id(200) != other_id );
+  // Too small for the largest.
+  REQUIRE( other.blob_id(600) == other_id );
+  REQUIRE( dm::album_cover::make_missing_thumbnails() == 0 );
+
+  // Thumbnails are removed with the cover.
+  cover.erase();
+
+  for ( auto& id : ids ) {
+    REQUIRE( covers.get(id) == nullptr );
+  }
+
+  other.erase();
+
+  REQUIRE( covers.get(other_id) == nullptr );
+
+  std::remove("test_thumbs_blobs");
+}
@@ -0,0 +1,442 @@
+// ----------------------------------------------------------------------------
+#include <dm/storage_engine.h>
+#include <dm/versioned_engine.h>
+#include <dm/kvstore.h>
+#include <dm/compactor.h>
+
+// ----------------------------------------------------------------------------
+#include "catch.hpp"
+
+// ----------------------------------------------------------------------------
+#include <cstdio>
+#include <vector>
+#include <thread>
+
+// ----------------------------------------------------------------------------
+static std::vector<std::string> keys(dm::storage_engine::cursor& cur)
+{
+  std::vector<std::string> result;
+  std::string              key;
+
+  while ( cur.get_key(&key, true) ) {
+    result.push_back(key);
+  }
+  return result;
+}
+
+// ----------------------------------------------------------------------------
+static void check_engine(dm::storage_engine::type type, const std::string& filename, bool journal = false)
+{
+  std::remove(filename.c_str());
+
+  auto db = dm::storage_engine::open(type, filename, journal);
+
+  std::string value;
+
+  REQUIRE( db->count() == 0 );
+  REQUIRE( !db->get("a", &value) );
+
+  REQUIRE( db->set("b", "2") );
+  REQUIRE( db->set("a", "1") );
+  REQUIRE( db->set("c", std::string("3\0three", 7)) );
+  REQUIRE( db->set("b", "two") );
+
+  REQUIRE( db->count() == 3 );
+  REQUIRE( db->get("b", &value) );
+  REQUIRE( value == "two" );
+  REQUIRE( db->get("c", &value) );
+  REQUIRE( value == std::string("3\0three", 7) );
+
+  REQUIRE( db->remove("a") );
+  REQUIRE( !db->remove("a") );
+  REQUIRE( db->count() == 2 );
+
+  REQUIRE( db->defrag(16) );
+  REQUIRE( db->count() == 2 );
+
+  // Ordered by key.
+  db->set("ab", "");
+  db->set("d", "4");
+
+  auto cur = db->make_cursor();
+
+  REQUIRE( cur->jump() );
+  REQUIRE( (keys(*cur) == std::vector<std::string>{ "ab", "b", "c", "d" }) );
+
+  REQUIRE( cur->jump("bb") );
+  REQUIRE( cur->get(nullptr, &value) );
+  REQUIRE( value == std::string("3\0three", 7) );
+  REQUIRE( cur->step() );
+  REQUIRE( cur->get_key(&value) );
+  REQUIRE( value == "d" );
+  REQUIRE( !cur->step() );
+  REQUIRE( !cur->get_key(&value) );
+
+  REQUIRE( !cur->jump("e") );
+
+  REQUIRE( cur->jump_back("c") );
+  REQUIRE( cur->get_key(&value) );
+  REQUIRE( value == "c" );
+  REQUIRE( cur->jump_back("bz") );
+  REQUIRE( cur->get_key(&value) );
+  REQUIRE( value == "b" );
+  REQUIRE( cur->jump_back("z") );
+  REQUIRE( cur->get_key(&value) );
+  REQUIRE( value == "d" );
+  REQUIRE( !cur->jump_back("a") );
+
+  cur.reset();
+
+  // Counters.
+  REQUIRE( db->increment("n", 10) == 10 );
+  REQUIRE( db->increment("n", -3) == 7 );
+  REQUIRE( db->increment("n", 0) == 7 );
+  db->remove("n");
+
+  // Transactions.
+  REQUIRE( db->begin_transaction(false) );
+  db->set("e", "5");
+  db->remove("b");
+  db->set("c", "three");
+  // Seen by the thread writing.
+  REQUIRE( db->get("e", &value) );
+  REQUIRE( db->end_transaction(false) );
+
+  REQUIRE( !db->get("e", &value) );
+  REQUIRE( db->get("b", &value) );
+  REQUIRE( value == "two" );
+  REQUIRE( db->get("c", &value) );
+  REQUIRE( value == std::string("3\0three", 7) );
+
+  REQUIRE( db->begin_transaction(true) );
+  db->set("e", "5");
+  db->remove("b");
+  REQUIRE( db->end_transaction(true) );
+
+  REQUIRE( db->get("e", &value) );
+  REQUIRE( !db->get("b", &value) );
+  REQUIRE( db->count() == 4 );
+
+  // Snapshots, if the engine has them, are not affected by later writes.
+  auto snapshot = db->make_snapshot();
+
+  if ( snapshot )
+  {
+    db->set("a", "1");
+    db->remove("e");
+
+    REQUIRE( !snapshot->get("a", &value) );
+    REQUIRE( snapshot->get("e", &value) );
+
+    auto scur = snapshot->make_cursor();
+
+    REQUIRE( scur->jump() );
+    REQUIRE( (keys(*scur) == std::vector<std::string>{ "ab", "c", "d", "e" }) );
+
+    scur.reset();
+    snapshot.reset();
+
+    cur = db->make_cursor();
+    cur->jump();
+    REQUIRE( (keys(*cur) == std::vector<std::string>{ "a", "ab", "c", "d" }) );
+
+    // Taken during a transaction, without its writes.
+    REQUIRE( db->begin_transaction(false) );
+    db->set("b", "2");
+    db->remove("c");
+
+    snapshot = db->make_snapshot();
+
+    db->set("f", "6");
+    REQUIRE( db->end_transaction(true) );
+
+    REQUIRE( !snapshot->get("b", &value) );
+    REQUIRE( snapshot->get("c", &value) );
+    REQUIRE( value == std::string("3\0three", 7) );
+
+    scur = snapshot->make_cursor();
+
+    REQUIRE( scur->jump() );
+    REQUIRE( (keys(*scur) == std::vector<std::string>{ "a", "ab", "c", "d" }) );
+    REQUIRE( scur->jump_back("cz") );
+    REQUIRE( scur->get_key(&value) );
+    REQUIRE( value == "c" );
+    REQUIRE( scur->step_back() );
+    REQUIRE( scur->get(&value, nullptr) );
+    REQUIRE( value == "ab" );
+    REQUIRE( scur->jump("b") );
+    REQUIRE( scur->get_key(&value) );
+    REQUIRE( value == "c" );
+
+    scur.reset();
+    snapshot.reset();
+
+    db->set("c", std::string("3\0three", 7));
+    db->remove("b");
+    db->remove("f");
+  }
+
+  cur = db->make_cursor();
+
+  REQUIRE( cur->jump_back("cz") );
+  REQUIRE( cur->step_back() );
+  REQUIRE( cur->get_key(&value) );
+  REQUIRE( value == "ab" );
+  REQUIRE( cur->jump() );
+  REQUIRE( !cur->step_back() );
+
+  cur.reset();
+
+  REQUIRE( db->synchronize(false) );
+  REQUIRE( db->size() >= 0 );
+  REQUIRE( db->clear() );
+  REQUIRE( db->count() == 0 );
+
+  cur = db->make_cursor();
+  REQUIRE( !cur->jump() );
+
+  cur.reset();
+  db.reset();
+
+  std::remove(filename.c_str());
+}
+
+// ----------------------------------------------------------------------------
+static void check_engine_versions(dm::versioned_engine& db)
+{
+  std::string value;
+
+  db.set("a", "1");
+
+  REQUIRE( db.num_versioned() == 0 );
+
+  auto s1 = db.make_snapshot();
+
+  db.set("a", "2");
+  db.set("a", "3");
+
+  auto s2 = db.make_snapshot();
+
+  db.begin_transaction(false);
+  db.set("a", "4");
+  db.set("b", "1");
+
+  REQUIRE( s1->get("a", &value) );
+  REQUIRE( value == "1" );
+  REQUIRE( s2->get("a", &value) );
+  REQUIRE( value == "3" );
+  REQUIRE( !s2->get("b", &value) );
+
+  db.end_transaction(false);
+
+  REQUIRE( db.get("a", &value) );
+  REQUIRE( value == "3" );
+  REQUIRE( !db.get("b", &value) );
+  REQUIRE( db.num_versioned() == 1 );
+
+  // Versions are dropped once no snapshot needs them.
+  s1.reset();
+
+  REQUIRE( db.num_versioned() == 0 );
+
+  db.set("a", "5");
+  db.remove("a");
+
+  REQUIRE( s2->get("a", &value) );
+  REQUIRE( value == "3" );
+
+  auto cur = s2->make_cursor();
+
+  REQUIRE( cur->jump() );
+  REQUIRE( (keys(*cur) == std::vector<std::string>{ "a" }) );
+
+  cur.reset();
+  s2.reset();
+
+  REQUIRE( db.num_versioned() == 0 );
+}
+
+// ----------------------------------------------------------------------------
+static void check_kvstore(dm::storage_engine::type type, const std::string& filename)
+{
+  std::remove(filename.c_str());
+  std::remove((filename+".idx").c_str());
+
+  {
+    dm::kvstore kvstore(filename, dm::kvstore::durability::soft, type);
+
+    kvstore.index("title", "t", [](const json::value& record, std::vector<std::string>& values)
+    {
+      values.push_back(record.as_object().at("title").as_string());
+    });
+
+    REQUIRE( kvstore.create_track_key() == "t00001" );
+
+    kvstore.set("t00001", json::object{ { "title", "One" } });
+
+    {
+      dm::kvstore::transaction transaction(kvstore);
+
+      kvstore.set("t00002", json::object{ { "title", "Two" } });
+      kvstore.set("t00003", json::object{ { "title", "One" } });
+
+      transaction.commit();
+    }
+
+    {
+      dm::kvstore::transaction transaction(kvstore);
+
+      kvstore.remove("t00001");
+    }
+
+    REQUIRE( kvstore.get("t00001").as_object()["title"].as_string() == "One" );
+    REQUIRE( (kvstore.find("title", "One") == std::vector<std::string>{ "t00001", "t00003" }) );
+
+    size_t visited = 0;
+
+    kvstore.parallel_each("t", [](json::value&) { return true; }, [&](json::value&) { visited++; return true; });
+
+    REQUIRE( visited == 3 );
+    REQUIRE( kvstore.last_change() == 3 );
+  }
+
+  if ( type != dm::storage_engine::type::memory )
+  {
+    dm::kvstore kvstore(filename, dm::kvstore::durability::soft, type);
+
+    REQUIRE( kvstore.get("t00002").as_object()["title"].as_string() == "Two" );
+    REQUIRE( kvstore.create_track_key() == "t00002" );
+  }
+
+  std::remove(filename.c_str());
+  std::remove((filename+".idx").c_str());
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("storage-engine-kyoto")
+{
+  check_engine(dm::storage_engine::type::kyoto, "test_engine.kct");
+  check_engine(dm::storage_engine::type::kyoto, "test_engine.kct", true);
+  check_kvstore(dm::storage_engine::type::kyoto, "test_engine_store.kct");
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("storage-engine-lmdb")
+{
+  check_engine(dm::storage_engine::type::lmdb, "test_engine.mdb");
+  check_kvstore(dm::storage_engine::type::lmdb, "test_engine_store.mdb");
+
+  // Readers on other threads see the last committed records.
+  std::remove("test_engine.mdb");
+
+  auto db = dm::storage_engine::open(dm::storage_engine::type::lmdb, "test_engine.mdb");
+
+  db->set("a", "1");
+  db->begin_transaction(false);
+  db->set("a", "2");
+
+  std::string value;
+
+  std::thread([&]() { db->get("a", &value); }).join();
+
+  REQUIRE( value == "1" );
+
+  db->end_transaction(true);
+
+  std::thread([&]() { db->get("a", &value); }).join();
+
+  REQUIRE( value == "2" );
+
+  db.reset();
+  std::remove("test_engine.mdb");
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("storage-engine-memory")
+{
+  check_engine(dm::storage_engine::type::memory, "");
+  check_kvstore(dm::storage_engine::type::memory, "");
+
+  REQUIRE( dm::storage_engine::parse_type("lmdb") == dm::storage_engine::type::lmdb );
+  REQUIRE_THROWS( dm::storage_engine::parse_type("bdb") );
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("storage-engine-versioned")
+{
+  dm::versioned_engine db(dm::storage_engine::open(dm::storage_engine::type::memory, ""));
+
+  check_engine_versions(db);
+}
+
+// ----------------------------------------------------------------------------
+TEST_CASE("compactor")
+{
+  std::remove("test_compactor.kct");
+
+  {
+    dm::kvstore kvstore("test_compactor.kct", dm::kvstore::durability::soft, dm::storage_engine::type::kyoto, true);
+
+    for ( int i = 0; i < 100; ++i ) {
+      kvstore.set("t" + std::to_string(10000+i), json::object{ { "title", std::string(100, 'x') } });
+    }
+
+    for ( int i = 0; i < 100; i += 2 ) {
+      kvstore.remove("t" + std::to_string(10000+i));
+    }
+
+    {
+      // Left alone while a transaction is active.
+      dm::kvstore::transaction transaction(kvstore);
+
+      REQUIRE( !kvstore.checkpoint() );
+      REQUIRE( kvstore.defrag(std::chrono::milliseconds(1), 8) == 0 );
+    }
+
+    REQUIRE( kvstore.checkpoint() );
+    REQUIRE( kvstore.defrag(std::chrono::milliseconds(0), 8) == 8 );
+    REQUIRE( kvstore.size() > 0 );
+
+    dm::compactor::settings settings;
+
+    settings.slice               = std::chrono::milliseconds(1);
+    settings.pause               = std::chrono::milliseconds(1);
+    settings.checkpoint_interval = std::chrono::milliseconds(1);
+    settings.changes_per_pass    = 10;
+
+    dm::compactor compactor(kvstore, settings);
+
+    auto passes = [&](uint64_t n)
+    {
+      for ( int i = 0; i < 2000 && compactor.stats().passes < n; ++i ) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return compactor.stats();
+    };
+
+    // One pass when started.
+    auto stats = passes(1);
+
+    REQUIRE( stats.passes == 1 );
+    REQUIRE( !stats.running );
+    REQUIRE( stats.progress == 1 );
+    REQUIRE( stats.checkpoints > 0 );
+    REQUIRE( stats.size == kvstore.size() );
+    REQUIRE( stats.reclaimed >= 0 );
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    REQUIRE( compactor.stats().passes == 1 );
+
+    // Another after changes_per_pass changes.
+    for ( int i = 0; i < 10; ++i ) {
+      kvstore.set("t" + std::to_string(20000+i), json::object{ { "title", "y" } });
+    }
+
+    REQUIRE( passes(2).passes == 2 );
+    REQUIRE( kvstore.count() > 50 );
+  }
+
+  std::remove("test_compactor.kct");
+  std::remove("test_compactor.kct.idx");
+}
@@ -24,7 +24,6 @@ module TestApp
   end
 
   DEFAULT_CONTENT_TYPE = { "Content-Type" => 'application/json'}.freeze
-  IMAGE_CONTENT_TYPE   = { "Content-Type" => 'image/jpeg', 'Cache-Control' => 'public, max-age=3600' }.freeze
 
   class Main < Sinatra::Base
     enable  :sessions
@@ -110,12 +109,9 @@ module TestApp
       [-1, {}, []]
     end
 
+    # Covers are served by mboxd itself.
     get '/albums/:id/cover' do |id|
-      MusicBox.call("db/cover", { "album_id" => id }) do |req|
-        req.callback { |res| ok(Base64.decode64(res['image_data']), IMAGE_CONTENT_TYPE) }
-        req.errback  { |err| not_found(err || "unknown error") }
-      end
-      [-1, {}, []]
+      redirect "http://#{request.host}:#{MusicBox::COVER_PORT}/covers/#{id}"
     end
 
     post '/tracks/:id/queue' do |id|
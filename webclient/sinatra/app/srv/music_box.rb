@@ -116,6 +116,9 @@ module MusicBox
   IP   = '127.0.0.1'.freeze
   PORT = 8212.freeze
 
+  # Http port of the album covers.
+  COVER_PORT = 8213.freeze
+
   def self.conn
     @conn ||= EventMachine::connect IP, PORT, MusicBox::Connection, IP, PORT
   end
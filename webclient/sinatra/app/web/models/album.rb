@@ -17,7 +17,8 @@ class Album < Vienna::Model
     if ext_cover_url
       'https://i.scdn.co/image/d3c9914e2dbd9bdb7c6dd84714a853440417dbad'
     else
-      "/albums/#{id}/cover"
+      # Fetched from mboxd, which runs on the host serving the web client.
+      "http://#{`window.location.hostname`}:8213/covers/#{id}"
     end
   end
 